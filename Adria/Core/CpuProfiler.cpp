@@ -0,0 +1,175 @@
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include "CpuProfiler.h"
+#include "ConsoleManager.h"
+#include "Paths.h"
+#include "Logging/Logger.h"
+
+namespace adria
+{
+	static TAutoConsoleVariable<bool> CpuProfiling("cpu.Profiling", true, "Enable or disable recording of CPU profile scopes");
+
+	namespace
+	{
+		constexpr uint64 ThreadBufferCapacity = 1 << 16;
+
+		//the fields are relaxed atomics so that a dump copying an event while its owner overwrites it is not a data race
+		struct RecordedEvent
+		{
+			std::atomic<char const*> name;
+			std::atomic<uint64> begin_ns;
+			std::atomic<uint64> end_ns;
+		};
+
+		//written only by its owner thread like a seqlock: begin_index is bumped before an event is overwritten and
+		//write_index once it is complete, so a dump can tell which of the events it copied may be torn
+		struct ThreadEventBuffer
+		{
+			std::unique_ptr<RecordedEvent[]> events = std::make_unique<RecordedEvent[]>(ThreadBufferCapacity);
+			std::atomic<uint64> begin_index = 0;
+			std::atomic<uint64> write_index = 0;
+			uint32 thread_index = 0;
+			std::string thread_name;
+		};
+
+		struct ThreadEventBufferRegistry
+		{
+			std::mutex mutex;
+			std::vector<std::unique_ptr<ThreadEventBuffer>> buffers;
+		};
+		ThreadEventBufferRegistry& GetRegistry()
+		{
+			static ThreadEventBufferRegistry registry;
+			return registry;
+		}
+
+		thread_local ThreadEventBuffer* thread_event_buffer = nullptr;
+		ThreadEventBuffer* GetThreadEventBuffer()
+		{
+			if (thread_event_buffer) [[likely]] return thread_event_buffer;
+
+			ThreadEventBufferRegistry& registry = GetRegistry();
+			std::lock_guard lock(registry.mutex);
+			ThreadEventBuffer* buffer = registry.buffers.emplace_back(std::make_unique<ThreadEventBuffer>()).get();
+			buffer->thread_index = (uint32)registry.buffers.size() - 1;
+			buffer->thread_name = "Thread " + std::to_string(buffer->thread_index);
+			thread_event_buffer = buffer;
+			return buffer;
+		}
+
+		std::chrono::steady_clock::time_point const profiler_epoch = std::chrono::steady_clock::now();
+
+		void WriteJsonString(std::ofstream& json, char const* str)
+		{
+			json << '"';
+			for (char const* c = str; *c; ++c)
+			{
+				if (*c == '"' || *c == '\\') json << '\\';
+				json << *c;
+			}
+			json << '"';
+		}
+
+		void DumpTrace()
+		{
+			static uint32 dump_index = 0;
+			std::string trace_path = paths::ProfilerDir + "CpuTrace" + std::to_string(dump_index++) + ".json";
+			if (CpuProfiler::DumpChromeTrace(trace_path)) ADRIA_LOG(INFO, "CPU trace written to %s", trace_path.c_str());
+			else ADRIA_LOG(WARNING, "Failed to write CPU trace to %s", trace_path.c_str());
+		}
+		AutoConsoleCommand dump_cpu_trace("cpu.DumpTrace", "Writes the recorded CPU profile scopes of all threads as a Chrome trace to Saved/Profiler",
+			ConsoleCommandDelegate::CreateStatic(DumpTrace));
+	}
+
+	namespace CpuProfiler
+	{
+		void Initialize()
+		{
+			enabled = CpuProfiling.Get();
+			CpuProfiling->AddOnChanged(ConsoleVariableDelegate::CreateLambda([](IConsoleVariable* cvar) { enabled = cvar->GetBool(); }));
+			SetThreadName("Main Thread");
+		}
+
+		void SetThreadName(char const* name)
+		{
+			ThreadEventBuffer* buffer = GetThreadEventBuffer();
+			std::lock_guard lock(GetRegistry().mutex);
+			buffer->thread_name = name;
+		}
+
+		uint64 Now()
+		{
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profiler_epoch).count();
+		}
+
+		void RecordEvent(char const* name, uint64 begin_ns, uint64 end_ns)
+		{
+			ThreadEventBuffer* buffer = GetThreadEventBuffer();
+			uint64 const index = buffer->write_index.load(std::memory_order_relaxed);
+			buffer->begin_index.store(index + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			RecordedEvent& event = buffer->events[index & (ThreadBufferCapacity - 1)];
+			event.name.store(name, std::memory_order_relaxed);
+			event.begin_ns.store(begin_ns, std::memory_order_relaxed);
+			event.end_ns.store(end_ns, std::memory_order_relaxed);
+			buffer->write_index.store(index + 1, std::memory_order_release);
+		}
+
+		bool DumpChromeTrace(std::string const& file_path)
+		{
+			std::filesystem::path path(file_path);
+			if (path.has_parent_path()) std::filesystem::create_directories(path.parent_path());
+			std::ofstream json(file_path);
+			if (!json.is_open()) return false;
+
+			json << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+			bool first_event = true;
+			auto BeginEvent = [&]() { if (!first_event) json << ",\n"; first_event = false; };
+
+			ThreadEventBufferRegistry& registry = GetRegistry();
+			std::lock_guard lock(registry.mutex);
+			std::vector<CpuProfileEvent> events;
+			for (auto const& buffer : registry.buffers)
+			{
+				BeginEvent();
+				json << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << buffer->thread_index << ",\"args\":{\"name\":";
+				WriteJsonString(json, buffer->thread_name.c_str());
+				json << "}}";
+
+				//only events below the published write index are copied. The owner thread keeps writing meanwhile, so once the copy is
+				//done every event whose slot it started to overwrite, including one it has not finished yet, is dropped
+				uint64 const end_index = buffer->write_index.load(std::memory_order_acquire);
+				uint64 const begin_index = end_index > ThreadBufferCapacity ? end_index - ThreadBufferCapacity : 0;
+				events.clear();
+				for (uint64 i = begin_index; i < end_index; ++i)
+				{
+					RecordedEvent const& event = buffer->events[i & (ThreadBufferCapacity - 1)];
+					events.push_back(CpuProfileEvent{ event.name.load(std::memory_order_relaxed), event.begin_ns.load(std::memory_order_relaxed), event.end_ns.load(std::memory_order_relaxed) });
+				}
+				std::atomic_thread_fence(std::memory_order_acquire);
+				uint64 const overwrite_index = buffer->begin_index.load(std::memory_order_relaxed);
+				uint64 const first_valid_index = overwrite_index > ThreadBufferCapacity ? overwrite_index - ThreadBufferCapacity : 0;
+				uint64 const skipped_count = std::min(first_valid_index > begin_index ? first_valid_index - begin_index : 0, (uint64)events.size());
+
+				json << std::fixed;
+				json.precision(3);
+				for (uint64 i = skipped_count; i < events.size(); ++i)
+				{
+					CpuProfileEvent const& event = events[i];
+					BeginEvent();
+					json << "{\"name\":";
+					WriteJsonString(json, event.name);
+					json << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer->thread_index
+						<< ",\"ts\":" << event.begin_ns / 1000.0 << ",\"dur\":" << (event.end_ns - event.begin_ns) / 1000.0 << "}";
+				}
+			}
+			json << "]}\n";
+			return true;
+		}
+	}
+}
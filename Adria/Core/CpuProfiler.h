@@ -0,0 +1,47 @@
+#pragma once
+#include <atomic>
+#include <string>
+
+namespace adria
+{
+	struct CpuProfileEvent
+	{
+		char const* name;
+		uint64 begin_ns;
+		uint64 end_ns;
+	};
+
+	//Always available CPU profiler. Every thread records finished scopes into its own ring buffer without locking,
+	//the most recent events of all threads can be dumped as a Chrome trace (chrome://tracing, ui.perfetto.dev).
+	namespace CpuProfiler
+	{
+		void Initialize();
+		void SetThreadName(char const* name);
+
+		inline std::atomic<bool> enabled = true;
+		inline bool IsEnabled() { return enabled.load(std::memory_order_relaxed); }
+		uint64 Now();
+		void RecordEvent(char const* name, uint64 begin_ns, uint64 end_ns);
+
+		bool DumpChromeTrace(std::string const& file_path);
+	}
+
+	class CpuProfileScope
+	{
+	public:
+		explicit CpuProfileScope(char const* name) : name(name), active(CpuProfiler::IsEnabled()), begin_ns(active ? CpuProfiler::Now() : 0) {}
+		ADRIA_NONCOPYABLE_NONMOVABLE(CpuProfileScope)
+		~CpuProfileScope()
+		{
+			if (active) CpuProfiler::RecordEvent(name, begin_ns, CpuProfiler::Now());
+		}
+
+	private:
+		char const* name;
+		bool const active;
+		uint64 const begin_ns;
+	};
+	//names are stored by pointer, the "" forces them to be string literals
+	#define AdriaCpuProfileScope(name) CpuProfileScope ADRIA_CONCAT(cpu_scope, __COUNTER__)("" name)
+	#define AdriaCpuProfileFunction()  CpuProfileScope ADRIA_CONCAT(cpu_scope, __COUNTER__)(__FUNCTION__)
+}
@@ -4,14 +4,16 @@
 #include "Input.h"
 #include "Paths.h"
 #include "ConsoleManager.h"
+#include "CpuProfiler.h"
 #include "Logging/Logger.h"
 #include "Graphics/GfxDevice.h"
 #include "Graphics/GfxCommandList.h"
+#include "Graphics/GfxUploadManager.h"
 #include "Rendering/Renderer.h"
 #include "Rendering/Camera.h"
 #include "Rendering/EntityLoader.h"
 #include "Rendering/ShaderManager.h"
-#include "Utilities/ThreadPool.h"
+#include "Utilities/JobSystem.h"
 #include "Utilities/Random.h"
 #include "Utilities/Timer.h"
 #include "Utilities/JsonUtil.h"
@@ -226,7 +228,8 @@ namespace adria
 
 	Engine::Engine(EngineInit const& init) : window { init.window }
 	{
-		g_ThreadPool.Initialize();
+		CpuProfiler::Initialize();
+		g_JobSystem.Initialize();
 		GfxShaderCompiler::Initialize();
 		gfx = std::make_unique<GfxDevice>(window, init.gfx_options);
 		ShaderManager::Initialize();
@@ -255,7 +258,7 @@ namespace adria
 		g_TextureManager.Destroy();
 		ShaderManager::Destroy();
 		GfxShaderCompiler::Destroy();
-		g_ThreadPool.Destroy();
+		g_JobSystem.Destroy();
 	}
 
 	void Engine::OnWindowEvent(WindowEventData const& msg_data)
@@ -275,13 +278,16 @@ namespace adria
 
 	void Engine::Update(float dt)
 	{
+		AdriaCpuProfileScope("Engine::Update");
 		camera->Tick(dt);
 		renderer->NewFrame(camera.get());
 		renderer->Update(dt);
 	}
 	void Engine::Render()
 	{
+		AdriaCpuProfileScope("Engine::Render");
 		gfx->BeginFrame();
+		g_TextureManager.Update();
 		renderer->Render();
 		gfx->EndFrame();
 	}
@@ -320,7 +326,16 @@ namespace adria
 		camera = std::make_unique<Camera>(config.camera_params);
 		entity_loader->LoadSkybox(config.skybox_params);
 
+		entity_loader->ResetTextureCompressionStats();
 		for (auto const& model : config.scene_models) entity_loader->ImportModel_GLTF(model);
+		TextureCompressionStats const& texture_compression_stats = entity_loader->GetTextureCompressionStats();
+		if (texture_compression_stats.uncompressed_bytes > 0)
+		{
+			ADRIA_LOG(INFO, "Scene textures: %u encoded, %u from the texture cache, compression saved %.1f MB (%.1f MB -> %.1f MB)",
+				texture_compression_stats.encoded_count, texture_compression_stats.cached_count,
+				(texture_compression_stats.uncompressed_bytes - texture_compression_stats.compressed_bytes) / (1024.0f * 1024.0f),
+				texture_compression_stats.uncompressed_bytes / (1024.0f * 1024.0f), texture_compression_stats.compressed_bytes / (1024.0f * 1024.0f));
+		}
 		for (auto const& light : config.scene_lights) entity_loader->LoadLight(light);
 
 		auto ray_tracing_view = reg.view<Mesh, RayTracing>();
@@ -328,7 +343,7 @@ namespace adria
 		{
 			auto const& mesh = ray_tracing_view.get<Mesh>(entity);
 			GfxBuffer* buffer = g_GeometryBufferCache.GetGeometryBuffer(mesh.geometry_buffer_handle);
-			cmd_list->BufferBarrier(*buffer, GfxResourceState::CopyDst, GfxResourceState::AllSRV);
+			cmd_list->BufferBarrier(*buffer, gfx->GetUploadManager()->GetUploadedState(), GfxResourceState::AllSRV);
 		}
 
 		renderer->OnSceneInitialized();
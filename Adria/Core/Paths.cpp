@@ -27,8 +27,14 @@ namespace adria
 	
 	std::string const paths::RenderGraphDir = SavedDir + "RenderGraph/";
 
+	std::string const paths::ProfilerDir = SavedDir + "Profiler/";
+
 	std::string const paths::ShaderCacheDir = SavedDir + "ShaderCache/";
 
+	std::string const paths::MeshCacheDir = SavedDir + "MeshCache/";
+
+	std::string const paths::TextureCacheDir = SavedDir + "TextureCache/";
+
 	std::string const paths::ShaderPDBDir = SavedDir + "ShaderPDB/";
 
 	std::string const paths::IniDir = SavedDir + "Ini/";
@@ -17,8 +17,11 @@
 #include "Graphics/GfxDevice.h"
 #include "Graphics/GfxCommandList.h"
 #include "Graphics/GfxTexture.h"
+#include "Graphics/GfxResidencyManager.h"
 #include "Graphics/GfxRingDescriptorAllocator.h"
 #include "Graphics/GfxProfiler.h"
+#include "Graphics/GfxPipelineStatistics.h"
+#include "Graphics/GfxCommandAllocatorPool.h"
 #include "RenderGraph/RenderGraph.h"
 #include "Utilities/FilesUtil.h"
 #include "Utilities/StringUtil.h"
@@ -32,26 +35,6 @@ namespace adria
 {
 	extern bool dump_render_graph;
 
-	struct ProfilerState
-	{
-		bool  show_average = false;
-		struct AccumulatedTimeStamp
-		{
-			float sum;
-			float minimum;
-			float maximum;
-
-			AccumulatedTimeStamp()
-				: sum(0.0f), minimum(FLT_MAX), maximum(0)
-			{}
-		};
-
-		std::vector<AccumulatedTimeStamp> displayed_timestamps;
-		std::vector<AccumulatedTimeStamp> accumulating_timestamps;
-		double last_reset_time = 0.0;
-		uint32 accumulating_frame_count = 0;
-	};
-
 	Editor::Editor() = default;
 	Editor::~Editor() = default;
 	void Editor::Init(EditorInit&& init)
@@ -695,6 +678,21 @@ namespace adria
 					ImGui::SliderFloat("Emissive Factor", &material->emissive_factor, 0.0f, 32.0f);
 				}
 
+				auto mesh = engine->reg.try_get<Mesh>(selected_entity);
+				if (mesh && !mesh->instances.empty() && ImGui::CollapsingHeader("Mesh"))
+				{
+					ImGui::Text("Submeshes: %u, Instances: %u", (uint32)mesh->submeshes.size(), (uint32)mesh->instances.size());
+
+					//moves all instances of the mesh, patching the component lets the GPU scene and the TLAS pick up the new transforms
+					Vector3 const translation = mesh->instances[0].world_transform.Translation();
+					float new_translation[3] = { translation.x, translation.y, translation.z };
+					if (ImGui::DragFloat3("Translation", new_translation, 0.1f))
+					{
+						Matrix const offset = Matrix::CreateTranslation(Vector3(new_translation) - translation);
+						engine->reg.patch<Mesh>(selected_entity, [&offset](Mesh& mesh) { for (SubMeshInstance& instance : mesh.instances) instance.world_transform *= offset; });
+					}
+				}
+
 				auto transform = engine->reg.try_get<Transform>(selected_entity);
 				if (transform && ImGui::CollapsingHeader("Transform"))
 				{
@@ -977,7 +975,8 @@ namespace adria
 				static constexpr uint64 NUM_FRAMES = 128;
 				static constexpr int32 FRAME_TIME_GRAPH_MAX_FPS[] = { 800, 240, 120, 90, 65, 45, 30, 15, 10, 5, 4, 3, 2, 1 };
 
-				static ProfilerState state{};
+				static bool show_statistics = false;
+				static bool show_pipeline_statistics = false;
 				static float FrameTimeArray[NUM_FRAMES] = { 0 };
 				static float RecentHighestFrameTime = 0.0f;
 				static float FrameTimeGraphMaxValues[ARRAYSIZE(FRAME_TIME_GRAPH_MAX_FPS)] = { 0 };
@@ -993,7 +992,19 @@ namespace adria
 				ImGui::Text("FPS        : %d (%.2f ms)", fps, frame_time_ms);
 				if (ImGui::CollapsingHeader("Timings", ImGuiTreeNodeFlags_DefaultOpen))
 				{
-					ImGui::Checkbox("Show Avg/Min/Max", &state.show_average);
+					ImGui::Checkbox("Show Min/Avg/P95/Max", &show_statistics);
+					ImGui::SameLine();
+					if (ImGui::Button("Export CSV"))
+					{
+						std::string csv_path = paths::ProfilerDir + "GpuProfile.csv";
+						if (g_GfxProfiler.ExportToCSV(csv_path)) ADRIA_LOG(INFO, "GPU profile exported to %s", csv_path.c_str());
+						else ADRIA_LOG(WARNING, "Failed to export GPU profile to %s", csv_path.c_str());
+					}
+					ImGui::Checkbox("Show Pipeline Statistics", &show_pipeline_statistics);
+					if (show_pipeline_statistics && !g_GfxPipelineStatistics.IsEnabled())
+					{
+						ImGui::TextDisabled("Enable rhi.PipelineStatistics to collect pipeline statistics");
+					}
 					ImGui::Spacing();
 
 					uint64 max_i = 0;
@@ -1007,79 +1018,88 @@ namespace adria
 					}
 					ImGui::PlotLines("", FrameTimeArray, NUM_FRAMES, 0, "GPU frame time (ms)", 0.0f, FrameTimeGraphMaxValues[max_i], ImVec2(0, 80));
 
-					constexpr uint32 avg_timestamp_update_interval = 1000;
-					static auto MillisecondsNow = []()
-					{
-						static LARGE_INTEGER s_frequency;
-						static BOOL s_use_qpc = QueryPerformanceFrequency(&s_frequency);
-						double milliseconds = 0;
-						if (s_use_qpc)
-						{
-							LARGE_INTEGER now;
-							QueryPerformanceCounter(&now);
-							milliseconds = double(1000.0 * now.QuadPart) / s_frequency.QuadPart;
-						}
-						else milliseconds = double(GetTickCount64());
-						return milliseconds;
-					};
-					const double current_time = MillisecondsNow();
-
-					bool reset_accumulating_state = false;
-					if ((state.accumulating_frame_count > 1) &&
-						((current_time - state.last_reset_time) > avg_timestamp_update_interval))
+					//passes with the same name (e.g. executed on several command lists) are summed up
+					std::unordered_map<std::string_view, GfxPipelineStatisticsResult> pipeline_statistics;
+					if (show_pipeline_statistics)
 					{
-						std::swap(state.displayed_timestamps, state.accumulating_timestamps);
-						for (uint32 i = 0; i < state.displayed_timestamps.size(); i++)
+						for (GfxPipelineStatisticsResult const& result : g_GfxPipelineStatistics.GetResults())
 						{
-							state.displayed_timestamps[i].sum /= state.accumulating_frame_count;
+							auto [it, inserted] = pipeline_statistics.try_emplace(result.name, result);
+							if (inserted) continue;
+							GfxPipelineStatisticsResult& sum = it->second;
+							sum.input_vertices += result.input_vertices;
+							sum.input_primitives += result.input_primitives;
+							sum.vs_invocations += result.vs_invocations;
+							sum.rasterized_primitives += result.rasterized_primitives;
+							sum.ps_invocations += result.ps_invocations;
+							sum.cs_invocations += result.cs_invocations;
+							sum.samples_passed += result.samples_passed;
 						}
-						reset_accumulating_state = true;
-					}
-
-					reset_accumulating_state |= (state.accumulating_timestamps.size() != time_stamps.size());
-					if (reset_accumulating_state)
-					{
-						state.accumulating_timestamps.resize(0);
-						state.accumulating_timestamps.resize(time_stamps.size());
-						state.last_reset_time = current_time;
-						state.accumulating_frame_count = 0;
 					}
 
 					float total_time_ms = 0.0f;
-					ImGui::BeginTable("Profiler", 2, ImGuiTableFlags_SizingFixedFit | ImGuiTableFlags_RowBg);
+					int32 const column_count = 2 + (show_statistics ? 4 : 0) + (show_pipeline_statistics ? 5 : 0);
+					ImGui::BeginTable("Profiler", column_count, ImGuiTableFlags_SizingFixedFit | ImGuiTableFlags_RowBg);
 					ImGui::TableSetupColumn("Pass");
 					ImGui::TableSetupColumn("Time");
-					for (uint64 i = 0; i < time_stamps.size(); i++)
+					if (show_statistics)
+					{
+						ImGui::TableSetupColumn("Min");
+						ImGui::TableSetupColumn("Avg");
+						ImGui::TableSetupColumn("P95");
+						ImGui::TableSetupColumn("Max");
+					}
+					if (show_pipeline_statistics)
+					{
+						ImGui::TableSetupColumn("VS");
+						ImGui::TableSetupColumn("PS");
+						ImGui::TableSetupColumn("Prims");
+						ImGui::TableSetupColumn("CS");
+						ImGui::TableSetupColumn("Samples");
+					}
+					ImGui::TableHeadersRow();
+					for (GfxTimestamp const& time_stamp : time_stamps)
 					{
 						ImGui::TableNextRow();
 
 						ImGui::TableSetColumnIndex(0);
-						ImGui::Text("%s", time_stamps[i].name.c_str());
+						ImGui::Text("%*s%.*s", (int32)time_stamp.depth * 2, "", (int32)time_stamp.name.size(), time_stamp.name.data());
 						ImGui::TableSetColumnIndex(1);
-						ImGui::Text("%.2f ms", time_stamps[i].time_in_ms);
-						
-						if (state.show_average)
+						ImGui::Text("%.2f ms", time_stamp.time_in_ms);
+						if (show_statistics)
+						{
+							ImGui::TableSetColumnIndex(2);
+							ImGui::Text("%.2f ms", time_stamp.min_in_ms);
+							ImGui::TableSetColumnIndex(3);
+							ImGui::Text("%.2f ms", time_stamp.avg_in_ms);
+							ImGui::TableSetColumnIndex(4);
+							ImGui::Text("%.2f ms", time_stamp.p95_in_ms);
+							ImGui::TableSetColumnIndex(5);
+							ImGui::Text("%.2f ms", time_stamp.max_in_ms);
+						}
+						if (show_pipeline_statistics)
 						{
-							if (state.displayed_timestamps.size() == time_stamps.size())
+							if (auto it = pipeline_statistics.find(time_stamp.name); it != pipeline_statistics.end())
 							{
-								ImGui::SameLine();
-								ImGui::Text("  avg: %.2f ms", state.displayed_timestamps[i].sum);
-								ImGui::SameLine();	 
-								ImGui::Text("  min: %.2f ms", state.displayed_timestamps[i].minimum);
-								ImGui::SameLine();	 
-								ImGui::Text("  max: %.2f ms", state.displayed_timestamps[i].maximum);
+								GfxPipelineStatisticsResult const& result = it->second;
+								int32 const first_column = show_statistics ? 6 : 2;
+								ImGui::TableSetColumnIndex(first_column + 0);
+								ImGui::Text("%llu", result.vs_invocations);
+								ImGui::TableSetColumnIndex(first_column + 1);
+								ImGui::Text("%llu", result.ps_invocations);
+								ImGui::TableSetColumnIndex(first_column + 2);
+								ImGui::Text("%llu", result.rasterized_primitives);
+								ImGui::TableSetColumnIndex(first_column + 3);
+								ImGui::Text("%llu", result.cs_invocations);
+								ImGui::TableSetColumnIndex(first_column + 4);
+								if (result.graphics) ImGui::Text("%llu", result.samples_passed);
+								else ImGui::TextDisabled("-");
 							}
-						
-							ProfilerState::AccumulatedTimeStamp* accumulating_timestamp = &state.accumulating_timestamps[i];
-							accumulating_timestamp->sum += time_stamps[i].time_in_ms;
-							accumulating_timestamp->minimum = std::min<float>(accumulating_timestamp->minimum, time_stamps[i].time_in_ms);
-							accumulating_timestamp->maximum = std::max<float>(accumulating_timestamp->maximum, time_stamps[i].time_in_ms);
 						}
-						total_time_ms += time_stamps[i].time_in_ms;
+						if (time_stamp.depth == 0) total_time_ms += time_stamp.time_in_ms;
 					}
 					ImGui::EndTable();
 					ImGui::Text("Total: %7.2f %s", total_time_ms, "ms");
-					state.accumulating_frame_count++;
 				}
 			}
 			static bool display_vram_usage = false;
@@ -1094,6 +1114,35 @@ namespace adria
 				else ImGui::PushStyleColor(ImGuiCol_Text, IM_COL32(255, 255, 255, 255));
 				ImGui::TextWrapped(vram_display_string.c_str());
 				ImGui::PopStyleColor();
+
+				GfxResidencyManager* residency_manager = gfx->GetResidencyManager();
+				GfxResidencyStats residency_stats = residency_manager->GetStats();
+				ImGui::Text("Residency budget: %llu MB", residency_manager->GetBudget() / 1024 / 1024);
+				ImGui::Text("Managed resources: %u resident, %u trimmed, %u evicted (%llu MB resident)", residency_stats.resident_count,
+					residency_stats.trimmed_count, residency_stats.evicted_count, residency_stats.resident_bytes / 1024 / 1024);
+
+				TextureStreamingStats const streaming_stats = g_TextureManager.GetStreamingStats();
+				ImGui::Text("Streamed textures: %u (%llu MB resident, %llu MB committed)", streaming_stats.texture_count,
+					streaming_stats.resident_bytes / 1024 / 1024, streaming_stats.committed_bytes / 1024 / 1024);
+				ImGui::Text("Streaming requests in flight: %u, %u textures starved by the budget", streaming_stats.in_flight_count, streaming_stats.starved_count);
+			}
+			static bool display_cmd_list_stats = false;
+			ImGui::Checkbox("Display Command List Stats", &display_cmd_list_stats);
+			if (display_cmd_list_stats)
+			{
+				GfxCommandListStats const& stats = gfx->GetCommandList()->GetStats();
+				uint32 const total_calls = stats.issued_state_calls + stats.filtered_state_calls;
+				ImGui::Text("State calls issued: %u", stats.issued_state_calls);
+				ImGui::Text("State calls filtered: %u (%.1f%%)", stats.filtered_state_calls, total_calls ? 100.0f * stats.filtered_state_calls / total_calls : 0.0f);
+				ImGui::Text("Barriers requested: %u", stats.requested_barriers);
+				ImGui::Text("Barriers submitted: %u", stats.submitted_barriers);
+				ImGui::Text("Shader table bytes uploaded: %llu", stats.shader_table_bytes_uploaded);
+
+				GfxCommandAllocatorPoolStats const allocator_stats = gfx->GetCommandAllocatorPool(GfxCommandListType::Graphics)->GetStats();
+				ImGui::Text("Command allocators: %u (%u recording, %u in flight)", allocator_stats.allocator_count,
+					allocator_stats.allocators_recording, allocator_stats.allocators_in_flight);
+				ImGui::Text("Commands in flight: %llu (peak %llu)", allocator_stats.commands_in_flight, allocator_stats.peak_commands_in_flight);
+				ImGui::Text("Allocator resets: %u (%llu us, max %llu us)", allocator_stats.reset_count, allocator_stats.reset_time_us, allocator_stats.max_reset_time_us);
 			}
 		}
 		ImGui::End();
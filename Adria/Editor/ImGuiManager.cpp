@@ -66,6 +66,7 @@ namespace adria
 			ID3D12DescriptorHeap* pp_heaps[] = { imgui_allocator->GetHeap() };
 			cmd_list->GetNative()->SetDescriptorHeaps(ARRAYSIZE(pp_heaps), pp_heaps);
 			ImGui_ImplDX12_RenderDrawData(ImGui::GetDrawData(), cmd_list->GetNative());
+			cmd_list->InvalidateStateCache();
 		}
 
 		if (ImGui::GetIO().ConfigFlags & ImGuiConfigFlags_ViewportsEnable)
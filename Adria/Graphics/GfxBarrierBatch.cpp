@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <numeric>
+#include "GfxBarrierBatch.h"
+#include "Core/ConsoleManager.h"
+#include "Logging/Logger.h"
+
+namespace adria
+{
+	namespace
+	{
+		//same state barriers in these states still order writes, e.g. two dispatches writing the same UAV
+		bool NeedsSameStateBarrier(GfxResourceState state)
+		{
+			return HasAnyFlag(state, GfxResourceState::AllUAV | GfxResourceState::ClearUAV | GfxResourceState::ASWrite);
+		}
+
+		//reduces hand written barrier sequences and checks the result, together with the barrier type the legacy path submits for it
+		void BarrierReductionSelfCheck()
+		{
+			using enum GfxResourceState;
+			void* const texture = reinterpret_cast<void*>(uintptr_t(0x100));
+			void* const buffer = reinterpret_cast<void*>(uintptr_t(0x200));
+			auto Global = [](GfxResourceState before, GfxResourceState after)
+				{
+					return GfxBarrier{ .type = GfxBarrierType::Global, .before = before, .after = after };
+				};
+			auto Texture = [texture](GfxResourceState before, GfxResourceState after, uint32 subresource = 0)
+				{
+					return GfxBarrier{ .type = GfxBarrierType::Texture, .resource = texture, .before = before, .after = after, .subresource = subresource };
+				};
+			auto Buffer = [buffer](GfxResourceState before, GfxResourceState after)
+				{
+					return GfxBarrier{ .type = GfxBarrierType::Buffer, .resource = buffer, .before = before, .after = after };
+				};
+
+			uint32 failures = 0;
+			auto Check = [&failures](bool condition, char const* message)
+				{
+					if (condition) return;
+					ADRIA_LOG(ERROR, "Barrier reduction self check failed: %s", message);
+					++failures;
+				};
+
+			GfxBarrierBatch batch;
+			auto ReducesTo = [&batch](std::initializer_list<GfxBarrier> requested, std::initializer_list<GfxBarrier> expected)
+				{
+					batch.Clear();
+					for (GfxBarrier const& barrier : requested) batch.AddBarrier(barrier);
+					std::span<GfxBarrier const> reduced = batch.Reduce();
+					return std::equal(reduced.begin(), reduced.end(), expected.begin(), expected.end(), [](GfxBarrier const& a, GfxBarrier const& b)
+						{
+							return a.type == b.type && a.resource == b.resource && a.before == b.before && a.after == b.after && a.subresource == b.subresource;
+						});
+				};
+
+			Check(ReducesTo({ Global(ComputeUAV, ComputeUAV), Global(ComputeUAV, ComputeUAV), Global(ASWrite, ASRead) },
+							{ Global(ComputeUAV, ComputeUAV), Global(ASWrite, ASRead) }), "identical global barriers are not deduplicated");
+			Check(ReducesTo({ Texture(RTV, PixelSRV), Texture(PixelSRV, ComputeSRV), Texture(ComputeSRV, CopySrc) },
+							{ Texture(RTV, CopySrc) }), "a transition chain is not merged into one transition");
+			Check(ReducesTo({ Buffer(ComputeSRV, CopyDst), Buffer(CopyDst, ComputeSRV) }, {}), "a round trip back to a read state is not dropped");
+			Check(ReducesTo({ Buffer(ComputeUAV, ComputeUAV), Buffer(ComputeUAV, ComputeUAV) },
+							{ Buffer(ComputeUAV, ComputeUAV) }), "repeated UAV barriers are not reduced to a single UAV barrier");
+			Check(ReducesTo({ Buffer(ComputeUAV, CopySrc), Buffer(CopySrc, ComputeUAV) },
+							{ Buffer(ComputeUAV, ComputeUAV) }), "a round trip back to a UAV state drops the barrier ordering the writes");
+			Check(ReducesTo({ Texture(RTV, PixelSRV, 0), Texture(RTV, PixelSRV, 1) },
+							{ Texture(RTV, PixelSRV, 0), Texture(RTV, PixelSRV, 1) }), "barriers on different subresources are not kept as requested");
+			Check(ReducesTo({ Texture(RTV, PixelSRV), Texture(CopyDst, CopySrc) },
+							{ Texture(RTV, PixelSRV), Texture(CopyDst, CopySrc) }), "a broken transition chain is not kept as requested");
+			Check(ReducesTo({ Buffer(CopyDst, ComputeSRV), Texture(RTV, PixelSRV), Buffer(ComputeSRV, IndirectArgs), Global(ComputeUAV, ComputeUAV) },
+							{ Buffer(CopyDst, IndirectArgs), Texture(RTV, PixelSRV), Global(ComputeUAV, ComputeUAV) }), "reduced barriers are not in the order they were first requested");
+
+			Check(IsLegacyUAVBarrier(Global(ComputeUAV, ComputeUAV)), "a global barrier is not a legacy UAV barrier");
+			Check(IsLegacyUAVBarrier(Buffer(ComputeUAV, ComputeUAV)), "a same state UAV barrier is not a legacy UAV barrier");
+			Check(IsLegacyUAVBarrier(Texture(ComputeUAV, PixelUAV)), "UAV states of different shader stages are not a legacy UAV barrier");
+			Check(!IsLegacyUAVBarrier(Texture(RTV, PixelSRV)), "a state change is not a legacy transition");
+			Check(!IsLegacyUAVBarrier(Buffer(ComputeUAV, ComputeSRV)), "a UAV to SRV state change is not a legacy transition");
+			if (failures == 0) ADRIA_LOG(INFO, "Barrier reduction self check passed");
+		}
+		AutoConsoleCommand barrier_reduction_self_check("rhi.BarrierReductionSelfCheck", "Reduces hand written barrier sequences and checks the barriers that would be submitted",
+			ConsoleCommandDelegate::CreateStatic(BarrierReductionSelfCheck));
+	}
+
+	std::span<GfxBarrier const> GfxBarrierBatch::Reduce()
+	{
+		reduced_barriers.clear();
+		ordered_barriers.clear();
+
+		sorted_indices.resize(barriers.size());
+		std::iota(sorted_indices.begin(), sorted_indices.end(), 0u);
+		std::stable_sort(sorted_indices.begin(), sorted_indices.end(), [this](uint32 a, uint32 b)
+			{
+				return std::less<void*>{}(barriers[a].resource, barriers[b].resource);
+			});
+
+		for (uint64 group_begin = 0; group_begin < sorted_indices.size();)
+		{
+			void* resource = barriers[sorted_indices[group_begin]].resource;
+			uint64 group_end = group_begin + 1;
+			while (group_end < sorted_indices.size() && barriers[sorted_indices[group_end]].resource == resource) ++group_end;
+
+			std::span<uint32 const> group(sorted_indices.data() + group_begin, group_end - group_begin);
+			if (resource == nullptr) ReduceGlobalBarriers(group);
+			else ReduceResourceBarriers(group);
+			group_begin = group_end;
+		}
+
+		std::sort(ordered_barriers.begin(), ordered_barriers.end(), [](auto const& a, auto const& b) { return a.first < b.first; });
+		reduced_barriers.reserve(ordered_barriers.size());
+		for (auto const& [index, barrier] : ordered_barriers) reduced_barriers.push_back(barrier);
+		return reduced_barriers;
+	}
+
+	void GfxBarrierBatch::ReduceGlobalBarriers(std::span<uint32 const> group)
+	{
+		for (uint64 i = 0; i < group.size(); ++i)
+		{
+			GfxBarrier const& barrier = barriers[group[i]];
+			bool const duplicate = std::any_of(group.begin(), group.begin() + i, [&](uint32 j)
+				{
+					return barriers[j].before == barrier.before && barriers[j].after == barrier.after;
+				});
+			if (!duplicate) ordered_barriers.emplace_back(group[i], barrier);
+		}
+	}
+
+	void GfxBarrierBatch::ReduceResourceBarriers(std::span<uint32 const> group)
+	{
+		GfxBarrier const& first = barriers[group.front()];
+		bool foldable = true;
+		for (uint64 i = 1; i < group.size() && foldable; ++i)
+		{
+			GfxBarrier const& previous = barriers[group[i - 1]];
+			GfxBarrier const& current = barriers[group[i]];
+			foldable = current.type == first.type && current.subresource == first.subresource && current.before == previous.after;
+		}
+
+		if (!foldable)
+		{
+			//mixed subresources or a broken chain, keep the barriers exactly as requested
+			for (uint32 index : group) ordered_barriers.emplace_back(index, barriers[index]);
+			return;
+		}
+
+		GfxBarrier folded = first;
+		folded.after = barriers[group.back()].after;
+		if (folded.before == folded.after && !NeedsSameStateBarrier(folded.after)) return;
+		ordered_barriers.emplace_back(group.front(), folded);
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <vector>
+#include <span>
+#include "GfxResourceCommon.h"
+
+namespace adria
+{
+	enum class GfxBarrierType : uint8
+	{
+		Global,
+		Buffer,
+		Texture
+	};
+
+	struct GfxBarrier
+	{
+		GfxBarrierType type = GfxBarrierType::Global;
+		void* resource = nullptr;
+		GfxResourceState before = GfxResourceState::None;
+		GfxResourceState after = GfxResourceState::None;
+		uint32 subresource = 0;
+	};
+
+	//Collects the barriers requested between two flushes and reduces them before submission: transition chains on a resource
+	//collapse into a single transition (A->B->C becomes A->C), round trips back to the starting state are dropped and repeated
+	//UAV and global barriers are merged. No GPU work is recorded between barriers of one batch, which is what makes this valid.
+	//Works only on GfxBarrier values and never touches the graphics API.
+	class GfxBarrierBatch
+	{
+	public:
+		void AddBarrier(GfxBarrier const& barrier)
+		{
+			barriers.push_back(barrier);
+		}
+		std::span<GfxBarrier const> GetBarriers() const
+		{
+			return barriers;
+		}
+		bool IsEmpty() const
+		{
+			return barriers.empty();
+		}
+		void Clear()
+		{
+			barriers.clear();
+			reduced_barriers.clear();
+		}
+
+		std::span<GfxBarrier const> Reduce();
+
+	private:
+		std::vector<GfxBarrier> barriers;
+		std::vector<GfxBarrier> reduced_barriers;
+		std::vector<uint32> sorted_indices;
+		std::vector<std::pair<uint32, GfxBarrier>> ordered_barriers;
+
+	private:
+		void ReduceGlobalBarriers(std::span<uint32 const> group);
+		void ReduceResourceBarriers(std::span<uint32 const> group);
+	};
+
+	//legacy barriers can't transition a resource to the state it is already in, so global barriers and barriers
+	//whose states map to the same legacy state (e.g. a compute UAV write followed by a pixel UAV write) are submitted as UAV barriers
+	inline bool IsLegacyUAVBarrier(GfxBarrier const& barrier)
+	{
+		return barrier.type == GfxBarrierType::Global || ToD3D12LegacyResourceState(barrier.before) == ToD3D12LegacyResourceState(barrier.after);
+	}
+}
@@ -1,7 +1,7 @@
 #include "GfxBuffer.h"
 #include "GfxDevice.h"
 #include "GfxCommandList.h"
-#include "GfxLinearDynamicAllocator.h"
+#include "GfxUploadManager.h"
 
 #include <format>
 
@@ -85,20 +85,13 @@ namespace adria
 
 		if (initial_data != nullptr && desc.resource_usage != GfxResourceUsage::Upload)
 		{
-			auto cmd_list = gfx->GetCommandList();
-			auto upload_buffer = gfx->GetDynamicAllocator();
-			GfxDynamicAllocation upload_alloc = upload_buffer->Allocate(buffer_size);
-			upload_alloc.Update(initial_data, desc.size);
-			cmd_list->CopyBuffer(
-				*this,
-				0,
-				*upload_alloc.buffer,
-				upload_alloc.offset,
-				desc.size);
+			GfxUploadManager* upload_manager = gfx->GetUploadManager();
+			upload_manager->UploadBuffer(*this, 0, initial_data, desc.size);
 
 			if (HasAnyFlag(desc.bind_flags, GfxBindFlag::ShaderResource))
 			{
-				cmd_list->BufferBarrier(*this, GfxResourceState::CopyDst, GfxResourceState::AllSRV);
+				auto cmd_list = gfx->GetCommandList();
+				cmd_list->BufferBarrier(*this, upload_manager->GetUploadedState(), GfxResourceState::AllSRV);
 				cmd_list->FlushBarriers();
 			}
 		}
@@ -112,6 +105,8 @@ namespace adria
 			resource->Unmap(0, nullptr);
 			mapped_data = nullptr;
 		}
+		gfx->AddToReleaseQueue(resource.Detach());
+		gfx->AddToReleaseQueue(allocation.release());
 	}
 
 	void* GfxBuffer::GetMappedData() const
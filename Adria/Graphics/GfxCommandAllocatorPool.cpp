@@ -0,0 +1,146 @@
+#include "GfxCommandAllocatorPool.h"
+#include "GfxDevice.h"
+#include "GfxCommandList.h"
+#include "GfxFence.h"
+#include "Utilities/Timer.h"
+
+namespace adria
+{
+	namespace
+	{
+		constexpr D3D12_COMMAND_LIST_TYPE ToD3D12CommandListType(GfxCommandListType type)
+		{
+			switch (type)
+			{
+			case GfxCommandListType::Graphics:
+				return D3D12_COMMAND_LIST_TYPE_DIRECT;
+			case GfxCommandListType::Compute:
+				return D3D12_COMMAND_LIST_TYPE_COMPUTE;
+			case GfxCommandListType::Copy:
+				return D3D12_COMMAND_LIST_TYPE_COPY;
+			}
+			return D3D12_COMMAND_LIST_TYPE_NONE;
+		}
+	}
+
+	GfxCommandAllocatorPool::GfxCommandAllocatorPool(GfxDevice* gfx, GfxCommandListType type) : gfx(gfx), type(type)
+	{
+	}
+
+	GfxCommandAllocatorPool::~GfxCommandAllocatorPool() = default;
+
+	ID3D12CommandAllocator* GfxCommandAllocatorPool::Acquire(uint32 expected_command_count)
+	{
+#if GFX_MULTITHREADED
+		std::scoped_lock lock(pool_mutex);
+#endif
+		RecycleCompletedAllocators();
+
+		//smallest allocator that fits, otherwise the largest one since it will have to grow the least
+		int64 best_index = -1;
+		for (int64 i = 0; i < (int64)ready_allocators.size(); ++i)
+		{
+			if (best_index < 0)
+			{
+				best_index = i;
+				continue;
+			}
+			uint32 const capacity = ready_allocators[i]->capacity;
+			uint32 const best_capacity = ready_allocators[best_index]->capacity;
+			bool const fits = capacity >= expected_command_count;
+			bool const best_fits = best_capacity >= expected_command_count;
+			bool better = false;
+			if (fits != best_fits) better = fits;
+			else if (fits) better = capacity < best_capacity;
+			else better = capacity > best_capacity;
+			if (better) best_index = i;
+		}
+
+		AllocatorEntry* entry = nullptr;
+		if (best_index >= 0)
+		{
+			entry = ready_allocators[best_index];
+			std::swap(ready_allocators[best_index], ready_allocators.back());
+			ready_allocators.pop_back();
+
+			Timer<std::chrono::microseconds> reset_timer;
+			GFX_CHECK_HR(entry->allocator->Reset());
+			uint64 const reset_time_us = reset_timer.Elapsed();
+			++stats.reset_count;
+			stats.reset_time_us += reset_time_us;
+			stats.max_reset_time_us = std::max(stats.max_reset_time_us, reset_time_us);
+		}
+		else
+		{
+			entry = allocators.emplace_back(std::make_unique<AllocatorEntry>()).get();
+			GFX_CHECK_HR(gfx->GetDevice()->CreateCommandAllocator(ToD3D12CommandListType(type), IID_PPV_ARGS(entry->allocator.GetAddressOf())));
+			allocator_entry_map[entry->allocator.Get()] = entry;
+			++stats.allocator_count;
+		}
+
+		++stats.allocators_recording;
+		stats.commands_in_flight += entry->capacity;
+		stats.peak_commands_in_flight = std::max(stats.peak_commands_in_flight, stats.commands_in_flight);
+		return entry->allocator.Get();
+	}
+
+	void GfxCommandAllocatorPool::Release(ID3D12CommandAllocator* allocator, uint32 command_count, GfxFence& fence, uint64 fence_value)
+	{
+#if GFX_MULTITHREADED
+		std::scoped_lock lock(pool_mutex);
+#endif
+		ADRIA_ASSERT(allocator_entry_map.contains(allocator));
+		AllocatorEntry* entry = allocator_entry_map[allocator];
+		stats.commands_in_flight -= entry->capacity;
+		entry->capacity = std::max(entry->capacity, command_count);
+		entry->fence = &fence;
+		entry->fence_value = fence_value;
+		in_flight_allocators.push_back(entry);
+
+		--stats.allocators_recording;
+		++stats.allocators_in_flight;
+		stats.commands_in_flight += entry->capacity;
+		stats.peak_commands_in_flight = std::max(stats.peak_commands_in_flight, stats.commands_in_flight);
+	}
+
+	void GfxCommandAllocatorPool::NewFrame()
+	{
+#if GFX_MULTITHREADED
+		std::scoped_lock lock(pool_mutex);
+#endif
+		RecycleCompletedAllocators();
+		previous_stats = stats;
+		stats.reset_count = 0;
+		stats.reset_time_us = 0;
+		stats.max_reset_time_us = 0;
+	}
+
+	GfxCommandAllocatorPoolStats GfxCommandAllocatorPool::GetStats() const
+	{
+#if GFX_MULTITHREADED
+		std::scoped_lock lock(pool_mutex);
+#endif
+		GfxCommandAllocatorPoolStats current_stats = stats;
+		current_stats.reset_count = previous_stats.reset_count;
+		current_stats.reset_time_us = previous_stats.reset_time_us;
+		current_stats.max_reset_time_us = previous_stats.max_reset_time_us;
+		return current_stats;
+	}
+
+	void GfxCommandAllocatorPool::RecycleCompletedAllocators()
+	{
+		for (uint64 i = 0; i < in_flight_allocators.size();)
+		{
+			AllocatorEntry* entry = in_flight_allocators[i];
+			if (entry->fence->IsCompleted(entry->fence_value))
+			{
+				stats.commands_in_flight -= entry->capacity;
+				--stats.allocators_in_flight;
+				ready_allocators.push_back(entry);
+				in_flight_allocators[i] = in_flight_allocators.back();
+				in_flight_allocators.pop_back();
+			}
+			else ++i;
+		}
+	}
+}
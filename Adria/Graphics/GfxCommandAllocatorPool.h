@@ -0,0 +1,72 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#if GFX_MULTITHREADED
+#include <mutex>
+#endif
+
+namespace adria
+{
+	class GfxDevice;
+	class GfxFence;
+	enum class GfxCommandListType : uint8;
+
+	struct GfxCommandAllocatorPoolStats
+	{
+		uint32 allocator_count = 0;
+		uint32 allocators_recording = 0;
+		uint32 allocators_in_flight = 0;
+		uint64 commands_in_flight = 0;
+		uint64 peak_commands_in_flight = 0;
+		uint32 reset_count = 0;
+		uint64 reset_time_us = 0;
+		uint64 max_reset_time_us = 0;
+	};
+
+	//Command allocators shared by all command lists of one queue type. Every recording (e.g. one per thread) acquires
+	//its own allocator and releases it with the fence value that marks the end of its execution, the allocator is
+	//reset and handed out again once that value completes. D3D12 allocators keep the memory they grew to, so each one
+	//remembers the largest command count it was used for and acquiring picks the smallest one that fits the expected
+	//command count, instead of growing small allocators and leaving large ones idle.
+	class GfxCommandAllocatorPool
+	{
+		struct AllocatorEntry
+		{
+			Ref<ID3D12CommandAllocator> allocator;
+			uint32 capacity = 0;
+			GfxFence* fence = nullptr;
+			uint64 fence_value = 0;
+		};
+
+	public:
+		GfxCommandAllocatorPool(GfxDevice* gfx, GfxCommandListType type);
+		ADRIA_NONCOPYABLE_NONMOVABLE(GfxCommandAllocatorPool)
+		~GfxCommandAllocatorPool();
+
+		ID3D12CommandAllocator* Acquire(uint32 expected_command_count);
+		void Release(ID3D12CommandAllocator* allocator, uint32 command_count, GfxFence& fence, uint64 fence_value);
+
+		void NewFrame();
+		//reset counters are those of the previous frame
+		GfxCommandAllocatorPoolStats GetStats() const;
+
+	private:
+		GfxDevice* gfx;
+		GfxCommandListType type;
+		std::vector<std::unique_ptr<AllocatorEntry>> allocators;
+		std::unordered_map<ID3D12CommandAllocator*, AllocatorEntry*> allocator_entry_map;
+		std::vector<AllocatorEntry*> ready_allocators;
+		std::vector<AllocatorEntry*> in_flight_allocators;
+
+		GfxCommandAllocatorPoolStats stats;
+		GfxCommandAllocatorPoolStats previous_stats;
+
+#if GFX_MULTITHREADED
+		mutable std::mutex pool_mutex;
+#endif
+
+	private:
+		void RecycleCompletedAllocators();
+	};
+}
@@ -1,5 +1,6 @@
 #include "GfxCommandList.h"
 #include "GfxCommandQueue.h"
+#include "GfxCommandAllocatorPool.h"
 #include "GfxDevice.h"
 #include "GfxBuffer.h"
 #include "GfxTexture.h"
@@ -11,9 +12,13 @@
 #include "GfxRayTracingShaderTable.h"
 #include "GfxStateObject.h"
 #include "Utilities/StringUtil.h"
+#include "Core/ConsoleManager.h"
 
 namespace adria
 {
+	static TAutoConsoleVariable<bool> StateFiltering("rhi.StateFiltering", true, "0: Forward every state change to D3D12. 1: Drop redundant state changes.");
+	static TAutoConsoleVariable<bool> BarrierReduction("rhi.BarrierReduction", true, "0: Submit barriers as requested. 1: Collapse transition chains and drop redundant barriers before submission.");
+
 	namespace
 	{
 		constexpr D3D_PRIMITIVE_TOPOLOGY ToD3D12PrimitiveTopology(GfxPrimitiveTopology topology)
@@ -119,11 +124,19 @@ namespace adria
 		}
 	}
 
-	GfxCommandList::GfxCommandList(GfxDevice* gfx, GfxCommandListType type, char const* name)
-		: gfx(gfx), type(type), cmd_queue(gfx->GetCommandQueue(type)), use_legacy_barriers(!gfx->GetCapabilities().SupportsEnhancedBarriers()), current_rt_table(nullptr)
+	GfxCommandList::GfxCommandList(GfxDevice* gfx, GfxCommandListType type, char const* name, GfxCommandAllocatorPool* allocator_pool)
+		: gfx(gfx), type(type), cmd_queue(gfx->GetCommandQueue(type)), allocator_pool(allocator_pool), use_legacy_barriers(!gfx->GetCapabilities().SupportsEnhancedBarriers())
 	{
 		D3D12_COMMAND_LIST_TYPE cmd_list_type = ToD3D12CommandListType(type);
-		ID3D12Device* device = gfx->GetDevice();
+		ID3D12Device5* device = gfx->GetDevice();
+		if (allocator_pool)
+		{
+			HRESULT hr = device->CreateCommandList1(0, cmd_list_type, D3D12_COMMAND_LIST_FLAG_NONE, IID_PPV_ARGS(cmd_list.GetAddressOf()));
+			GFX_CHECK_HR(hr);
+			cmd_list->SetName(ToWideString(name).c_str());
+			return;
+		}
+
 		HRESULT hr = device->CreateCommandAllocator(cmd_list_type, IID_PPV_ARGS(cmd_allocator.GetAddressOf()));
 		GFX_CHECK_HR(hr);
 
@@ -134,16 +147,31 @@ namespace adria
 		cmd_list->Close();
 	}
 
-	GfxCommandList::~GfxCommandList(){}
+	GfxCommandList::~GfxCommandList()
+	{
+		//a list destroyed while recording was never submitted, its allocator can be reused once the frame completes
+		if (allocator_pool && cmd_allocator) allocator_pool->Release(cmd_allocator.Get(), command_count, gfx->frame_fence, gfx->frame_fence_value);
+	}
 
 	void GfxCommandList::ResetAllocator()
 	{
+		//pooled allocators are reset by the pool when they are recycled
+		if (allocator_pool) return;
 		cmd_allocator->Reset();
 	}
 
 	void GfxCommandList::Begin()
 	{
+		if (allocator_pool)
+		{
+			ADRIA_ASSERT_MSG(!cmd_allocator, "Command list was begun twice without ending it");
+			cmd_allocator = allocator_pool->Acquire(previous_command_count);
+		}
 		cmd_list->Reset(cmd_allocator.Get(), nullptr);
+		//counters roll over once per recording, ResetState is also called mid-list after third party code recorded into the list
+		command_count = 0;
+		previous_stats = stats;
+		stats = {};
 		ResetState();
 	}
 
@@ -151,6 +179,13 @@ namespace adria
 	{
 		FlushBarriers();
 		cmd_list->Close();
+		if (allocator_pool)
+		{
+			//the frame fence is signaled after every list of the frame has been submitted
+			allocator_pool->Release(cmd_allocator.Get(), command_count, gfx->frame_fence, gfx->frame_fence_value);
+			cmd_allocator = nullptr;
+		}
+		previous_command_count = command_count;
 	}
 
 	void GfxCommandList::Wait(GfxFence& fence, uint64 value)
@@ -194,12 +229,10 @@ namespace adria
 
 	void GfxCommandList::ResetState()
 	{
-		command_count = 0;
-		current_pso = nullptr;
 		current_render_pass = nullptr;
-		current_state_object = nullptr;
-		current_rt_table.reset();
+		current_rt_table = nullptr;
 		current_context = Context::Invalid;
+		InvalidateStateCache();
 
 		if (type == GfxCommandListType::Graphics || type == GfxCommandListType::Compute)
 		{
@@ -219,7 +252,9 @@ namespace adria
 	void GfxCommandList::BeginQuery(GfxQueryHeap& query_heap, uint32 index)
 	{
 		D3D12_QUERY_TYPE d3d12_query_type = ToD3D12QueryType(query_heap.GetDesc().type);
-		cmd_list->EndQuery(query_heap, d3d12_query_type, index);
+		//timestamps have no begin, they are written by EndQuery
+		if (d3d12_query_type == D3D12_QUERY_TYPE_TIMESTAMP) cmd_list->EndQuery(query_heap, d3d12_query_type, index);
+		else cmd_list->BeginQuery(query_heap, d3d12_query_type, index);
 	}
 
 	void GfxCommandList::EndQuery(GfxQueryHeap& query_heap, uint32 index)
@@ -295,117 +330,77 @@ namespace adria
 		dispatch_desc.Width = dispatch_width;
 		dispatch_desc.Height = dispatch_height;
 		dispatch_desc.Depth = dispatch_depth;
-		current_rt_table->Commit(*gfx->GetDynamicAllocator(), dispatch_desc);
+		stats.shader_table_bytes_uploaded += current_rt_table->Commit(dispatch_desc);
 		cmd_list->DispatchRays(&dispatch_desc);
 	}
 
 	void GfxCommandList::TextureBarrier(GfxTexture const& texture, GfxResourceState flags_before, GfxResourceState flags_after, uint32 subresource)
 	{
-		if (use_legacy_barriers)
-		{
-			if (flags_before == GfxResourceState::ComputeUAV && flags_after == GfxResourceState::ComputeUAV)
-			{
-				D3D12_RESOURCE_BARRIER barrier{};
-				barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
-				barrier.UAV.pResource = texture.GetNative();
-				legacy_barriers.push_back(barrier);
-			}
-			else
-			{
-				D3D12_RESOURCE_BARRIER barrier{};
-				barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-				barrier.Transition.pResource = texture.GetNative();
-				barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-				barrier.Transition.StateBefore = ToD3D12LegacyResourceState(flags_before);
-				barrier.Transition.StateAfter = ToD3D12LegacyResourceState(flags_after);
-				legacy_barriers.push_back(barrier);
-			}
-		}
-		else
-		{
-			D3D12_TEXTURE_BARRIER barrier{};
-			barrier.SyncBefore = ToD3D12BarrierSync(flags_before);
-			barrier.SyncAfter = ToD3D12BarrierSync(flags_after);
-			barrier.AccessBefore = ToD3D12BarrierAccess(flags_before);
-			barrier.AccessAfter = ToD3D12BarrierAccess(flags_after);
-			barrier.LayoutBefore = ToD3D12BarrierLayout(flags_before);
-			barrier.LayoutAfter = ToD3D12BarrierLayout(flags_after);
-			barrier.pResource = texture.GetNative();
-			barrier.Subresources = CD3DX12_BARRIER_SUBRESOURCE_RANGE(subresource);
-
-			if (HasAnyFlag(flags_before, GfxResourceState::Discard)) barrier.Flags = D3D12_TEXTURE_BARRIER_FLAG_DISCARD;
-			texture_barriers.push_back(barrier);
-		}
+		GfxBarrier barrier{};
+		barrier.type = GfxBarrierType::Texture;
+		barrier.resource = texture.GetNative();
+		barrier.before = flags_before;
+		barrier.after = flags_after;
+		barrier.subresource = use_legacy_barriers ? D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES : subresource;
+		pending_barriers.AddBarrier(barrier);
 	}
 
 	void GfxCommandList::BufferBarrier(GfxBuffer const& buffer, GfxResourceState flags_before, GfxResourceState flags_after)
 	{
-		if (use_legacy_barriers)
-		{
-			if (flags_before == GfxResourceState::ComputeUAV && flags_after == GfxResourceState::ComputeUAV)
-			{
-				D3D12_RESOURCE_BARRIER barrier{};
-				barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
-				barrier.UAV.pResource = buffer.GetNative();
-				legacy_barriers.push_back(barrier);
-			}
-			else
-			{
-				D3D12_RESOURCE_BARRIER barrier{};
-				barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-				barrier.Transition.pResource = buffer.GetNative();
-				barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-				barrier.Transition.StateBefore = ToD3D12LegacyResourceState(flags_before);
-				barrier.Transition.StateAfter = ToD3D12LegacyResourceState(flags_after);
-				legacy_barriers.push_back(barrier);
-			}
-		}
-		else
-		{
-			D3D12_BUFFER_BARRIER barrier{};
-			barrier.SyncBefore = ToD3D12BarrierSync(flags_before);
-			barrier.SyncAfter = ToD3D12BarrierSync(flags_after);
-			barrier.AccessBefore = ToD3D12BarrierAccess(flags_before);
-			barrier.AccessAfter = ToD3D12BarrierAccess(flags_after);
-			barrier.pResource = buffer.GetNative();
-			barrier.Offset = 0;
-			barrier.Size = UINT64_MAX;
-
-			buffer_barriers.push_back(barrier);
-		}
+		GfxBarrier barrier{};
+		barrier.type = GfxBarrierType::Buffer;
+		barrier.resource = buffer.GetNative();
+		barrier.before = flags_before;
+		barrier.after = flags_after;
+		pending_barriers.AddBarrier(barrier);
 	}
 
 	void GfxCommandList::GlobalBarrier(GfxResourceState flags_before, GfxResourceState flags_after)
 	{
-		if (use_legacy_barriers)
+		//legacy global barriers are UAV barriers, they can only wait for UAV writes and acceleration structure builds
+		GfxResourceState const legacy_global_states = GfxResourceState::ComputeUAV | GfxResourceState::AllAS;
+		if (use_legacy_barriers && (!HasAnyFlag(flags_before, legacy_global_states) || HasAnyFlag(flags_before, ~legacy_global_states)))
 		{
-			if (flags_before == GfxResourceState::ComputeUAV && flags_after == GfxResourceState::ComputeUAV)
-			{
-				D3D12_RESOURCE_BARRIER barrier{};
-				barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
-				barrier.UAV.pResource = nullptr;
-				legacy_barriers.push_back(barrier);
-			}
-			else
-			{
-				ADRIA_ASSERT_MSG(false, "Unsupported flags for legacy barriers!");
-			}
-		}
-		else
-		{
-			D3D12_GLOBAL_BARRIER barrier{};
-			barrier.SyncBefore = ToD3D12BarrierSync(flags_before);
-			barrier.SyncAfter = ToD3D12BarrierSync(flags_after);
-			barrier.AccessBefore = ToD3D12BarrierAccess(flags_before);
-			barrier.AccessAfter = ToD3D12BarrierAccess(flags_after);
-			global_barriers.push_back(barrier);
+			ADRIA_ASSERT_MSG(false, "Unsupported flags for legacy barriers!");
+			return;
 		}
+
+		GfxBarrier barrier{};
+		barrier.type = GfxBarrierType::Global;
+		barrier.before = flags_before;
+		barrier.after = flags_after;
+		pending_barriers.AddBarrier(barrier);
 	}
 
 	void GfxCommandList::FlushBarriers()
 	{
+		if (pending_barriers.IsEmpty()) return;
+
+		std::span<GfxBarrier const> barriers = BarrierReduction.Get() ? pending_barriers.Reduce() : pending_barriers.GetBarriers();
+		stats.requested_barriers += (uint32)pending_barriers.GetBarriers().size();
+		stats.submitted_barriers += (uint32)barriers.size();
+
 		if (use_legacy_barriers)
 		{
+			for (GfxBarrier const& barrier : barriers)
+			{
+				D3D12_RESOURCE_BARRIER d3d12_barrier{};
+				if (IsLegacyUAVBarrier(barrier))
+				{
+					d3d12_barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+					d3d12_barrier.UAV.pResource = static_cast<ID3D12Resource*>(barrier.resource);
+				}
+				else
+				{
+					d3d12_barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+					d3d12_barrier.Transition.pResource = static_cast<ID3D12Resource*>(barrier.resource);
+					d3d12_barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+					d3d12_barrier.Transition.StateBefore = ToD3D12LegacyResourceState(barrier.before);
+					d3d12_barrier.Transition.StateAfter = ToD3D12LegacyResourceState(barrier.after);
+				}
+				legacy_barriers.push_back(d3d12_barrier);
+			}
+
 			if (!legacy_barriers.empty())
 			{
 				cmd_list->ResourceBarrier((uint32)legacy_barriers.size(), legacy_barriers.data());
@@ -415,27 +410,69 @@ namespace adria
 		}
 		else
 		{
-			std::vector<D3D12_BARRIER_GROUP> barrier_groups;
-			barrier_groups.reserve(3);
+			for (GfxBarrier const& barrier : barriers)
+			{
+				switch (barrier.type)
+				{
+				case GfxBarrierType::Texture:
+				{
+					D3D12_TEXTURE_BARRIER d3d12_barrier{};
+					d3d12_barrier.SyncBefore = ToD3D12BarrierSync(barrier.before);
+					d3d12_barrier.SyncAfter = ToD3D12BarrierSync(barrier.after);
+					d3d12_barrier.AccessBefore = ToD3D12BarrierAccess(barrier.before);
+					d3d12_barrier.AccessAfter = ToD3D12BarrierAccess(barrier.after);
+					d3d12_barrier.LayoutBefore = ToD3D12BarrierLayout(barrier.before);
+					d3d12_barrier.LayoutAfter = ToD3D12BarrierLayout(barrier.after);
+					d3d12_barrier.pResource = static_cast<ID3D12Resource*>(barrier.resource);
+					d3d12_barrier.Subresources = CD3DX12_BARRIER_SUBRESOURCE_RANGE(barrier.subresource);
+					if (HasAnyFlag(barrier.before, GfxResourceState::Discard)) d3d12_barrier.Flags = D3D12_TEXTURE_BARRIER_FLAG_DISCARD;
+					texture_barriers.push_back(d3d12_barrier);
+				}
+				break;
+				case GfxBarrierType::Buffer:
+				{
+					D3D12_BUFFER_BARRIER d3d12_barrier{};
+					d3d12_barrier.SyncBefore = ToD3D12BarrierSync(barrier.before);
+					d3d12_barrier.SyncAfter = ToD3D12BarrierSync(barrier.after);
+					d3d12_barrier.AccessBefore = ToD3D12BarrierAccess(barrier.before);
+					d3d12_barrier.AccessAfter = ToD3D12BarrierAccess(barrier.after);
+					d3d12_barrier.pResource = static_cast<ID3D12Resource*>(barrier.resource);
+					d3d12_barrier.Offset = 0;
+					d3d12_barrier.Size = UINT64_MAX;
+					buffer_barriers.push_back(d3d12_barrier);
+				}
+				break;
+				case GfxBarrierType::Global:
+				{
+					D3D12_GLOBAL_BARRIER d3d12_barrier{};
+					d3d12_barrier.SyncBefore = ToD3D12BarrierSync(barrier.before);
+					d3d12_barrier.SyncAfter = ToD3D12BarrierSync(barrier.after);
+					d3d12_barrier.AccessBefore = ToD3D12BarrierAccess(barrier.before);
+					d3d12_barrier.AccessAfter = ToD3D12BarrierAccess(barrier.after);
+					global_barriers.push_back(d3d12_barrier);
+				}
+				break;
+				}
+			}
 
+			D3D12_BARRIER_GROUP barrier_groups[3] = {};
+			uint32 barrier_group_count = 0;
 			if (!texture_barriers.empty())
 			{
-				barrier_groups.push_back(CD3DX12_BARRIER_GROUP((uint32)texture_barriers.size(), texture_barriers.data()));
+				barrier_groups[barrier_group_count++] = CD3DX12_BARRIER_GROUP((uint32)texture_barriers.size(), texture_barriers.data());
 			}
-
 			if (!buffer_barriers.empty())
 			{
-				barrier_groups.push_back(CD3DX12_BARRIER_GROUP((uint32)buffer_barriers.size(), buffer_barriers.data()));
+				barrier_groups[barrier_group_count++] = CD3DX12_BARRIER_GROUP((uint32)buffer_barriers.size(), buffer_barriers.data());
 			}
-
 			if (!global_barriers.empty())
 			{
-				barrier_groups.push_back(CD3DX12_BARRIER_GROUP((uint32)global_barriers.size(), global_barriers.data()));
+				barrier_groups[barrier_group_count++] = CD3DX12_BARRIER_GROUP((uint32)global_barriers.size(), global_barriers.data());
 			}
 
-			if (!barrier_groups.empty())
+			if (barrier_group_count > 0)
 			{
-				cmd_list->Barrier((uint32)barrier_groups.size(), barrier_groups.data());
+				cmd_list->Barrier(barrier_group_count, barrier_groups);
 				++command_count;
 			}
 
@@ -443,6 +480,7 @@ namespace adria
 			buffer_barriers.clear();
 			global_barriers.clear();
 		}
+		pending_barriers.Clear();
 	}
 
 	void GfxCommandList::CopyBuffer(GfxBuffer& dst, uint64 dst_offset, GfxBuffer const& src, uint64 src_offset, uint64 size)
@@ -610,9 +648,11 @@ namespace adria
 
 	void GfxCommandList::SetPipelineState(GfxPipelineState* state)
 	{
-		if (state != current_pso)
+		if (state != current_pso || current_state_object != nullptr || !StateFiltering.Get())
 		{
+			++stats.issued_state_calls;
 			current_pso = state;
+			current_state_object = nullptr;
 			if (state == nullptr)
 			{
 				cmd_list->SetPipelineState(nullptr);
@@ -625,6 +665,7 @@ namespace adria
 				else ADRIA_ASSERT(current_context == Context::Compute);
 			}
 		}
+		else ++stats.filtered_state_calls;
 	}
 
 	GfxRayTracingShaderTable& GfxCommandList::SetStateObject(GfxStateObject* state_object)
@@ -632,10 +673,11 @@ namespace adria
 		if (state_object->d3d12_so != current_state_object)
 		{
 			current_state_object = state_object->d3d12_so;
+			current_pso = nullptr;
 			cmd_list->SetPipelineState1(state_object->d3d12_so.Get());
 			current_context = state_object->d3d12_so ? Context::Compute : Context::Invalid;
-			current_rt_table = std::make_unique<GfxRayTracingShaderTable>(state_object);
 		}
+		current_rt_table = &state_object->GetShaderTable(gfx);
 		return *current_rt_table;
 	}
 
@@ -651,25 +693,39 @@ namespace adria
 
 	void GfxCommandList::SetTopology(GfxPrimitiveTopology topology)
 	{
-		cmd_list->IASetPrimitiveTopology(ToD3D12PrimitiveTopology(topology));
+		D3D12_PRIMITIVE_TOPOLOGY d3d12_topology = ToD3D12PrimitiveTopology(topology);
+		if (d3d12_topology == current_topology && StateFiltering.Get())
+		{
+			++stats.filtered_state_calls;
+			return;
+		}
+		++stats.issued_state_calls;
+		current_topology = d3d12_topology;
+		cmd_list->IASetPrimitiveTopology(d3d12_topology);
 	}
 
 	void GfxCommandList::SetIndexBuffer(GfxIndexBufferView* index_buffer_view)
 	{
 		ADRIA_ASSERT(current_context == Context::Graphics);
 
+		D3D12_INDEX_BUFFER_VIEW ibv{};
 		if (index_buffer_view)
 		{
-			D3D12_INDEX_BUFFER_VIEW ibv{};
 			ibv.BufferLocation = index_buffer_view->buffer_location;
 			ibv.SizeInBytes = index_buffer_view->size_in_bytes;
 			ibv.Format = ConvertGfxFormat(index_buffer_view->format);
-			cmd_list->IASetIndexBuffer(&ibv);
 		}
-		else
+
+		if (index_buffer_cached && StateFiltering.Get() && ibv.BufferLocation == current_index_buffer.BufferLocation &&
+			ibv.SizeInBytes == current_index_buffer.SizeInBytes && ibv.Format == current_index_buffer.Format)
 		{
-			cmd_list->IASetIndexBuffer(nullptr);
+			++stats.filtered_state_calls;
+			return;
 		}
+		++stats.issued_state_calls;
+		current_index_buffer = ibv;
+		index_buffer_cached = true;
+		cmd_list->IASetIndexBuffer(index_buffer_view ? &ibv : nullptr);
 	}
 
 	void GfxCommandList::SetVertexBuffer(GfxVertexBufferView const& vertex_buffer_view, uint32 start_slot /*= 0*/)
@@ -777,6 +833,7 @@ namespace adria
 	void GfxCommandList::SetRootConstant(uint32 slot, uint32 data, uint32 offset)
 	{
 		ADRIA_ASSERT(current_context != Context::Invalid);
+		if (FilterRootConstants(slot, &data, 1, offset)) return;
 
 		if (current_context == Context::Graphics)
 		{
@@ -791,6 +848,7 @@ namespace adria
 	void GfxCommandList::SetRootConstants(uint32 slot, void const* data, uint32 data_size, uint32 offset)
 	{
 		ADRIA_ASSERT(current_context != Context::Invalid);
+		if (FilterRootConstants(slot, data, data_size / sizeof(uint32), offset)) return;
 
 		if (current_context == Context::Graphics)
 		{
@@ -805,10 +863,19 @@ namespace adria
 	void GfxCommandList::SetRootCBV(uint32 slot, void const* data, uint64 data_size)
 	{
 		ADRIA_ASSERT(current_context != Context::Invalid);
+		if (FilterRootCBV(slot, data, data_size)) return;
 
 		auto dynamic_allocator = gfx->GetDynamicAllocator();
 		GfxDynamicAllocation alloc = dynamic_allocator->Allocate(data_size, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
 		alloc.Update(data, data_size);
+		FilterRootDescriptor(slot, alloc.gpu_address);
+		if (slot < MaxCachedRootParameters)
+		{
+			RootStateCache& cache = GetRootStateCache();
+			uint8 const* bytes = static_cast<uint8 const*>(data);
+			cache.root_cbv_data[slot].assign(bytes, bytes + data_size);
+			cache.root_cbv_allocators[slot] = dynamic_allocator;
+		}
 
 		if (current_context == Context::Graphics)
 		{
@@ -822,6 +889,7 @@ namespace adria
 
 	void GfxCommandList::SetRootCBV(uint32 slot, uint64 gpu_address)
 	{
+		if (FilterRootDescriptor(slot, gpu_address)) return;
 		if (current_context == Context::Graphics)
 		{
 			cmd_list->SetGraphicsRootConstantBufferView(slot, gpu_address);
@@ -835,6 +903,7 @@ namespace adria
 	void GfxCommandList::SetRootSRV(uint32 slot, uint64 gpu_address)
 	{
 		ADRIA_ASSERT(current_context != Context::Invalid);
+		if (FilterRootDescriptor(slot, gpu_address)) return;
 
 		if (current_context == Context::Graphics)
 		{
@@ -849,6 +918,7 @@ namespace adria
 	void GfxCommandList::SetRootUAV(uint32 slot, uint64 gpu_address)
 	{
 		ADRIA_ASSERT(current_context != Context::Invalid);
+		if (FilterRootDescriptor(slot, gpu_address)) return;
 
 		if (current_context == Context::Graphics)
 		{
@@ -862,6 +932,8 @@ namespace adria
 
 	void GfxCommandList::SetRootDescriptorTable(uint32 slot, GfxDescriptor base_descriptor)
 	{
+		D3D12_GPU_DESCRIPTOR_HANDLE handle = base_descriptor;
+		if (FilterRootDescriptor(slot, handle.ptr)) return;
 		if (current_context == Context::Graphics)
 		{
 			cmd_list->SetGraphicsRootDescriptorTable(slot, base_descriptor);
@@ -889,6 +961,19 @@ namespace adria
 		cmd_list->ClearDepthStencilView(dsv, d3d12_clear_flags, depth, stencil, 0, nullptr);
 	}
 
+	void GfxCommandList::ClearDepth(GfxDescriptor dsv, std::span<GfxRect const> rects, float depth /*= 1.0f*/, uint8 stencil /*= 0*/, bool clear_stencil /*= false*/)
+	{
+		if (rects.empty()) return;
+		D3D12_CLEAR_FLAGS d3d12_clear_flags = D3D12_CLEAR_FLAG_DEPTH;
+		if (clear_stencil) d3d12_clear_flags |= D3D12_CLEAR_FLAG_STENCIL;
+		std::vector<D3D12_RECT> d3d12_rects(rects.size());
+		for (uint64 i = 0; i < rects.size(); ++i)
+		{
+			d3d12_rects[i] = { (LONG)rects[i].x, (LONG)rects[i].y, LONG(rects[i].x + rects[i].width), LONG(rects[i].y + rects[i].height) };
+		}
+		cmd_list->ClearDepthStencilView(dsv, d3d12_clear_flags, depth, stencil, (UINT)d3d12_rects.size(), d3d12_rects.data());
+	}
+
 	void GfxCommandList::SetRenderTargets(std::span<GfxDescriptor const> rtvs, GfxDescriptor const* dsv /*= nullptr*/, bool single_rt /*= false*/)
 	{
 		D3D12_CPU_DESCRIPTOR_HANDLE* d3d12_dsv = nullptr;
@@ -907,5 +992,90 @@ namespace adria
 		current_context = ctx;
 	}
 
+	void GfxCommandList::InvalidateStateCache()
+	{
+		current_pso = nullptr;
+		current_state_object = nullptr;
+		current_topology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+		index_buffer_cached = false;
+		for (RootStateCache& root_state_cache : root_state_caches)
+		{
+			root_state_cache.root_descriptor_mask = 0;
+			for (uint32 i = 0; i < MaxCachedRootParameters; ++i)
+			{
+				root_state_cache.root_constant_masks[i] = 0;
+				root_state_cache.root_cbv_data[i].clear();
+				root_state_cache.root_cbv_allocators[i] = nullptr;
+			}
+		}
+	}
+
+	GfxCommandList::RootStateCache& GfxCommandList::GetRootStateCache()
+	{
+		return root_state_caches[current_context == Context::Graphics ? 0 : 1];
+	}
+
+	bool GfxCommandList::FilterRootDescriptor(uint32 slot, uint64 value)
+	{
+		if (slot >= MaxCachedRootParameters)
+		{
+			++stats.issued_state_calls;
+			return false;
+		}
+
+		RootStateCache& cache = GetRootStateCache();
+		uint32 const slot_bit = 1u << slot;
+		if ((cache.root_descriptor_mask & slot_bit) && cache.root_descriptors[slot] == value && StateFiltering.Get())
+		{
+			++stats.filtered_state_calls;
+			return true;
+		}
+		++stats.issued_state_calls;
+		cache.root_descriptors[slot] = value;
+		cache.root_descriptor_mask |= slot_bit;
+		cache.root_cbv_data[slot].clear();
+		return false;
+	}
+
+	bool GfxCommandList::FilterRootConstants(uint32 slot, void const* data, uint32 count, uint32 offset)
+	{
+		if (slot >= MaxCachedRootParameters || offset + count > MaxCachedRootConstants)
+		{
+			++stats.issued_state_calls;
+			return false;
+		}
+
+		RootStateCache& cache = GetRootStateCache();
+		uint32 const range_mask = ((1u << count) - 1) << offset;
+		uint32* cached_constants = cache.root_constants[slot] + offset;
+		if ((cache.root_constant_masks[slot] & range_mask) == range_mask && StateFiltering.Get() &&
+			memcmp(cached_constants, data, count * sizeof(uint32)) == 0)
+		{
+			++stats.filtered_state_calls;
+			return true;
+		}
+		++stats.issued_state_calls;
+		memcpy(cached_constants, data, count * sizeof(uint32));
+		cache.root_constant_masks[slot] |= range_mask;
+		return false;
+	}
+
+	bool GfxCommandList::FilterRootCBV(uint32 slot, void const* data, uint64 data_size)
+	{
+		if (slot >= MaxCachedRootParameters || !StateFiltering.Get()) return false;
+
+		//the previous upload stays alive until the dynamic allocator is recycled, so identical data can reuse the bound address
+		RootStateCache& cache = GetRootStateCache();
+		std::vector<uint8>& cbv_data = cache.root_cbv_data[slot];
+		GfxLinearDynamicAllocator* dynamic_allocator = gfx->GetDynamicAllocator();
+		if ((cache.root_descriptor_mask & (1u << slot)) && cache.root_cbv_allocators[slot] == dynamic_allocator &&
+			cbv_data.size() == data_size && memcmp(cbv_data.data(), data, data_size) == 0)
+		{
+			++stats.filtered_state_calls;
+			return true;
+		}
+		return false;
+	}
+
 }
 
@@ -5,6 +5,7 @@
 #include "GfxDynamicAllocation.h"
 #include "GfxShadingRate.h"
 #include "GfxStates.h"
+#include "GfxBarrierBatch.h"
 
 namespace adria
 {
@@ -21,6 +22,8 @@ namespace adria
 	struct GfxRenderPassDesc;
 	struct GfxShadingRateInfo;
 	class GfxRayTracingShaderTable;
+	class GfxLinearDynamicAllocator;
+	class GfxCommandAllocatorPool;
 
 	enum class GfxCommandListType : uint8
 	{
@@ -29,6 +32,23 @@ namespace adria
 		Copy
 	};
 
+	struct GfxRect
+	{
+		uint32 x;
+		uint32 y;
+		uint32 width;
+		uint32 height;
+	};
+
+	struct GfxCommandListStats
+	{
+		uint32 issued_state_calls = 0;
+		uint32 filtered_state_calls = 0;
+		uint32 requested_barriers = 0;
+		uint32 submitted_barriers = 0;
+		uint64 shader_table_bytes_uploaded = 0;
+	};
+
 	class GfxCommandList
 	{
 	public:
@@ -40,7 +60,10 @@ namespace adria
 		};
 
 	public:
-		explicit GfxCommandList(GfxDevice* gfx, GfxCommandListType type = GfxCommandListType::Graphics, char const* name = "");
+		//lists created with an allocator pool take an allocator from it in Begin and give it back in End, such lists
+		//have to be submitted before the end of the frame they were recorded in
+		explicit GfxCommandList(GfxDevice* gfx, GfxCommandListType type = GfxCommandListType::Graphics, char const* name = "",
+			GfxCommandAllocatorPool* allocator_pool = nullptr);
 		~GfxCommandList();
 
 		GfxDevice* GetDevice() const { return gfx; }
@@ -55,6 +78,7 @@ namespace adria
 		void WaitAll();
 		void Submit();
 		void SignalAll();
+		//invalidates the cached state, call it after code outside the engine recorded into the list
 		void ResetState();
 
 		void BeginQuery(GfxQueryHeap& query_heap, uint32 index);
@@ -131,33 +155,68 @@ namespace adria
 
 		void ClearRenderTarget(GfxDescriptor rtv, float const* clear_color);
 		void ClearDepth(GfxDescriptor dsv, float depth = 1.0f, uint8 stencil = 0, bool clear_stencil = false);
+		void ClearDepth(GfxDescriptor dsv, std::span<GfxRect const> rects, float depth = 1.0f, uint8 stencil = 0, bool clear_stencil = false);
 		void SetRenderTargets(std::span<GfxDescriptor const> rtvs, GfxDescriptor const* dsv = nullptr, bool single_rt = false);
 
 		void SetContext(Context ctx);
 
+		//forgets the shadowed state, needed after recording through GetNative() (e.g. ImGui)
+		void InvalidateStateCache();
+		//stats of the previous recording of this command list
+		GfxCommandListStats const& GetStats() const { return previous_stats; }
+
+	private:
+		static constexpr uint32 MaxCachedRootParameters = 4;
+		static constexpr uint32 MaxCachedRootConstants = 8;
+		struct RootStateCache
+		{
+			uint64 root_descriptors[MaxCachedRootParameters] = {};
+			uint32 root_descriptor_mask = 0;
+			uint32 root_constants[MaxCachedRootParameters][MaxCachedRootConstants] = {};
+			uint32 root_constant_masks[MaxCachedRootParameters] = {};
+			std::vector<uint8> root_cbv_data[MaxCachedRootParameters];
+			GfxLinearDynamicAllocator* root_cbv_allocators[MaxCachedRootParameters] = {};
+		};
+
 	private:
 		GfxDevice* gfx = nullptr;
 		GfxCommandListType type;
 		GfxCommandQueue& cmd_queue;
 		Ref<ID3D12GraphicsCommandList7> cmd_list = nullptr;
 		Ref<ID3D12CommandAllocator> cmd_allocator = nullptr;
+		GfxCommandAllocatorPool* allocator_pool = nullptr;
 
 		uint32 command_count = 0;
+		uint32 previous_command_count = 0;
 		GfxPipelineState* current_pso = nullptr;
 		GfxRenderPassDesc const* current_render_pass = nullptr;
 
 		ID3D12StateObject* current_state_object = nullptr;
-		std::unique_ptr<GfxRayTracingShaderTable> current_rt_table;
+		GfxRayTracingShaderTable* current_rt_table = nullptr;
 
 		Context current_context = Context::Invalid;
 
+		D3D12_PRIMITIVE_TOPOLOGY current_topology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+		D3D12_INDEX_BUFFER_VIEW current_index_buffer{};
+		bool index_buffer_cached = false;
+		RootStateCache root_state_caches[2];
+		GfxCommandListStats stats;
+		GfxCommandListStats previous_stats;
+
 		std::vector<std::pair<GfxFence&, uint64>> pending_waits;
 		std::vector<std::pair<GfxFence&, uint64>> pending_signals;
 
 		bool use_legacy_barriers = false;
+		GfxBarrierBatch pending_barriers;
 		std::vector<D3D12_TEXTURE_BARRIER>		  texture_barriers;
 		std::vector<D3D12_BUFFER_BARRIER>		  buffer_barriers;
 		std::vector<D3D12_GLOBAL_BARRIER>		  global_barriers;
 		std::vector<D3D12_RESOURCE_BARRIER>		  legacy_barriers;
+
+	private:
+		RootStateCache& GetRootStateCache();
+		bool FilterRootDescriptor(uint32 slot, uint64 value);
+		bool FilterRootConstants(uint32 slot, void const* data, uint32 count, uint32 offset);
+		bool FilterRootCBV(uint32 slot, void const* data, uint64 data_size);
 	};
 }
\ No newline at end of file
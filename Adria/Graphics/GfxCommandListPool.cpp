@@ -1,12 +1,13 @@
 #include "GfxCommandListPool.h"
 #include "GfxCommandList.h"
+#include "GfxDevice.h"
 
 namespace adria
 {
 
 	GfxCommandListPool::GfxCommandListPool(GfxDevice* gfx, GfxCommandListType type) : gfx(gfx), type(type)
 	{
-		cmd_lists.push_back(std::make_unique<GfxCommandList>(gfx, type));
+		cmd_lists.push_back(std::make_unique<GfxCommandList>(gfx, type, "", gfx->GetCommandAllocatorPool(type)));
 	}
 
 	GfxCommandList* GfxCommandListPool::GetMainCmdList() const
@@ -20,8 +21,7 @@ namespace adria
 
 	GfxCommandList* GfxCommandListPool::AllocateCmdList()
 	{
-		cmd_lists.push_back(std::make_unique<GfxCommandList>(gfx, type));
-		cmd_lists.back()->ResetAllocator();
+		cmd_lists.push_back(std::make_unique<GfxCommandList>(gfx, type, "", gfx->GetCommandAllocatorPool(type)));
 		cmd_lists.back()->Begin();
 		return cmd_lists.back().get();
 	}
@@ -40,11 +40,7 @@ namespace adria
 
 	void GfxCommandListPool::BeginCmdLists()
 	{
-		for (auto& cmd_list : cmd_lists)
-		{
-			cmd_list->ResetAllocator();
-			cmd_list->Begin();
-		}
+		for (auto& cmd_list : cmd_lists) cmd_list->Begin();
 	}
 	void GfxCommandListPool::EndCmdLists()
 	{
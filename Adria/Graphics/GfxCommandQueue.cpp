@@ -2,12 +2,15 @@
 #include "GfxDevice.h"
 #include "GfxCommandList.h"
 #include "GfxCommandListPool.h"
+#include "GfxUploadManager.h"
 #include "Utilities/StringUtil.h"
 
 namespace adria
 {
 	bool GfxCommandQueue::Create(GfxDevice* gfx, GfxCommandListType type, char const* name)
 	{
+		this->gfx = gfx;
+		this->type = type;
 		ID3D12Device* device = gfx->GetDevice();
 		D3D12_COMMAND_QUEUE_DESC queue_desc{};
 		auto GetCmdListType = [](GfxCommandListType type)
@@ -38,6 +41,10 @@ namespace adria
 	{
 		if (cmd_lists.empty()) return;
 
+		//uploads are recorded on the copy queue, make sure they land before anything that may read them
+		GfxUploadManager* upload_manager = gfx->GetUploadManager();
+		if (upload_manager && type != GfxCommandListType::Copy) upload_manager->WaitOnQueue(*this);
+
 		for (GfxCommandList* cmd_list : cmd_lists) cmd_list->WaitAll();
 
 		std::vector<ID3D12CommandList*> d3d12_cmd_lists(cmd_lists.size());
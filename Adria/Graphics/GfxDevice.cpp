@@ -5,11 +5,14 @@
 #include "GfxSwapchain.h"
 #include "GfxCommandList.h"
 #include "GfxCommandListPool.h"
+#include "GfxCommandAllocatorPool.h"
 #include "GfxTexture.h"
 #include "GfxBuffer.h"
 #include "GfxDescriptorAllocator.h"
 #include "GfxRingDescriptorAllocator.h"
 #include "GfxLinearDynamicAllocator.h"
+#include "GfxUploadManager.h"
+#include "GfxResidencyManager.h"
 #include "GfxQueryHeap.h"
 #include "GfxPipelineState.h"
 #include "GfxNsightAftermathGpuCrashTracker.h"
@@ -330,6 +333,9 @@ namespace adria
 		compute_queue.Create(this, GfxCommandListType::Compute, "Compute Queue");
 		copy_queue.Create(this, GfxCommandListType::Copy, "Copy Queue");
 
+		graphics_cmd_allocator_pool = std::make_unique<GfxCommandAllocatorPool>(this, GfxCommandListType::Graphics);
+		compute_cmd_allocator_pool	= std::make_unique<GfxCommandAllocatorPool>(this, GfxCommandListType::Compute);
+		copy_cmd_allocator_pool		= std::make_unique<GfxCommandAllocatorPool>(this, GfxCommandListType::Copy);
 		for (uint32 i = 0; i < GFX_BACKBUFFER_COUNT; ++i)
 		{
 			graphics_cmd_list_pool[i] = std::make_unique<GfxGraphicsCommandListPool>(this);
@@ -346,7 +352,7 @@ namespace adria
 			cpu_descriptor_allocators[i] = std::make_unique<GfxDescriptorAllocator>(this, desc);
 		}
 		for (uint32 i = 0; i < GFX_BACKBUFFER_COUNT; ++i) dynamic_allocators.emplace_back(new GfxLinearDynamicAllocator(this, 1 << 20));
-		dynamic_allocator_on_init.reset(new GfxLinearDynamicAllocator(this, 1 << 30));
+		dynamic_allocator_on_init.reset(new GfxLinearDynamicAllocator(this, 1 << 26));
 
 		GfxSwapchainDesc swapchain_desc{};
 		swapchain_desc.width = width;
@@ -360,6 +366,8 @@ namespace adria
 		async_compute_fence.Create(this, "Async Compute Fence");
 		wait_fence.Create(this, "Wait Fence");
 		release_fence.Create(this, "Release Fence");
+		upload_manager = std::make_unique<GfxUploadManager>(this, upload_fence);
+		residency_manager = std::make_unique<GfxResidencyManager>(this);
 
 		draw_indirect_signature = std::make_unique<DrawIndirectSignature>(device.Get());
 		draw_indexed_indirect_signature = std::make_unique<DrawIndexedIndirectSignature>(device.Get());
@@ -374,6 +382,7 @@ namespace adria
 	}
 	GfxDevice::~GfxDevice()
 	{
+		upload_manager.reset();
 		WaitForGPU();
 		ProcessReleaseQueue();
 		frame_fence.Wait(frame_fence_values[swapchain->GetBackbufferIndex()]);
@@ -381,6 +390,7 @@ namespace adria
 
 	void GfxDevice::WaitForGPU()
 	{
+		if (upload_manager) upload_manager->Submit();
 		graphics_queue.Signal(wait_fence, wait_fence_value);
 		copy_queue.Signal(wait_fence, wait_fence_value);
 		wait_fence.Wait(wait_fence_value);
@@ -417,8 +427,13 @@ namespace adria
 		gpu_descriptor_allocator->ReleaseCompletedFrames(frame_index);
 		dynamic_allocators[backbuffer_index]->Clear();
 
+		graphics_cmd_allocator_pool->NewFrame();
+		compute_cmd_allocator_pool->NewFrame();
+		copy_cmd_allocator_pool->NewFrame();
 		graphics_cmd_list_pool[backbuffer_index]->BeginCmdLists();
 		copy_cmd_list_pool[backbuffer_index]->BeginCmdLists();
+
+		residency_manager->Update();
 	}
 	void GfxDevice::EndFrame()
 	{
@@ -573,6 +588,22 @@ namespace adria
 		ADRIA_UNREACHABLE();
 	}
 
+	GfxCommandAllocatorPool* GfxDevice::GetCommandAllocatorPool(GfxCommandListType type) const
+	{
+		switch (type)
+		{
+		case GfxCommandListType::Graphics:
+			return graphics_cmd_allocator_pool.get();
+		case GfxCommandListType::Compute:
+			return compute_cmd_allocator_pool.get();
+		case GfxCommandListType::Copy:
+			return copy_cmd_allocator_pool.get();
+		default:
+			return graphics_cmd_allocator_pool.get();
+		}
+		ADRIA_UNREACHABLE();
+	}
+
 	void GfxDevice::CopyDescriptors(uint32 count, GfxDescriptor dst, GfxDescriptor src, GfxDescriptorHeapType type /*= GfxDescriptorHeapType::CBV_SRV_UAV*/)
 	{
 		device->CopyDescriptorsSimple(count, dst, src, ToD3D12HeapType(type));
@@ -692,11 +723,11 @@ namespace adria
 		return std::make_unique<GfxQueryHeap>(this, desc);
 	}
 
-	std::unique_ptr<GfxRayTracingTLAS> GfxDevice::CreateRayTracingTLAS(std::span<GfxRayTracingInstance> instances, GfxRayTracingASFlags flags)
+	std::unique_ptr<GfxRayTracingTLAS> GfxDevice::CreateRayTracingTLAS(uint32 instance_count, GfxRayTracingASFlags flags)
 	{
-		return std::make_unique<GfxRayTracingTLAS>(this, instances, flags);
+		return std::make_unique<GfxRayTracingTLAS>(this, instance_count, flags);
 	}
-	std::unique_ptr<GfxRayTracingBLAS> GfxDevice::CreateRayTracingBLAS(std::span<GfxRayTracingGeometry> geometries, GfxRayTracingASFlags flags)
+	std::unique_ptr<GfxRayTracingBLAS> GfxDevice::CreateRayTracingBLAS(std::span<GfxRayTracingGeometry const> geometries, GfxRayTracingASFlags flags)
 	{
 		return std::make_unique<GfxRayTracingBLAS>(this, geometries, flags);
 	}
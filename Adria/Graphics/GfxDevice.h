@@ -36,6 +36,7 @@ namespace adria
 	class GfxGraphicsCommandListPool;
 	class GfxComputeCommandListPool;
 	class GfxCopyCommandListPool;
+	class GfxCommandAllocatorPool;
 
 	enum class GfxSubresourceType : uint8;
 
@@ -61,6 +62,8 @@ namespace adria
 	class GfxMeshShaderPipelineState;
 
 	class GfxLinearDynamicAllocator;
+	class GfxUploadManager;
+	class GfxResidencyManager;
 	class GfxDescriptorAllocator;
 	template<bool>
 	class GfxRingDescriptorAllocator;
@@ -121,9 +124,11 @@ namespace adria
 		GfxCommandList* GetLatestCommandList(GfxCommandListType type) const;
 		GfxCommandList* AllocateCommandList(GfxCommandListType type) const;
 		void			FreeCommandList(GfxCommandList*, GfxCommandListType type);
+		GfxCommandAllocatorPool* GetCommandAllocatorPool(GfxCommandListType type) const;
 
 		GfxTexture* GetBackbuffer() const;
 
+		//not synchronized, resources have to be destroyed on the main thread
 		template<Releasable T>
 		void AddToReleaseQueue(T* alloc)
 		{
@@ -138,6 +143,8 @@ namespace adria
 		void InitShaderVisibleAllocator(uint32 reserve);
 
 		GfxLinearDynamicAllocator* GetDynamicAllocator() const;
+		GfxUploadManager* GetUploadManager() const { return upload_manager.get(); }
+		GfxResidencyManager* GetResidencyManager() const { return residency_manager.get(); }
 
 		std::unique_ptr<GfxTexture> CreateBackbufferTexture(GfxTextureDesc const& desc, void* backbuffer);
 		std::unique_ptr<GfxTexture> CreateTexture(GfxTextureDesc const& desc, GfxTextureData const& data);
@@ -151,8 +158,8 @@ namespace adria
 
 		std::unique_ptr<GfxQueryHeap>	   CreateQueryHeap(GfxQueryHeapDesc const& desc);
 
-		std::unique_ptr<GfxRayTracingTLAS> CreateRayTracingTLAS(std::span<GfxRayTracingInstance> instances, GfxRayTracingASFlags flags);
-		std::unique_ptr<GfxRayTracingBLAS> CreateRayTracingBLAS(std::span<GfxRayTracingGeometry> geometries, GfxRayTracingASFlags flags);
+		std::unique_ptr<GfxRayTracingTLAS> CreateRayTracingTLAS(uint32 instance_count, GfxRayTracingASFlags flags);
+		std::unique_ptr<GfxRayTracingBLAS> CreateRayTracingBLAS(std::span<GfxRayTracingGeometry const> geometries, GfxRayTracingASFlags flags);
 
 		GfxDescriptor CreateBufferSRV(GfxBuffer const*, GfxBufferDescriptorDesc const* = nullptr);
 		GfxDescriptor CreateBufferUAV(GfxBuffer const*, GfxBufferDescriptorDesc const* = nullptr);
@@ -211,10 +218,14 @@ namespace adria
 		GfxCommandQueue compute_queue;
 		GfxCommandQueue copy_queue;
 
+		std::unique_ptr<GfxCommandAllocatorPool> graphics_cmd_allocator_pool;
+		std::unique_ptr<GfxCommandAllocatorPool> compute_cmd_allocator_pool;
+		std::unique_ptr<GfxCommandAllocatorPool> copy_cmd_allocator_pool;
+
 		std::unique_ptr<GfxGraphicsCommandListPool> graphics_cmd_list_pool[GFX_BACKBUFFER_COUNT];
 		GfxFence	 frame_fence;
-		uint64		 frame_fence_value = 0;
-		uint64       frame_fence_values[GFX_BACKBUFFER_COUNT];
+		uint64		 frame_fence_value = 1;
+		uint64       frame_fence_values[GFX_BACKBUFFER_COUNT] = {};
 
 		std::unique_ptr<GfxComputeCommandListPool> compute_cmd_list_pool[GFX_BACKBUFFER_COUNT];
 		GfxFence async_compute_fence;
@@ -222,7 +233,6 @@ namespace adria
 
 		std::unique_ptr<GfxCopyCommandListPool> copy_cmd_list_pool[GFX_BACKBUFFER_COUNT];
 		GfxFence upload_fence;
-		uint64   upload_fence_value = 0;
 
 		GfxFence     wait_fence;
 		uint64       wait_fence_value = 1;
@@ -242,6 +252,8 @@ namespace adria
 
 		std::vector<std::unique_ptr<GfxLinearDynamicAllocator>> dynamic_allocators;
 		std::unique_ptr<GfxLinearDynamicAllocator> dynamic_allocator_on_init;
+		std::unique_ptr<GfxUploadManager> upload_manager;
+		std::unique_ptr<GfxResidencyManager> residency_manager;
 
 		std::unique_ptr<DrawIndirectSignature> draw_indirect_signature;
 		std::unique_ptr<DrawIndexedIndirectSignature> draw_indexed_indirect_signature;
@@ -0,0 +1,220 @@
+#include <vector>
+#include <memory>
+#include <array>
+#include <deque>
+#include <string>
+#if GFX_MULTITHREADED
+#include <mutex>
+#endif
+
+#include "GfxPipelineStatistics.h"
+#include "GfxDevice.h"
+#include "GfxCommandList.h"
+#include "GfxQueryHeap.h"
+#include "GfxBuffer.h"
+#include "Core/ConsoleManager.h"
+
+
+namespace adria
+{
+	static TAutoConsoleVariable<bool> PipelineStatistics("rhi.PipelineStatistics", false, "Collect pipeline statistics and occlusion queries for every render graph pass");
+
+	struct GfxPipelineStatistics::Impl
+	{
+		static constexpr uint64 FRAME_COUNT = GFX_BACKBUFFER_COUNT;
+		static constexpr uint32 MAX_SCOPES = 512;
+		static constexpr uint32 INVALID_INDEX = uint32(-1);
+
+		struct ScopeRecord
+		{
+			uint32 name_id;
+			GfxCommandList* cmd_list;
+			uint32 occlusion_index;
+			bool finished;
+		};
+		struct FrameData
+		{
+			std::vector<ScopeRecord> scopes;
+			uint32 occlusion_scope_count = 0;
+			bool resolved = false;
+		};
+
+		GfxDevice* gfx = nullptr;
+		std::unique_ptr<GfxQueryHeap> statistics_query_heap;
+		std::unique_ptr<GfxQueryHeap> occlusion_query_heap;
+		std::unique_ptr<GfxBuffer> statistics_readback_buffer;
+		std::unique_ptr<GfxBuffer> occlusion_readback_buffer;
+
+		std::deque<std::string> names;
+		std::unordered_map<std::string_view, uint32> name_to_id_map;
+
+		std::array<FrameData, FRAME_COUNT> frames;
+		uint64 current_frame = 0;
+		std::vector<GfxPipelineStatisticsResult> latest_results;
+
+#if GFX_MULTITHREADED
+		mutable std::mutex scope_mutex;
+#endif
+
+		void Init(GfxDevice* _gfx)
+		{
+			gfx = _gfx;
+
+			GfxQueryHeapDesc query_heap_desc{};
+			query_heap_desc.count = MAX_SCOPES;
+			query_heap_desc.type = GfxQueryType::PipelineStatistics;
+			statistics_query_heap = gfx->CreateQueryHeap(query_heap_desc);
+			query_heap_desc.type = GfxQueryType::Occlusion;
+			occlusion_query_heap = gfx->CreateQueryHeap(query_heap_desc);
+
+			statistics_readback_buffer = gfx->CreateBuffer(ReadBackBufferDesc(MAX_SCOPES * FRAME_COUNT * sizeof(D3D12_QUERY_DATA_PIPELINE_STATISTICS)));
+			occlusion_readback_buffer = gfx->CreateBuffer(ReadBackBufferDesc(MAX_SCOPES * FRAME_COUNT * sizeof(uint64)));
+		}
+		void Destroy()
+		{
+			statistics_query_heap.reset();
+			occlusion_query_heap.reset();
+			statistics_readback_buffer.reset();
+			occlusion_readback_buffer.reset();
+			gfx = nullptr;
+		}
+		void NewFrame()
+		{
+			current_frame = gfx->GetBackbufferIndex();
+			FrameData& frame = frames[current_frame];
+			if (!PipelineStatistics.Get()) latest_results.clear();
+			//the device waited for this backbuffer's previous frame, so its queries are in the readback buffers
+			ReadFrame(frame);
+			frame.scopes.clear();
+			frame.occlusion_scope_count = 0;
+			frame.resolved = false;
+		}
+		void EndFrame(GfxCommandList* cmd_list)
+		{
+			FrameData& frame = frames[current_frame];
+			if (frame.scopes.empty()) return;
+
+			uint32 const scope_count = (uint32)frame.scopes.size();
+			cmd_list->ResolveQueryData(*statistics_query_heap, 0, scope_count, *statistics_readback_buffer,
+				current_frame * MAX_SCOPES * sizeof(D3D12_QUERY_DATA_PIPELINE_STATISTICS));
+			if (frame.occlusion_scope_count > 0)
+			{
+				cmd_list->ResolveQueryData(*occlusion_query_heap, 0, frame.occlusion_scope_count, *occlusion_readback_buffer,
+					current_frame * MAX_SCOPES * sizeof(uint64));
+			}
+			frame.resolved = true;
+		}
+		uint32 BeginScope(GfxCommandList* cmd_list, char const* name, bool graphics)
+		{
+			if (!PipelineStatistics.Get()) return INVALID_INDEX;
+#if GFX_MULTITHREADED
+			std::scoped_lock lock(scope_mutex);
+#endif
+			FrameData& frame = frames[current_frame];
+			uint32 const scope_index = (uint32)frame.scopes.size();
+			if (scope_index >= MAX_SCOPES) return INVALID_INDEX;
+
+			uint32 const occlusion_index = graphics ? frame.occlusion_scope_count++ : INVALID_INDEX;
+			frame.scopes.push_back(ScopeRecord{ .name_id = InternName(name), .cmd_list = cmd_list, .occlusion_index = occlusion_index, .finished = false });
+			cmd_list->BeginQuery(*statistics_query_heap, scope_index);
+			if (graphics) cmd_list->BeginQuery(*occlusion_query_heap, occlusion_index);
+			return scope_index;
+		}
+		void EndScope(uint32 scope_index)
+		{
+			if (scope_index == INVALID_INDEX) return;
+#if GFX_MULTITHREADED
+			std::scoped_lock lock(scope_mutex);
+#endif
+			ScopeRecord& scope = frames[current_frame].scopes[scope_index];
+			ADRIA_ASSERT(!scope.finished);
+			if (scope.occlusion_index != INVALID_INDEX) scope.cmd_list->EndQuery(*occlusion_query_heap, scope.occlusion_index);
+			scope.cmd_list->EndQuery(*statistics_query_heap, scope_index);
+			scope.finished = true;
+		}
+		std::vector<GfxPipelineStatisticsResult> GetResults() const
+		{
+			return latest_results;
+		}
+
+	private:
+		uint32 InternName(char const* name)
+		{
+			if (auto it = name_to_id_map.find(name); it != name_to_id_map.end()) return it->second;
+			uint32 name_id = (uint32)names.size();
+			std::string const& interned_name = names.emplace_back(name);
+			name_to_id_map.emplace(interned_name, name_id);
+			return name_id;
+		}
+		void ReadFrame(FrameData const& frame)
+		{
+			if (!frame.resolved) return;
+
+			D3D12_QUERY_DATA_PIPELINE_STATISTICS const* statistics = statistics_readback_buffer->GetMappedData<D3D12_QUERY_DATA_PIPELINE_STATISTICS>() + current_frame * MAX_SCOPES;
+			uint64 const* samples_passed = occlusion_readback_buffer->GetMappedData<uint64>() + current_frame * MAX_SCOPES;
+
+			latest_results.clear();
+			for (uint32 i = 0; i < frame.scopes.size(); ++i)
+			{
+				ScopeRecord const& scope = frame.scopes[i];
+				if (!scope.finished) continue;
+
+				GfxPipelineStatisticsResult& result = latest_results.emplace_back();
+				result.name = names[scope.name_id];
+				result.graphics = scope.occlusion_index != INVALID_INDEX;
+				result.input_vertices = statistics[i].IAVertices;
+				result.input_primitives = statistics[i].IAPrimitives;
+				result.vs_invocations = statistics[i].VSInvocations;
+				result.rasterized_primitives = statistics[i].CPrimitives;
+				result.ps_invocations = statistics[i].PSInvocations;
+				result.cs_invocations = statistics[i].CSInvocations;
+				result.samples_passed = result.graphics ? samples_passed[scope.occlusion_index] : 0;
+			}
+		}
+	};
+
+	void GfxPipelineStatistics::Initialize(GfxDevice* _gfx)
+	{
+		pimpl = std::make_unique<Impl>();
+		pimpl->Init(_gfx);
+	}
+
+	void GfxPipelineStatistics::Destroy()
+	{
+		pimpl->Destroy();
+		pimpl = nullptr;
+	}
+
+	void GfxPipelineStatistics::NewFrame()
+	{
+		pimpl->NewFrame();
+	}
+
+	void GfxPipelineStatistics::EndFrame(GfxCommandList* cmd_list)
+	{
+		pimpl->EndFrame(cmd_list);
+	}
+
+	uint32 GfxPipelineStatistics::BeginScope(GfxCommandList* cmd_list, char const* name, bool graphics)
+	{
+		return pimpl->BeginScope(cmd_list, name, graphics);
+	}
+
+	void GfxPipelineStatistics::EndScope(uint32 scope_index)
+	{
+		pimpl->EndScope(scope_index);
+	}
+
+	std::vector<GfxPipelineStatisticsResult> GfxPipelineStatistics::GetResults() const
+	{
+		return pimpl->GetResults();
+	}
+
+	bool GfxPipelineStatistics::IsEnabled() const
+	{
+		return PipelineStatistics.Get();
+	}
+
+	GfxPipelineStatistics::GfxPipelineStatistics() {}
+	GfxPipelineStatistics::~GfxPipelineStatistics() {}
+}
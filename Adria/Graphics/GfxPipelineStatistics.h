@@ -0,0 +1,73 @@
+#pragma once
+#include <memory>
+#include <string_view>
+#include "GfxDefines.h"
+#include "Utilities/Singleton.h"
+
+
+namespace adria
+{
+	struct GfxPipelineStatisticsResult
+	{
+		std::string_view name;
+		bool graphics;
+		uint64 input_vertices;
+		uint64 input_primitives;
+		uint64 vs_invocations;
+		uint64 rasterized_primitives;
+		uint64 ps_invocations;
+		uint64 cs_invocations;
+		uint64 samples_passed;		//only for graphics passes
+	};
+
+	class GfxDevice;
+	class GfxCommandList;
+
+	//Per pass pipeline statistics and occlusion queries. Results are read back once the device has waited for the frame
+	//that recorded them (GFX_BACKBUFFER_COUNT frames later), so reading them never stalls the GPU.
+	class GfxPipelineStatistics : public Singleton<GfxPipelineStatistics>
+	{
+		friend class Singleton<GfxPipelineStatistics>;
+		struct Impl;
+
+	public:
+
+		void Initialize(GfxDevice* gfx);
+		void Destroy();
+
+		void NewFrame();
+		void EndFrame(GfxCommandList* cmd_list);
+		uint32 BeginScope(GfxCommandList* cmd_list, char const* name, bool graphics);
+		void EndScope(uint32 scope_index);
+		std::vector<GfxPipelineStatisticsResult> GetResults() const;
+		bool IsEnabled() const;
+
+	private:
+		std::unique_ptr<Impl> pimpl;
+
+	private:
+		GfxPipelineStatistics();
+		~GfxPipelineStatistics();
+	};
+	#define g_GfxPipelineStatistics GfxPipelineStatistics::Get()
+
+
+#if GFX_PROFILING
+	struct GfxPipelineStatisticsScope
+	{
+		GfxPipelineStatisticsScope(GfxCommandList* cmd_list, char const* name, bool graphics)
+			: scope_index{ g_GfxPipelineStatistics.BeginScope(cmd_list, name, graphics) }
+		{
+		}
+		~GfxPipelineStatisticsScope()
+		{
+			g_GfxPipelineStatistics.EndScope(scope_index);
+		}
+
+		uint32 const scope_index;
+	};
+	#define AdriaGfxPipelineStatisticsScope(cmd_list, name, graphics) GfxPipelineStatisticsScope ADRIA_CONCAT(pipeline_statistics_scope, __COUNTER__)(cmd_list, name, graphics)
+#else
+	#define AdriaGfxPipelineStatisticsScope(cmd_list, name, graphics)
+#endif
+}
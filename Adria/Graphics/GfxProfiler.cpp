@@ -1,7 +1,11 @@
 #include <vector>
 #include <memory>
 #include <array>
+#include <deque>
 #include <string>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
 #if GFX_MULTITHREADED
 #include <mutex>
 #endif
@@ -18,38 +22,58 @@ namespace adria
 	struct GfxProfiler::Impl
 	{
 		static constexpr uint64 FRAME_COUNT = GFX_BACKBUFFER_COUNT;
-		static constexpr uint64 MAX_PROFILES = 256;
+		static constexpr uint32 INITIAL_MAX_SCOPES = 256;
+		static constexpr uint32 HISTORY_FRAME_COUNT = 128;
+		static constexpr uint32 INVALID_INDEX = uint32(-1);
 
-		struct QueryData
+		//one node per unique (parent, name) pair, kept across frames so timings can be accumulated
+		struct ScopeNode
 		{
-			bool query_started = false;
-			bool query_finished = false;
-			GfxCommandList* cmd_list = nullptr;
+			uint32 name_id;
+			uint32 parent_node;
+			uint32 depth;
+			std::array<float, HISTORY_FRAME_COUNT> history{};
+			uint32 history_head = 0;
+			uint32 history_count = 0;
+			float last_time_ms = 0.0f;
+		};
+		struct ScopeRecord
+		{
+			uint32 node;
+			GfxCommandList* cmd_list;
+			bool timed;
+			bool finished;
+		};
+		struct FrameData
+		{
+			std::vector<ScopeRecord> scopes;
+			uint32 resolved_scope_count = 0;
 		};
 
 		GfxDevice* gfx = nullptr;
 		std::unique_ptr<GfxQueryHeap> query_heap;
 		std::unique_ptr<GfxBuffer> query_readback_buffer;
+		uint32 max_scopes = INITIAL_MAX_SCOPES;
+		uint32 required_scopes = 0;
 
-		std::array<QueryData, MAX_PROFILES> query_data;
-		std::unordered_map<std::string, uint32> name_to_index_map;
+		std::deque<std::string> names;
+		std::unordered_map<std::string_view, uint32> name_to_id_map;
+		std::vector<ScopeNode> nodes;
+		std::unordered_map<uint64, uint32> node_map;
+
+		std::array<FrameData, FRAME_COUNT> frames;
+		uint64 current_frame = 0;
+		std::vector<uint32> scope_stack;
+		std::vector<uint32> latest_frame_nodes;
 
 #if GFX_MULTITHREADED
-		mutable std::mutex map_mutex;
-		std::atomic_uint scope_counter = 0;
-#else
-		uint32 scope_counter = 0;
+		mutable std::mutex scope_mutex;
 #endif
 
 		void Init(GfxDevice* _gfx)
 		{
 			gfx = _gfx;
-			query_readback_buffer = gfx->CreateBuffer(ReadBackBufferDesc(MAX_PROFILES * 2 * FRAME_COUNT * sizeof(uint64)));
-
-			GfxQueryHeapDesc query_heap_desc{};
-			query_heap_desc.count = MAX_PROFILES * 2;
-			query_heap_desc.type = GfxQueryType::Timestamp;
-			query_heap = gfx->CreateQueryHeap(query_heap_desc);
+			CreateQueryHeap();
 		}
 		void Destroy()
 		{
@@ -59,92 +83,172 @@ namespace adria
 		}
 		void NewFrame()
 		{
-			for (auto& profile_data : query_data)
+			current_frame = gfx->GetBackbufferIndex();
+			FrameData& frame = frames[current_frame];
+			//the device waited for this backbuffer's previous frame, so its timestamps are in the readback buffer
+			ReadFrame(frame);
+			frame.scopes.clear();
+			frame.resolved_scope_count = 0;
+			scope_stack.clear();
+
+			if (required_scopes > max_scopes)
 			{
-				profile_data.query_started = profile_data.query_finished = false;
-				profile_data.cmd_list = nullptr;
+				gfx->WaitForGPU();
+				while (max_scopes < required_scopes) max_scopes *= 2;
+				CreateQueryHeap();
+				for (FrameData& frame_data : frames)
+				{
+					frame_data.scopes.clear();
+					frame_data.resolved_scope_count = 0;
+				}
 			}
-			name_to_index_map.clear();
-			scope_counter = 0;
+			required_scopes = 0;
 		}
-		void BeginProfileScope(GfxCommandList* cmd_list, char const* name)
+		void EndFrame(GfxCommandList* cmd_list)
+		{
+			FrameData& frame = frames[current_frame];
+			ADRIA_ASSERT(scope_stack.empty());
+			uint32 const timed_scope_count = std::min<uint32>((uint32)frame.scopes.size(), max_scopes);
+			if (timed_scope_count == 0) return;
+
+			uint64 const readback_offset = current_frame * max_scopes * 2 * sizeof(uint64);
+			cmd_list->ResolveQueryData(*query_heap, 0, timed_scope_count * 2, *query_readback_buffer, readback_offset);
+			frame.resolved_scope_count = timed_scope_count;
+		}
+		uint32 BeginProfileScope(GfxCommandList* cmd_list, char const* name)
 		{
-			uint32 profile_index = scope_counter++;
 #if GFX_MULTITHREADED
-			{
-				std::scoped_lock(map_mutex);
-				name_to_index_map[name] = profile_index;
-			}
-#else
-			name_to_index_map[name] = profile_index;
+			std::scoped_lock lock(scope_mutex);
 #endif
-			QueryData& profile_data = query_data[profile_index];
-			ADRIA_ASSERT(profile_data.query_started == false);
-			ADRIA_ASSERT(profile_data.query_finished == false);
-			uint32 begin_query_index = uint32(profile_index * 2);
-			cmd_list->BeginQuery(*query_heap, begin_query_index);
-			profile_data.query_started = true;
-			profile_data.cmd_list = cmd_list;
+			FrameData& frame = frames[current_frame];
+			uint32 const parent_node = scope_stack.empty() ? INVALID_INDEX : frame.scopes[scope_stack.back()].node;
+			uint32 const scope_index = (uint32)frame.scopes.size();
+			bool const timed = scope_index < max_scopes;
+			frame.scopes.push_back(ScopeRecord{ .node = GetNode(parent_node, InternName(name)), .cmd_list = cmd_list, .timed = timed, .finished = false });
+			scope_stack.push_back(scope_index);
+			required_scopes = std::max(required_scopes, scope_index + 1);
+
+			if (timed) cmd_list->BeginQuery(*query_heap, scope_index * 2);
+			return scope_index;
 		}
-		void EndProfileScope(char const* name)
+		void EndProfileScope(uint32 scope_index)
 		{
-			uint32 profile_index = -1;
 #if GFX_MULTITHREADED
-			{
-				std::scoped_lock(map_mutex);
-				profile_index = name_to_index_map[name];
-			}
-#else
-			profile_index = name_to_index_map[name];
+			std::scoped_lock lock(scope_mutex);
 #endif
-			ADRIA_ASSERT(profile_index != uint32(-1));
-			QueryData& profile_data = query_data[profile_index];
-			ADRIA_ASSERT(profile_data.query_started == true);
-			ADRIA_ASSERT(profile_data.query_finished == false);
-			uint32 begin_query_index = uint32(profile_index * 2);
-			uint32 end_query_index = uint32(profile_index * 2 + 1);
-			profile_data.cmd_list->EndQuery(*query_heap, end_query_index);
-			profile_data.query_finished = true;
+			ADRIA_ASSERT_MSG(!scope_stack.empty() && scope_stack.back() == scope_index, "Profile scopes have to be strictly nested");
+			scope_stack.pop_back();
+
+			ScopeRecord& scope = frames[current_frame].scopes[scope_index];
+			ADRIA_ASSERT(!scope.finished);
+			if (scope.timed) scope.cmd_list->EndQuery(*query_heap, scope_index * 2 + 1);
+			scope.finished = true;
 		}
 		std::vector<GfxTimestamp> GetResults()
 		{
-			uint64 gpu_frequency = 0;
-			gfx->GetTimestampFrequency(gpu_frequency);
-			uint64 current_backbuffer_index = gfx->GetBackbufferIndex();
-			for (auto const& [_, index] : name_to_index_map)
+			std::vector<GfxTimestamp> results{};
+			results.reserve(latest_frame_nodes.size());
+
+			std::unordered_map<uint32, uint32> node_to_result_index;
+			std::vector<float> sorted_history;
+			for (uint32 node_index : latest_frame_nodes)
 			{
-				ADRIA_ASSERT(index < MAX_PROFILES);
-				QueryData& profile_data = query_data[index];
-				if (profile_data.query_started && profile_data.query_finished)
-				{
-					uint32 begin_query_index = uint32(index * 2);
-					uint32 end_query_index = uint32(index * 2 + 1);
-					uint64 readback_offset = ((current_backbuffer_index * MAX_PROFILES * 2) + begin_query_index) * sizeof(uint64);
-					ADRIA_ASSERT(profile_data.cmd_list);
-					profile_data.cmd_list->ResolveQueryData(*query_heap, begin_query_index, 2, *query_readback_buffer, readback_offset);
-				}
+				ScopeNode const& node = nodes[node_index];
+				sorted_history.assign(node.history.begin(), node.history.begin() + node.history_count);
+				std::sort(sorted_history.begin(), sorted_history.end());
+				float sum = 0.0f;
+				for (float time : sorted_history) sum += time;
+
+				GfxTimestamp& timestamp = results.emplace_back();
+				timestamp.name = names[node.name_id];
+				timestamp.depth = node.depth;
+				auto parent_it = node_to_result_index.find(node.parent_node);
+				timestamp.parent_index = parent_it != node_to_result_index.end() ? parent_it->second : INVALID_INDEX;
+				timestamp.time_in_ms = node.last_time_ms;
+				timestamp.min_in_ms = sorted_history.front();
+				timestamp.avg_in_ms = sum / sorted_history.size();
+				timestamp.p95_in_ms = sorted_history[(sorted_history.size() * 95 + 99) / 100 - 1];
+				timestamp.max_in_ms = sorted_history.back();
+				timestamp.sample_count = node.history_count;
+				node_to_result_index[node_index] = (uint32)results.size() - 1;
 			}
+			return results;
+		}
+		bool ExportToCSV(std::string const& file_path)
+		{
+			std::filesystem::path path(file_path);
+			if (path.has_parent_path()) std::filesystem::create_directories(path.parent_path());
+			std::ofstream csv(file_path);
+			if (!csv.is_open()) return false;
+
+			std::vector<GfxTimestamp> results = GetResults();
+			std::vector<std::string> scope_paths(results.size());
+			csv << "Scope,Depth,Last (ms),Min (ms),Avg (ms),P95 (ms),Max (ms),Samples\n";
+			for (uint64 i = 0; i < results.size(); ++i)
+			{
+				GfxTimestamp const& timestamp = results[i];
+				scope_paths[i] = timestamp.parent_index != INVALID_INDEX ? scope_paths[timestamp.parent_index] + "/" : std::string{};
+				scope_paths[i] += timestamp.name;
+				csv << '"' << scope_paths[i] << "\"," << timestamp.depth << ',' << timestamp.time_in_ms << ',' << timestamp.min_in_ms << ','
+					<< timestamp.avg_in_ms << ',' << timestamp.p95_in_ms << ',' << timestamp.max_in_ms << ',' << timestamp.sample_count << '\n';
+			}
+			return true;
+		}
+
+	private:
+		void CreateQueryHeap()
+		{
+			query_readback_buffer = gfx->CreateBuffer(ReadBackBufferDesc(max_scopes * 2 * FRAME_COUNT * sizeof(uint64)));
+
+			GfxQueryHeapDesc query_heap_desc{};
+			query_heap_desc.count = max_scopes * 2;
+			query_heap_desc.type = GfxQueryType::Timestamp;
+			query_heap = gfx->CreateQueryHeap(query_heap_desc);
+		}
+		uint32 InternName(char const* name)
+		{
+			if (auto it = name_to_id_map.find(name); it != name_to_id_map.end()) return it->second;
+			uint32 name_id = (uint32)names.size();
+			std::string const& interned_name = names.emplace_back(name);
+			name_to_id_map.emplace(interned_name, name_id);
+			return name_id;
+		}
+		uint32 GetNode(uint32 parent_node, uint32 name_id)
+		{
+			uint64 const node_key = (uint64(parent_node) << 32) | name_id;
+			if (auto it = node_map.find(node_key); it != node_map.end()) return it->second;
+			uint32 node_index = (uint32)nodes.size();
+			ScopeNode& node = nodes.emplace_back();
+			node.name_id = name_id;
+			node.parent_node = parent_node;
+			node.depth = parent_node != INVALID_INDEX ? nodes[parent_node].depth + 1 : 0;
+			node_map.emplace(node_key, node_index);
+			return node_index;
+		}
+		void ReadFrame(FrameData const& frame)
+		{
+			if (frame.resolved_scope_count == 0) return;
+
+			uint64 gpu_frequency = 0;
+			gfx->GetTimestampFrequency(gpu_frequency);
 			uint64 const* query_timestamps = query_readback_buffer->GetMappedData<uint64>();
-			uint64 const* frame_query_timestamps = query_timestamps + (current_backbuffer_index * MAX_PROFILES * 2);
+			uint64 const* frame_query_timestamps = query_timestamps + current_frame * max_scopes * 2;
 
-			std::vector<GfxTimestamp> results{};
-			results.reserve(name_to_index_map.size());
-			for (auto const& [name, index] : name_to_index_map)
+			latest_frame_nodes.clear();
+			for (uint32 i = 0; i < frame.resolved_scope_count; ++i)
 			{
-				ADRIA_ASSERT(index < MAX_PROFILES);
-				QueryData& profile_data = query_data[index];
-				if (profile_data.query_started && profile_data.query_finished)
-				{
-					uint64 start_time = frame_query_timestamps[index * 2 + 0];
-					uint64 end_time = frame_query_timestamps[index * 2 + 1];
+				ScopeRecord const& scope = frame.scopes[i];
+				if (!scope.finished) continue;
 
-					uint64 delta = end_time - start_time;
-					float frequency = float(gpu_frequency);
-					float time_ms = (delta / frequency) * 1000.0f;
-					results.emplace_back(time_ms, name);
-				}
+				uint64 const delta = frame_query_timestamps[i * 2 + 1] - frame_query_timestamps[i * 2];
+				float const time_ms = (delta / float(gpu_frequency)) * 1000.0f;
+				ScopeNode& node = nodes[scope.node];
+				node.last_time_ms = time_ms;
+				node.history[node.history_head] = time_ms;
+				node.history_head = (node.history_head + 1) % HISTORY_FRAME_COUNT;
+				node.history_count = std::min(node.history_count + 1, HISTORY_FRAME_COUNT);
+				latest_frame_nodes.push_back(scope.node);
 			}
-			return results;
 		}
 	};
 
@@ -165,14 +269,19 @@ namespace adria
 		pimpl->NewFrame();
 	}
 
-	void GfxProfiler::BeginProfileScope(GfxCommandList* cmd_list, char const* name)
+	void GfxProfiler::EndFrame(GfxCommandList* cmd_list)
 	{
-		pimpl->BeginProfileScope(cmd_list, name);
+		pimpl->EndFrame(cmd_list);
 	}
 
-	void GfxProfiler::EndProfileScope(char const* name)
+	uint32 GfxProfiler::BeginProfileScope(GfxCommandList* cmd_list, char const* name)
 	{
-		pimpl->EndProfileScope(name);
+		return pimpl->BeginProfileScope(cmd_list, name);
+	}
+
+	void GfxProfiler::EndProfileScope(uint32 scope_index)
+	{
+		pimpl->EndProfileScope(scope_index);
 	}
 
 	std::vector<GfxTimestamp> GfxProfiler::GetResults()
@@ -180,9 +289,11 @@ namespace adria
 		return pimpl->GetResults();
 	}
 
+	bool GfxProfiler::ExportToCSV(std::string const& file_path)
+	{
+		return pimpl->ExportToCSV(file_path);
+	}
+
 	GfxProfiler::GfxProfiler() {}
 	GfxProfiler::~GfxProfiler() {}
 }
-
-
-
@@ -1,5 +1,6 @@
 #pragma once
 #include <memory>
+#include <string_view>
 #include "GfxDefines.h"
 #include "Utilities/Singleton.h"
 
@@ -8,8 +9,15 @@ namespace adria
 {
 	struct GfxTimestamp
 	{
-		float time_in_ms;
-		std::string name;
+		std::string_view name;
+		uint32 depth;
+		uint32 parent_index;	//index of the parent scope in the results, -1 for root scopes
+		float time_in_ms;		//time in the latest completed frame
+		float min_in_ms;
+		float avg_in_ms;
+		float p95_in_ms;
+		float max_in_ms;
+		uint32 sample_count;
 	};
 
 	class GfxDevice;
@@ -28,9 +36,11 @@ namespace adria
 		void Destroy();
 
 		void NewFrame();
-		void BeginProfileScope(GfxCommandList* cmd_list, char const* name);
-		void EndProfileScope(char const* name);
+		void EndFrame(GfxCommandList* cmd_list);
+		uint32 BeginProfileScope(GfxCommandList* cmd_list, char const* name);
+		void EndProfileScope(uint32 scope_index);
 		std::vector<GfxTimestamp> GetResults();
+		bool ExportToCSV(std::string const& file_path);
 
 	private:
 		std::unique_ptr<Impl> pimpl;
@@ -45,31 +55,30 @@ namespace adria
 #if GFX_PROFILING
 	struct GfxProfileScope
 	{
-		GfxProfileScope(GfxCommandList* _cmd_list, char const* _name, bool active = true)
-			: name{ _name }, cmd_list{ _cmd_list }, active{ active }, color{ 0xffffffff }
+		GfxProfileScope(GfxCommandList* cmd_list, char const* name, bool active = true)
+			: active{ active }, color{ 0xffffffff }
 		{
-			if (active) g_GfxProfiler.BeginProfileScope(cmd_list, name.c_str());
+			if (active) scope_index = g_GfxProfiler.BeginProfileScope(cmd_list, name);
 		}
-		GfxProfileScope(GfxCommandList* _cmd_list, char const* _name, uint32 color, bool active)
-			: name{ _name }, cmd_list{ _cmd_list }, color{ color }, active{ active }
+		GfxProfileScope(GfxCommandList* cmd_list, char const* name, uint32 color, bool active)
+			: active{ active }, color{ color }
 		{
-			if (active) g_GfxProfiler.BeginProfileScope(cmd_list, name.c_str());
+			if (active) scope_index = g_GfxProfiler.BeginProfileScope(cmd_list, name);
 		}
 
 		~GfxProfileScope()
 		{
-			if (active) g_GfxProfiler.EndProfileScope(name.c_str());
+			if (active) g_GfxProfiler.EndProfileScope(scope_index);
 		}
 
-		GfxCommandList* cmd_list;
-		std::string name;
+		uint32 scope_index = uint32(-1);
 		bool const active;
 		uint32 color;
 	};
 	#define AdriaGfxProfileScope(cmd_list, name) GfxProfileScope ADRIA_CONCAT(scope, __COUNTER__)(cmd_list, name)
 	#define AdriaGfxProfileCondScope(cmd_list, name, active) GfxProfileScope ADRIA_CONCAT(scope, __COUNTER__)(cmd_list, name, active)
 #else
-	#define AdriaGfxProfileScope(cmd_list, name) 
-	#define AdriaGfxProfileCondScope(cmd_list, name, active) 
+	#define AdriaGfxProfileScope(cmd_list, name)
+	#define AdriaGfxProfileCondScope(cmd_list, name, active)
 #endif
 }
@@ -55,28 +55,21 @@ namespace adria
 		}
 	}
 
-	GfxRayTracingBLAS::GfxRayTracingBLAS(GfxDevice* gfx, std::span<GfxRayTracingGeometry> geometries, GfxRayTracingASFlags flags)
+	GfxRayTracingBLAS::GfxRayTracingBLAS(GfxDevice* gfx, std::span<GfxRayTracingGeometry const> geometries, GfxRayTracingASFlags flags) : gfx(gfx)
 	{
-		std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geo_descs; geo_descs.reserve(geometries.size());
-		for (auto&& geometry : geometries)	geo_descs.push_back(ConvertRayTracingGeometry(geometry));
+		geometry_descs.reserve(geometries.size());
+		for (auto&& geometry : geometries)	geometry_descs.push_back(ConvertRayTracingGeometry(geometry));
 
-		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs{};
 		inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
 		inputs.Flags = ConvertASFlags(flags);
 		inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
-
-		inputs.NumDescs = (uint32)geo_descs.size();
-		inputs.pGeometryDescs = geo_descs.data();
+		inputs.NumDescs = (uint32)geometry_descs.size();
+		inputs.pGeometryDescs = geometry_descs.data();
 
 		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO bl_prebuild_info{};
 		gfx->GetDevice()->GetRaytracingAccelerationStructurePrebuildInfo(&inputs, &bl_prebuild_info);
 		ADRIA_ASSERT(bl_prebuild_info.ResultDataMaxSizeInBytes > 0);
-
-		GfxBufferDesc scratch_buffer_desc{};
-		scratch_buffer_desc.bind_flags = GfxBindFlag::UnorderedAccess;
-		scratch_buffer_desc.size = bl_prebuild_info.ScratchDataSizeInBytes;
-		scratch_buffer = gfx->CreateBuffer(scratch_buffer_desc);
-		scratch_buffer->SetName("scratch buffer");
+		scratch_size = bl_prebuild_info.ScratchDataSizeInBytes;
 
 		GfxBufferDesc result_buffer_desc{};
 		result_buffer_desc.bind_flags = GfxBindFlag::UnorderedAccess | GfxBindFlag::ShaderResource;
@@ -84,31 +77,66 @@ namespace adria
 		result_buffer_desc.misc_flags = GfxBufferMiscFlag::AccelStruct;
 		result_buffer_desc.stride = 4;
 		result_buffer = gfx->CreateBuffer(result_buffer_desc);
-		scratch_buffer->SetName("result buffer");
+		result_buffer->SetName("BLAS");
+	}
 
+	GfxRayTracingBLAS::~GfxRayTracingBLAS() = default;
+
+	void GfxRayTracingBLAS::Build(GfxCommandList* cmd_list, uint64 scratch_address, uint64 compacted_size_address)
+	{
 		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC blas_desc{};
 		blas_desc.Inputs = inputs;
 		blas_desc.DestAccelerationStructureData = result_buffer->GetGpuAddress();
-		blas_desc.ScratchAccelerationStructureData = scratch_buffer->GetGpuAddress();
+		blas_desc.ScratchAccelerationStructureData = scratch_address;
 
-		GfxCommandList* cmd_list = gfx->GetCommandList();
-		cmd_list->GetNative()->BuildRaytracingAccelerationStructure(&blas_desc, 0, nullptr);
+		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_DESC postbuild_info_desc{};
+		postbuild_info_desc.InfoType = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_COMPACTED_SIZE;
+		postbuild_info_desc.DestBuffer = compacted_size_address;
+		uint32 const postbuild_info_count = compacted_size_address != 0 ? 1 : 0;
+		cmd_list->GetNative()->BuildRaytracingAccelerationStructure(&blas_desc, postbuild_info_count, postbuild_info_count ? &postbuild_info_desc : nullptr);
 	}
 
-	GfxRayTracingBLAS::~GfxRayTracingBLAS() = default;
+	//the compacted copy replaces the result buffer, instances referencing this BLAS have to be rebuilt afterwards.
+	//The source buffer is freed through the device release queue, so the copy and TLASes built earlier in the frame can still read it.
+	void GfxRayTracingBLAS::Compact(GfxCommandList* cmd_list, uint64 compacted_size)
+	{
+		ADRIA_ASSERT(compacted_size > 0 && compacted_size <= result_buffer->GetSize());
+		GfxBufferDesc compacted_buffer_desc = result_buffer->GetDesc();
+		compacted_buffer_desc.size = compacted_size;
+		std::unique_ptr<GfxBuffer> compacted_buffer = gfx->CreateBuffer(compacted_buffer_desc);
+		compacted_buffer->SetName("BLAS");
+
+		cmd_list->GetNative()->CopyRaytracingAccelerationStructure(compacted_buffer->GetGpuAddress(), result_buffer->GetGpuAddress(),
+			D3D12_RAYTRACING_ACCELERATION_STRUCTURE_COPY_MODE_COMPACT);
+		result_buffer = std::move(compacted_buffer);
+	}
+
+	uint64 GfxRayTracingBLAS::GetSize() const
+	{
+		return result_buffer->GetSize();
+	}
 
 	uint64 GfxRayTracingBLAS::GetGpuAddress() const
 	{
 		return result_buffer->GetGpuAddress();
 	}
 
-	GfxRayTracingTLAS::GfxRayTracingTLAS(GfxDevice* gfx, std::span<GfxRayTracingInstance> instances, GfxRayTracingASFlags flags)
+	void PackRayTracingInstance(GfxRayTracingInstance const& instance, void* dst)
+	{
+		D3D12_RAYTRACING_INSTANCE_DESC& instance_desc = *static_cast<D3D12_RAYTRACING_INSTANCE_DESC*>(dst);
+		instance_desc.InstanceID = instance.instance_id;
+		instance_desc.InstanceContributionToHitGroupIndex = 0;
+		instance_desc.Flags = ConvertInstanceFlags(instance.flags);
+		memcpy(instance_desc.Transform, &instance.transform, sizeof(instance_desc.Transform));
+		instance_desc.AccelerationStructure = instance.blas ? instance.blas->GetGpuAddress() : 0;
+		instance_desc.InstanceMask = instance.instance_mask;
+	}
+
+	GfxRayTracingTLAS::GfxRayTracingTLAS(GfxDevice* gfx, uint32 instance_count, GfxRayTracingASFlags flags)
 	{
-		// First, get the size of the TLAS buffers and create them
-		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs{};
 		inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
 		inputs.Flags = ConvertASFlags(flags);
-		inputs.NumDescs = (uint32)instances.size();
+		inputs.NumDescs = instance_count;
 		inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
 
 		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO tl_prebuild_info;
@@ -117,7 +145,7 @@ namespace adria
 
 		GfxBufferDesc scratch_buffer_desc{};
 		scratch_buffer_desc.bind_flags = GfxBindFlag::UnorderedAccess;
-		scratch_buffer_desc.size = tl_prebuild_info.ScratchDataSizeInBytes;
+		scratch_buffer_desc.size = std::max(tl_prebuild_info.ScratchDataSizeInBytes, tl_prebuild_info.UpdateScratchDataSizeInBytes);
 		scratch_buffer = gfx->CreateBuffer(scratch_buffer_desc);
 
 		GfxBufferDesc result_buffer_desc{};
@@ -128,29 +156,24 @@ namespace adria
 
 		GfxBufferDesc instance_buffer_desc{};
 		instance_buffer_desc.bind_flags = GfxBindFlag::None;
-		instance_buffer_desc.size = sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * instances.size();
-		instance_buffer_desc.resource_usage = GfxResourceUsage::Upload;
+		instance_buffer_desc.size = GFX_RAYTRACING_INSTANCE_SIZE * std::max(instance_count, 1u);
 		instance_buffer = gfx->CreateBuffer(instance_buffer_desc);
+		instance_buffer->SetName("TLAS Instance Buffer");
+	}
 
-		D3D12_RAYTRACING_INSTANCE_DESC* p_instance_desc = instance_buffer->GetMappedData<D3D12_RAYTRACING_INSTANCE_DESC>();
-		for (uint64 i = 0; i < instances.size(); ++i)
-		{
-			p_instance_desc[i].InstanceID = instances[i].instance_id;
-			p_instance_desc[i].InstanceContributionToHitGroupIndex = 0;
-			p_instance_desc[i].Flags = ConvertInstanceFlags(instances[i].flags);
-			memcpy(p_instance_desc[i].Transform, &instances[i].transform, sizeof(p_instance_desc->Transform));
-			p_instance_desc[i].AccelerationStructure = instances[i].blas->GetGpuAddress();
-			p_instance_desc[i].InstanceMask = instances[i].instance_mask;
-		}
-		instance_buffer->Unmap();
-
+	void GfxRayTracingTLAS::Build(GfxCommandList* cmd_list, bool update)
+	{
 		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC tlas_desc{};
 		tlas_desc.Inputs = inputs;
 		tlas_desc.Inputs.InstanceDescs = instance_buffer->GetGpuAddress();
+		if (update)
+		{
+			ADRIA_ASSERT(inputs.Flags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE);
+			tlas_desc.Inputs.Flags |= D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE;
+			tlas_desc.SourceAccelerationStructureData = result_buffer->GetGpuAddress();
+		}
 		tlas_desc.DestAccelerationStructureData = result_buffer->GetGpuAddress();
 		tlas_desc.ScratchAccelerationStructureData = scratch_buffer->GetGpuAddress();
-
-		GfxCommandList* cmd_list = gfx->GetCommandList();
 		cmd_list->GetNative()->BuildRaytracingAccelerationStructure(&tlas_desc, 0, nullptr);
 	}
 
@@ -1,5 +1,6 @@
 #pragma once
 #include <span>
+#include <vector>
 #include <memory>
 #include "GfxFormat.h"
 
@@ -7,6 +8,7 @@ namespace adria
 {
 	class GfxBuffer;
 	class GfxDevice;
+	class GfxCommandList;
 	class GfxRayTracingBLAS;
 
 	enum GfxRayTracingASFlagBit : uint32
@@ -48,19 +50,28 @@ namespace adria
 		bool opaque;
 	};
 
+	//creating a BLAS only allocates its memory, builds are recorded separately so several BLASes can share one scratch buffer
 	class GfxRayTracingBLAS
 	{
 	public:
-		GfxRayTracingBLAS(GfxDevice* gfx, std::span<GfxRayTracingGeometry> geometries, GfxRayTracingASFlags flags);
+		GfxRayTracingBLAS(GfxDevice* gfx, std::span<GfxRayTracingGeometry const> geometries, GfxRayTracingASFlags flags);
 		~GfxRayTracingBLAS();
 
+		void Build(GfxCommandList* cmd_list, uint64 scratch_address, uint64 compacted_size_address = 0);
+		void Compact(GfxCommandList* cmd_list, uint64 compacted_size);
+
+		uint64 GetScratchSize() const { return scratch_size; }
+		uint64 GetSize() const;
 		uint64 GetGpuAddress() const;
 		GfxBuffer const& GetBuffer() const { return *result_buffer; }
 		GfxBuffer const& operator*() const { return *result_buffer; }
 
 	private:
+		GfxDevice* gfx;
 		std::unique_ptr<GfxBuffer> result_buffer;
-		std::unique_ptr<GfxBuffer> scratch_buffer;
+		std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geometry_descs;
+		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs{};
+		uint64 scratch_size = 0;
 	};
 
 
@@ -73,12 +84,21 @@ namespace adria
 		GfxRayTracingInstanceFlags flags;
 	};
 
+	inline constexpr uint64 GFX_RAYTRACING_INSTANCE_SIZE = sizeof(D3D12_RAYTRACING_INSTANCE_DESC);
+	void PackRayTracingInstance(GfxRayTracingInstance const& instance, void* dst);
+
+	//the instance buffer is owned by the TLAS and filled by the caller with packed instances before a build is recorded
 	class GfxRayTracingTLAS
 	{
 	public:
-		GfxRayTracingTLAS(GfxDevice* gfx, std::span<GfxRayTracingInstance> instances, GfxRayTracingASFlags flags);
+		GfxRayTracingTLAS(GfxDevice* gfx, uint32 instance_count, GfxRayTracingASFlags flags);
 		~GfxRayTracingTLAS();
 
+		//update refits the TLAS in place to the current instance buffer, it needs GfxRayTracingASFlag_AllowUpdate
+		void Build(GfxCommandList* cmd_list, bool update = false);
+
+		uint32 GetInstanceCount() const { return inputs.NumDescs; }
+		GfxBuffer& GetInstanceBuffer() const { return *instance_buffer; }
 		uint64 GetGpuAddress() const;
 		GfxBuffer const& GetBuffer() const { return *result_buffer; }
 		GfxBuffer const& operator*() const { return *result_buffer; }
@@ -87,6 +107,6 @@ namespace adria
 		std::unique_ptr<GfxBuffer> result_buffer;
 		std::unique_ptr<GfxBuffer> scratch_buffer;
 		std::unique_ptr<GfxBuffer> instance_buffer;
-		void* instance_buffer_cpu_address = nullptr;
+		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs{};
 	};
 }
\ No newline at end of file
@@ -1,55 +1,166 @@
 #include "GfxRayTracingShaderTable.h"
 #include "GfxStateObject.h"
+#include "GfxDevice.h"
+#include "GfxBuffer.h"
 #include "GfxLinearDynamicAllocator.h"
-#include "GfxRingDynamicAllocator.h"
 #include "Utilities/StringUtil.h"
 
 namespace adria
 {
+	namespace
+	{
+		uint32 GetRecordSize(uint32 data_size)
+		{
+			return (uint32)Align(D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES + data_size, D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT);
+		}
+		uint32 GetSectionSize(uint32 record_size, uint32 record_count)
+		{
+			return (uint32)Align(record_size * record_count, D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT);
+		}
+	}
 
-	GfxRayTracingShaderTable::GfxRayTracingShaderTable(GfxStateObject* state_object)
+	GfxRayTracingShaderTable::GfxRayTracingShaderTable(GfxDevice* gfx, GfxStateObject* state_object) : gfx(gfx)
 	{
 		GFX_CHECK_HR(state_object->d3d12_so->QueryInterface(IID_PPV_ARGS(pso_info.GetAddressOf())));
 	}
 
-	void GfxRayTracingShaderTable::SetRayGenShader(char const* name, void* local_data /*= nullptr*/, uint32 data_size /*= 0*/)
+	GfxRayTracingShaderTable::~GfxRayTracingShaderTable() = default;
+
+	void GfxRayTracingShaderTable::SetRayGenShader(char const* name, void const* local_data /*= nullptr*/, uint32 data_size /*= 0*/)
 	{
-		void const* ray_gen_id = pso_info->GetShaderIdentifier(ToWideString(name).c_str());
-		ray_gen_record.Init(ray_gen_id, local_data, data_size);
-		ray_gen_record_size = (uint32)Align(D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES + data_size, D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT);
+		SetRecord(ray_gen_record, name, local_data, data_size);
+		layout.ray_gen_record_size = GetRecordSize(data_size);
 	}
 
-	void GfxRayTracingShaderTable::AddMissShader(char const* name, uint32 i, void* local_data /*= nullptr*/, uint32 data_size /*= 0*/)
+	void GfxRayTracingShaderTable::AddMissShader(char const* name, uint32 i, void const* local_data /*= nullptr*/, uint32 data_size /*= 0*/)
 	{
 		if (i >= (uint32)miss_shader_records.size())
 		{
 			miss_shader_records.resize(i + 1);
+			layout.miss_shader_count = i + 1;
 		}
-		void const* miss_id = pso_info->GetShaderIdentifier(ToWideString(name).c_str());
-		miss_shader_records[i].Init(miss_id, local_data, data_size);
-		miss_shader_record_size = std::max(miss_shader_record_size, (uint32)Align(D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES + data_size, D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT));
+		SetRecord(miss_shader_records[i], name, local_data, data_size);
+		layout.miss_shader_record_size = std::max(layout.miss_shader_record_size, GetRecordSize(data_size));
 	}
 
-	void GfxRayTracingShaderTable::AddHitGroup(char const* name, uint32 i, void* local_data /*= nullptr*/, uint32 data_size /*= 0*/)
+	void GfxRayTracingShaderTable::AddHitGroup(char const* name, uint32 i, void const* local_data /*= nullptr*/, uint32 data_size /*= 0*/)
 	{
 		if (i >= (uint32)hit_group_records.size())
 		{
 			hit_group_records.resize(i + 1);
+			layout.hit_group_count = i + 1;
 		}
-		void const* miss_id = pso_info->GetShaderIdentifier(ToWideString(name).c_str());
-		hit_group_records[i].Init(miss_id, local_data, data_size);
-		hit_group_record_size = std::max(hit_group_record_size, (uint32)Align(D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES + data_size, D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT));
+		SetRecord(hit_group_records[i], name, local_data, data_size);
+		layout.hit_group_record_size = std::max(layout.hit_group_record_size, GetRecordSize(data_size));
 	}
 
-	void GfxRayTracingShaderTable::Commit(GfxLinearDynamicAllocator& allocator, D3D12_DISPATCH_RAYS_DESC& desc)
+	uint64 GfxRayTracingShaderTable::Commit(D3D12_DISPATCH_RAYS_DESC& desc)
 	{
-		CommitImpl(allocator, desc);
+		uint32 const frame_index = gfx->GetFrameIndex();
+		GfxShaderTableCopy& table_copy = table_copies[gfx->GetBackbufferIndex()];
+		if (table_copy.version == version && table_copy.layout == layout && table_copy.buffer)
+		{
+			table_copy.committed_frame = frame_index;
+			FillDispatchDesc(table_copy.buffer->GetGpuAddress(), desc);
+			return 0;
+		}
+
+		uint64 const table_size = GetTableSize();
+		if (table_copy.committed_frame == frame_index)
+		{
+			//an earlier dispatch of this frame still reads this copy, the changed table goes to transient memory instead
+			GfxDynamicAllocation allocation = gfx->GetDynamicAllocator()->Allocate(table_size, D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT);
+			uint64 const written_bytes = WriteTable((uint8*)allocation.cpu_address, 0, true);
+			FillDispatchDesc(allocation.gpu_address, desc);
+			return written_bytes;
+		}
+
+		bool full_write = table_copy.layout != layout;
+		if (!table_copy.buffer || table_copy.buffer->GetSize() < table_size)
+		{
+			GfxBufferDesc buffer_desc{};
+			buffer_desc.size = table_size;
+			buffer_desc.resource_usage = GfxResourceUsage::Upload;
+			table_copy.buffer = gfx->CreateBuffer(buffer_desc);
+			ADRIA_ASSERT(table_copy.buffer->IsMapped());
+			full_write = true;
+		}
+
+		//the device waited for this backbuffer's previous frame, so the copy is no longer read by the GPU
+		uint64 const written_bytes = WriteTable(table_copy.buffer->GetMappedData<uint8>(), table_copy.version, full_write);
+		table_copy.layout = layout;
+		table_copy.version = version;
+		table_copy.committed_frame = frame_index;
+		FillDispatchDesc(table_copy.buffer->GetGpuAddress(), desc);
+		return written_bytes;
 	}
 
-	void GfxRayTracingShaderTable::Commit(GfxRingDynamicAllocator& allocator, D3D12_DISPATCH_RAYS_DESC& desc)
+	void const* GfxRayTracingShaderTable::GetShaderIdentifier(char const* name)
 	{
-		CommitImpl(allocator, desc);
+		if (auto it = shader_identifier_map.find(name); it != shader_identifier_map.end()) return it->second;
+		void const* shader_id = pso_info->GetShaderIdentifier(ToWideString(name).c_str());
+		ADRIA_ASSERT_MSG(shader_id != nullptr, "Export not found in the state object");
+		shader_identifier_map.emplace(name, shader_id);
+		return shader_id;
 	}
 
-}
+	void GfxRayTracingShaderTable::SetRecord(GfxShaderRecord& record, char const* name, void const* local_data, uint32 data_size)
+	{
+		void const* shader_id = GetShaderIdentifier(name);
+		bool const changed = record.version == 0 || memcmp(record.shader_id, shader_id, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES) != 0
+			|| record.local_root_args.size() != data_size || (data_size > 0 && memcmp(record.local_root_args.data(), local_data, data_size) != 0);
+		if (!changed) return;
 
+		memcpy(record.shader_id, shader_id, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
+		record.local_root_args.assign((uint8 const*)local_data, (uint8 const*)local_data + data_size);
+		record.version = ++version;
+	}
+
+	uint64 GfxRayTracingShaderTable::WriteTable(uint8* table_data, uint64 written_version, bool full_write) const
+	{
+		uint64 written_bytes = 0;
+		auto WriteRecord = [&](GfxShaderRecord const& record, uint8* record_data, uint32 record_size)
+		{
+			if (!full_write && record.version <= written_version) return;
+			memcpy(record_data, record.shader_id, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
+			memcpy(record_data + D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES, record.local_root_args.data(), record.local_root_args.size());
+			written_bytes += record_size;
+		};
+
+		WriteRecord(ray_gen_record, table_data, layout.ray_gen_record_size);
+		uint8* miss_data = table_data + GetSectionSize(layout.ray_gen_record_size, 1);
+		for (uint32 i = 0; i < layout.miss_shader_count; ++i)
+		{
+			WriteRecord(miss_shader_records[i], miss_data + i * layout.miss_shader_record_size, layout.miss_shader_record_size);
+		}
+		uint8* hit_data = miss_data + GetSectionSize(layout.miss_shader_record_size, layout.miss_shader_count);
+		for (uint32 i = 0; i < layout.hit_group_count; ++i)
+		{
+			WriteRecord(hit_group_records[i], hit_data + i * layout.hit_group_record_size, layout.hit_group_record_size);
+		}
+		return written_bytes;
+	}
+
+	void GfxRayTracingShaderTable::FillDispatchDesc(uint64 gpu_address, D3D12_DISPATCH_RAYS_DESC& desc) const
+	{
+		uint32 const ray_gen_section = GetSectionSize(layout.ray_gen_record_size, 1);
+		uint32 const miss_section = GetSectionSize(layout.miss_shader_record_size, layout.miss_shader_count);
+
+		desc.RayGenerationShaderRecord.StartAddress = gpu_address;
+		desc.RayGenerationShaderRecord.SizeInBytes = layout.ray_gen_record_size;
+		desc.MissShaderTable.StartAddress = gpu_address + ray_gen_section;
+		desc.MissShaderTable.SizeInBytes = layout.miss_shader_record_size * layout.miss_shader_count;
+		desc.MissShaderTable.StrideInBytes = layout.miss_shader_record_size;
+		desc.HitGroupTable.StartAddress = gpu_address + ray_gen_section + miss_section;
+		desc.HitGroupTable.SizeInBytes = layout.hit_group_record_size * layout.hit_group_count;
+		desc.HitGroupTable.StrideInBytes = layout.hit_group_record_size;
+	}
+
+	uint64 GfxRayTracingShaderTable::GetTableSize() const
+	{
+		uint32 const table_size = GetSectionSize(layout.ray_gen_record_size, 1)
+			+ GetSectionSize(layout.miss_shader_record_size, layout.miss_shader_count)
+			+ GetSectionSize(layout.hit_group_record_size, layout.hit_group_count);
+		return Align(table_size, 256);
+	}
+}
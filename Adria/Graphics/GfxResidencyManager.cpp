@@ -0,0 +1,183 @@
+#include <algorithm>
+#include "GfxResidencyManager.h"
+#include "GfxDevice.h"
+#include "Core/ConsoleManager.h"
+#include "Logging/Logger.h"
+
+namespace adria
+{
+	static TAutoConsoleVariable<bool> Residency("rhi.Residency", true, "0: resources are kept resident. 1: resources are evicted and trimmed to stay within the VRAM budget");
+	static TAutoConsoleVariable<int>  ResidencyBudgetOverride("rhi.ResidencyBudgetOverride", 0, "Overrides the VRAM budget (in MB) used by the residency manager, 0 uses the budget reported by the device");
+
+	namespace
+	{
+		//runs the policy against a simulated budget: a scene of textures whose working set sweeps through the registered resources,
+		//then shrinks so that trimmed resources can be restored. Fails if the policy breaks one of its guarantees.
+		void SimulateResidency()
+		{
+			constexpr uint64 MB = 1024 * 1024;
+			constexpr uint64 Budget = 256 * MB;
+			constexpr uint64 UnmanagedUsage = 64 * MB;
+			constexpr uint32 ResourceCount = 64;
+			constexpr uint32 WorkingSetSize = 16;
+			constexpr uint32 SmallWorkingSetSize = 4;
+			constexpr uint64 SweepFrameCount = 2000;
+			constexpr uint64 FrameCount = SweepFrameCount + 500;
+			constexpr GfxResidencyPolicyDesc Desc{};
+
+			GfxResidencyPolicy policy(Desc);
+			std::vector<uint32> ids(ResourceCount);
+			std::vector<uint64> sizes(ResourceCount), trimmed_sizes(ResourceCount), last_used(ResourceCount, 0);
+			//the state each resource is in if the decisions were carried out, checked against the policy's own bookkeeping
+			std::vector<GfxResidencyState> states(ResourceCount, GfxResidencyState::Resident);
+			for (uint32 i = 0; i < ResourceCount; ++i)
+			{
+				sizes[i] = (1 + i % 4) * 4 * MB;
+				trimmed_sizes[i] = sizes[i] / 2;
+				GfxResidencyPriority priority = i % 8 == 0 ? GfxResidencyPriority::High : GfxResidencyPriority::Normal;
+				ids[i] = policy.AddEntry(sizes[i], trimmed_sizes[i], priority, 0);
+			}
+
+			uint64 evictions = 0, trims = 0, restores = 0, on_demand_restores = 0, frames_over_budget = 0, peak_usage = 0, usage = 0;
+			uint64 frames_over_budget_in_a_row = 0, max_frames_over_budget_in_a_row = 0;
+			uint64 active_evictions = 0, invalid_decisions = 0, state_mismatches = 0;
+			for (uint64 frame = 0; frame < FrameCount; ++frame)
+			{
+				uint32 const first_used = static_cast<uint32>((frame / 50) % ResourceCount);
+				uint32 const working_set_size = frame < SweepFrameCount ? WorkingSetSize : SmallWorkingSetSize;
+				for (uint32 i = 0; i < working_set_size; ++i)
+				{
+					uint32 const index = (first_used + i) % ResourceCount;
+					bool const restore = policy.MarkUsed(ids[index], frame);
+					on_demand_restores += restore;
+					invalid_decisions += restore != (states[index] == GfxResidencyState::Evicted);
+					if (restore) states[index] = GfxResidencyState::Resident;
+					last_used[index] = frame;
+				}
+
+				usage = UnmanagedUsage;
+				for (uint32 i = 0; i < ResourceCount; ++i)
+				{
+					if (states[i] == GfxResidencyState::Resident) usage += sizes[i];
+					else if (states[i] == GfxResidencyState::Trimmed) usage += trimmed_sizes[i];
+				}
+				peak_usage = std::max(peak_usage, usage);
+				frames_over_budget += usage > Budget;
+				//every resource counts as used when it is added, nothing can be evicted before the minimum idle time
+				bool const evictable = frame >= Desc.min_idle_frames;
+				frames_over_budget_in_a_row = usage > Budget && evictable ? frames_over_budget_in_a_row + 1 : 0;
+				max_frames_over_budget_in_a_row = std::max(max_frames_over_budget_in_a_row, frames_over_budget_in_a_row);
+
+				for (GfxResidencyDecision const& decision : policy.Evaluate(frame, usage, Budget))
+				{
+					uint32 const index = static_cast<uint32>(std::find(ids.begin(), ids.end(), decision.id) - ids.begin());
+					GfxResidencyState& state = states[index];
+					switch (decision.action)
+					{
+					case GfxResidencyAction::Evict:
+						++evictions;
+						active_evictions += frame - last_used[index] < Desc.min_idle_frames;
+						invalid_decisions += state == GfxResidencyState::Evicted;
+						state = GfxResidencyState::Evicted;
+						break;
+					case GfxResidencyAction::Trim:
+						++trims;
+						invalid_decisions += state != GfxResidencyState::Resident;
+						state = GfxResidencyState::Trimmed;
+						break;
+					case GfxResidencyAction::Restore:
+						++restores;
+						invalid_decisions += state != GfxResidencyState::Trimmed;
+						state = GfxResidencyState::Resident;
+						break;
+					}
+				}
+				for (uint32 i = 0; i < ResourceCount; ++i) state_mismatches += policy.GetEntry(ids[i]).state != states[i];
+			}
+
+			GfxResidencyStats stats = policy.GetStats();
+			ADRIA_LOG(INFO, "Residency simulation (%llu MB budget, %llu frames): %llu evictions, %llu trims, %llu restores, %llu on demand restores",
+				Budget / MB, FrameCount, evictions, trims, restores, on_demand_restores);
+			ADRIA_LOG(INFO, "Residency simulation: peak usage %llu MB, %llu frames over budget, final state %u resident / %u trimmed / %u evicted",
+				peak_usage / MB, frames_over_budget, stats.resident_count, stats.trimmed_count, stats.evicted_count);
+
+			//the working set fits the budget, so once idle resources can be evicted the policy has to get below it within one evaluation and its settle time
+			uint32 failures = 0;
+			auto Check = [&failures](bool condition, char const* message)
+				{
+					if (condition) return;
+					ADRIA_LOG(ERROR, "Residency simulation failed: %s", message);
+					++failures;
+				};
+			Check(max_frames_over_budget_in_a_row <= Desc.settle_frames, "usage stayed over the budget for longer than the settle time");
+			Check(active_evictions == 0, "resources used within the minimum idle time were evicted");
+			Check(invalid_decisions == 0, "decisions don't match the state of the resources they act on");
+			Check(state_mismatches == 0, "the policy state doesn't match the decisions it returned");
+			uint64 const low_watermark = static_cast<uint64>(Budget * Desc.low_watermark);
+			bool restorable_trimmed = false;
+			for (uint32 i = 0; i < ResourceCount; ++i)
+			{
+				restorable_trimmed |= states[i] == GfxResidencyState::Trimmed && usage + sizes[i] - trimmed_sizes[i] <= low_watermark;
+			}
+			Check(!restorable_trimmed, "trimmed resources were not restored once the working set shrank");
+			if (failures == 0) ADRIA_LOG(INFO, "Residency simulation passed");
+		}
+		AutoConsoleCommand residency_simulation("rhi.ResidencySimulate", "Runs the residency policy against a simulated VRAM budget, logs its decisions and checks them",
+			ConsoleCommandDelegate::CreateStatic(SimulateResidency));
+	}
+
+	GfxResidencyManager::GfxResidencyManager(GfxDevice* gfx) : gfx(gfx), policy(GfxResidencyPolicyDesc{ .settle_frames = GFX_BACKBUFFER_COUNT + 1 })
+	{
+	}
+
+	GfxResidencyManager::~GfxResidencyManager() = default;
+
+	GfxResidencyHandle GfxResidencyManager::Register(uint64 size, uint64 trimmed_size, GfxResidencyPriority priority, GfxResidencyCallback callback)
+	{
+		GfxResidencyHandle handle = policy.AddEntry(size, trimmed_size, priority, gfx->GetFrameIndex());
+		if (handle >= callbacks.size()) callbacks.resize(handle + 1);
+		callbacks[handle] = std::move(callback);
+		return handle;
+	}
+
+	void GfxResidencyManager::Unregister(GfxResidencyHandle handle)
+	{
+		policy.RemoveEntry(handle);
+		callbacks[handle].Unbind();
+	}
+
+	void GfxResidencyManager::UpdateSize(GfxResidencyHandle handle, uint64 size, uint64 trimmed_size)
+	{
+		policy.SetSize(handle, size, trimmed_size);
+	}
+
+	void GfxResidencyManager::MarkUsed(GfxResidencyHandle handle)
+	{
+		if (policy.MarkUsed(handle, gfx->GetFrameIndex())) callbacks[handle].Execute(GfxResidencyAction::Restore);
+	}
+
+	GfxResidencyState GfxResidencyManager::GetState(GfxResidencyHandle handle) const
+	{
+		return policy.GetEntry(handle).state;
+	}
+
+	void GfxResidencyManager::Update()
+	{
+		if (!Residency.Get()) return;
+
+		GPUMemoryUsage vram = gfx->GetMemoryUsage();
+		std::span<GfxResidencyDecision const> decisions = policy.Evaluate(gfx->GetFrameIndex(), vram.usage, GetBudget());
+		//callbacks create and destroy resources and may register new ones, so don't iterate the policy's storage
+		pending_decisions.assign(decisions.begin(), decisions.end());
+		for (GfxResidencyDecision const& decision : pending_decisions)
+		{
+			callbacks[decision.id].Execute(decision.action);
+		}
+	}
+
+	uint64 GfxResidencyManager::GetBudget() const
+	{
+		if (ResidencyBudgetOverride.Get() > 0) return static_cast<uint64>(ResidencyBudgetOverride.Get()) * 1024 * 1024;
+		return gfx->GetMemoryUsage().budget;
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "GfxResidencyPolicy.h"
+#include "Utilities/Delegate.h"
+
+namespace adria
+{
+	class GfxDevice;
+
+	using GfxResidencyHandle = uint32;
+	inline constexpr GfxResidencyHandle INVALID_RESIDENCY_HANDLE = GfxResidencyHandle(-1);
+
+	DECLARE_DELEGATE(GfxResidencyCallback, GfxResidencyAction)
+
+	//Keeps registered resources within the VRAM budget. Owners register a resource with its size and priority, mark it
+	//as used every frame it is needed and carry out the evictions, trims and restores the policy asks for through the
+	//callback. Evicted resources are restored on demand the next time they are marked as used.
+	class GfxResidencyManager
+	{
+	public:
+		explicit GfxResidencyManager(GfxDevice* gfx);
+		ADRIA_NONCOPYABLE_NONMOVABLE(GfxResidencyManager)
+		~GfxResidencyManager();
+
+		GfxResidencyHandle Register(uint64 size, uint64 trimmed_size, GfxResidencyPriority priority, GfxResidencyCallback callback);
+		void Unregister(GfxResidencyHandle handle);
+		void UpdateSize(GfxResidencyHandle handle, uint64 size, uint64 trimmed_size);
+		void MarkUsed(GfxResidencyHandle handle);
+		GfxResidencyState GetState(GfxResidencyHandle handle) const;
+
+		void Update();
+
+		GfxResidencyStats GetStats() const { return policy.GetStats(); }
+		uint64 GetBudget() const;
+
+	private:
+		GfxDevice* gfx;
+		GfxResidencyPolicy policy;
+		std::vector<GfxResidencyCallback> callbacks;
+		std::vector<GfxResidencyDecision> pending_decisions;
+	};
+}
@@ -0,0 +1,163 @@
+#include <algorithm>
+#include "GfxResidencyPolicy.h"
+
+namespace adria
+{
+	uint32 GfxResidencyPolicy::AddEntry(uint64 size, uint64 trimmed_size, GfxResidencyPriority priority, uint64 frame)
+	{
+		uint32 id;
+		if (!free_ids.empty())
+		{
+			id = free_ids.back();
+			free_ids.pop_back();
+		}
+		else
+		{
+			id = static_cast<uint32>(entries.size());
+			entries.emplace_back();
+		}
+
+		GfxResidencyEntry& entry = entries[id];
+		entry.size = size;
+		entry.trimmed_size = std::min(trimmed_size, size);
+		entry.last_used_frame = frame;
+		entry.priority = priority;
+		entry.state = GfxResidencyState::Resident;
+		entry.registered = true;
+		return id;
+	}
+
+	void GfxResidencyPolicy::RemoveEntry(uint32 id)
+	{
+		ADRIA_ASSERT(entries[id].registered);
+		entries[id] = GfxResidencyEntry{};
+		free_ids.push_back(id);
+	}
+
+	void GfxResidencyPolicy::SetSize(uint32 id, uint64 size, uint64 trimmed_size)
+	{
+		entries[id].size = size;
+		entries[id].trimmed_size = std::min(trimmed_size, size);
+	}
+
+	bool GfxResidencyPolicy::MarkUsed(uint32 id, uint64 frame)
+	{
+		GfxResidencyEntry& entry = entries[id];
+		ADRIA_ASSERT(entry.registered);
+		entry.last_used_frame = std::max(entry.last_used_frame, frame);
+		if (entry.state != GfxResidencyState::Evicted) return false;
+		entry.state = GfxResidencyState::Resident;
+		return true;
+	}
+
+	std::span<GfxResidencyDecision const> GfxResidencyPolicy::Evaluate(uint64 frame, uint64 usage, uint64 budget)
+	{
+		decisions.clear();
+		if (budget == 0 || frame < next_evaluation_frame) return decisions;
+
+		uint64 const high_watermark = static_cast<uint64>(budget * desc.high_watermark);
+		uint64 const low_watermark = static_cast<uint64>(budget * desc.low_watermark);
+		if (usage > high_watermark) FreeMemory(frame, usage - low_watermark);
+		else if (usage < low_watermark) RestoreTrimmed(low_watermark - usage);
+
+		if (!decisions.empty()) next_evaluation_frame = frame + desc.settle_frames;
+		return decisions;
+	}
+
+	GfxResidencyStats GfxResidencyPolicy::GetStats() const
+	{
+		GfxResidencyStats stats{};
+		for (GfxResidencyEntry const& entry : entries)
+		{
+			if (!entry.registered) continue;
+			switch (entry.state)
+			{
+			case GfxResidencyState::Resident:
+				++stats.resident_count;
+				stats.resident_bytes += entry.size;
+				break;
+			case GfxResidencyState::Trimmed:
+				++stats.trimmed_count;
+				stats.resident_bytes += entry.trimmed_size;
+				break;
+			case GfxResidencyState::Evicted:
+				++stats.evicted_count;
+				break;
+			}
+		}
+		return stats;
+	}
+
+	void GfxResidencyPolicy::FreeMemory(uint64 frame, uint64 bytes_to_free)
+	{
+		uint64 freed_bytes = 0;
+
+		//evict whatever has been idle long enough, least valuable first
+		candidates.clear();
+		for (uint32 id = 0; id < entries.size(); ++id)
+		{
+			GfxResidencyEntry const& entry = entries[id];
+			if (!entry.registered || entry.state == GfxResidencyState::Evicted) continue;
+			if (frame - std::min(frame, entry.last_used_frame) >= desc.min_idle_frames) candidates.push_back(id);
+		}
+		SortCandidates(false);
+		for (uint32 id : candidates)
+		{
+			if (freed_bytes >= bytes_to_free) break;
+			GfxResidencyEntry& entry = entries[id];
+			freed_bytes += entry.state == GfxResidencyState::Trimmed ? entry.trimmed_size : entry.size;
+			entry.state = GfxResidencyState::Evicted;
+			decisions.push_back(GfxResidencyDecision{ id, GfxResidencyAction::Evict });
+		}
+
+		//still over budget, drop the top mips of resources that are in use
+		candidates.clear();
+		for (uint32 id = 0; id < entries.size(); ++id)
+		{
+			GfxResidencyEntry const& entry = entries[id];
+			if (entry.registered && entry.state == GfxResidencyState::Resident && entry.trimmed_size < entry.size) candidates.push_back(id);
+		}
+		SortCandidates(false);
+		for (uint32 id : candidates)
+		{
+			if (freed_bytes >= bytes_to_free) break;
+			GfxResidencyEntry& entry = entries[id];
+			freed_bytes += entry.size - entry.trimmed_size;
+			entry.state = GfxResidencyState::Trimmed;
+			decisions.push_back(GfxResidencyDecision{ id, GfxResidencyAction::Trim });
+		}
+	}
+
+	void GfxResidencyPolicy::RestoreTrimmed(uint64 headroom)
+	{
+		//evicted entries are restored on demand in MarkUsed, here only trimmed ones get their full size back
+		candidates.clear();
+		for (uint32 id = 0; id < entries.size(); ++id)
+		{
+			GfxResidencyEntry const& entry = entries[id];
+			if (entry.registered && entry.state == GfxResidencyState::Trimmed) candidates.push_back(id);
+		}
+		SortCandidates(true);
+		for (uint32 id : candidates)
+		{
+			GfxResidencyEntry& entry = entries[id];
+			uint64 const restore_cost = entry.size - entry.trimmed_size;
+			if (restore_cost > headroom) continue;
+			headroom -= restore_cost;
+			entry.state = GfxResidencyState::Resident;
+			decisions.push_back(GfxResidencyDecision{ id, GfxResidencyAction::Restore });
+		}
+	}
+
+	void GfxResidencyPolicy::SortCandidates(bool most_valuable_first)
+	{
+		std::sort(candidates.begin(), candidates.end(), [this, most_valuable_first](uint32 a, uint32 b)
+			{
+				GfxResidencyEntry const& entry_a = entries[a];
+				GfxResidencyEntry const& entry_b = entries[b];
+				bool less_valuable = entry_a.priority != entry_b.priority ? entry_a.priority < entry_b.priority : entry_a.last_used_frame < entry_b.last_used_frame;
+				bool more_valuable = entry_a.priority != entry_b.priority ? entry_a.priority > entry_b.priority : entry_a.last_used_frame > entry_b.last_used_frame;
+				return most_valuable_first ? more_valuable : less_valuable;
+			});
+	}
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <vector>
+#include <span>
+
+namespace adria
+{
+	enum class GfxResidencyPriority : uint8
+	{
+		Low,
+		Normal,
+		High
+	};
+
+	enum class GfxResidencyState : uint8
+	{
+		Resident,
+		Trimmed,
+		Evicted
+	};
+
+	enum class GfxResidencyAction : uint8
+	{
+		Evict,
+		Trim,
+		Restore
+	};
+
+	struct GfxResidencyDecision
+	{
+		uint32 id;
+		GfxResidencyAction action;
+	};
+
+	struct GfxResidencyPolicyDesc
+	{
+		float  high_watermark = 0.95f;	//fraction of the budget above which memory is freed
+		float  low_watermark = 0.85f;	//fraction of the budget memory is freed down to and below which trimmed entries are restored
+		uint64 min_idle_frames = 120;	//entries used more recently than this are trimmed but never evicted
+		uint64 settle_frames = 4;		//frames to wait after acting so freed memory shows up in the reported usage
+	};
+
+	struct GfxResidencyEntry
+	{
+		uint64 size = 0;
+		uint64 trimmed_size = 0;	//size once trimmed, equal to size for entries that can't be trimmed
+		uint64 last_used_frame = 0;
+		GfxResidencyPriority priority = GfxResidencyPriority::Normal;
+		GfxResidencyState state = GfxResidencyState::Resident;
+		bool registered = false;
+	};
+
+	struct GfxResidencyStats
+	{
+		uint32 resident_count = 0;
+		uint32 trimmed_count = 0;
+		uint32 evicted_count = 0;
+		uint64 resident_bytes = 0;
+	};
+
+	//Decides what to evict, trim or restore given the memory usage and budget. It only does bookkeeping and never touches
+	//the graphics API: Evaluate updates the entry states as if every returned decision was carried out, which lets it
+	//be driven by the device budget as well as by a simulated one.
+	class GfxResidencyPolicy
+	{
+	public:
+		explicit GfxResidencyPolicy(GfxResidencyPolicyDesc const& desc = {}) : desc(desc) {}
+
+		uint32 AddEntry(uint64 size, uint64 trimmed_size, GfxResidencyPriority priority, uint64 frame);
+		void RemoveEntry(uint32 id);
+		void SetSize(uint32 id, uint64 size, uint64 trimmed_size);
+		//returns true if the entry was evicted and has to be restored before it is used
+		bool MarkUsed(uint32 id, uint64 frame);
+
+		std::span<GfxResidencyDecision const> Evaluate(uint64 frame, uint64 usage, uint64 budget);
+
+		GfxResidencyEntry const& GetEntry(uint32 id) const { return entries[id]; }
+		GfxResidencyStats GetStats() const;
+
+	private:
+		GfxResidencyPolicyDesc desc;
+		std::vector<GfxResidencyEntry> entries;
+		std::vector<uint32> free_ids;
+		std::vector<uint32> candidates;
+		std::vector<GfxResidencyDecision> decisions;
+		uint64 next_evaluation_frame = 0;
+
+	private:
+		void FreeMemory(uint64 frame, uint64 bytes_to_free);
+		void RestoreTrimmed(uint64 headroom);
+		void SortCandidates(bool most_valuable_first);
+	};
+}
@@ -1,3 +1,5 @@
+#include <deque>
+#include <shared_mutex>
 #include "GfxShaderKey.h"
 #include "GfxShader.h"
 #include "Rendering/ShaderManager.h"
@@ -5,41 +7,90 @@
 
 namespace adria
 {
-	struct GfxShaderKey::Impl
+	namespace
 	{
-		ShaderID id = ShaderID_Invalid;
-		std::vector<GfxShaderDefine> defines;
-	};
+		constexpr uint32 MaxDefineSets = 1u << 24;
 
-	GfxShaderKey::GfxShaderKey()
-	{
-		impl = std::make_unique<Impl>();
-	}
+		struct GfxShaderDefineSet
+		{
+			std::vector<GfxShaderDefine> defines;
+			std::string signature;
+			uint64 hash = 0;
+		};
 
-	GfxShaderKey::GfxShaderKey(ShaderID shader_id) : GfxShaderKey()
-	{
-		impl->id = shader_id;
-	}
+		class GfxShaderDefineSetTable
+		{
+		public:
+			GfxShaderDefineSetTable()
+			{
+				GfxShaderDefineSet& empty_set = define_sets.emplace_back();
+				empty_set.hash = crc64("", 0);
+				signature_map.emplace("", 0);
+			}
+
+			uint32 AddDefine(uint32 set_index, char const* name, char const* value)
+			{
+				std::string signature;
+				{
+					std::shared_lock lock(mutex);
+					signature = define_sets[set_index].signature;
+					signature += name;
+					signature += '=';
+					signature += value;
+					signature += ';';
+					if (auto it = signature_map.find(signature); it != signature_map.end()) return it->second;
+				}
+
+				std::unique_lock lock(mutex);
+				if (auto it = signature_map.find(signature); it != signature_map.end()) return it->second;
+
+				uint32 new_set_index = static_cast<uint32>(define_sets.size());
+				ADRIA_ASSERT(new_set_index < MaxDefineSets);
+				GfxShaderDefineSet new_set{};
+				new_set.defines = define_sets[set_index].defines;
+				new_set.defines.emplace_back(name, value);
+				new_set.hash = crc64(signature.c_str(), signature.size());
+				new_set.signature = signature;
+				define_sets.push_back(std::move(new_set));
+				signature_map.emplace(std::move(signature), new_set_index);
+				return new_set_index;
+			}
+
+			GfxShaderDefineSet const& GetDefineSet(uint32 set_index) const
+			{
+				std::shared_lock lock(mutex);
+				return define_sets[set_index];
+			}
+
+		private:
+			mutable std::shared_mutex mutex;
+			std::deque<GfxShaderDefineSet> define_sets;
+			std::unordered_map<std::string, uint32> signature_map;
+		};
+
+		GfxShaderDefineSetTable& GetDefineSetTable()
+		{
+			static GfxShaderDefineSetTable define_set_table;
+			return define_set_table;
+		}
 
-	GfxShaderKey::GfxShaderKey(GfxShaderKey const& k) 
-	{
-		impl = std::make_unique<Impl>();
-		impl->id = k.impl->id;
-		impl->defines = k.impl->defines;
+		uint64 PackShaderKey(ShaderID shader_id, uint32 set_index, uint64 set_hash)
+		{
+			uint64 content_hash = set_hash;
+			HashCombine(content_hash, static_cast<uint8>(shader_id));
+			return static_cast<uint64>(shader_id) | (static_cast<uint64>(set_index) << 8) | (content_hash << 32);
+		}
 	}
 
-	GfxShaderKey::~GfxShaderKey() = default;
-
-	void GfxShaderKey::Init(ShaderID shader_id)
+	GfxShaderKey::GfxShaderKey(ShaderID shader_id)
 	{
-		impl->id = shader_id;
+		Init(shader_id);
 	}
 
-	GfxShaderKey& GfxShaderKey::operator=(GfxShaderKey const& k)
+	void GfxShaderKey::Init(ShaderID shader_id)
 	{
-		impl->id = k.impl->id;
-		impl->defines = k.impl->defines;
-		return *this;
+		uint32 set_index = GetDefineSetIndex();
+		key = PackShaderKey(shader_id, set_index, GetDefineSetTable().GetDefineSet(set_index).hash);
 	}
 
 	void GfxShaderKey::operator=(ShaderID shader_id)
@@ -49,45 +100,18 @@ namespace adria
 
 	void GfxShaderKey::AddDefine(char const* name, char const* value)
 	{
-		impl->defines.emplace_back(name, value);
+		GfxShaderDefineSetTable& define_set_table = GetDefineSetTable();
+		uint32 set_index = define_set_table.AddDefine(GetDefineSetIndex(), name, value);
+		key = PackShaderKey(GetShaderID(), set_index, define_set_table.GetDefineSet(set_index).hash);
 	}
 
 	bool GfxShaderKey::IsValid() const
 	{
-		return impl->id != ShaderID_Invalid;
-	}
-
-	GfxShaderKey::operator ShaderID() const
-	{
-		return impl->id;
+		return GetShaderID() != ShaderID_Invalid;
 	}
 
 	std::vector<GfxShaderDefine> const& GfxShaderKey::GetDefines() const
 	{
-		return impl->defines;
-	}
-
-	ShaderID GfxShaderKey::GetShaderID() const
-	{
-		return impl->id;
+		return GetDefineSetTable().GetDefineSet(GetDefineSetIndex()).defines;
 	}
-
-	uint64 GfxShaderKey::GetHash() const
-	{
-		std::string define_key;
-		for (GfxShaderDefine const& define : impl->defines)
-		{
-			define_key += define.name;
-			define_key += define.value;
-		}
-		define_key += std::to_string(impl->id);
-		uint64 define_hash = crc64(define_key.c_str(), define_key.size());
-		return define_hash;
-	}
-
-	bool GfxShaderKey::operator==(GfxShaderKey const& key) const
-	{
-		return GetHash() == key.GetHash();
-	}
-
 }
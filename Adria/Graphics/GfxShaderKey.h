@@ -5,18 +5,18 @@ namespace adria
 	enum ShaderID : uint8;
 	struct GfxShaderDefine;
 
+	//Shader keys are interned: the define list of a key lives in a global table and the key itself is a single 64-bit value
+	//packing the shader id (bits 0-7), the interned define set index (bits 8-31) and a 32-bit content hash (bits 32-63).
+	//Copying a key is a plain copy and comparing/hashing two keys never touches the define strings.
 	class GfxShaderKey
 	{
-		struct Impl;
 		friend class ShaderManager;
 		friend struct GfxShaderKeyHash;
 	public:
-		GfxShaderKey();
+		GfxShaderKey() = default;
 		GfxShaderKey(ShaderID shader_id);
-		~GfxShaderKey();
-
-		GfxShaderKey(GfxShaderKey const&);
-		GfxShaderKey& operator=(GfxShaderKey const&);
+		ADRIA_DEFAULT_COPYABLE_MOVABLE(GfxShaderKey)
+		~GfxShaderKey() = default;
 
 		void Init(ShaderID shader_id);
 		void operator=(ShaderID shader_id);
@@ -25,16 +25,32 @@ namespace adria
 		bool IsValid() const;
 
 		std::vector<GfxShaderDefine> const& GetDefines() const;
-		ShaderID GetShaderID() const;
+		ShaderID GetShaderID() const
+		{
+			return static_cast<ShaderID>(key & 0xff);
+		}
 
-		operator ShaderID() const;
-		bool operator==(GfxShaderKey const& key) const;
+		operator ShaderID() const
+		{
+			return GetShaderID();
+		}
+		bool operator==(GfxShaderKey const& k) const
+		{
+			return key == k.key;
+		}
 
 	private:
-		std::unique_ptr<Impl> impl;
+		uint64 key = 0;
 
 	private:
-		uint64 GetHash() const;
+		uint32 GetDefineSetIndex() const
+		{
+			return static_cast<uint32>((key >> 8) & 0xffffff);
+		}
+		uint64 GetHash() const
+		{
+			return key;
+		}
 	};
 
 	struct GfxShaderKeyHash
@@ -1,5 +1,6 @@
 #include "GfxStateObject.h"
 #include "GfxDevice.h"
+#include "GfxRayTracingShaderTable.h"
 
 namespace adria
 {
@@ -28,4 +29,12 @@ namespace adria
 		return new GfxStateObject(state_obj);
 	}
 
+	GfxStateObject::~GfxStateObject() = default;
+
+	GfxRayTracingShaderTable& GfxStateObject::GetShaderTable(GfxDevice* gfx)
+	{
+		if (!shader_table) shader_table = std::make_unique<GfxRayTracingShaderTable>(gfx, this);
+		return *shader_table;
+	}
+
 }
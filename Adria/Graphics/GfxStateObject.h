@@ -5,6 +5,7 @@
 namespace adria
 {
 	class GfxDevice;
+	class GfxRayTracingShaderTable;
 
 	enum class GfxStateObjectType
 	{
@@ -20,16 +21,20 @@ namespace adria
 		friend class GfxRayTracingShaderTable;
 
 	public:
+		~GfxStateObject();
 		bool IsValid() const { return d3d12_so != nullptr; }
 
 	private:
 		Ref<ID3D12StateObject> d3d12_so;
+		std::unique_ptr<GfxRayTracingShaderTable> shader_table;
 
 	private:
 		explicit GfxStateObject(ID3D12StateObject* so)
 		{
 			d3d12_so.Attach(so);
 		}
+
+		GfxRayTracingShaderTable& GetShaderTable(GfxDevice* gfx);
 	};
 
 	class GfxStateObjectBuilder
@@ -2,7 +2,7 @@
 #include "GfxDevice.h"
 #include "GfxBuffer.h"
 #include "GfxCommandList.h"
-#include "GfxLinearDynamicAllocator.h"
+#include "GfxUploadManager.h"
 #include "d3dx12.h"
 
 namespace adria
@@ -187,29 +187,16 @@ namespace adria
 			const_cast<GfxTextureDesc&>(desc).mip_levels = (uint32_t)log2(std::max<uint32>(desc.width, desc.height)) + 1;
 		}
 
-		auto dynamic_allocator = gfx->GetDynamicAllocator();
-		auto cmd_list = gfx->GetCommandList();
 		if (data.sub_data != nullptr)
 		{
-			uint32 subresource_count = data.sub_count;
-			if (subresource_count == uint32(-1)) subresource_count = desc.array_size * std::max<uint32>(1u, desc.mip_levels);
-			uint64 required_size;
-			device->GetCopyableFootprints(&resource_desc, 0, (uint32)subresource_count, 0, nullptr, nullptr, nullptr, &required_size);
-			GfxDynamicAllocation dyn_alloc = dynamic_allocator->Allocate(required_size, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
-			
-			std::vector<D3D12_SUBRESOURCE_DATA> subresource_data(subresource_count);
-			for (uint32 i = 0; i < subresource_count; ++i)
-			{
-				GfxTextureSubData init_data = data.sub_data[i];
-				subresource_data[i].pData = init_data.data;
-				subresource_data[i].RowPitch = init_data.row_pitch;
-				subresource_data[i].SlicePitch = init_data.slice_pitch;
-			}
-			UpdateSubresources(cmd_list->GetNative(), resource.Get(), dyn_alloc.buffer->GetNative(), dyn_alloc.offset, 0, subresource_count, subresource_data.data());
+			GfxUploadManager* upload_manager = gfx->GetUploadManager();
+			upload_manager->UploadTexture(*this, data);
 
-			if (desc.initial_state != GfxResourceState::CopyDst)
+			GfxResourceState uploaded_state = upload_manager->GetUploadedState();
+			if (desc.initial_state != uploaded_state)
 			{
-				cmd_list->TextureBarrier(*this, GfxResourceState::CopyDst, desc.initial_state);
+				auto cmd_list = gfx->GetCommandList();
+				cmd_list->TextureBarrier(*this, uploaded_state, desc.initial_state);
 				cmd_list->FlushBarriers();
 			}
 		}
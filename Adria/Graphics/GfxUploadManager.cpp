@@ -0,0 +1,213 @@
+#include "GfxUploadManager.h"
+#include "GfxDevice.h"
+#include "GfxBuffer.h"
+#include "GfxTexture.h"
+#include "GfxCommandList.h"
+#include "GfxCommandQueue.h"
+#include "GfxFence.h"
+#include "Utilities/AllocatorUtil.h"
+#include "d3dx12.h"
+
+namespace adria
+{
+	GfxUploadManager::GfxUploadManager(GfxDevice* gfx, GfxFence& upload_fence) : gfx(gfx), upload_fence(upload_fence)
+	{
+		GfxBufferDesc staging_desc{};
+		staging_desc.size = staging_size;
+		staging_desc.resource_usage = GfxResourceUsage::Upload;
+		staging_buffer = gfx->CreateBuffer(staging_desc);
+		ADRIA_ASSERT(staging_buffer->IsMapped());
+		staging_cpu_address = staging_buffer->GetMappedData<uint8>();
+	}
+
+	GfxUploadManager::~GfxUploadManager()
+	{
+		GfxUploadTicket ticket = Submit();
+		Wait(ticket);
+		RetireCompletedBatches(false);
+	}
+
+	GfxUploadTicket GfxUploadManager::UploadBuffer(GfxBuffer& dst, uint64 dst_offset, void const* data, uint64 size)
+	{
+		uint8 const* src = static_cast<uint8 const*>(data);
+		GfxUploadTicket ticket{ last_submitted_fence_value };
+		for (uint64 uploaded = 0; uploaded < size;)
+		{
+			uint64 const chunk_size = std::min(size - uploaded, MaxChunkSize);
+			uint64 const staging_offset = AllocateStaging(chunk_size, 16);
+			memcpy(staging_cpu_address + staging_offset, src + uploaded, chunk_size);
+
+			GfxCommandList* cmd_list = GetBatchCommandList();
+			cmd_list->CopyBuffer(dst, dst_offset + uploaded, *staging_buffer, staging_offset, chunk_size);
+			ticket = GetCurrentTicket();
+			uploaded += chunk_size;
+
+			if (current_batch_staging_bytes >= MaxBatchSize) Submit();
+		}
+		return ticket;
+	}
+
+	GfxUploadTicket GfxUploadManager::UploadTexture(GfxTexture& dst, GfxTextureData const& data)
+	{
+		D3D12_RESOURCE_DESC resource_desc = dst.GetNative()->GetDesc();
+		uint32 subresource_count = data.sub_count;
+		if (subresource_count == uint32(-1))
+		{
+			uint32 array_size = resource_desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D ? 1u : resource_desc.DepthOrArraySize;
+			subresource_count = array_size * resource_desc.MipLevels;
+		}
+		std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> footprints(subresource_count);
+		std::vector<uint32> row_counts(subresource_count);
+		std::vector<uint64> row_sizes(subresource_count);
+		gfx->GetDevice()->GetCopyableFootprints(&resource_desc, 0, subresource_count, 0, footprints.data(), row_counts.data(), row_sizes.data(), nullptr);
+
+		GfxUploadTicket ticket{ last_submitted_fence_value };
+		for (uint32 i = 0; i < subresource_count; ++i)
+		{
+			D3D12_SUBRESOURCE_FOOTPRINT const& footprint = footprints[i].Footprint;
+			uint64 const slice_size = (uint64)footprint.RowPitch * row_counts[i];
+			uint64 const subresource_size = slice_size * footprint.Depth;
+
+			GfxBuffer* src_buffer = staging_buffer.get();
+			uint8* dst_memory = nullptr;
+			uint64 src_offset = 0;
+			if (subresource_size <= MaxChunkSize)
+			{
+				src_offset = AllocateStaging(subresource_size, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+				dst_memory = staging_cpu_address + src_offset;
+			}
+			else
+			{
+				//a single subresource can't be split into chunks, stage it in its own buffer which lives until the batch completes
+				GfxBufferDesc dedicated_desc{};
+				dedicated_desc.size = subresource_size;
+				dedicated_desc.resource_usage = GfxResourceUsage::Upload;
+				src_buffer = current_dedicated_staging_buffers.emplace_back(gfx->CreateBuffer(dedicated_desc)).get();
+				dst_memory = src_buffer->GetMappedData<uint8>();
+			}
+
+			GfxTextureSubData const& sub_data = data.sub_data[i];
+			uint8 const* src_memory = static_cast<uint8 const*>(sub_data.data);
+			for (uint32 z = 0; z < footprint.Depth; ++z)
+			{
+				for (uint32 row = 0; row < row_counts[i]; ++row)
+				{
+					memcpy(dst_memory + z * slice_size + row * footprint.RowPitch, src_memory + z * sub_data.slice_pitch + row * sub_data.row_pitch, row_sizes[i]);
+				}
+			}
+
+			D3D12_PLACED_SUBRESOURCE_FOOTPRINT placed_footprint = footprints[i];
+			placed_footprint.Offset = src_offset;
+			CD3DX12_TEXTURE_COPY_LOCATION dst_location(dst.GetNative(), i);
+			CD3DX12_TEXTURE_COPY_LOCATION src_location(src_buffer->GetNative(), placed_footprint);
+			GfxCommandList* cmd_list = GetBatchCommandList();
+			cmd_list->GetNative()->CopyTextureRegion(&dst_location, 0, 0, 0, &src_location, nullptr);
+			ticket = GetCurrentTicket();
+
+			if (current_batch_staging_bytes >= MaxBatchSize) Submit();
+		}
+		return ticket;
+	}
+
+	GfxUploadTicket GfxUploadManager::Submit()
+	{
+		if (!current_cmd_list) return GfxUploadTicket{ last_submitted_fence_value };
+
+		current_cmd_list->End();
+		current_cmd_list->Signal(upload_fence, next_fence_value);
+		current_cmd_list->Submit();
+
+		InFlightBatch& batch = in_flight_batches.emplace_back();
+		batch.fence_value = next_fence_value;
+		batch.staging_bytes = current_batch_staging_bytes;
+		batch.cmd_list = current_cmd_list;
+		batch.dedicated_staging_buffers = std::move(current_dedicated_staging_buffers);
+
+		last_submitted_fence_value = next_fence_value++;
+		current_cmd_list = nullptr;
+		current_batch_staging_bytes = 0;
+		current_dedicated_staging_buffers.clear();
+
+		RetireCompletedBatches(false);
+		return GfxUploadTicket{ last_submitted_fence_value };
+	}
+
+	void GfxUploadManager::WaitOnQueue(GfxCommandQueue& queue)
+	{
+		Submit();
+		if (last_submitted_fence_value > 0) queue.Wait(upload_fence, last_submitted_fence_value);
+	}
+
+	bool GfxUploadManager::IsCompleted(GfxUploadTicket ticket) const
+	{
+		return upload_fence.IsCompleted(ticket.fence_value);
+	}
+
+	void GfxUploadManager::Wait(GfxUploadTicket ticket)
+	{
+		if (ticket.fence_value > last_submitted_fence_value) Submit();
+		upload_fence.Wait(ticket.fence_value);
+	}
+
+	GfxResourceState GfxUploadManager::GetUploadedState() const
+	{
+		//with legacy barriers every resource used on the copy queue decays to the common state
+		return gfx->GetCapabilities().SupportsEnhancedBarriers() ? GfxResourceState::CopyDst : GfxResourceState::Common;
+	}
+
+	GfxCommandList* GfxUploadManager::GetBatchCommandList()
+	{
+		if (!current_cmd_list)
+		{
+			if (!free_cmd_lists.empty())
+			{
+				current_cmd_list = free_cmd_lists.back();
+				free_cmd_lists.pop_back();
+			}
+			else
+			{
+				current_cmd_list = cmd_lists.emplace_back(std::make_unique<GfxCommandList>(gfx, GfxCommandListType::Copy, "Upload Command List")).get();
+			}
+			current_cmd_list->Begin();
+		}
+		return current_cmd_list;
+	}
+
+	uint64 GfxUploadManager::AllocateStaging(uint64 size, uint64 alignment)
+	{
+		ADRIA_ASSERT(size <= staging_size);
+		while (true)
+		{
+			if (staging_used == 0) staging_head = 0;
+			uint64 offset = Align(staging_head, alignment);
+			if (offset + size > staging_size) offset = 0;
+			uint64 const padding = offset >= staging_head ? offset - staging_head : staging_size - staging_head;
+			if (staging_used + padding + size <= staging_size)
+			{
+				staging_used += padding + size;
+				current_batch_staging_bytes += padding + size;
+				staging_head = offset + size;
+				return offset;
+			}
+
+			//the ring is full, submit what was recorded so far and wait for the oldest batch to free its staging memory
+			Submit();
+			ADRIA_ASSERT(!in_flight_batches.empty());
+			RetireCompletedBatches(true);
+		}
+	}
+
+	void GfxUploadManager::RetireCompletedBatches(bool wait_for_oldest)
+	{
+		if (wait_for_oldest && !in_flight_batches.empty()) upload_fence.Wait(in_flight_batches.front().fence_value);
+		while (!in_flight_batches.empty() && upload_fence.IsCompleted(in_flight_batches.front().fence_value))
+		{
+			InFlightBatch& batch = in_flight_batches.front();
+			staging_used -= batch.staging_bytes;
+			batch.cmd_list->ResetAllocator();
+			free_cmd_lists.push_back(batch.cmd_list);
+			in_flight_batches.pop_front();
+		}
+		if (staging_used == 0) staging_head = 0;
+	}
+}
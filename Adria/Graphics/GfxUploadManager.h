@@ -0,0 +1,78 @@
+#pragma once
+#include <deque>
+#include "GfxResourceCommon.h"
+
+namespace adria
+{
+	class GfxDevice;
+	class GfxBuffer;
+	class GfxTexture;
+	class GfxCommandList;
+	class GfxCommandQueue;
+	class GfxFence;
+	struct GfxTextureData;
+
+	struct GfxUploadTicket
+	{
+		uint64 fence_value = 0;
+	};
+
+	//Records uploads on the copy queue. Data is staged through a fixed size ring buffer, uploads larger than
+	//MaxChunkSize are split into chunks and small uploads are batched into a single submission. A ticket is
+	//returned for every upload and can be used to poll or wait for its completion on the upload fence.
+	class GfxUploadManager
+	{
+		static constexpr uint64 DefaultStagingSize = 64 * 1024 * 1024;
+		static constexpr uint64 MaxChunkSize = DefaultStagingSize / 4;
+		static constexpr uint64 MaxBatchSize = DefaultStagingSize / 2;
+
+		struct InFlightBatch
+		{
+			uint64 fence_value;
+			uint64 staging_bytes;
+			GfxCommandList* cmd_list;
+			std::vector<std::unique_ptr<GfxBuffer>> dedicated_staging_buffers;
+		};
+
+	public:
+		GfxUploadManager(GfxDevice* gfx, GfxFence& upload_fence);
+		ADRIA_NONCOPYABLE_NONMOVABLE(GfxUploadManager)
+		~GfxUploadManager();
+
+		GfxUploadTicket UploadBuffer(GfxBuffer& dst, uint64 dst_offset, void const* data, uint64 size);
+		GfxUploadTicket UploadTexture(GfxTexture& dst, GfxTextureData const& data);
+
+		GfxUploadTicket Submit();
+		void WaitOnQueue(GfxCommandQueue& queue);
+		bool IsCompleted(GfxUploadTicket ticket) const;
+		void Wait(GfxUploadTicket ticket);
+
+		//state of the uploaded resources once the copy queue is done with them
+		GfxResourceState GetUploadedState() const;
+
+	private:
+		GfxDevice* gfx;
+		GfxFence& upload_fence;
+		uint64 next_fence_value = 1;
+		uint64 last_submitted_fence_value = 0;
+
+		std::unique_ptr<GfxBuffer> staging_buffer;
+		uint8* staging_cpu_address = nullptr;
+		uint64 staging_size = DefaultStagingSize;
+		uint64 staging_head = 0;
+		uint64 staging_used = 0;
+
+		std::vector<std::unique_ptr<GfxCommandList>> cmd_lists;
+		std::vector<GfxCommandList*> free_cmd_lists;
+		GfxCommandList* current_cmd_list = nullptr;
+		uint64 current_batch_staging_bytes = 0;
+		std::vector<std::unique_ptr<GfxBuffer>> current_dedicated_staging_buffers;
+		std::deque<InFlightBatch> in_flight_batches;
+
+	private:
+		GfxCommandList* GetBatchCommandList();
+		uint64 AllocateStaging(uint64 size, uint64 alignment);
+		void RetireCompletedBatches(bool wait_for_oldest);
+		GfxUploadTicket GetCurrentTicket() const { return GfxUploadTicket{ next_fence_value }; }
+	};
+}
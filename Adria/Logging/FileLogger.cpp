@@ -19,5 +19,9 @@ namespace adria
 		log_stream << GetLogTime() + LineInfoToString(file, line) + LevelToString(level) + std::string(entry) << "\n";
 	}
 
-}
+	void FileLogger::Flush()
+	{
+		log_stream.flush();
+	}
 
+}
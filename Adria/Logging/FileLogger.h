@@ -10,6 +10,7 @@ namespace adria
 		FileLogger(char const* log_file, LogLevel logger_level = LogLevel::LOG_DEBUG);
 		virtual ~FileLogger() override;
 		virtual void Log(LogLevel level, char const* entry, char const* file, uint32 line) override;
+		virtual void Flush() override;
 	private:
 		std::ofstream log_stream;
 		LogLevel const logger_level;
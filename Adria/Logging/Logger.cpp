@@ -3,59 +3,227 @@
 #include <ctime>   
 #include <vector>
 #include <thread>
-#include "Utilities/ConcurrentQueue.h"
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include "Core/ConsoleManager.h"
+#include "Utilities/Timer.h"
 
 namespace adria
 {
-	struct QueueEntry
+	namespace
 	{
-		LogLevel level;
-		std::string str;
-		std::string filename;
-		uint32 line;
-	};
+		//benchmark entries go through the queue and get formatted, but are not passed to the loggers
+		constexpr char BenchmarkFile[] = "LogBenchmark";
+	}
 
+	//Bounded multi producer, single consumer ring of log records (Vyukov's bounded queue). Producers claim a slot with a CAS
+	//and publish it through the slot sequence, the logger thread sleeps until records arrive and flushes the loggers once per batch.
+	//When the ring is full debug and info entries are dropped and counted, warnings and errors wait for a free slot.
 	class LogManagerImpl
 	{
+		static constexpr uint64 LOG_QUEUE_CAPACITY = 4096;
+		static constexpr uint64 MAX_MESSAGE_SIZE = 1024;
+
+		struct LogSlot
+		{
+			std::atomic<uint64> sequence;
+			LogRecord record;
+		};
+
 	public:
 
-		LogManagerImpl() : log_thread(&LogManagerImpl::ProcessLogs, this) {}
+		LogManagerImpl() : slots(new LogSlot[LOG_QUEUE_CAPACITY])
+		{
+			for (uint64 i = 0; i < LOG_QUEUE_CAPACITY; ++i) slots[i].sequence.store(i, std::memory_order_relaxed);
+			log_thread = std::thread(&LogManagerImpl::ProcessLogs, this);
+		}
 		~LogManagerImpl()
 		{
-			exit.store(true);
+			{
+				std::lock_guard lock(wake_mutex);
+				exit.store(true);
+			}
+			wake_cv.notify_one();
 			log_thread.join();
 		}
 
 		void RegisterLogger(ILogger* logger)
 		{
+			std::lock_guard lock(loggers_mutex);
 			loggers.emplace_back(logger);
 		}
-		void Log(LogLevel level, char const* str, char const* filename, uint32 line)
+
+		LogRecord* AcquireRecord(LogLevel level, uint64& position)
+		{
+			position = enqueue_position.load(std::memory_order_relaxed);
+			while (true)
+			{
+				LogSlot& slot = slots[position & (LOG_QUEUE_CAPACITY - 1)];
+				int64 const diff = (int64)slot.sequence.load(std::memory_order_acquire) - (int64)position;
+				if (diff == 0)
+				{
+					if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) return &slot.record;
+				}
+				else if (diff < 0)
+				{
+					if (level < LogLevel::LOG_WARNING)
+					{
+						dropped_records.fetch_add(1, std::memory_order_relaxed);
+						return nullptr;
+					}
+					WakeLogThread();
+					std::this_thread::yield();
+					position = enqueue_position.load(std::memory_order_relaxed);
+				}
+				else position = enqueue_position.load(std::memory_order_relaxed);
+			}
+		}
+
+		void PublishRecord(uint64 position)
 		{
-			log_queue.Push(QueueEntry{ level, str, filename, line });
+			slots[position & (LOG_QUEUE_CAPACITY - 1)].sequence.store(position + 1, std::memory_order_release);
+			//pairs with the fence in ProcessLogs, either the logger thread sees the record or this thread sees it waiting
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (log_thread_waiting.load(std::memory_order_relaxed)) WakeLogThread();
 		}
 
+		uint64 GetDroppedCount() const { return dropped_records.load(std::memory_order_relaxed); }
+
+	private:
+		std::unique_ptr<LogSlot[]> slots;
+		alignas(64) std::atomic<uint64> enqueue_position = 0;
+		alignas(64) uint64 dequeue_position = 0;
+		std::atomic<uint64> dropped_records = 0;
+		uint64 reported_dropped_records = 0;
+
+		std::mutex loggers_mutex;
 		std::vector<std::unique_ptr<ILogger>> loggers;
-		ConcurrentQueue<QueueEntry> log_queue;
+
 		std::thread log_thread;
 		std::atomic_bool exit = false;
+		std::atomic_bool log_thread_waiting = false;
+		std::mutex wake_mutex;
+		std::condition_variable wake_cv;
 
 	private:
+		void WakeLogThread()
+		{
+			std::lock_guard lock(wake_mutex);
+			wake_cv.notify_one();
+		}
+
+		bool HasRecords() const
+		{
+			return slots[dequeue_position & (LOG_QUEUE_CAPACITY - 1)].sequence.load(std::memory_order_acquire) == dequeue_position + 1;
+		}
+
+		void Dispatch(LogLevel level, char const* entry, char const* file, uint32 line)
+		{
+			for (auto&& logger : loggers) if (logger) logger->Log(level, entry, file, line);
+		}
+
+		void ProcessRecord(LogRecord const& record)
+		{
+			char message[MAX_MESSAGE_SIZE];
+			int const length = record.format(message, MAX_MESSAGE_SIZE, record.fmt, record.args);
+			if (record.file != BenchmarkFile)
+			{
+				if (length >= (int)MAX_MESSAGE_SIZE)
+				{
+					std::string long_message(length + 1, '\0');
+					record.format(long_message.data(), long_message.size(), record.fmt, record.args);
+					Dispatch(record.level, long_message.c_str(), record.file, record.line);
+				}
+				else Dispatch(record.level, length >= 0 ? message : record.fmt, record.file, record.line);
+			}
+			if (record.release) record.release(record.args);
+		}
+
 		void ProcessLogs()
 		{
-			QueueEntry entry{};
 			while (true)
 			{
-				bool success = log_queue.TryPop(entry);
-				if (success)
 				{
-					for (auto&& logger : loggers) if (logger) logger->Log(entry.level, entry.str.c_str(), entry.filename.c_str(), entry.line);
+					std::lock_guard lock(loggers_mutex);
+					uint64 processed_count = 0;
+					while (HasRecords())
+					{
+						LogSlot& slot = slots[dequeue_position & (LOG_QUEUE_CAPACITY - 1)];
+						ProcessRecord(slot.record);
+						slot.sequence.store(dequeue_position + LOG_QUEUE_CAPACITY, std::memory_order_release);
+						++dequeue_position;
+						++processed_count;
+					}
+
+					uint64 const dropped_count = dropped_records.load(std::memory_order_relaxed);
+					if (dropped_count != reported_dropped_records)
+					{
+						std::string const message = std::to_string(dropped_count - reported_dropped_records) + " log entries were dropped, the log queue was full";
+						Dispatch(LogLevel::LOG_WARNING, message.c_str(), __FILE__, __LINE__);
+						reported_dropped_records = dropped_count;
+						++processed_count;
+					}
+					if (processed_count > 0) for (auto&& logger : loggers) if (logger) logger->Flush();
 				}
-				if (exit.load() && log_queue.Empty()) break;
+
+				std::unique_lock lock(wake_mutex);
+				log_thread_waiting.store(true, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				wake_cv.wait(lock, [this]() { return exit.load() || HasRecords(); });
+				log_thread_waiting.store(false, std::memory_order_relaxed);
+				if (exit.load() && !HasRecords()) break;
 			}
 		}
 	};
 
+	namespace
+	{
+		void LogBenchmark()
+		{
+			static constexpr uint32 ProducerCount = 16;
+			static constexpr uint32 EntriesPerProducer = 4096;
+
+			uint64 const dropped_before = g_Log.GetDroppedCount();
+			std::vector<std::vector<uint64>> latencies(ProducerCount);
+			std::vector<std::thread> producers;
+			producers.reserve(ProducerCount);
+			Timer<std::chrono::microseconds> total_timer;
+			for (uint32 producer = 0; producer < ProducerCount; ++producer)
+			{
+				producers.emplace_back([producer, &latencies]()
+					{
+						std::vector<uint64>& producer_latencies = latencies[producer];
+						producer_latencies.reserve(EntriesPerProducer);
+						Timer<std::chrono::nanoseconds> timer;
+						for (uint32 i = 0; i < EntriesPerProducer; ++i)
+						{
+							timer.Mark();
+							g_Log.LogFormat(LogLevel::LOG_DEBUG, BenchmarkFile, __LINE__, "Producer %u entry %u value %f name %s", producer, i, i * 0.5f, "benchmark");
+							producer_latencies.push_back(timer.Mark());
+						}
+					});
+			}
+			for (std::thread& producer : producers) producer.join();
+			float const total_ms = total_timer.ElapsedInSeconds() * 1000.0f;
+
+			std::vector<uint64> all_latencies;
+			all_latencies.reserve(ProducerCount * EntriesPerProducer);
+			for (std::vector<uint64> const& producer_latencies : latencies) all_latencies.insert(all_latencies.end(), producer_latencies.begin(), producer_latencies.end());
+			std::sort(all_latencies.begin(), all_latencies.end());
+			uint64 latency_sum = 0;
+			for (uint64 latency : all_latencies) latency_sum += latency;
+			auto Percentile = [&all_latencies](float p) { return all_latencies[std::min((uint64)(p * all_latencies.size()), all_latencies.size() - 1)]; };
+
+			ADRIA_LOG(INFO, "Logger benchmark: %u producers x %u entries in %.3f ms, call site latency mean %llu ns, p50 %llu ns, p99 %llu ns, max %llu ns, %llu dropped",
+				ProducerCount, EntriesPerProducer, total_ms, latency_sum / all_latencies.size(), Percentile(0.5f), Percentile(0.99f), all_latencies.back(),
+				g_Log.GetDroppedCount() - dropped_before);
+		}
+		AutoConsoleCommand log_benchmark("log.Benchmark", "Logs from 16 threads at once and reports the call site latency, the entries are not written to the loggers",
+			ConsoleCommandDelegate::CreateStatic(LogBenchmark));
+	}
+
 	std::string LevelToString(LogLevel type)
 	{
 		switch (type)
@@ -94,10 +262,24 @@ namespace adria
 
 	void LogManager::Log(LogLevel level, char const* str, char const* filename, uint32 line)
 	{
-		pimpl->Log(level, str, filename, line);
+		LogFormat(level, filename, line, "%s", str);
 	}
 	void LogManager::Log(LogLevel level, char const* str, std::source_location location /*= std::source_location::current()*/)
 	{
 		Log(level, str, location.file_name(), location.line());
 	}
-}
\ No newline at end of file
+
+	LogRecord* LogManager::AcquireRecord(LogLevel level, uint64& position)
+	{
+		return pimpl->AcquireRecord(level, position);
+	}
+	uint64 LogManager::GetDroppedCount() const
+	{
+		return pimpl->GetDroppedCount();
+	}
+
+	void LogManager::PublishRecord(uint64 position)
+	{
+		pimpl->PublishRecord(position);
+	}
+}
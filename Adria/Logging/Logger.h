@@ -1,6 +1,9 @@
 #pragma once
-#include <memory> 
+#include <memory>
 #include <string>
+#include <utility>
+#include <cstring>
+#include <cstdio>
 #include <source_location>
 
 namespace adria
@@ -23,8 +26,125 @@ namespace adria
 	public:
 		virtual ~ILogger() = default;
 		virtual void Log(LogLevel level, char const* entry, char const* file, uint32 line) = 0;
+		//called after every batch of entries the logger thread dispatched
+		virtual void Flush() {}
 	};
 
+	//Fixed size entry of the log queue. The call site only copies the format arguments into the record,
+	//formatting happens on the logger thread. Strings that do not fit into the record are copied to the heap.
+	struct LogRecord
+	{
+		static constexpr uint64 ARGS_SIZE = 216;
+		using FormatFn = int(*)(char* dst, uint64 dst_size, char const* fmt, std::byte const* args);
+		using ReleaseFn = void(*)(std::byte const* args);
+
+		char const* fmt;
+		FormatFn format;
+		ReleaseFn release;
+		char const* file;
+		uint32 line;
+		LogLevel level;
+		alignas(8) std::byte args[ARGS_SIZE];
+	};
+
+	namespace impl
+	{
+		//every argument gets an 8 byte slot at the start of the record, copied strings follow the slots
+		inline constexpr uint32 LOG_ARGUMENT_SLOT_SIZE = 8;
+
+		template<typename T>
+		struct LogArgument
+		{
+			using Type = std::decay_t<T>;
+			static constexpr bool IsString = std::is_same_v<Type, char*> || std::is_same_v<Type, char const*>;
+			static constexpr bool IsWideString = std::is_same_v<Type, wchar_t*> || std::is_same_v<Type, wchar_t const*>;
+			using CharType = std::conditional_t<IsWideString, wchar_t, char>;
+			static_assert(std::is_arithmetic_v<Type> || std::is_enum_v<Type> || std::is_pointer_v<Type> || std::is_null_pointer_v<Type>,
+						  "Log arguments have to be printf compatible, pass std::string as .c_str()");
+			//strings are stored as an offset into the record or as the address of a heap copy, addresses are never below ARGS_SIZE
+			using StoredType = std::conditional_t<IsString || IsWideString, uint64, std::conditional_t<std::is_pointer_v<Type>, void const*, Type>>;
+		};
+
+		template<typename CharT>
+		uint64 StoreLogString(std::byte* args, uint32& offset, CharT const* str, bool& spilled)
+		{
+			static constexpr CharT NullString[] = { '(', 'n', 'u', 'l', 'l', ')', 0 };
+			if (!str) str = NullString;
+
+			uint64 const size = (std::char_traits<CharT>::length(str) + 1) * sizeof(CharT);
+			offset = (offset + alignof(CharT) - 1) & ~(uint32)(alignof(CharT) - 1);
+			if (offset + size <= LogRecord::ARGS_SIZE)
+			{
+				uint32 const str_offset = offset;
+				std::memcpy(args + offset, str, size);
+				offset += (uint32)size;
+				return str_offset;
+			}
+
+			CharT* str_copy = new CharT[size / sizeof(CharT)];
+			std::memcpy(str_copy, str, size);
+			spilled = true;
+			return reinterpret_cast<uint64>(str_copy);
+		}
+
+		template<typename T>
+		void StoreLogArgument(std::byte* args, uint32& offset, uint32 slot, T const& arg, bool& spilled)
+		{
+			using Argument = LogArgument<T>;
+			static_assert(sizeof(typename Argument::StoredType) <= LOG_ARGUMENT_SLOT_SIZE);
+			typename Argument::StoredType stored;
+			if constexpr (Argument::IsString || Argument::IsWideString) stored = StoreLogString<typename Argument::CharType>(args, offset, arg, spilled);
+			else stored = typename Argument::StoredType(arg);
+			std::memcpy(args + slot * LOG_ARGUMENT_SLOT_SIZE, &stored, sizeof(stored));
+		}
+
+		template<typename T>
+		auto LoadLogArgument(std::byte const* args, uint32 slot)
+		{
+			using Argument = LogArgument<T>;
+			typename Argument::StoredType stored;
+			std::memcpy(&stored, args + slot * LOG_ARGUMENT_SLOT_SIZE, sizeof(stored));
+			if constexpr (Argument::IsString || Argument::IsWideString)
+			{
+				using CharT = typename Argument::CharType;
+				return stored < LogRecord::ARGS_SIZE ? reinterpret_cast<CharT const*>(args + stored) : reinterpret_cast<CharT const*>(stored);
+			}
+			else return stored;
+		}
+
+		template<typename T>
+		void ReleaseLogArgument(std::byte const* args, uint32 slot)
+		{
+			using Argument = LogArgument<T>;
+			if constexpr (Argument::IsString || Argument::IsWideString)
+			{
+				uint64 stored;
+				std::memcpy(&stored, args + slot * LOG_ARGUMENT_SLOT_SIZE, sizeof(stored));
+				if (stored >= LogRecord::ARGS_SIZE) delete[] reinterpret_cast<typename Argument::CharType*>(stored);
+			}
+		}
+
+		template<typename... Args, uint32... Slots>
+		int FormatLogArguments(char* dst, uint64 dst_size, char const* fmt, std::byte const* args, std::integer_sequence<uint32, Slots...>)
+		{
+			return snprintf(dst, dst_size, fmt, LoadLogArgument<Args>(args, Slots)...);
+		}
+
+		template<typename... Args>
+		int FormatLogRecord(char* dst, uint64 dst_size, char const* fmt, std::byte const* args)
+		{
+			if constexpr (sizeof...(Args) == 0) return snprintf(dst, dst_size, "%s", fmt);
+			else return FormatLogArguments<Args...>(dst, dst_size, fmt, args, std::make_integer_sequence<uint32, sizeof...(Args)>{});
+		}
+
+		template<typename... Args>
+		void ReleaseLogRecord(std::byte const* args)
+		{
+			uint32 slot = 0;
+			(ReleaseLogArgument<Args>(args, slot++), ...);
+		}
+	}
+
 	class LogManager
 	{
 	public:
@@ -36,17 +156,45 @@ namespace adria
 		void Log(LogLevel level, char const* str, char const* file, uint32 line);
 		void Log(LogLevel level, char const* str, std::source_location location = std::source_location::current());
 
+		//fmt is not copied and has to outlive the logger thread, a string literal. Without arguments fmt is logged as is.
+		template<typename... Args>
+		void LogFormat(LogLevel level, char const* file, uint32 line, char const* fmt, Args const&... args)
+		{
+			uint64 position;
+			LogRecord* record = AcquireRecord(level, position);
+			if (!record) return;
+
+			record->fmt = fmt;
+			record->format = &impl::FormatLogRecord<Args...>;
+			record->file = file;
+			record->line = line;
+			record->level = level;
+			record->release = nullptr;
+			if constexpr (sizeof...(Args) > 0)
+			{
+				static_assert(sizeof...(Args) * impl::LOG_ARGUMENT_SLOT_SIZE <= LogRecord::ARGS_SIZE, "Too many log arguments");
+				uint32 offset = sizeof...(Args) * impl::LOG_ARGUMENT_SLOT_SIZE;
+				uint32 slot = 0;
+				bool spilled = false;
+				(impl::StoreLogArgument(record->args, offset, slot++, args, spilled), ...);
+				if (spilled) record->release = &impl::ReleaseLogRecord<Args...>;
+			}
+			PublishRecord(position);
+		}
+
+		//debug and info entries that were dropped because the queue was full
+		uint64 GetDroppedCount() const;
+
 	private:
 		std::unique_ptr<class LogManagerImpl> pimpl;
+
+	private:
+		//returns nullptr if the queue is full and the entry was dropped
+		LogRecord* AcquireRecord(LogLevel level, uint64& position);
+		void PublishRecord(uint64 position);
 	};
 	inline LogManager g_Log{};
 
-	#define ADRIA_LOG(level, ... ) [&]()  \
-	{ \
-		uint64 const size = snprintf(nullptr, 0, __VA_ARGS__) + 1; \
-		std::unique_ptr<char[]> buf = std::make_unique<char[]>(size); \
-		snprintf(buf.get(), size, __VA_ARGS__); \
-		g_Log.Log(LogLevel::LOG_##level, buf.get(), __FILE__, __LINE__);  \
-	}()
+	#define ADRIA_LOG(level, ... ) g_Log.LogFormat(LogLevel::LOG_##level, __FILE__, __LINE__, __VA_ARGS__)
 
-}
\ No newline at end of file
+}
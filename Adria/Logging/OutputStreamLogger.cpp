@@ -15,5 +15,9 @@ namespace adria
 		(use_cerr ? std::cerr : std::cout) << GetLogTime() + LineInfoToString(file, line) + LevelToString(level) + std::string(entry) << "\n";
 	}
 
-}
+	void OutputStreamLogger::Flush()
+	{
+		(use_cerr ? std::cerr : std::cout).flush();
+	}
 
+}
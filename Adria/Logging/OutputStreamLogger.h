@@ -9,6 +9,7 @@ namespace adria
 		OutputStreamLogger(bool use_cerr = false, LogLevel logger_level = LogLevel::LOG_DEBUG);
 		virtual ~OutputStreamLogger() override;
 		virtual void Log(LogLevel level, char const* entry, char const* file, uint32 line) override;
+		virtual void Flush() override;
 	private:
 		bool const use_cerr;
 		LogLevel const logger_level;
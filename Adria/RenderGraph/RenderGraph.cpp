@@ -6,10 +6,12 @@
 #include "Graphics/GfxCommandList.h"
 #include "Graphics/GfxRenderPass.h"
 #include "Graphics/GfxProfiler.h"
+#include "Graphics/GfxPipelineStatistics.h"
 #include "Graphics/GfxTracyProfiler.h"
 #include "Utilities/StringUtil.h"
 #include "Utilities/FilesUtil.h"
 #include "Core/Paths.h"
+#include "Core/CpuProfiler.h"
 #include "Logging/Logger.h"
 
 
@@ -119,6 +121,7 @@ namespace adria
 
 	void RenderGraph::Build()
 	{
+		AdriaCpuProfileScope("RenderGraph::Build");
 		BuildAdjacencyLists();
 		TopologicalSort();
 		BuildDependencyLevels();
@@ -130,6 +133,7 @@ namespace adria
 
 	void RenderGraph::Execute()
 	{
+		AdriaCpuProfileScope("RenderGraph::Execute");
 #if RG_MULTITHREADED
 		Execute_Multithreaded();
 #else
@@ -1079,6 +1083,7 @@ namespace adria
 				PIXScopedEvent(cmd_list->GetNative(), PIX_COLOR_DEFAULT, pass->name.c_str());
 				AdriaGfxProfileScope(cmd_list, pass->name.c_str());
 				TracyGfxProfileScope(cmd_list->GetNative(), pass->name.c_str());
+				AdriaGfxPipelineStatisticsScope(cmd_list, pass->name.c_str(), true);
 				cmd_list->SetContext(GfxCommandList::Context::Graphics);
 				cmd_list->BeginRenderPass(render_pass_desc);
 				pass->Execute(rg_resources,cmd_list);
@@ -1089,6 +1094,7 @@ namespace adria
 				PIXScopedEvent(cmd_list->GetNative(), PIX_COLOR_DEFAULT, pass->name.c_str());
 				AdriaGfxProfileScope(cmd_list, pass->name.c_str());
 				TracyGfxProfileScope(cmd_list->GetNative(), pass->name.c_str());
+				AdriaGfxPipelineStatisticsScope(cmd_list, pass->name.c_str(), false);
 				cmd_list->SetContext(GfxCommandList::Context::Compute);
 				pass->Execute(rg_resources, cmd_list);
 			}
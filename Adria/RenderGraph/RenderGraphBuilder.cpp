@@ -256,7 +256,8 @@ namespace adria
 		ADRIA_ASSERT(rg_pass.type != RGPassType::Copy && "Invalid Call in Copy Pass");
 		RGBufferReadWriteId read_write_id = rg.WriteBuffer(name, desc);
 		RGBufferId res_id = read_write_id.GetResourceId();
-		rg_pass.buffer_state_map[res_id] = GfxResourceState::ComputeUAV;
+		//graphics passes can write from any of their shader stages
+		rg_pass.buffer_state_map[res_id] = rg_pass.type == RGPassType::Graphics ? GfxResourceState::AllUAV : GfxResourceState::ComputeUAV;
 		if (!rg_pass.buffer_creates.contains(res_id))
 		{
 			DummyReadBuffer(name);
@@ -275,8 +276,9 @@ namespace adria
 		RGBufferId counter_id = rg.GetBufferId(counter_name);
 		
 		RGBufferId res_id = read_write_id.GetResourceId();
-		rg_pass.buffer_state_map[res_id] = GfxResourceState::ComputeUAV;
-		rg_pass.buffer_state_map[counter_id] = GfxResourceState::ComputeUAV;
+		GfxResourceState const uav_state = rg_pass.type == RGPassType::Graphics ? GfxResourceState::AllUAV : GfxResourceState::ComputeUAV;
+		rg_pass.buffer_state_map[res_id] = uav_state;
+		rg_pass.buffer_state_map[counter_id] = uav_state;
 		DummyWriteBuffer(counter_name);
 		if (!rg_pass.buffer_creates.contains(res_id))
 		{
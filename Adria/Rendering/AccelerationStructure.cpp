@@ -1,22 +1,131 @@
+#include <bit>
 #include "AccelerationStructure.h"
 #include "Components.h"
 #include "Graphics/GfxBuffer.h"
 #include "Graphics/GfxDevice.h"
 #include "Graphics/GfxCommandList.h"
+#include "Graphics/GfxLinearDynamicAllocator.h"
+#include "Core/ConsoleManager.h"
+#include "Core/CpuProfiler.h"
+#include "Logging/Logger.h"
+#include "Utilities/JobSystem.h"
+#include "Utilities/Timer.h"
 
 namespace adria
 {
+	static TAutoConsoleVariable<int> RefitsBeforeRebuild("r.RayTracing.RefitsBeforeRebuild", 16, "Number of in place updates of the TLAS before it is rebuilt to restore its trace quality");
+
+	//BLAS builds are batched until their scratch memory would exceed this size, then the scratch buffer is reused for the next batch
+	static constexpr uint64 MAX_SCRATCH_BATCH_SIZE = 64 * 1024 * 1024;
+
+	namespace
+	{
+		constexpr uint32 DIRTY_MASK_BATCH_SIZE = 256;
+		constexpr uint32 PACK_BATCH_SIZE = 4096;
+
+		void CollectDirtyInstances(std::span<std::atomic<uint64>> dirty_masks, std::vector<std::vector<uint32>>& dirty_batches, std::vector<uint32>& dirty_instances, bool parallel)
+		{
+			uint32 const mask_count = (uint32)dirty_masks.size();
+			dirty_batches.resize((mask_count + DIRTY_MASK_BATCH_SIZE - 1) / DIRTY_MASK_BATCH_SIZE);
+			auto CollectBatch = [&](uint32 begin, uint32 end)
+			{
+				std::vector<uint32>& dirty_batch = dirty_batches[begin / DIRTY_MASK_BATCH_SIZE];
+				dirty_batch.clear();
+				for (uint32 i = begin; i < end; ++i)
+				{
+					if (dirty_masks[i].load(std::memory_order_relaxed) == 0) continue;
+					for (uint64 mask = dirty_masks[i].exchange(0, std::memory_order_relaxed); mask != 0; mask &= mask - 1)
+					{
+						dirty_batch.push_back(i * 64 + std::countr_zero(mask));
+					}
+				}
+			};
+			if (parallel) g_JobSystem.ParallelFor(mask_count, DIRTY_MASK_BATCH_SIZE, CollectBatch);
+			else for (uint32 begin = 0; begin < mask_count; begin += DIRTY_MASK_BATCH_SIZE) CollectBatch(begin, std::min(begin + DIRTY_MASK_BATCH_SIZE, mask_count));
+
+			//batches cover increasing mask ranges, so the merged list stays sorted
+			dirty_instances.clear();
+			for (std::vector<uint32> const& dirty_batch : dirty_batches) dirty_instances.insert(dirty_instances.end(), dirty_batch.begin(), dirty_batch.end());
+		}
+
+		//packs instance_indices[i] to dst[i], or all instances when instance_indices is empty
+		void PackInstances(std::span<GfxRayTracingInstance const> instances, std::span<uint32 const> instance_indices, uint8* dst, bool parallel)
+		{
+			uint32 const pack_count = instance_indices.empty() ? (uint32)instances.size() : (uint32)instance_indices.size();
+			auto PackBatch = [&](uint32 begin, uint32 end)
+			{
+				for (uint32 i = begin; i < end; ++i)
+				{
+					uint32 const instance_index = instance_indices.empty() ? i : instance_indices[i];
+					PackRayTracingInstance(instances[instance_index], dst + i * GFX_RAYTRACING_INSTANCE_SIZE);
+				}
+			};
+			if (parallel) g_JobSystem.ParallelFor(pack_count, PACK_BATCH_SIZE, PackBatch);
+			else PackBatch(0, pack_count);
+		}
+
+		//streams transforms of scattered instances of a synthetic scene and times the CPU side of an incremental TLAS update
+		void InstanceStreamingBenchmark()
+		{
+			constexpr uint32 InstanceCount = 200000;
+			constexpr uint32 IterationCount = 50;
+			constexpr float DirtyFractions[] = { 0.01f, 0.1f, 0.5f };
+
+			std::vector<GfxRayTracingInstance> instances(InstanceCount);
+			uint32 const mask_count = (InstanceCount + 63) / 64;
+			std::unique_ptr<std::atomic<uint64>[]> dirty_masks = std::make_unique<std::atomic<uint64>[]>(mask_count);
+			std::vector<std::vector<uint32>> dirty_batches;
+			std::vector<uint32> dirty_instances;
+			std::vector<uint8> packed_instances(InstanceCount * GFX_RAYTRACING_INSTANCE_SIZE);
+
+			for (float dirty_fraction : DirtyFractions)
+			{
+				uint32 const dirty_count = static_cast<uint32>(InstanceCount * dirty_fraction);
+				for (bool parallel : { false, true })
+				{
+					float streaming_ms = 0.0f, collect_ms = 0.0f, pack_ms = 0.0f;
+					for (uint32 iteration = 0; iteration < IterationCount; ++iteration)
+					{
+						Timer<std::chrono::microseconds> timer;
+						auto StreamBatch = [&](uint32 begin, uint32 end)
+						{
+							for (uint32 i = begin; i < end; ++i)
+							{
+								uint32 const instance_index = static_cast<uint32>((uint64(i) * 2654435761u + iteration) % InstanceCount);
+								Matrix transform = Matrix::CreateTranslation(float(i), float(iteration), 0.0f);
+								memcpy(instances[instance_index].transform, &transform, sizeof(transform));
+								dirty_masks[instance_index / 64].fetch_or(1ull << (instance_index % 64), std::memory_order_relaxed);
+							}
+						};
+						if (parallel) g_JobSystem.ParallelFor(dirty_count, PACK_BATCH_SIZE, StreamBatch);
+						else StreamBatch(0, dirty_count);
+						streaming_ms += timer.Mark() / 1000.0f;
+
+						CollectDirtyInstances(std::span(dirty_masks.get(), mask_count), dirty_batches, dirty_instances, parallel);
+						collect_ms += timer.Mark() / 1000.0f;
+						PackInstances(instances, dirty_instances, packed_instances.data(), parallel);
+						pack_ms += timer.Mark() / 1000.0f;
+					}
+					ADRIA_LOG(INFO, "Instance streaming (%u instances, %u dirty, %s): transform writes %.3f ms, dirty collection %.3f ms, packing %.3f ms",
+						InstanceCount, (uint32)dirty_instances.size(), parallel ? "parallel" : "serial",
+						streaming_ms / IterationCount, collect_ms / IterationCount, pack_ms / IterationCount);
+				}
+			}
+		}
+		AutoConsoleCommand instance_streaming_benchmark("r.RayTracing.InstanceStreamingBenchmark", "Times the CPU side of incremental TLAS updates for a synthetic scene and logs the results",
+			ConsoleCommandDelegate::CreateStatic(InstanceStreamingBenchmark));
+	}
 
 	AccelerationStructure::AccelerationStructure(GfxDevice* gfx) : gfx(gfx)
 	{
 		build_fence.Create(gfx, "Build Fence");
-		++build_fence_value;
 	}
 
-	void AccelerationStructure::AddInstance(Mesh const& mesh)
+	AccelerationStructure::~AccelerationStructure() = default;
+
+	uint32 AccelerationStructure::AddInstance(Mesh const& mesh)
 	{
-		auto dynamic_allocator = gfx->GetDynamicAllocator();
-		blases.resize(mesh.instances.size());
+		uint32 const first_instance = (uint32)rt_instances.size();
 		uint32 instance_id = 0;
 
 		GfxBuffer* geometry_buffer = g_GeometryBufferCache.GetGeometryBuffer(mesh.geometry_buffer_handle);
@@ -25,18 +134,25 @@ namespace adria
 			SubMeshGPU const& submesh = mesh.submeshes[instance.submesh_index];
 			Material const& material = mesh.materials[submesh.material_index];
 
-			GfxRayTracingGeometry& rt_geometry = rt_geometries.emplace_back();
-			rt_geometry.vertex_buffer = geometry_buffer;
-			rt_geometry.vertex_buffer_offset = submesh.positions_offset;
-			rt_geometry.vertex_format = GfxFormat::R32G32B32_FLOAT;
-			rt_geometry.vertex_stride = GetGfxFormatStride(rt_geometry.vertex_format);
-			rt_geometry.vertex_count = submesh.vertices_count;
+			//instances of the same submesh share one BLAS
+			GeometryKey geometry_key{ geometry_buffer, submesh.positions_offset, submesh.indices_offset };
+			auto [geometry_it, inserted] = rt_geometry_map.try_emplace(geometry_key, (uint32)rt_geometries.size());
+			if (inserted)
+			{
+				GfxRayTracingGeometry& rt_geometry = rt_geometries.emplace_back();
+				rt_geometry.vertex_buffer = geometry_buffer;
+				rt_geometry.vertex_buffer_offset = submesh.positions_offset;
+				rt_geometry.vertex_format = GfxFormat::R32G32B32_FLOAT;
+				rt_geometry.vertex_stride = GetGfxFormatStride(rt_geometry.vertex_format);
+				rt_geometry.vertex_count = submesh.vertices_count;
 
-			rt_geometry.index_buffer = geometry_buffer;
-			rt_geometry.index_buffer_offset = submesh.indices_offset;
-			rt_geometry.index_count = submesh.indices_count;
-			rt_geometry.index_format = GfxFormat::R32_UINT;
-			rt_geometry.opaque = material.alpha_mode == MaterialAlphaMode::Opaque;
+				rt_geometry.index_buffer = geometry_buffer;
+				rt_geometry.index_buffer_offset = submesh.indices_offset;
+				rt_geometry.index_count = submesh.indices_count;
+				rt_geometry.index_format = GfxFormat::R32_UINT;
+				rt_geometry.opaque = material.alpha_mode == MaterialAlphaMode::Opaque;
+			}
+			rt_instance_blas_indices.push_back(geometry_it->second);
 
 			GfxRayTracingInstance& rt_instance = rt_instances.emplace_back();
 			rt_instance.flags = GfxRayTracingInstanceFlag_None;
@@ -45,15 +161,49 @@ namespace adria
 			const auto T = XMMatrixTranspose(instance.world_transform);
 			memcpy(rt_instance.transform, &T, sizeof(T));
 		}
+		return first_instance;
 	}
 
 	void AccelerationStructure::Build()
 	{
-		if (blases.empty()) return;
+		if (rt_geometries.empty()) return;
 		BuildBottomLevels();
-		for(auto& rt_instance : rt_instances) rt_instance.blas = blases[rt_instance.instance_id].get();
-		BuildTopLevel();
+
+		for (uint64 i = 0; i < rt_instances.size(); ++i)
+		{
+			rt_instances[i].blas = blases[rt_instance_blas_indices[i]].get();
+		}
+		tlas = gfx->CreateRayTracingTLAS((uint32)rt_instances.size(), GfxRayTracingASFlag_PreferFastTrace | GfxRayTracingASFlag_AllowUpdate);
+		if (tlas_srv.IsValid()) gfx->FreeDescriptorCPU(tlas_srv, GfxDescriptorHeapType::CBV_SRV_UAV);
 		tlas_srv = gfx->CreateBufferSRV(&tlas->GetBuffer());
+		instance_buffer_readable = false;
+
+		dirty_instance_mask_count = ((uint32)rt_instances.size() + 63) / 64;
+		dirty_instance_masks = std::make_unique<std::atomic<uint64>[]>(dirty_instance_mask_count);
+		UpdateTopLevel(true);
+	}
+
+	void AccelerationStructure::Update()
+	{
+		if (!tlas) return;
+		AdriaCpuProfileScope("AccelerationStructure::Update");
+
+		bool rebuild_tlas = false;
+		if (compaction_pending && build_fence.IsCompleted(build_fence_value))
+		{
+			CompactBottomLevels();
+			rebuild_tlas = true;
+		}
+		CollectDirtyInstances(std::span(dirty_instance_masks.get(), dirty_instance_mask_count), dirty_instance_batches, dirty_instances, true);
+		if (rebuild_tlas || !dirty_instances.empty()) UpdateTopLevel(rebuild_tlas);
+	}
+
+	void AccelerationStructure::SetInstanceTransform(uint32 instance_index, Matrix const& world_transform)
+	{
+		ADRIA_ASSERT(instance_index < rt_instances.size() && dirty_instance_masks);
+		const auto T = XMMatrixTranspose(world_transform);
+		memcpy(rt_instances[instance_index].transform, &T, sizeof(T));
+		dirty_instance_masks[instance_index / 64].fetch_or(1ull << (instance_index % 64), std::memory_order_relaxed);
 	}
 
 	int32 AccelerationStructure::GetTLASIndex() const
@@ -67,34 +217,121 @@ namespace adria
 	{
 		GfxCommandList* cmd_list = gfx->GetCommandList();
 
-		std::span<GfxRayTracingGeometry> geometry_span(rt_geometries);
+		blases.clear();
+		blases.reserve(rt_geometries.size());
+
+		uint64 total_scratch_size = 0, max_scratch_size = 0;
+		for (uint64 i = 0; i < rt_geometries.size(); ++i)
+		{
+			auto& blas = blases.emplace_back(gfx->CreateRayTracingBLAS(std::span(&rt_geometries[i], 1), GfxRayTracingASFlag_PreferFastTrace | GfxRayTracingASFlag_AllowCompaction));
+			uint64 const scratch_size = Align(blas->GetScratchSize(), D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT);
+			total_scratch_size += scratch_size;
+			max_scratch_size = std::max(max_scratch_size, scratch_size);
+		}
+
+		GfxBufferDesc scratch_buffer_desc{};
+		scratch_buffer_desc.bind_flags = GfxBindFlag::UnorderedAccess;
+		scratch_buffer_desc.size = std::min(total_scratch_size, std::max(MAX_SCRATCH_BATCH_SIZE, max_scratch_size));
+		scratch_buffer = gfx->CreateBuffer(scratch_buffer_desc);
+		scratch_buffer->SetName("BLAS Scratch Buffer");
+
+		GfxBufferDesc compacted_sizes_desc{};
+		compacted_sizes_desc.bind_flags = GfxBindFlag::UnorderedAccess;
+		compacted_sizes_desc.size = blases.size() * sizeof(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_COMPACTED_SIZE_DESC);
+		compacted_sizes_buffer = gfx->CreateBuffer(compacted_sizes_desc);
+		compacted_sizes_readback_buffer = gfx->CreateBuffer(ReadBackBufferDesc(compacted_sizes_desc.size));
+
+		uint64 scratch_offset = 0;
 		for (uint64 i = 0; i < blases.size(); ++i)
 		{
-			blases[i] = gfx->CreateRayTracingBLAS(geometry_span.subspan(i, 1), GfxRayTracingASFlag_PreferFastTrace);
+			uint64 const scratch_size = Align(blases[i]->GetScratchSize(), D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT);
+			if (scratch_offset + scratch_size > scratch_buffer->GetSize())
+			{
+				cmd_list->GlobalBarrier(GfxResourceState::ASWrite, GfxResourceState::ASWrite);
+				cmd_list->FlushBarriers();
+				scratch_offset = 0;
+			}
+			uint64 const compacted_size_address = compacted_sizes_buffer->GetGpuAddress() + i * sizeof(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_COMPACTED_SIZE_DESC);
+			blases[i]->Build(cmd_list, scratch_buffer->GetGpuAddress() + scratch_offset, compacted_size_address);
+			scratch_offset += scratch_size;
 		}
-		cmd_list->Signal(build_fence, build_fence_value);
-		cmd_list->End();
-		cmd_list->Submit();
+
+		cmd_list->GlobalBarrier(GfxResourceState::ASWrite, GfxResourceState::ASRead);
+		cmd_list->BufferBarrier(*compacted_sizes_buffer, GfxResourceState::ComputeUAV, GfxResourceState::CopySrc);
+		cmd_list->FlushBarriers();
+		cmd_list->CopyBuffer(*compacted_sizes_readback_buffer, *compacted_sizes_buffer);
+
+		//compaction needs the sizes on the CPU, it is finished in Update once the GPU is done with the build
+		cmd_list->Signal(build_fence, ++build_fence_value);
+		compaction_pending = true;
 	}
 
-	void AccelerationStructure::BuildTopLevel()
+	void AccelerationStructure::CompactBottomLevels()
 	{
 		GfxCommandList* cmd_list = gfx->GetCommandList();
-		cmd_list->Begin();
+		auto const* compacted_sizes = compacted_sizes_readback_buffer->GetMappedData<D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_COMPACTED_SIZE_DESC>();
+
+		uint64 size_before = 0, size_after = 0;
+		for (uint64 i = 0; i < blases.size(); ++i)
+		{
+			size_before += blases[i]->GetSize();
+			blases[i]->Compact(cmd_list, compacted_sizes[i].CompactedSizeInBytes);
+			size_after += blases[i]->GetSize();
+		}
+		cmd_list->GlobalBarrier(GfxResourceState::ASWrite, GfxResourceState::ASRead);
+		cmd_list->FlushBarriers();
 
-		build_fence.Wait(build_fence_value);
-		++build_fence_value;
+		scratch_buffer.reset();
+		compacted_sizes_buffer.reset();
+		compacted_sizes_readback_buffer.reset();
+		compaction_pending = false;
 
-		tlas = gfx->CreateRayTracingTLAS(rt_instances, GfxRayTracingASFlag_PreferFastTrace);
+		ADRIA_LOG(INFO, "BLAS compaction: %llu BLASes for %llu instances, %.2f MB before, %.2f MB after compaction",
+			(uint64)blases.size(), (uint64)rt_instances.size(), size_before / (1024.0 * 1024.0), size_after / (1024.0 * 1024.0));
+	}
 
-		cmd_list->Signal(build_fence, build_fence_value);
-		cmd_list->End();
-		cmd_list->Submit();
+	void AccelerationStructure::UpdateTopLevel(bool rebuild)
+	{
+		GfxCommandList* cmd_list = gfx->GetCommandList();
+		GfxBuffer& instance_buffer = tlas->GetInstanceBuffer();
+		uint32 const instance_count = (uint32)rt_instances.size();
 
-		build_fence.Wait(build_fence_value);
-		++build_fence_value;
+		//scattered updates are uploaded as one copy per run of consecutive instances, large ones as a single copy of all instances
+		bool const upload_all = rebuild || dirty_instances.size() > instance_count / 2;
+		uint32 const upload_count = upload_all ? instance_count : (uint32)dirty_instances.size();
+		if (upload_count > 0)
+		{
+			GfxDynamicAllocation staging = gfx->GetDynamicAllocator()->Allocate(upload_count * GFX_RAYTRACING_INSTANCE_SIZE, 16);
+			PackInstances(rt_instances, upload_all ? std::span<uint32 const>{} : std::span<uint32 const>(dirty_instances), (uint8*)staging.cpu_address, true);
+			//the previous TLAS build read the instance buffer, a new one starts in the common state
+			if (instance_buffer_readable)
+			{
+				cmd_list->BufferBarrier(instance_buffer, GfxResourceState::ComputeSRV, GfxResourceState::CopyDst);
+				cmd_list->FlushBarriers();
+			}
+			if (upload_all)
+			{
+				cmd_list->CopyBuffer(instance_buffer, 0, *staging.buffer, staging.offset, upload_count * GFX_RAYTRACING_INSTANCE_SIZE);
+			}
+			else
+			{
+				for (uint32 run_begin = 0; run_begin < upload_count;)
+				{
+					uint32 run_end = run_begin + 1;
+					while (run_end < upload_count && dirty_instances[run_end] == dirty_instances[run_end - 1] + 1) ++run_end;
+					cmd_list->CopyBuffer(instance_buffer, dirty_instances[run_begin] * GFX_RAYTRACING_INSTANCE_SIZE,
+						*staging.buffer, staging.offset + run_begin * GFX_RAYTRACING_INSTANCE_SIZE, (run_end - run_begin) * GFX_RAYTRACING_INSTANCE_SIZE);
+					run_begin = run_end;
+				}
+			}
+			cmd_list->BufferBarrier(instance_buffer, GfxResourceState::CopyDst, GfxResourceState::ComputeSRV);
+			cmd_list->FlushBarriers();
+			instance_buffer_readable = true;
+		}
 
-		cmd_list->Begin();
+		bool const update = !rebuild && tlas_update_count < (uint32)std::max(RefitsBeforeRebuild.Get(), 0);
+		tlas->Build(cmd_list, update);
+		tlas_update_count = update ? tlas_update_count + 1 : 0;
+		cmd_list->GlobalBarrier(GfxResourceState::ASWrite, GfxResourceState::ASRead | GfxResourceState::ComputeSRV);
 	}
 }
-
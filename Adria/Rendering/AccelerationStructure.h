@@ -1,6 +1,9 @@
 #pragma once
 #include <vector>
 #include <memory>
+#include <map>
+#include <tuple>
+#include <atomic>
 #include <d3d12.h>
 #include <DirectXMath.h>
 #include "Graphics/GfxFence.h"
@@ -15,28 +18,50 @@ namespace adria
 
 	class AccelerationStructure
 	{
+		using GeometryKey = std::tuple<GfxBuffer const*, uint32, uint32>;
 
 	public:
 		explicit AccelerationStructure(GfxDevice* gfx);
+		~AccelerationStructure();
 
-		void AddInstance(Mesh const& mesh);
+		//returns the index of the first instance of the mesh
+		uint32 AddInstance(Mesh const& mesh);
 		void Build();
+		void Update();
+
+		//can be called from multiple threads for different instances, but not concurrently with Update
+		void SetInstanceTransform(uint32 instance_index, Matrix const& world_transform);
 
 		int32 GetTLASIndex() const;
 
 	private:
 		GfxDevice* gfx;
 		std::vector<GfxRayTracingGeometry> rt_geometries;
+		std::map<GeometryKey, uint32> rt_geometry_map;
 		std::vector<std::unique_ptr<GfxRayTracingBLAS>> blases;
 
 		std::vector<GfxRayTracingInstance> rt_instances;
+		std::vector<uint32> rt_instance_blas_indices;
 		std::unique_ptr<GfxRayTracingTLAS> tlas;
 		GfxDescriptor tlas_srv;
+		uint32 tlas_update_count = 0;
+		bool instance_buffer_readable = false;
+
+		std::unique_ptr<std::atomic<uint64>[]> dirty_instance_masks;
+		uint32 dirty_instance_mask_count = 0;
+		std::vector<std::vector<uint32>> dirty_instance_batches;
+		std::vector<uint32> dirty_instances;
 
+		std::unique_ptr<GfxBuffer> scratch_buffer;
+		std::unique_ptr<GfxBuffer> compacted_sizes_buffer;
+		std::unique_ptr<GfxBuffer> compacted_sizes_readback_buffer;
 		GfxFence build_fence;
 		uint64 build_fence_value = 0;
+		bool compaction_pending = false;
+
 	private:
 		void BuildBottomLevels();
-		void BuildTopLevel();
+		void CompactBottomLevels();
+		void UpdateTopLevel(bool rebuild);
 	};
-}
\ No newline at end of file
+}
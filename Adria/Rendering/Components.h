@@ -173,8 +173,6 @@ namespace adria
 		MaterialAlphaMode alpha_mode;
 		Matrix world_transform;
 		BoundingBox bounding_box;
-
-		bool camera_visibility = true;
 	};
 
 	void Draw(SubMesh const& submesh, GfxCommandList* cmd_list, bool override_topology = false, GfxPrimitiveTopology new_topology = GfxPrimitiveTopology::Undefined);
@@ -0,0 +1,221 @@
+#include <fstream>
+#include <filesystem>
+#include "CookedMesh.h"
+#include "Utilities/MemoryMappedFile.h"
+#include "Utilities/AllocatorUtil.h"
+
+namespace adria
+{
+	namespace
+	{
+		constexpr uint32 COOKED_MESH_MAGIC = 0x48534D41; //AMSH
+		constexpr uint32 COOKED_MESH_VERSION = 1;
+		constexpr uint32 NO_TEXTURE_PATH = uint32(-1);
+
+		struct CookedMeshHeader
+		{
+			uint32 magic;
+			uint32 version;
+			uint64 source_hash;
+			uint32 material_count;
+			uint32 submesh_count;
+			uint32 instance_count;
+			uint32 strings_size;
+			uint64 materials_offset;
+			uint64 submeshes_offset;
+			uint64 instances_offset;
+			uint64 strings_offset;
+			uint64 geometry_offset;
+			uint64 geometry_size;
+		};
+
+		struct CookedMaterialEntry
+		{
+			uint32 albedo_texture;
+			uint32 normal_texture;
+			uint32 metallic_roughness_texture;
+			uint32 emissive_texture;
+			float base_color[3];
+			float metallic_factor;
+			float roughness_factor;
+			float emissive_factor;
+			float alpha_cutoff;
+			uint32 alpha_mode;
+			uint32 double_sided;
+		};
+
+		struct CookedInstanceEntry
+		{
+			uint32 submesh_index;
+			uint32 padding[3];
+			Matrix local_to_world;
+		};
+
+		static_assert(std::is_trivially_copyable_v<SubMeshGPU>);
+		static_assert(std::is_trivially_copyable_v<CookedInstanceEntry>);
+
+		constexpr uint64 SECTION_ALIGNMENT = 16;
+	}
+
+	bool SaveCookedMesh(std::string const& path, uint64 source_hash, CookedMeshData const& cooked_mesh)
+	{
+		std::string strings;
+		auto AddString = [&strings](std::string const& str)
+		{
+			if (str.empty()) return NO_TEXTURE_PATH;
+			uint32 const offset = (uint32)strings.size();
+			strings.append(str);
+			strings.push_back('\0');
+			return offset;
+		};
+
+		std::vector<CookedMaterialEntry> materials(cooked_mesh.materials.size());
+		for (uint64 i = 0; i < materials.size(); ++i)
+		{
+			CookedMaterial const& cooked_material = cooked_mesh.materials[i];
+			Material const& material = cooked_material.material;
+			CookedMaterialEntry& entry = materials[i];
+			entry.albedo_texture = AddString(cooked_material.albedo_texture);
+			entry.normal_texture = AddString(cooked_material.normal_texture);
+			entry.metallic_roughness_texture = AddString(cooked_material.metallic_roughness_texture);
+			entry.emissive_texture = AddString(cooked_material.emissive_texture);
+			std::memcpy(entry.base_color, material.base_color, sizeof(entry.base_color));
+			entry.metallic_factor = material.metallic_factor;
+			entry.roughness_factor = material.roughness_factor;
+			entry.emissive_factor = material.emissive_factor;
+			entry.alpha_cutoff = material.alpha_cutoff;
+			entry.alpha_mode = (uint32)material.alpha_mode;
+			entry.double_sided = material.double_sided;
+		}
+
+		std::vector<CookedInstanceEntry> instances(cooked_mesh.instances.size());
+		for (uint64 i = 0; i < instances.size(); ++i)
+		{
+			instances[i] = {};
+			instances[i].submesh_index = cooked_mesh.instances[i].submesh_index;
+			instances[i].local_to_world = cooked_mesh.instances[i].local_to_world;
+		}
+
+		CookedMeshHeader header{};
+		header.magic = COOKED_MESH_MAGIC;
+		header.version = COOKED_MESH_VERSION;
+		header.source_hash = source_hash;
+		header.material_count = (uint32)materials.size();
+		header.submesh_count = (uint32)cooked_mesh.submeshes.size();
+		header.instance_count = (uint32)instances.size();
+		header.strings_size = (uint32)strings.size();
+
+		uint64 offset = Align(sizeof(CookedMeshHeader), SECTION_ALIGNMENT);
+		auto AddSection = [&offset](uint64 section_size)
+		{
+			uint64 const section_offset = offset;
+			offset = Align(offset + section_size, SECTION_ALIGNMENT);
+			return section_offset;
+		};
+		header.materials_offset = AddSection(materials.size() * sizeof(CookedMaterialEntry));
+		header.submeshes_offset = AddSection(cooked_mesh.submeshes.size() * sizeof(SubMeshGPU));
+		header.instances_offset = AddSection(instances.size() * sizeof(CookedInstanceEntry));
+		header.strings_offset = AddSection(strings.size());
+		header.geometry_offset = AddSection(cooked_mesh.geometry.size());
+		header.geometry_size = cooked_mesh.geometry.size();
+
+		//written to a temporary file first, a crash while cooking never leaves a truncated .amesh behind
+		std::string const temp_path = path + ".tmp";
+		{
+			std::ofstream os(temp_path, std::ios::binary | std::ios::trunc);
+			if (!os) return false;
+			auto WriteSection = [&os](uint64 section_offset, void const* data, uint64 size)
+			{
+				static constexpr char Padding[SECTION_ALIGNMENT] = {};
+				uint64 const position = (uint64)os.tellp();
+				if (section_offset > position) os.write(Padding, section_offset - position);
+				if (size > 0) os.write(static_cast<char const*>(data), size);
+			};
+			WriteSection(0, &header, sizeof(header));
+			WriteSection(header.materials_offset, materials.data(), materials.size() * sizeof(CookedMaterialEntry));
+			WriteSection(header.submeshes_offset, cooked_mesh.submeshes.data(), cooked_mesh.submeshes.size() * sizeof(SubMeshGPU));
+			WriteSection(header.instances_offset, instances.data(), instances.size() * sizeof(CookedInstanceEntry));
+			WriteSection(header.strings_offset, strings.data(), strings.size());
+			WriteSection(header.geometry_offset, cooked_mesh.geometry.data(), cooked_mesh.geometry.size());
+			if (!os) return false;
+		}
+		std::error_code error;
+		std::filesystem::rename(temp_path, path, error);
+		return !error;
+	}
+
+	bool LoadCookedMesh(std::string const& path, uint64 source_hash, MemoryMappedFile& file, CookedMeshData& cooked_mesh)
+	{
+		if (!file.Open(path)) return false;
+
+		uint8 const* data = file.GetData();
+		uint64 const size = file.GetSize();
+		auto IsInFile = [size](uint64 offset, uint64 section_size) { return offset <= size && section_size <= size - offset; };
+		if (size < sizeof(CookedMeshHeader))
+		{
+			file.Close();
+			return false;
+		}
+
+		CookedMeshHeader header;
+		std::memcpy(&header, data, sizeof(header));
+		bool const valid = header.magic == COOKED_MESH_MAGIC && header.version == COOKED_MESH_VERSION && header.source_hash == source_hash &&
+						   IsInFile(header.materials_offset, (uint64)header.material_count * sizeof(CookedMaterialEntry)) &&
+						   IsInFile(header.submeshes_offset, (uint64)header.submesh_count * sizeof(SubMeshGPU)) &&
+						   IsInFile(header.instances_offset, (uint64)header.instance_count * sizeof(CookedInstanceEntry)) &&
+						   IsInFile(header.strings_offset, header.strings_size) &&
+						   IsInFile(header.geometry_offset, header.geometry_size);
+		if (!valid)
+		{
+			file.Close();
+			return false;
+		}
+
+		char const* strings = reinterpret_cast<char const*>(data + header.strings_offset);
+		auto GetString = [&](uint32 offset) -> std::string
+		{
+			if (offset == NO_TEXTURE_PATH || offset >= header.strings_size) return {};
+			return std::string(strings + offset, strnlen(strings + offset, header.strings_size - offset));
+		};
+
+		cooked_mesh.materials.resize(header.material_count);
+		for (uint32 i = 0; i < header.material_count; ++i)
+		{
+			CookedMaterialEntry entry;
+			std::memcpy(&entry, data + header.materials_offset + i * sizeof(CookedMaterialEntry), sizeof(entry));
+			CookedMaterial& cooked_material = cooked_mesh.materials[i];
+			Material& material = cooked_material.material;
+			std::memcpy(material.base_color, entry.base_color, sizeof(entry.base_color));
+			material.metallic_factor = entry.metallic_factor;
+			material.roughness_factor = entry.roughness_factor;
+			material.emissive_factor = entry.emissive_factor;
+			material.alpha_cutoff = entry.alpha_cutoff;
+			material.alpha_mode = (MaterialAlphaMode)entry.alpha_mode;
+			material.double_sided = entry.double_sided != 0;
+			cooked_material.albedo_texture = GetString(entry.albedo_texture);
+			cooked_material.normal_texture = GetString(entry.normal_texture);
+			cooked_material.metallic_roughness_texture = GetString(entry.metallic_roughness_texture);
+			cooked_material.emissive_texture = GetString(entry.emissive_texture);
+		}
+
+		cooked_mesh.submeshes.resize(header.submesh_count);
+		if (header.submesh_count > 0) std::memcpy(cooked_mesh.submeshes.data(), data + header.submeshes_offset, header.submesh_count * sizeof(SubMeshGPU));
+
+		cooked_mesh.instances.resize(header.instance_count);
+		for (uint32 i = 0; i < header.instance_count; ++i)
+		{
+			CookedInstanceEntry entry;
+			std::memcpy(&entry, data + header.instances_offset + i * sizeof(CookedInstanceEntry), sizeof(entry));
+			if (entry.submesh_index >= header.submesh_count)
+			{
+				file.Close();
+				return false;
+			}
+			cooked_mesh.instances[i].submesh_index = entry.submesh_index;
+			cooked_mesh.instances[i].local_to_world = entry.local_to_world;
+		}
+
+		cooked_mesh.geometry = std::span<uint8 const>(data + header.geometry_offset, header.geometry_size);
+		return true;
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <span>
+#include "Components.h"
+
+namespace adria
+{
+	class MemoryMappedFile;
+
+	//material of a cooked mesh, empty texture paths use the default textures
+	struct CookedMaterial
+	{
+		Material material;
+		std::string albedo_texture;
+		std::string normal_texture;
+		std::string metallic_roughness_texture;
+		std::string emissive_texture;
+	};
+
+	struct CookedMeshInstance
+	{
+		uint32 submesh_index;
+		Matrix local_to_world;
+	};
+
+	struct CookedMeshData
+	{
+		std::vector<CookedMaterial> materials;
+		std::vector<SubMeshGPU> submeshes;
+		std::vector<CookedMeshInstance> instances;
+		//contents of the geometry buffer, the submesh offsets point into it
+		std::span<uint8 const> geometry;
+	};
+
+	//.amesh files store everything a glTF import produces so that later loads skip parsing and mesh processing.
+	//The geometry section is the geometry buffer as is and can be uploaded straight from the mapped file.
+	bool SaveCookedMesh(std::string const& path, uint64 source_hash, CookedMeshData const& cooked_mesh);
+	//fails if the file is missing, corrupt, from another format version or cooked from a different source.
+	//cooked_mesh.geometry points into file and stays valid while the file is open.
+	bool LoadCookedMesh(std::string const& path, uint64 source_hash, MemoryMappedFile& file, CookedMeshData& cooked_mesh);
+}
@@ -1,6 +1,7 @@
 #define TINYOBJLOADER_IMPLEMENTATION
 #define TINYOBJLOADER_USE_MAPBOX_EARCUT
 #define CGLTF_IMPLEMENTATION
+#include <filesystem>
 #include "tiny_obj_loader.h"
 #include "cgltf.h"
 #include "meshoptimizer.h"
@@ -8,13 +9,19 @@
 #include "Components.h"
 #include "Meshlet.h"
 #include "Graphics/GfxDevice.h"
-#include "Graphics/GfxLinearDynamicAllocator.h"
 #include "Logging/Logger.h"
 #include "Math/BoundingVolumeUtil.h"
 #include "Core/Paths.h"
+#include "Core/CpuProfiler.h"
 #include "Utilities/StringUtil.h"
 #include "Utilities/FilesUtil.h"
 #include "Utilities/Heightmap.h"
+#include "Utilities/JobSystem.h"
+#include "Utilities/Timer.h"
+#include "Utilities/HashUtil.h"
+#include "Utilities/MemoryMappedFile.h"
+#include "Core/ConsoleManager.h"
+#include "CookedMesh.h"
 
 
 using namespace DirectX;
@@ -22,9 +29,40 @@ using namespace DirectX;
 
 namespace adria
 {
+	static TAutoConsoleVariable<bool> UseMeshCache("r.MeshCache", true, "Load glTF models from cooked .amesh files and cook them on first import");
+	static TAutoConsoleVariable<bool> UseTextureCompression("r.TextureCompression", true, "Compress glTF material textures to BCn at import and load them from the DDS texture cache");
+
+	namespace
+	{
+		//the JSON is hashed by content, external buffers by size and write time so that the warm path does not read them
+		uint64 ComputeGLTFSourceHash(cgltf_data const* gltf_data, ModelParameters const& params)
+		{
+			uint64 hash = crc64(static_cast<char const*>(gltf_data->json), gltf_data->json_size);
+			HashCombine(hash, params.textures_path);
+			HashCombine(hash, params.triangle_ccw);
+			HashCombine(hash, params.force_mask_alpha_usage);
+			HashCombine(hash, MESHLET_MAX_VERTICES);
+			HashCombine(hash, MESHLET_MAX_TRIANGLES);
+			auto HashFile = [&hash](std::string const& file_path)
+			{
+				std::error_code error;
+				HashCombine(hash, (uint64)std::filesystem::file_size(file_path, error));
+				if (!error) HashCombine(hash, GetFileLastWriteTime(file_path));
+			};
+			if (gltf_data->bin) HashFile(params.model_path);
+			std::string const model_dir = GetParentPath(params.model_path);
+			for (uint64 i = 0; i < gltf_data->buffers_count; ++i)
+			{
+				char const* uri = gltf_data->buffers[i].uri;
+				if (uri && strncmp(uri, "data:", 5) != 0) HashFile(model_dir + "/" + uri);
+			}
+			return hash;
+		}
+	}
 
 	std::vector<entt::entity> EntityLoader::LoadGrid(GridParameters const& params)
 	{
+		AdriaCpuProfileScope("EntityLoader::LoadGrid");
 		if (params.heightmap)
 		{
 			ADRIA_ASSERT(params.heightmap->Depth() == params.tile_count_z + 1);
@@ -187,6 +225,7 @@ namespace adria
 
 	std::vector<entt::entity> EntityLoader::LoadObjMesh(std::string const& model_path)
 	{
+		AdriaCpuProfileScope("EntityLoader::LoadObjMesh");
 		tinyobj::ObjReaderConfig reader_config{};
 		tinyobj::ObjReader reader;
 		std::string model_name = GetFilename(model_path);
@@ -194,13 +233,13 @@ namespace adria
 		{
 			if (!reader.Error().empty())
 			{
-				ADRIA_LOG(ERROR, reader.Error().c_str());
+				ADRIA_LOG(ERROR, "%s", reader.Error().c_str());
 			}
 			return {};
 		}
 		if (!reader.Warning().empty())
 		{
-			ADRIA_LOG(WARNING, reader.Warning().c_str());
+			ADRIA_LOG(WARNING, "%s", reader.Warning().c_str());
 		}
 
 		tinyobj::attrib_t const& attrib = reader.GetAttrib();
@@ -315,6 +354,7 @@ namespace adria
 
 	entt::entity EntityLoader::LoadSkybox(SkyboxParameters const& params)
     {
+        AdriaCpuProfileScope("EntityLoader::LoadSkybox");
         entt::entity skybox = reg.create();
 
         Skybox sky{};
@@ -445,6 +485,7 @@ namespace adria
 
 	entt::entity EntityLoader::LoadDecal(DecalParameters const& params)
 	{
+		AdriaCpuProfileScope("EntityLoader::LoadDecal");
 		Decal decal{};
 		g_TextureManager.EnableMipMaps(false);
 		if (!params.albedo_texture_path.empty()) decal.albedo_decal_texture = g_TextureManager.LoadTexture(params.albedo_texture_path);
@@ -486,6 +527,8 @@ namespace adria
 
 	entt::entity EntityLoader::ImportModel_GLTF(ModelParameters const& params)
 	{
+		AdriaCpuProfileScope("EntityLoader::ImportModel_GLTF");
+		Timer<std::chrono::microseconds> import_timer;
 		cgltf_options options{};
 		cgltf_data* gltf_data = nullptr;
 		cgltf_result result = cgltf_parse_file(&options, params.model_path.c_str(), &gltf_data);
@@ -494,22 +537,40 @@ namespace adria
 			ADRIA_LOG(WARNING, "GLTF - Failed to load '%s'", params.model_path.c_str());
 			return entt::null;
 		}
+
+		uint64 const source_hash = ComputeGLTFSourceHash(gltf_data, params);
+		char cooked_path[256];
+		sprintf_s(cooked_path, "%s%s_%llx.amesh", paths::MeshCacheDir.c_str(), GetFilenameWithoutExtension(params.model_path).c_str(),
+												  crc64(params.model_path.c_str(), params.model_path.size()));
+		if (UseMeshCache.Get())
+		{
+			MemoryMappedFile cooked_file;
+			CookedMeshData cooked_mesh{};
+			if (LoadCookedMesh(cooked_path, source_hash, cooked_file, cooked_mesh))
+			{
+				cgltf_free(gltf_data);
+				entt::entity mesh_entity = CreateModelEntity(params, cooked_mesh);
+				ADRIA_LOG(INFO, "GLTF Model %s loaded from cooked mesh %s in %.2f ms", params.model_path.c_str(), cooked_path, import_timer.ElapsedInSeconds() * 1000.0f);
+				return mesh_entity;
+			}
+		}
+
 		result = cgltf_load_buffers(&options, gltf_data, params.model_path.c_str());
 		if (result != cgltf_result_success)
 		{
 			ADRIA_LOG(WARNING, "GLTF - Failed to load buffers '%s'", params.model_path.c_str());
+			cgltf_free(gltf_data);
 			return entt::null;
 		}
+		float const parse_ms = import_timer.MarkInSeconds() * 1000.0f;
 
-		std::string model_name = GetFilename(params.model_path);
-		entt::entity mesh_entity = reg.create();
-		Mesh mesh{};
-
-		mesh.materials.reserve(gltf_data->materials_count);
+		CookedMeshData cooked_mesh{};
+		cooked_mesh.materials.reserve(gltf_data->materials_count);
 		for (uint32 i = 0; i < gltf_data->materials_count; ++i)
 		{
 			cgltf_material const& gltf_material = gltf_data->materials[i];
-			Material& material = mesh.materials.emplace_back();
+			CookedMaterial& cooked_material = cooked_mesh.materials.emplace_back();
+			Material& material = cooked_material.material;
 			material.alpha_cutoff = (float)gltf_material.alpha_cutoff;
 			material.double_sided = gltf_material.double_sided;
 
@@ -537,56 +598,20 @@ namespace adria
 			material.roughness_factor = (float)pbr_metallic_roughness.roughness_factor;
 			material.emissive_factor = (float)gltf_material.emissive_factor[0];
 
-			if (cgltf_texture* texture = pbr_metallic_roughness.base_color_texture.texture)
-			{
-				cgltf_image* image = texture->image;
-				std::string texbase = params.textures_path + image->uri;
-				material.albedo_texture = g_TextureManager.LoadTexture(texbase);
-			}
-			else
-			{
-				material.albedo_texture = DEFAULT_WHITE_TEXTURE_HANDLE;
-			}
-
-			if (cgltf_texture* texture = pbr_metallic_roughness.metallic_roughness_texture.texture)
-			{
-				cgltf_image* image = texture->image;
-				std::string texmetallicroughness = params.textures_path + image->uri;
-				material.metallic_roughness_texture = g_TextureManager.LoadTexture(texmetallicroughness);
-			}
-			else
-			{
-				material.metallic_roughness_texture = DEFAULT_METALLIC_ROUGHNESS_TEXTURE_HANDLE;
-			}
-
-			if (cgltf_texture* texture = gltf_material.normal_texture.texture)
-			{
-				cgltf_image* image = texture->image;
-				std::string texnormal = params.textures_path + image->uri;
-				material.normal_texture = g_TextureManager.LoadTexture(texnormal);
-			}
-			else
-			{
-				material.normal_texture = DEFAULT_NORMAL_TEXTURE_HANDLE;
-			}
-
-			if (cgltf_texture* texture = gltf_material.emissive_texture.texture)
-			{
-				cgltf_image* image = texture->image;
-				std::string texemissive = params.textures_path + image->uri;
-				material.emissive_texture = g_TextureManager.LoadTexture(texemissive);
-			}
-			else
-			{
-				material.emissive_texture = DEFAULT_BLACK_TEXTURE_HANDLE;
-			}
+			if (cgltf_texture* texture = pbr_metallic_roughness.base_color_texture.texture) cooked_material.albedo_texture = params.textures_path + texture->image->uri;
+			if (cgltf_texture* texture = pbr_metallic_roughness.metallic_roughness_texture.texture) cooked_material.metallic_roughness_texture = params.textures_path + texture->image->uri;
+			if (cgltf_texture* texture = gltf_material.normal_texture.texture) cooked_material.normal_texture = params.textures_path + texture->image->uri;
+			if (cgltf_texture* texture = gltf_material.emissive_texture.texture) cooked_material.emissive_texture = params.textures_path + texture->image->uri;
 		}
 
+		float const materials_ms = import_timer.MarkInSeconds() * 1000.0f;
+
 		std::unordered_map<cgltf_mesh const*, std::vector<int32>> mesh_primitives_map; //mesh -> vector of primitive indices
 		int32 primitive_count = 0;
 
 		struct MeshData
 		{
+			cgltf_primitive const* gltf_primitive = nullptr;
 			DirectX::BoundingBox bounding_box;
 			int32 material_index = -1;
 			GfxPrimitiveTopology topology = GfxPrimitiveTopology::TriangleList;
@@ -612,18 +637,8 @@ namespace adria
 				ADRIA_ASSERT(gltf_primitive.indices->count >= 0);
 
 				MeshData& mesh_data = mesh_datas.emplace_back();
+				mesh_data.gltf_primitive = &gltf_primitive;
 				mesh_data.material_index = (int32)(gltf_primitive.material - gltf_data->materials);
-				mesh_data.indices.reserve(gltf_primitive.indices->count);
-				
-				uint32 triangle_cw[] = { 0, 1, 2 };
-				uint32 triangle_ccw[] = { 0, 2, 1 };
-				uint32* order = params.triangle_ccw ? triangle_ccw : triangle_cw;
-				for (uint64 i = 0; i < gltf_primitive.indices->count; i += 3)
-				{
-					mesh_data.indices.push_back((uint32)cgltf_accessor_read_index(gltf_primitive.indices, i + order[0]));
-					mesh_data.indices.push_back((uint32)cgltf_accessor_read_index(gltf_primitive.indices, i + order[1]));
-					mesh_data.indices.push_back((uint32)cgltf_accessor_read_index(gltf_primitive.indices, i + order[2]));
-				}
 
 				switch (gltf_primitive.type)
 				{
@@ -645,169 +660,208 @@ namespace adria
 				default:
 					ADRIA_ASSERT(false);
 				}
+				primitives.push_back(primitive_count++);
+			}
+		}
+		float const setup_ms = import_timer.MarkInSeconds() * 1000.0f;
 
-				for (uint32 k = 0; k < gltf_primitive.attributes_count; ++k)
+		//every primitive is decoded and processed by its own job, large accessors are split further.
+		//Each job only writes its own MeshData so the output does not depend on the order the jobs ran in.
+		static constexpr uint32 AccessorBatchSize = 1 << 16;
+		g_JobSystem.ParallelFor((uint32)mesh_datas.size(), 1, [&](uint32 begin, uint32 end)
+			{
+				for (uint32 primitive_idx = begin; primitive_idx < end; ++primitive_idx)
 				{
-					cgltf_attribute const& gltf_attribute = gltf_primitive.attributes[k];
-					std::string const& attr_name = gltf_attribute.name;
+					MeshData& mesh_data = mesh_datas[primitive_idx];
+					cgltf_primitive const& gltf_primitive = *mesh_data.gltf_primitive;
+
+					uint32 triangle_cw[] = { 0, 1, 2 };
+					uint32 triangle_ccw[] = { 0, 2, 1 };
+					uint32* order = params.triangle_ccw ? triangle_ccw : triangle_cw;
+					uint32 const triangle_count = (uint32)(gltf_primitive.indices->count / 3);
+					mesh_data.indices.resize(triangle_count * 3);
+					g_JobSystem.ParallelFor(triangle_count, AccessorBatchSize / 3, [&](uint32 triangle_begin, uint32 triangle_end)
+						{
+							for (uint64 i = triangle_begin * 3ull; i < triangle_end * 3ull; i += 3)
+							{
+								mesh_data.indices[i + 0] = (uint32)cgltf_accessor_read_index(gltf_primitive.indices, i + order[0]);
+								mesh_data.indices[i + 1] = (uint32)cgltf_accessor_read_index(gltf_primitive.indices, i + order[1]);
+								mesh_data.indices[i + 2] = (uint32)cgltf_accessor_read_index(gltf_primitive.indices, i + order[2]);
+							}
+						});
 
-					auto ReadAttributeData = [&]<typename T>(std::vector<T>& stream, const char* stream_name)
+					for (uint32 k = 0; k < gltf_primitive.attributes_count; ++k)
 					{
-						if (!attr_name.compare(stream_name))
+						cgltf_attribute const& gltf_attribute = gltf_primitive.attributes[k];
+						std::string const& attr_name = gltf_attribute.name;
+
+						auto ReadAttributeData = [&]<typename T>(std::vector<T>& stream, const char* stream_name)
 						{
-							stream.resize(gltf_attribute.data->count);
-							for (uint64 i = 0; i < gltf_attribute.data->count; ++i)
+							if (!attr_name.compare(stream_name))
 							{
-								cgltf_accessor_read_float(gltf_attribute.data, i, &stream[i].x, sizeof(T) / sizeof(float));
+								stream.resize(gltf_attribute.data->count);
+								g_JobSystem.ParallelFor((uint32)gltf_attribute.data->count, AccessorBatchSize, [&](uint32 element_begin, uint32 element_end)
+									{
+										for (uint64 i = element_begin; i < element_end; ++i)
+										{
+											cgltf_accessor_read_float(gltf_attribute.data, i, &stream[i].x, sizeof(T) / sizeof(float));
+										}
+									});
 							}
-						}
-					};
-					ReadAttributeData(mesh_data.positions_stream, "POSITION");
-					ReadAttributeData(mesh_data.normals_stream, "NORMAL");
-					ReadAttributeData(mesh_data.tangents_stream, "TANGENT");
-					ReadAttributeData(mesh_data.uvs_stream, "TEXCOORD_0");
+						};
+						ReadAttributeData(mesh_data.positions_stream, "POSITION");
+						ReadAttributeData(mesh_data.normals_stream, "NORMAL");
+						ReadAttributeData(mesh_data.tangents_stream, "TANGENT");
+						ReadAttributeData(mesh_data.uvs_stream, "TEXCOORD_0");
+					}
 				}
-				primitives.push_back(primitive_count++);
-			}
-		}
+			});
+		float const decode_ms = import_timer.MarkInSeconds() * 1000.0f;
 
-		uint64 total_buffer_size = 0;
-		for (auto& mesh_data : mesh_datas)
-		{
-			std::vector<uint32> const& indices = mesh_data.indices;
-			uint64 vertex_count = mesh_data.positions_stream.size();
-
-			bool has_tangents = !mesh_data.tangents_stream.empty();
-			if (mesh_data.normals_stream.size() != vertex_count) mesh_data.normals_stream.resize(vertex_count);
-			if (mesh_data.uvs_stream.size() != vertex_count) mesh_data.uvs_stream.resize(vertex_count);
-			if (mesh_data.tangents_stream.size() != vertex_count) mesh_data.tangents_stream.resize(vertex_count);
-
-			if (!has_tangents)
+		//summed over all jobs, the wall clock time of the whole stage is logged separately
+		std::atomic<uint64> tangents_us = 0, optimize_us = 0, meshlets_us = 0;
+		g_JobSystem.ParallelFor((uint32)mesh_datas.size(), 1, [&](uint32 begin, uint32 end)
 			{
-				ComputeTangentFrame(mesh_data.indices.data(), mesh_data.indices.size(), mesh_data.positions_stream.data(),
-					mesh_data.normals_stream.data(), mesh_data.uvs_stream.data(), vertex_count, mesh_data.tangents_stream.data());
-			}
+				for (uint32 primitive_idx = begin; primitive_idx < end; ++primitive_idx)
+				{
+					MeshData& mesh_data = mesh_datas[primitive_idx];
+					Timer<std::chrono::microseconds> stage_timer;
+					uint64 vertex_count = mesh_data.positions_stream.size();
 
-			meshopt_optimizeVertexCache(mesh_data.indices.data(), mesh_data.indices.data(), mesh_data.indices.size(), vertex_count);
-			meshopt_optimizeOverdraw(mesh_data.indices.data(), mesh_data.indices.data(), mesh_data.indices.size(), &mesh_data.positions_stream[0].x, vertex_count, sizeof(Vector3), 1.05f);
-			std::vector<uint32> remap(vertex_count);
-			meshopt_optimizeVertexFetchRemap(&remap[0], mesh_data.indices.data(), mesh_data.indices.size(), vertex_count);
-			meshopt_remapIndexBuffer(mesh_data.indices.data(), mesh_data.indices.data(), mesh_data.indices.size(), &remap[0]);
-			meshopt_remapVertexBuffer(mesh_data.positions_stream.data(), mesh_data.positions_stream.data(), vertex_count, sizeof(Vector3), &remap[0]);
-			meshopt_remapVertexBuffer(mesh_data.normals_stream.data(), mesh_data.normals_stream.data(), mesh_data.normals_stream.size(), sizeof(Vector3), &remap[0]);
-			meshopt_remapVertexBuffer(mesh_data.tangents_stream.data(), mesh_data.tangents_stream.data(), mesh_data.tangents_stream.size(), sizeof(Vector4), &remap[0]);
-			meshopt_remapVertexBuffer(mesh_data.uvs_stream.data(), mesh_data.uvs_stream.data(), mesh_data.uvs_stream.size(), sizeof(Vector2), &remap[0]);
-
-			uint64 const max_meshlets = meshopt_buildMeshletsBound(mesh_data.indices.size(), MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES);
-			mesh_data.meshlets.resize(max_meshlets);
-			mesh_data.meshlet_vertices.resize(max_meshlets * MESHLET_MAX_VERTICES);
-
-			std::vector<unsigned char> meshlet_triangles(max_meshlets * MESHLET_MAX_TRIANGLES * 3);
-			std::vector<meshopt_Meshlet> meshlets(max_meshlets);
-
-			uint64 meshlet_count = meshopt_buildMeshlets(meshlets.data(), mesh_data.meshlet_vertices.data(), meshlet_triangles.data(),
-				mesh_data.indices.data(), mesh_data.indices.size(), &mesh_data.positions_stream[0].x, mesh_data.positions_stream.size(), sizeof(Vector3),
-				MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES, 0);
-
-			meshopt_Meshlet const& last = meshlets[meshlet_count - 1];
-			meshlet_triangles.resize(last.triangle_offset + ((last.triangle_count * 3 + 3) & ~3));
-			meshlets.resize(meshlet_count);
-
-			mesh_data.meshlets.resize(meshlet_count);
-			mesh_data.meshlet_vertices.resize(last.vertex_offset + last.vertex_count);
-			mesh_data.meshlet_triangles.resize(meshlet_triangles.size() / 3);
-
-			uint32 triangle_offset = 0;
-			for (uint64 i = 0; i < meshlet_count; ++i)
-			{
-				meshopt_Meshlet const& m = meshlets[i];
-				meshopt_Bounds meshopt_bounds = meshopt_computeMeshletBounds(&mesh_data.meshlet_vertices[m.vertex_offset], &meshlet_triangles[m.triangle_offset],
-					m.triangle_count, reinterpret_cast<float const*>(mesh_data.positions_stream.data()), vertex_count, sizeof(Vector3));
+					bool has_tangents = !mesh_data.tangents_stream.empty();
+					if (mesh_data.normals_stream.size() != vertex_count) mesh_data.normals_stream.resize(vertex_count);
+					if (mesh_data.uvs_stream.size() != vertex_count) mesh_data.uvs_stream.resize(vertex_count);
+					if (mesh_data.tangents_stream.size() != vertex_count) mesh_data.tangents_stream.resize(vertex_count);
 
-				unsigned char* src_triangles = meshlet_triangles.data() + m.triangle_offset;
-				for (uint32 triangle_idx = 0; triangle_idx < m.triangle_count; ++triangle_idx)
-				{
-					MeshletTriangle& tri = mesh_data.meshlet_triangles[triangle_idx + triangle_offset];
-					tri.V0 = *src_triangles++;
-					tri.V1 = *src_triangles++;
-					tri.V2 = *src_triangles++;
-				}
+					if (!has_tangents)
+					{
+						ComputeTangentFrame(mesh_data.indices.data(), mesh_data.indices.size(), mesh_data.positions_stream.data(),
+							mesh_data.normals_stream.data(), mesh_data.uvs_stream.data(), vertex_count, mesh_data.tangents_stream.data());
+					}
+					tangents_us.fetch_add(stage_timer.Mark(), std::memory_order_relaxed);
+
+					meshopt_optimizeVertexCache(mesh_data.indices.data(), mesh_data.indices.data(), mesh_data.indices.size(), vertex_count);
+					meshopt_optimizeOverdraw(mesh_data.indices.data(), mesh_data.indices.data(), mesh_data.indices.size(), &mesh_data.positions_stream[0].x, vertex_count, sizeof(Vector3), 1.05f);
+					std::vector<uint32> remap(vertex_count);
+					meshopt_optimizeVertexFetchRemap(&remap[0], mesh_data.indices.data(), mesh_data.indices.size(), vertex_count);
+					meshopt_remapIndexBuffer(mesh_data.indices.data(), mesh_data.indices.data(), mesh_data.indices.size(), &remap[0]);
+					meshopt_remapVertexBuffer(mesh_data.positions_stream.data(), mesh_data.positions_stream.data(), vertex_count, sizeof(Vector3), &remap[0]);
+					meshopt_remapVertexBuffer(mesh_data.normals_stream.data(), mesh_data.normals_stream.data(), mesh_data.normals_stream.size(), sizeof(Vector3), &remap[0]);
+					meshopt_remapVertexBuffer(mesh_data.tangents_stream.data(), mesh_data.tangents_stream.data(), mesh_data.tangents_stream.size(), sizeof(Vector4), &remap[0]);
+					meshopt_remapVertexBuffer(mesh_data.uvs_stream.data(), mesh_data.uvs_stream.data(), mesh_data.uvs_stream.size(), sizeof(Vector2), &remap[0]);
+					optimize_us.fetch_add(stage_timer.Mark(), std::memory_order_relaxed);
+
+					uint64 const max_meshlets = meshopt_buildMeshletsBound(mesh_data.indices.size(), MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES);
+					mesh_data.meshlets.resize(max_meshlets);
+					mesh_data.meshlet_vertices.resize(max_meshlets * MESHLET_MAX_VERTICES);
+
+					std::vector<unsigned char> meshlet_triangles(max_meshlets * MESHLET_MAX_TRIANGLES * 3);
+					std::vector<meshopt_Meshlet> meshlets(max_meshlets);
+
+					uint64 meshlet_count = meshopt_buildMeshlets(meshlets.data(), mesh_data.meshlet_vertices.data(), meshlet_triangles.data(),
+						mesh_data.indices.data(), mesh_data.indices.size(), &mesh_data.positions_stream[0].x, mesh_data.positions_stream.size(), sizeof(Vector3),
+						MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES, 0);
+
+					meshopt_Meshlet const& last = meshlets[meshlet_count - 1];
+					meshlet_triangles.resize(last.triangle_offset + ((last.triangle_count * 3 + 3) & ~3));
+					meshlets.resize(meshlet_count);
+
+					mesh_data.meshlets.resize(meshlet_count);
+					mesh_data.meshlet_vertices.resize(last.vertex_offset + last.vertex_count);
+					mesh_data.meshlet_triangles.resize(meshlet_triangles.size() / 3);
+
+					uint32 triangle_offset = 0;
+					for (uint64 i = 0; i < meshlet_count; ++i)
+					{
+						meshopt_Meshlet const& m = meshlets[i];
+						meshopt_Bounds meshopt_bounds = meshopt_computeMeshletBounds(&mesh_data.meshlet_vertices[m.vertex_offset], &meshlet_triangles[m.triangle_offset],
+							m.triangle_count, reinterpret_cast<float const*>(mesh_data.positions_stream.data()), vertex_count, sizeof(Vector3));
 
-				Meshlet& meshlet = mesh_data.meshlets[i];
-				std::memcpy(meshlet.center, meshopt_bounds.center, sizeof(float) * 3);
+						unsigned char* src_triangles = meshlet_triangles.data() + m.triangle_offset;
+						for (uint32 triangle_idx = 0; triangle_idx < m.triangle_count; ++triangle_idx)
+						{
+							MeshletTriangle& tri = mesh_data.meshlet_triangles[triangle_idx + triangle_offset];
+							tri.V0 = *src_triangles++;
+							tri.V1 = *src_triangles++;
+							tri.V2 = *src_triangles++;
+						}
 
-				meshlet.radius = meshopt_bounds.radius;
-				meshlet.vertex_count = m.vertex_count;
-				meshlet.triangle_count = m.triangle_count;
-				meshlet.vertex_offset = m.vertex_offset;
-				meshlet.triangle_offset = triangle_offset;
-				triangle_offset += m.triangle_count;
+						Meshlet& meshlet = mesh_data.meshlets[i];
+						std::memcpy(meshlet.center, meshopt_bounds.center, sizeof(float) * 3);
 
-			}
-			mesh_data.meshlet_triangles.resize(triangle_offset);
-
-			total_buffer_size += Align(mesh_data.indices.size() * sizeof(uint32), 16);
-			total_buffer_size += Align(mesh_data.positions_stream.size() * sizeof(Vector3), 16);
-			total_buffer_size += Align(mesh_data.uvs_stream.size() * sizeof(Vector2), 16);
-			total_buffer_size += Align(mesh_data.normals_stream.size() * sizeof(Vector3), 16);
-			total_buffer_size += Align(mesh_data.tangents_stream.size() * sizeof(Vector4), 16);
-			total_buffer_size += Align(mesh_data.meshlets.size() * sizeof(Meshlet), 16);
-			total_buffer_size += Align(mesh_data.meshlet_vertices.size() * sizeof(uint32), 16);
-			total_buffer_size += Align(mesh_data.meshlet_triangles.size() * sizeof(MeshletTriangle), 16);
-
-			mesh_data.bounding_box = AABBFromPositions(mesh_data.positions_stream);
-		}
+						meshlet.radius = meshopt_bounds.radius;
+						meshlet.vertex_count = m.vertex_count;
+						meshlet.triangle_count = m.triangle_count;
+						meshlet.vertex_offset = m.vertex_offset;
+						meshlet.triangle_offset = triangle_offset;
+						triangle_offset += m.triangle_count;
 
-		GfxDynamicAllocation staging_buffer = gfx->GetDynamicAllocator()->Allocate(total_buffer_size, 16);
+					}
+					mesh_data.meshlet_triangles.resize(triangle_offset);
+					mesh_data.bounding_box = AABBFromPositions(mesh_data.positions_stream);
+					meshlets_us.fetch_add(stage_timer.Mark(), std::memory_order_relaxed);
+				}
+			});
+		float const process_ms = import_timer.MarkInSeconds() * 1000.0f;
 
-		uint32 current_offset = 0;
-		auto CopyData = [&staging_buffer, &current_offset]<typename T>(std::vector<T> const& _data)
+		//offsets are assigned in primitive order, so the staging layout is the same as for a serial import
+		uint64 total_buffer_size = 0;
+		auto AllocateData = [&total_buffer_size]<typename T>(std::vector<T> const& _data)
 		{
-			uint64 current_copy_size = _data.size() * sizeof(T);
-			staging_buffer.Update(_data.data(), current_copy_size, current_offset);
-			current_offset += (uint32)Align(current_copy_size, 16);
+			uint32 const offset = (uint32)total_buffer_size;
+			total_buffer_size += Align(_data.size() * sizeof(T), 16);
+			return offset;
 		};
 
-		mesh.submeshes.reserve(mesh_datas.size());
+		cooked_mesh.submeshes.reserve(mesh_datas.size());
 		for (uint64 i = 0; i < mesh_datas.size(); ++i)
 		{
 			auto const& mesh_data = mesh_datas[i];
 
-			SubMeshGPU& submesh = mesh.submeshes.emplace_back();
+			SubMeshGPU& submesh = cooked_mesh.submeshes.emplace_back();
+			submesh = {};
 
-			submesh.indices_offset = current_offset;
+			submesh.indices_offset = AllocateData(mesh_data.indices);
 			submesh.indices_count = (uint32)mesh_data.indices.size();
-			CopyData(mesh_data.indices);
 
 			submesh.vertices_count = (uint32)mesh_data.positions_stream.size();
-			submesh.positions_offset = current_offset;
-			CopyData(mesh_data.positions_stream);
-
-			submesh.uvs_offset = current_offset;
-			CopyData(mesh_data.uvs_stream);
-
-			submesh.normals_offset = current_offset;
-			CopyData(mesh_data.normals_stream);
-
-			submesh.tangents_offset = current_offset;
-			CopyData(mesh_data.tangents_stream);
-
-			submesh.meshlet_offset = current_offset;
-			CopyData(mesh_data.meshlets);
-
-			submesh.meshlet_vertices_offset = current_offset;
-			CopyData(mesh_data.meshlet_vertices);
-
-			submesh.meshlet_triangles_offset = current_offset;
-			CopyData(mesh_data.meshlet_triangles);
-
+			submesh.positions_offset = AllocateData(mesh_data.positions_stream);
+			submesh.uvs_offset = AllocateData(mesh_data.uvs_stream);
+			submesh.normals_offset = AllocateData(mesh_data.normals_stream);
+			submesh.tangents_offset = AllocateData(mesh_data.tangents_stream);
+			submesh.meshlet_offset = AllocateData(mesh_data.meshlets);
+			submesh.meshlet_vertices_offset = AllocateData(mesh_data.meshlet_vertices);
+			submesh.meshlet_triangles_offset = AllocateData(mesh_data.meshlet_triangles);
 			submesh.meshlet_count = (uint32)mesh_data.meshlets.size();
 
 			submesh.bounding_box = mesh_data.bounding_box;
 			submesh.topology = mesh_data.topology;
 			submesh.material_index = mesh_data.material_index;
 		}
-		mesh.geometry_buffer_handle = g_GeometryBufferCache.CreateAndInitializeGeometryBuffer(staging_buffer.buffer, total_buffer_size, staging_buffer.offset);
+
+		std::vector<uint8> geometry_data(total_buffer_size);
+		g_JobSystem.ParallelFor((uint32)mesh_datas.size(), 16, [&](uint32 begin, uint32 end)
+			{
+				auto CopyData = [&geometry_data]<typename T>(std::vector<T> const& _data, uint32 offset)
+				{
+					uint64 copy_size = _data.size() * sizeof(T);
+					if (copy_size > 0) memcpy(geometry_data.data() + offset, _data.data(), copy_size);
+				};
+				for (uint32 i = begin; i < end; ++i)
+				{
+					MeshData const& mesh_data = mesh_datas[i];
+					SubMeshGPU const& submesh = cooked_mesh.submeshes[i];
+					CopyData(mesh_data.indices, submesh.indices_offset);
+					CopyData(mesh_data.positions_stream, submesh.positions_offset);
+					CopyData(mesh_data.uvs_stream, submesh.uvs_offset);
+					CopyData(mesh_data.normals_stream, submesh.normals_offset);
+					CopyData(mesh_data.tangents_stream, submesh.tangents_offset);
+					CopyData(mesh_data.meshlets, submesh.meshlet_offset);
+					CopyData(mesh_data.meshlet_vertices, submesh.meshlet_vertices_offset);
+					CopyData(mesh_data.meshlet_triangles, submesh.meshlet_triangles_offset);
+				}
+			});
+		float const staging_ms = import_timer.MarkInSeconds() * 1000.0f;
 
 		for (uint64 i = 0; i < gltf_data->nodes_count; ++i)
 		{
@@ -820,21 +874,117 @@ namespace adria
 
 				for (int32 primitive : mesh_primitives_map[gltf_node.mesh])
 				{
-					SubMeshInstance& instance = mesh.instances.emplace_back();
+					CookedMeshInstance& instance = cooked_mesh.instances.emplace_back();
 					instance.submesh_index = primitive;
-					instance.world_transform = local_to_world * params.model_matrix;
-					instance.parent = mesh_entity;
+					instance.local_to_world = local_to_world;
 				}
 			}
 		}
 
-		reg.emplace<Mesh>(mesh_entity, mesh);
-		reg.emplace<Tag>(mesh_entity, model_name + " mesh");
+		cooked_mesh.geometry = geometry_data;
+		entt::entity mesh_entity = CreateModelEntity(params, cooked_mesh);
+		float const upload_ms = import_timer.MarkInSeconds() * 1000.0f;
 
-		if (gfx->GetCapabilities().SupportsRayTracing()) reg.emplace<RayTracing>(mesh_entity);
+		if (UseMeshCache.Get())
+		{
+			std::filesystem::create_directories(paths::MeshCacheDir);
+			if (!SaveCookedMesh(cooked_path, source_hash, cooked_mesh)) ADRIA_LOG(WARNING, "GLTF - Failed to write cooked mesh '%s'", cooked_path);
+		}
+		float const cook_ms = import_timer.MarkInSeconds() * 1000.0f;
 
-		ADRIA_LOG(INFO, "GLTF Model %s successfully loaded!", params.model_path.c_str());
+		ADRIA_LOG(INFO, "GLTF Model %s successfully loaded in %.2f ms!", params.model_path.c_str(), import_timer.ElapsedInSeconds() * 1000.0f);
+		ADRIA_LOG(INFO, "GLTF import of %u primitives on %u threads: parse %.2f ms, materials %.2f ms, setup %.2f ms, decode %.2f ms, "
+			"process %.2f ms (tangents %.2f ms, optimize %.2f ms, meshlets %.2f ms summed over jobs), staging %.2f ms, upload %.2f ms, cook %.2f ms",
+			(uint32)mesh_datas.size(), g_JobSystem.GetWorkerCount() + 1, parse_ms, materials_ms, setup_ms, decode_ms,
+			process_ms, tangents_us.load() / 1000.0f, optimize_us.load() / 1000.0f, meshlets_us.load() / 1000.0f, staging_ms, upload_ms, cook_ms);
 		cgltf_free(gltf_data);
 		return mesh_entity;
 	}
+
+	entt::entity EntityLoader::CreateModelEntity(ModelParameters const& params, CookedMeshData const& cooked_mesh)
+	{
+		entt::entity mesh_entity = reg.create();
+		Mesh mesh{};
+
+		//material textures are compressed before they are loaded, BC7 for color, BC5 for normals and BC1 for metallic-roughness
+		//which keeps roughness and metallic in green and blue. Every texture is encoded on its own job and its blocks in parallel.
+		std::unordered_map<std::string, std::string> compressed_texture_paths;
+		if (UseTextureCompression.Get())
+		{
+			Timer<std::chrono::microseconds> compression_timer;
+			struct TextureCompressionJob
+			{
+				std::string const* path;
+				GfxFormat format;
+				std::string compressed_path;
+				TextureCompressionStats stats;
+			};
+			std::vector<TextureCompressionJob> compression_jobs;
+			auto AddCompressionJob = [&](std::string const& texture_path, GfxFormat format)
+			{
+				if (texture_path.empty() || !compressed_texture_paths.emplace(texture_path, texture_path).second) return;
+				compression_jobs.push_back(TextureCompressionJob{ .path = &texture_path, .format = format });
+			};
+			for (CookedMaterial const& cooked_material : cooked_mesh.materials)
+			{
+				AddCompressionJob(cooked_material.albedo_texture, GfxFormat::BC7_UNORM);
+				AddCompressionJob(cooked_material.metallic_roughness_texture, GfxFormat::BC1_UNORM);
+				AddCompressionJob(cooked_material.normal_texture, GfxFormat::BC5_UNORM);
+				AddCompressionJob(cooked_material.emissive_texture, GfxFormat::BC7_UNORM);
+			}
+			g_JobSystem.ParallelFor((uint32)compression_jobs.size(), 1, [&](uint32 begin, uint32 end)
+				{
+					for (uint32 i = begin; i < end; ++i)
+					{
+						TextureCompressionJob& job = compression_jobs[i];
+						job.compressed_path = CompressTexture(*job.path, job.format, job.stats);
+					}
+				});
+
+			TextureCompressionStats model_stats{};
+			for (TextureCompressionJob const& job : compression_jobs)
+			{
+				if (!job.compressed_path.empty()) compressed_texture_paths[*job.path] = job.compressed_path;
+				model_stats += job.stats;
+			}
+			texture_compression_stats += model_stats;
+			ADRIA_LOG(INFO, "GLTF Model %s textures: %u encoded, %u from the texture cache, %.1f MB uncompressed, %.1f MB compressed, in %.2f ms",
+				params.model_path.c_str(), model_stats.encoded_count, model_stats.cached_count, model_stats.uncompressed_bytes / (1024.0f * 1024.0f),
+				model_stats.compressed_bytes / (1024.0f * 1024.0f), compression_timer.ElapsedInSeconds() * 1000.0f);
+		}
+
+		auto LoadTexture = [&compressed_texture_paths](std::string const& texture_path, TextureHandle default_texture)
+		{
+			if (texture_path.empty()) return default_texture;
+			auto compressed_path = compressed_texture_paths.find(texture_path);
+			return g_TextureManager.LoadTexture(compressed_path != compressed_texture_paths.end() ? compressed_path->second : texture_path, true, default_texture);
+		};
+		mesh.materials.reserve(cooked_mesh.materials.size());
+		for (CookedMaterial const& cooked_material : cooked_mesh.materials)
+		{
+			Material& material = mesh.materials.emplace_back(cooked_material.material);
+			material.albedo_texture = LoadTexture(cooked_material.albedo_texture, DEFAULT_WHITE_TEXTURE_HANDLE);
+			material.metallic_roughness_texture = LoadTexture(cooked_material.metallic_roughness_texture, DEFAULT_METALLIC_ROUGHNESS_TEXTURE_HANDLE);
+			material.normal_texture = LoadTexture(cooked_material.normal_texture, DEFAULT_NORMAL_TEXTURE_HANDLE);
+			material.emissive_texture = LoadTexture(cooked_material.emissive_texture, DEFAULT_BLACK_TEXTURE_HANDLE);
+		}
+
+		mesh.submeshes = cooked_mesh.submeshes;
+		mesh.geometry_buffer_handle = g_GeometryBufferCache.CreateAndInitializeGeometryBuffer(cooked_mesh.geometry.data(), cooked_mesh.geometry.size());
+
+		mesh.instances.reserve(cooked_mesh.instances.size());
+		for (CookedMeshInstance const& cooked_instance : cooked_mesh.instances)
+		{
+			SubMeshInstance& instance = mesh.instances.emplace_back();
+			instance.submesh_index = cooked_instance.submesh_index;
+			instance.world_transform = cooked_instance.local_to_world * params.model_matrix;
+			instance.parent = mesh_entity;
+		}
+
+		reg.emplace<Mesh>(mesh_entity, std::move(mesh));
+		reg.emplace<Tag>(mesh_entity, GetFilename(params.model_path) + " mesh");
+
+		if (gfx->GetCapabilities().SupportsRayTracing()) reg.emplace<RayTracing>(mesh_entity);
+		return mesh_entity;
+	}
 }
\ No newline at end of file
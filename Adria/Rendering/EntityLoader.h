@@ -6,6 +6,7 @@
 #include "Components.h"
 #include "Math/NormalsUtil.h"
 #include "Utilities/Heightmap.h"
+#include "TextureCompressor.h"
 #include "entt/entity/registry.hpp"
 
 namespace adria
@@ -69,11 +70,13 @@ namespace adria
 	};
 
     class GfxDevice;
+	struct CookedMeshData;
  
 	class EntityLoader
 	{
 		ADRIA_NODISCARD std::vector<entt::entity> LoadGrid(GridParameters const&);
 		ADRIA_NODISCARD std::vector<entt::entity> LoadObjMesh(std::string const&);
+		entt::entity CreateModelEntity(ModelParameters const&, CookedMeshData const&);
 	public:
         
         EntityLoader(entt::registry& reg, GfxDevice* device);
@@ -84,9 +87,14 @@ namespace adria
 		ADRIA_MAYBE_UNUSED std::vector<entt::entity> LoadOcean(OceanParameters const&);
 		ADRIA_MAYBE_UNUSED entt::entity LoadDecal(DecalParameters const&);
 		ADRIA_MAYBE_UNUSED entt::entity ImportModel_GLTF(ModelParameters const&);
+
+		//texture compression of all models imported since the last reset
+		TextureCompressionStats const& GetTextureCompressionStats() const { return texture_compression_stats; }
+		void ResetTextureCompressionStats() { texture_compression_stats = {}; }
 	private:
         entt::registry& reg;
         GfxDevice* gfx;
+		TextureCompressionStats texture_compression_stats;
 	};
 }
 
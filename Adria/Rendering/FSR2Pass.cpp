@@ -21,10 +21,10 @@ namespace adria
 			switch (type)
 			{
 			case FFX_MESSAGE_TYPE_WARNING:
-				ADRIA_LOG(WARNING, msg.c_str());
+				ADRIA_LOG(WARNING, "%s", msg.c_str());
 				break;
 			case FFX_MESSAGE_TYPE_ERROR:
-				ADRIA_LOG(ERROR, msg.c_str());
+				ADRIA_LOG(ERROR, "%s", msg.c_str());
 				break;
 			default:
 				break;
@@ -0,0 +1,296 @@
+#include <random>
+#include <intrin.h>
+#include "FrustumCuller.h"
+#include "Core/ConsoleManager.h"
+#include "Logging/Logger.h"
+#include "Utilities/JobSystem.h"
+#include "Utilities/Timer.h"
+
+using namespace DirectX;
+
+namespace adria
+{
+	namespace
+	{
+		constexpr uint32 InstancesPerWord = 64;
+		constexpr uint32 WordsPerBatch = 64;
+		constexpr uint32 NearPlane = 4;
+
+		struct FrustumPlanes
+		{
+			float nx[6];
+			float ny[6];
+			float nz[6];
+			float d[6];
+		};
+
+		//planes of the clip volume of a row vector matrix (v * M) in the order left, right, bottom, top, near, far,
+		//points inside satisfy dot(n, p) + d >= 0
+		FrustumPlanes ExtractFrustumPlanes(Matrix const& m)
+		{
+			Vector4 const c0(m._11, m._21, m._31, m._41);
+			Vector4 const c1(m._12, m._22, m._32, m._42);
+			Vector4 const c2(m._13, m._23, m._33, m._43);
+			Vector4 const c3(m._14, m._24, m._34, m._44);
+			Vector4 const planes[6] = { c3 + c0, c3 - c0, c3 + c1, c3 - c1, c2, c3 - c2 };
+
+			FrustumPlanes frustum_planes{};
+			for (uint32 i = 0; i < 6; ++i)
+			{
+				frustum_planes.nx[i] = planes[i].x;
+				frustum_planes.ny[i] = planes[i].y;
+				frustum_planes.nz[i] = planes[i].z;
+				frustum_planes.d[i]  = planes[i].w;
+			}
+			return frustum_planes;
+		}
+
+		bool IsAVX2Supported()
+		{
+			int32 cpu_info[4];
+			__cpuid(cpu_info, 0);
+			if (cpu_info[0] < 7) return false;
+
+			__cpuid(cpu_info, 1);
+			bool const osxsave = (cpu_info[2] & (1 << 27)) != 0;
+			bool const avx = (cpu_info[2] & (1 << 28)) != 0;
+			if (!osxsave || !avx) return false;
+			if ((_xgetbv(0) & 0x6) != 0x6) return false;
+
+			__cpuidex(cpu_info, 7, 0);
+			return (cpu_info[1] & (1 << 5)) != 0;
+		}
+
+		struct CullInput
+		{
+			float const* center_x;
+			float const* center_y;
+			float const* center_z;
+			float const* extent_x;
+			float const* extent_y;
+			float const* extent_z;
+		};
+
+		void CullWords_AVX2(CullInput const& input, FrustumPlanes const& planes, uint64* words, uint32 word_begin, uint32 word_end)
+		{
+			__m256 const zero = _mm256_setzero_ps();
+			__m256 const abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+			__m256 nx[6], ny[6], nz[6], abs_nx[6], abs_ny[6], abs_nz[6], d[6];
+			for (uint32 p = 0; p < 6; ++p)
+			{
+				nx[p] = _mm256_set1_ps(planes.nx[p]);
+				ny[p] = _mm256_set1_ps(planes.ny[p]);
+				nz[p] = _mm256_set1_ps(planes.nz[p]);
+				abs_nx[p] = _mm256_and_ps(nx[p], abs_mask);
+				abs_ny[p] = _mm256_and_ps(ny[p], abs_mask);
+				abs_nz[p] = _mm256_and_ps(nz[p], abs_mask);
+				d[p] = _mm256_set1_ps(planes.d[p]);
+			}
+
+			for (uint32 word = word_begin; word < word_end; ++word)
+			{
+				uint64 word_bits = 0;
+				for (uint32 lane = 0; lane < InstancesPerWord; lane += 8)
+				{
+					uint32 const i = word * InstancesPerWord + lane;
+					__m256 const cx = _mm256_loadu_ps(input.center_x + i);
+					__m256 const cy = _mm256_loadu_ps(input.center_y + i);
+					__m256 const cz = _mm256_loadu_ps(input.center_z + i);
+					__m256 const ex = _mm256_loadu_ps(input.extent_x + i);
+					__m256 const ey = _mm256_loadu_ps(input.extent_y + i);
+					__m256 const ez = _mm256_loadu_ps(input.extent_z + i);
+
+					__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+					for (uint32 p = 0; p < 6; ++p)
+					{
+						__m256 distance = _mm256_add_ps(_mm256_mul_ps(cx, nx[p]), d[p]);
+						distance = _mm256_add_ps(distance, _mm256_mul_ps(cy, ny[p]));
+						distance = _mm256_add_ps(distance, _mm256_mul_ps(cz, nz[p]));
+						distance = _mm256_add_ps(distance, _mm256_mul_ps(ex, abs_nx[p]));
+						distance = _mm256_add_ps(distance, _mm256_mul_ps(ey, abs_ny[p]));
+						distance = _mm256_add_ps(distance, _mm256_mul_ps(ez, abs_nz[p]));
+						inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, zero, _CMP_GE_OQ));
+					}
+					word_bits |= uint64(_mm256_movemask_ps(inside)) << lane;
+				}
+				words[word] = word_bits;
+			}
+			_mm256_zeroupper();
+		}
+
+		void CullWords_SSE(CullInput const& input, FrustumPlanes const& planes, uint64* words, uint32 word_begin, uint32 word_end)
+		{
+			__m128 const zero = _mm_setzero_ps();
+			__m128 const abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+			__m128 nx[6], ny[6], nz[6], abs_nx[6], abs_ny[6], abs_nz[6], d[6];
+			for (uint32 p = 0; p < 6; ++p)
+			{
+				nx[p] = _mm_set1_ps(planes.nx[p]);
+				ny[p] = _mm_set1_ps(planes.ny[p]);
+				nz[p] = _mm_set1_ps(planes.nz[p]);
+				abs_nx[p] = _mm_and_ps(nx[p], abs_mask);
+				abs_ny[p] = _mm_and_ps(ny[p], abs_mask);
+				abs_nz[p] = _mm_and_ps(nz[p], abs_mask);
+				d[p] = _mm_set1_ps(planes.d[p]);
+			}
+
+			for (uint32 word = word_begin; word < word_end; ++word)
+			{
+				uint64 word_bits = 0;
+				for (uint32 lane = 0; lane < InstancesPerWord; lane += 4)
+				{
+					uint32 const i = word * InstancesPerWord + lane;
+					__m128 const cx = _mm_loadu_ps(input.center_x + i);
+					__m128 const cy = _mm_loadu_ps(input.center_y + i);
+					__m128 const cz = _mm_loadu_ps(input.center_z + i);
+					__m128 const ex = _mm_loadu_ps(input.extent_x + i);
+					__m128 const ey = _mm_loadu_ps(input.extent_y + i);
+					__m128 const ez = _mm_loadu_ps(input.extent_z + i);
+
+					__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+					for (uint32 p = 0; p < 6; ++p)
+					{
+						__m128 distance = _mm_add_ps(_mm_mul_ps(cx, nx[p]), d[p]);
+						distance = _mm_add_ps(distance, _mm_mul_ps(cy, ny[p]));
+						distance = _mm_add_ps(distance, _mm_mul_ps(cz, nz[p]));
+						distance = _mm_add_ps(distance, _mm_mul_ps(ex, abs_nx[p]));
+						distance = _mm_add_ps(distance, _mm_mul_ps(ey, abs_ny[p]));
+						distance = _mm_add_ps(distance, _mm_mul_ps(ez, abs_nz[p]));
+						inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, zero));
+					}
+					word_bits |= uint64(_mm_movemask_ps(inside)) << lane;
+				}
+				words[word] = word_bits;
+			}
+		}
+
+		//culls random boxes against a camera frustum with the previous per batch BoundingFrustum::Intersects loop and with the SoA culler
+		void FrustumCullingBenchmark()
+		{
+			constexpr uint32 InstanceCounts[] = { 10000, 100000, 1000000 };
+			constexpr uint32 IterationCount = 10;
+
+			Matrix const view = XMMatrixLookAtLH(Vector3(0.0f, 0.0f, 0.0f), Vector3(0.0f, 0.0f, 1.0f), Vector3(0.0f, 1.0f, 0.0f));
+			Matrix const projection = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 1000.0f);
+			BoundingFrustum camera_frustum(projection);
+			camera_frustum.Transform(camera_frustum, view.Invert());
+
+			std::mt19937 random_engine(42);
+			std::uniform_real_distribution<float> center_distribution(-1000.0f, 1000.0f);
+			std::uniform_real_distribution<float> extent_distribution(0.5f, 5.0f);
+			for (uint32 instance_count : InstanceCounts)
+			{
+				std::vector<BoundingBox> bounding_boxes(instance_count);
+				FrustumCuller culler;
+				culler.Resize(instance_count);
+				for (uint32 i = 0; i < instance_count; ++i)
+				{
+					bounding_boxes[i].Center = Vector3(center_distribution(random_engine), center_distribution(random_engine), center_distribution(random_engine));
+					bounding_boxes[i].Extents = Vector3(extent_distribution(random_engine), extent_distribution(random_engine), extent_distribution(random_engine));
+					culler.SetBounds(i, bounding_boxes[i]);
+				}
+
+				std::vector<bool> intersects(instance_count);
+				VisibilityMask visibility;
+				float scalar_ms = 0.0f, simd_ms = 0.0f, parallel_ms = 0.0f;
+				for (uint32 iteration = 0; iteration < IterationCount; ++iteration)
+				{
+					Timer<std::chrono::microseconds> timer;
+					for (uint32 i = 0; i < instance_count; ++i) intersects[i] = camera_frustum.Intersects(bounding_boxes[i]);
+					scalar_ms += timer.Mark() / 1000.0f;
+					culler.Cull(view * projection, visibility, FrustumCullFlags::None);
+					simd_ms += timer.Mark() / 1000.0f;
+					culler.Cull(view * projection, visibility, FrustumCullFlags::Parallel);
+					parallel_ms += timer.Mark() / 1000.0f;
+				}
+				scalar_ms /= IterationCount, simd_ms /= IterationCount, parallel_ms /= IterationCount;
+
+				uint32 scalar_visible_count = 0;
+				for (bool visible : intersects) scalar_visible_count += visible;
+				auto InstancesPerMs = [instance_count](float ms) { return ms > 0.0f ? instance_count / ms : 0.0f; };
+				ADRIA_LOG(INFO, "Frustum culling (%u instances, %u/%u visible): BoundingFrustum %.3f ms (%.0f instances/ms), %s %.3f ms (%.0f instances/ms), %s parallel %.3f ms (%.0f instances/ms)",
+					instance_count, visibility.GetVisibleCount(), scalar_visible_count,
+					scalar_ms, InstancesPerMs(scalar_ms),
+					FrustumCuller::UsesAVX2() ? "AVX2" : "SSE", simd_ms, InstancesPerMs(simd_ms),
+					FrustumCuller::UsesAVX2() ? "AVX2" : "SSE", parallel_ms, InstancesPerMs(parallel_ms));
+			}
+		}
+		AutoConsoleCommand frustum_culling_benchmark("r.Culling.Benchmark", "Times frustum culling of 10k, 100k and 1M instances with BoundingFrustum and with the SIMD culler and logs instances culled per millisecond",
+			ConsoleCommandDelegate::CreateStatic(FrustumCullingBenchmark));
+	}
+
+	void FrustumCuller::Resize(uint32 _count)
+	{
+		count = _count;
+		//padded to whole mask words, padding bits are cleared after culling
+		uint32 const padded_count = (count + InstancesPerWord - 1) / InstancesPerWord * InstancesPerWord;
+		center_x.assign(padded_count, 0.0f);
+		center_y.assign(padded_count, 0.0f);
+		center_z.assign(padded_count, 0.0f);
+		extent_x.assign(padded_count, 0.0f);
+		extent_y.assign(padded_count, 0.0f);
+		extent_z.assign(padded_count, 0.0f);
+	}
+
+	void FrustumCuller::SetBounds(uint32 index, BoundingBox const& bounding_box)
+	{
+		ADRIA_ASSERT(index < count);
+		center_x[index] = bounding_box.Center.x;
+		center_y[index] = bounding_box.Center.y;
+		center_z[index] = bounding_box.Center.z;
+		extent_x[index] = bounding_box.Extents.x;
+		extent_y[index] = bounding_box.Extents.y;
+		extent_z[index] = bounding_box.Extents.z;
+	}
+
+	BoundingBox FrustumCuller::GetBounds(uint32 index) const
+	{
+		ADRIA_ASSERT(index < count);
+		return BoundingBox(Vector3(center_x[index], center_y[index], center_z[index]), Vector3(extent_x[index], extent_y[index], extent_z[index]));
+	}
+
+	void FrustumCuller::Cull(Matrix const& view_projection, VisibilityMask& visibility, FrustumCullFlags flags) const
+	{
+		visibility.Resize(count);
+		if (count == 0) return;
+
+		FrustumPlanes planes = ExtractFrustumPlanes(view_projection);
+		if (HasFlag(flags, FrustumCullFlags::InfiniteNear))
+		{
+			planes.nx[NearPlane] = planes.ny[NearPlane] = planes.nz[NearPlane] = 0.0f;
+			planes.d[NearPlane] = 1.0f;
+		}
+		CullInput const input{ center_x.data(), center_y.data(), center_z.data(), extent_x.data(), extent_y.data(), extent_z.data() };
+		uint64* words = visibility.GetWords();
+		uint32 const word_count = visibility.GetWordCount();
+
+		auto CullWords = [&](uint32 word_begin, uint32 word_end)
+		{
+			if (UsesAVX2()) CullWords_AVX2(input, planes, words, word_begin, word_end);
+			else CullWords_SSE(input, planes, words, word_begin, word_end);
+		};
+		if (HasFlag(flags, FrustumCullFlags::Parallel)) g_JobSystem.ParallelFor(word_count, WordsPerBatch, CullWords);
+		else CullWords(0, word_count);
+
+		if (uint32 const tail = count % InstancesPerWord; tail != 0) words[word_count - 1] &= (1ull << tail) - 1;
+	}
+
+	bool FrustumCuller::Intersects(Matrix const& view_projection, BoundingBox const& bounding_box, FrustumCullFlags flags)
+	{
+		FrustumPlanes const planes = ExtractFrustumPlanes(view_projection);
+		for (uint32 p = 0; p < 6; ++p)
+		{
+			if (p == NearPlane && HasFlag(flags, FrustumCullFlags::InfiniteNear)) continue;
+			float const distance = bounding_box.Center.x * planes.nx[p] + bounding_box.Center.y * planes.ny[p] + bounding_box.Center.z * planes.nz[p] + planes.d[p];
+			float const radius = bounding_box.Extents.x * std::abs(planes.nx[p]) + bounding_box.Extents.y * std::abs(planes.ny[p]) + bounding_box.Extents.z * std::abs(planes.nz[p]);
+			if (distance + radius < 0.0f) return false;
+		}
+		return true;
+	}
+
+	bool FrustumCuller::UsesAVX2()
+	{
+		static bool const avx2_supported = IsAVX2Supported();
+		return avx2_supported;
+	}
+}
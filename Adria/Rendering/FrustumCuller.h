@@ -0,0 +1,73 @@
+#pragma once
+#include <vector>
+#include <bit>
+#include "Utilities/EnumUtil.h"
+
+namespace adria
+{
+	//one bit per instance, indexed by instance id
+	class VisibilityMask
+	{
+	public:
+		void Resize(uint32 count)
+		{
+			bit_count = count;
+			words.assign((count + 63) / 64, 0ull);
+		}
+		//instances outside of the mask were never culled
+		bool IsVisible(uint32 index) const
+		{
+			if (index >= bit_count) return true;
+			return (words[index >> 6] >> (index & 63)) & 1ull;
+		}
+		uint32 GetVisibleCount() const
+		{
+			uint32 visible_count = 0;
+			for (uint64 word : words) visible_count += (uint32)std::popcount(word);
+			return visible_count;
+		}
+		uint32 GetCount() const { return bit_count; }
+
+		uint64* GetWords() { return words.data(); }
+		uint32  GetWordCount() const { return (uint32)words.size(); }
+
+	private:
+		std::vector<uint64> words;
+		uint32 bit_count = 0;
+	};
+
+	enum class FrustumCullFlags : uint8
+	{
+		None = 0x00,
+		Parallel = 0x01,		//splits the culling across the thread pool
+		InfiniteNear = 0x02,	//keeps everything in front of the near plane, e.g. shadow casters between a directional light and its cascade
+	};
+	ENABLE_ENUM_BIT_OPERATORS(FrustumCullFlags);
+
+	//Instance bounds stored as structure of arrays (centers and extents), culled 8 at a time with AVX2 or 4 at a time
+	//with SSE when AVX2 is not available. Every 64 instances produce one word of the visibility mask, so the culling
+	//is split across the thread pool in runs of whole words.
+	class FrustumCuller
+	{
+	public:
+		FrustumCuller() = default;
+
+		void Resize(uint32 count);
+		void SetBounds(uint32 index, BoundingBox const& bounding_box);
+		BoundingBox GetBounds(uint32 index) const;
+		void Cull(Matrix const& view_projection, VisibilityMask& visibility, FrustumCullFlags flags = FrustumCullFlags::Parallel) const;
+
+		uint32 GetCount() const { return count; }
+		static bool Intersects(Matrix const& view_projection, BoundingBox const& bounding_box, FrustumCullFlags flags = FrustumCullFlags::None);
+		static bool UsesAVX2();
+
+	private:
+		std::vector<float> center_x;
+		std::vector<float> center_y;
+		std::vector<float> center_z;
+		std::vector<float> extent_x;
+		std::vector<float> extent_y;
+		std::vector<float> extent_z;
+		uint32 count = 0;
+	};
+}
@@ -3,6 +3,7 @@
 #include "ShaderStructs.h"
 #include "Components.h"
 #include "BlackboardData.h"
+#include "FrustumCuller.h"
 #include "ShaderManager.h"
 #include "Graphics/GfxReflection.h"
 #include "Graphics/GfxTracyProfiler.h"
@@ -24,9 +25,10 @@ namespace adria
 
 	GBufferPass::~GBufferPass() = default;
 
-	void GBufferPass::AddPass(RenderGraph& rg)
+	void GBufferPass::AddPass(RenderGraph& rg, VisibilityMask const& camera_visibility)
 	{
 		FrameBlackboardData const& frame_data = rg.GetBlackboard().Get<FrameBlackboardData>();
+		VisibilityMask const* visibility = &camera_visibility;
 		rg.AddPass<void>("GBuffer Pass",
 			[=](RenderGraphBuilder& builder)
 			{
@@ -52,6 +54,7 @@ namespace adria
 				builder.DeclareTexture(RG_NAME(DepthStencil), depth_desc);
 				builder.WriteDepthStencil(RG_NAME(DepthStencil), RGLoadStoreAccessOp::Clear_Preserve);
 				builder.SetViewport(width, height);
+				if (builder.IsBufferDeclared(RG_NAME(MipFeedbackBuffer))) std::ignore = builder.WriteBuffer(RG_NAME(MipFeedbackBuffer));
 			},
 			[=](RenderGraphContext& context, GfxCommandList* cmd_list)
 			{
@@ -79,7 +82,7 @@ namespace adria
 				for (auto batch_entity : batch_view)
 				{
 					Batch& batch = batch_view.get<Batch>(batch_entity);
-					if (!batch.camera_visibility) continue;
+					if (!visibility->IsVisible(batch.instance_id)) continue;
 
 					GfxPipelineState* pso = GetPSO(batch.alpha_mode);
 					if (use_rain_pso) pso = gbuffer_psos->Get<4>();
@@ -7,6 +7,7 @@ namespace adria
 {
 	class GfxDevice;
 	class RenderGraph;
+	class VisibilityMask;
 
 	class GBufferPass
 	{
@@ -14,7 +15,7 @@ namespace adria
 		GBufferPass(entt::registry& reg, GfxDevice* gfx, uint32 w, uint32 h);
 		~GBufferPass();
 
-		void AddPass(RenderGraph& rendergraph);
+		void AddPass(RenderGraph& rendergraph, VisibilityMask const& camera_visibility);
 		void OnResize(uint32 w, uint32 h);
 
 		void OnRainEvent(bool enabled)
@@ -303,7 +303,7 @@ namespace adria
 							}
 						}
 					}
-					ADRIA_LOG(DEBUG, fmt.c_str());
+					ADRIA_LOG(DEBUG, "%s", fmt.c_str());
 				}
 			}, RGPassType::Copy, RGPassFlags::ForceNoCull);
 	}
@@ -541,6 +541,7 @@ namespace adria
 
 				data.visible_meshlets = builder.ReadBuffer(RG_NAME(VisibleMeshlets));
 				data.draw_args = builder.ReadIndirectArgsBuffer(RG_NAME(MeshletDrawArgs));
+				if (builder.IsBufferDeclared(RG_NAME(MipFeedbackBuffer))) std::ignore = builder.WriteBuffer(RG_NAME(MipFeedbackBuffer));
 			},
 			[=](DrawMeshletsPassData const& data, RenderGraphContext& ctx, GfxCommandList* cmd_list)
 			{
@@ -831,6 +832,7 @@ namespace adria
 
 				data.visible_meshlets = builder.ReadBuffer(RG_NAME(VisibleMeshlets));
 				data.draw_args = builder.ReadIndirectArgsBuffer(RG_NAME(MeshletDrawArgs));
+				if (builder.IsBufferDeclared(RG_NAME(MipFeedbackBuffer))) std::ignore = builder.WriteBuffer(RG_NAME(MipFeedbackBuffer));
 			},
 			[=](DrawMeshletsPassData const& data, RenderGraphContext& ctx, GfxCommandList* cmd_list)
 			{
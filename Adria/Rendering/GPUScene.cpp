@@ -0,0 +1,407 @@
+#include <algorithm>
+#include "GPUScene.h"
+#include "Components.h"
+#include "TextureManager.h"
+#include "GeometryBufferCache.h"
+#include "Graphics/GfxBuffer.h"
+#include "Graphics/GfxDevice.h"
+#include "Graphics/GfxCommandList.h"
+#include "Graphics/GfxLinearDynamicAllocator.h"
+#include "Core/CpuProfiler.h"
+#include "Logging/Logger.h"
+#include "Utilities/Timer.h"
+
+namespace adria
+{
+	namespace
+	{
+		void PackInstance(InstanceGPU& instance_hlsl, uint32 instance_id, Matrix const& world_transform, BoundingBox const& bounding_box)
+		{
+			instance_hlsl.instance_id = instance_id;
+			instance_hlsl.world_matrix = world_transform;
+			instance_hlsl.inverse_world_matrix = XMMatrixInverse(nullptr, world_transform);
+			instance_hlsl.bb_origin = bounding_box.Center;
+			instance_hlsl.bb_extents = bounding_box.Extents;
+		}
+	}
+
+	GPUScene::GPUScene(entt::registry& reg, GfxDevice* gfx) : reg(reg), gfx(gfx), mesh_observer(reg, entt::collector.update<Mesh>())
+	{
+		reg.on_construct<Mesh>().connect<&GPUScene::OnMeshAddedOrRemoved>(this);
+		reg.on_destroy<Mesh>().connect<&GPUScene::OnMeshAddedOrRemoved>(this);
+	}
+
+	GPUScene::~GPUScene()
+	{
+		reg.on_construct<Mesh>().disconnect<&GPUScene::OnMeshAddedOrRemoved>(this);
+		reg.on_destroy<Mesh>().disconnect<&GPUScene::OnMeshAddedOrRemoved>(this);
+		for (SceneBuffer& scene_buffer : scene_buffers)
+		{
+			if (scene_buffer.buffer_srv.IsValid()) gfx->FreeDescriptorCPU(scene_buffer.buffer_srv, GfxDescriptorHeapType::CBV_SRV_UAV);
+		}
+	}
+
+	void GPUScene::RunBenchmark(GfxDevice* gfx)
+	{
+		constexpr uint32 InstanceCounts[] = { 1000, 10000, 100000 };
+		constexpr uint32 InstancesPerMesh = 250;
+		constexpr uint32 IterationCount = 5;
+		constexpr float DirtyFraction = 0.01f;
+
+		//the update only reads the address and the SRV of the geometry buffer, all meshes share an empty one
+		ArcGeometryBufferHandle geometry_buffer = g_GeometryBufferCache.CreateAndInitializeGeometryBuffer(nullptr, 256);
+		GfxCommandList* cmd_list = gfx->GetCommandList();
+		Matrix const light_transform = Matrix::Identity;
+		for (uint32 instance_count : InstanceCounts)
+		{
+			entt::registry reg;
+			uint32 const mesh_count = (instance_count + InstancesPerMesh - 1) / InstancesPerMesh;
+			std::vector<entt::entity> mesh_entities(mesh_count);
+			for (uint32 mesh_index = 0; mesh_index < mesh_count; ++mesh_index)
+			{
+				Mesh mesh{};
+				mesh.geometry_buffer_handle = geometry_buffer;
+				mesh.materials.emplace_back();
+				mesh.submeshes.emplace_back().bounding_box = BoundingBox(Vector3(0.0f, 0.0f, 0.0f), Vector3(1.0f, 1.0f, 1.0f));
+				uint32 const first_instance = mesh_index * InstancesPerMesh;
+				for (uint32 i = first_instance; i < std::min(first_instance + InstancesPerMesh, instance_count); ++i)
+				{
+					mesh.instances.push_back(SubMeshInstance{ .parent = entt::null, .submesh_index = 0, .world_transform = Matrix::CreateTranslation(float(i % 1000), float(i / 1000), 0.0f) });
+				}
+				mesh_entities[mesh_index] = reg.create();
+				reg.emplace<Mesh>(mesh_entities[mesh_index], std::move(mesh));
+			}
+
+			GPUScene gpu_scene(reg, gfx);
+			auto TimeFrame = [&](auto&& ChangeScene)
+			{
+				Timer<std::chrono::microseconds> timer;
+				ChangeScene();
+				gpu_scene.Update(light_transform);
+				gpu_scene.Upload(cmd_list);
+				gpu_scene.EndFrame();
+				return timer.Mark() / 1000.0f;
+			};
+			TimeFrame([]() {});
+
+			uint32 const patched_mesh_count = std::max(1u, static_cast<uint32>(mesh_count * DirtyFraction));
+			uint32 const moved_instance_count = std::max(1u, static_cast<uint32>(instance_count * DirtyFraction));
+			float rebuild_ms = 0.0f, patch_ms = 0.0f, move_ms = 0.0f;
+			for (uint32 iteration = 0; iteration < IterationCount; ++iteration)
+			{
+				rebuild_ms += TimeFrame([&]() { gpu_scene.structure_dirty = true; });
+				patch_ms += TimeFrame([&]()
+					{
+						for (uint32 i = 0; i < patched_mesh_count; ++i)
+						{
+							entt::entity mesh_entity = mesh_entities[(uint64(i) * 2654435761u + iteration) % mesh_count];
+							reg.patch<Mesh>(mesh_entity, [](Mesh& mesh)
+								{
+									for (SubMeshInstance& instance : mesh.instances) instance.world_transform *= Matrix::CreateTranslation(0.0f, 0.0f, 1.0f);
+								});
+						}
+					});
+				move_ms += TimeFrame([&]()
+					{
+						for (uint32 i = 0; i < moved_instance_count; ++i)
+						{
+							uint32 const instance_id = static_cast<uint32>((uint64(i) * 2654435761u + iteration) % instance_count);
+							gpu_scene.SetInstanceTransform(instance_id, Matrix::CreateTranslation(float(i), float(iteration), 1.0f));
+						}
+					});
+			}
+			ADRIA_LOG(INFO, "GPU scene (%u instances, %u meshes): Rebuild %.3f ms, patch<Mesh> of %u meshes %.3f ms, SetInstanceTransform of %u instances %.3f ms",
+				instance_count, mesh_count, rebuild_ms / IterationCount, patched_mesh_count, patch_ms / IterationCount, moved_instance_count, move_ms / IterationCount);
+		}
+	}
+
+	void GPUScene::Update(Matrix const& light_transform)
+	{
+		AdriaCpuProfileScope("GPUScene::Update");
+		if (!structure_dirty)
+		{
+			for (entt::entity mesh_entity : mesh_observer) UpdateMesh(mesh_entity);
+		}
+		mesh_observer.clear();
+		if (structure_dirty) Rebuild();
+
+		UpdateLights(light_transform);
+		UpdateMeshDescriptors();
+
+		ReserveBuffer<LightGPU>(GPUSceneBuffer_Light, lights.size());
+		ReserveBuffer<MeshGPU>(GPUSceneBuffer_Mesh, meshes.size());
+		ReserveBuffer<MaterialGPU>(GPUSceneBuffer_Material, materials.size());
+		ReserveBuffer<InstanceGPU>(GPUSceneBuffer_Instance, instances.size());
+	}
+
+	void GPUScene::Upload(GfxCommandList* cmd_list)
+	{
+		AdriaCpuProfileScope("GPUScene::Upload");
+		std::vector<uint32> no_dirty_elements;
+		UploadBuffer(cmd_list, GPUSceneBuffer_Light, lights, no_dirty_elements);
+		UploadBuffer(cmd_list, GPUSceneBuffer_Mesh, meshes, no_dirty_elements);
+		UploadBuffer(cmd_list, GPUSceneBuffer_Material, materials, dirty_materials);
+		UploadBuffer(cmd_list, GPUSceneBuffer_Instance, instances, dirty_instances);
+		cmd_list->FlushBarriers();
+
+		for (uint32 material_index : dirty_materials) material_dirty[material_index] = false;
+		for (uint32 instance_index : dirty_instances) instance_dirty[instance_index] = false;
+		dirty_materials.clear();
+		dirty_instances.clear();
+		full_upload.fill(false);
+	}
+
+	void GPUScene::EndFrame()
+	{
+		instance_changes.clear();
+	}
+
+	void GPUScene::SetInstanceTransform(uint32 instance_index, Matrix const& world_transform)
+	{
+		ADRIA_ASSERT(instance_index < instance_sources.size());
+		GPUSceneInstanceSource const& source = instance_sources[instance_index];
+		Mesh& mesh = reg.get<Mesh>(source.mesh_entity);
+		mesh.instances[source.mesh_instance_index].world_transform = world_transform;
+		UpdateInstance(instance_index);
+	}
+
+	void GPUScene::OnMeshAddedOrRemoved(entt::registry&, entt::entity)
+	{
+		structure_dirty = true;
+	}
+
+	void GPUScene::Rebuild()
+	{
+		for (auto e : reg.view<Batch>()) reg.destroy(e);
+		reg.clear<Batch>();
+
+		meshes.clear();
+		materials.clear();
+		instances.clear();
+		instance_batches.clear();
+		instance_sources.clear();
+		mesh_ranges.clear();
+
+		for (auto mesh_entity : reg.view<Mesh>())
+		{
+			Mesh& mesh = reg.get<Mesh>(mesh_entity);
+			MeshRange& range = mesh_ranges[mesh_entity];
+			range.first_instance = (uint32)instances.size();
+			range.instance_count = (uint32)mesh.instances.size();
+			range.first_mesh = (uint32)meshes.size();
+			range.mesh_count = (uint32)mesh.submeshes.size();
+			range.first_material = (uint32)materials.size();
+			range.material_count = (uint32)mesh.materials.size();
+
+			meshes.resize(meshes.size() + range.mesh_count);
+			materials.resize(materials.size() + range.material_count);
+			instances.resize(instances.size() + range.instance_count);
+			for (uint32 i = 0; i < range.instance_count; ++i)
+			{
+				instance_batches.push_back(reg.create());
+				reg.emplace<Batch>(instance_batches.back());
+				instance_sources.push_back(GPUSceneInstanceSource{ .mesh_entity = mesh_entity, .mesh_instance_index = i });
+			}
+		}
+
+		instance_culler.Resize((uint32)instances.size());
+		instance_dirty.assign(instances.size(), false);
+		material_dirty.assign(materials.size(), false);
+		dirty_instances.clear();
+		dirty_materials.clear();
+		full_upload.fill(true);
+		for (auto const& [mesh_entity, range] : mesh_ranges) UpdateMesh(mesh_entity);
+		instance_changes.clear();
+		++structure_version;
+		structure_dirty = false;
+	}
+
+	void GPUScene::UpdateMesh(entt::entity mesh_entity)
+	{
+		Mesh& mesh = reg.get<Mesh>(mesh_entity);
+		MeshRange const& range = mesh_ranges[mesh_entity];
+		if (range.instance_count != mesh.instances.size() || range.mesh_count != mesh.submeshes.size() || range.material_count != mesh.materials.size())
+		{
+			structure_dirty = true;
+			return;
+		}
+
+		GfxBuffer* mesh_buffer = g_GeometryBufferCache.GetGeometryBuffer(mesh.geometry_buffer_handle);
+		for (uint32 i = 0; i < range.mesh_count; ++i)
+		{
+			SubMeshGPU& submesh = mesh.submeshes[i];
+			submesh.buffer_address = mesh_buffer->GetGpuAddress();
+
+			MeshGPU& mesh_hlsl = meshes[range.first_mesh + i];
+			mesh_hlsl.indices_offset = submesh.indices_offset;
+			mesh_hlsl.positions_offset = submesh.positions_offset;
+			mesh_hlsl.normals_offset = submesh.normals_offset;
+			mesh_hlsl.tangents_offset = submesh.tangents_offset;
+			mesh_hlsl.uvs_offset = submesh.uvs_offset;
+
+			mesh_hlsl.meshlet_offset = submesh.meshlet_offset;
+			mesh_hlsl.meshlet_vertices_offset = submesh.meshlet_vertices_offset;
+			mesh_hlsl.meshlet_triangles_offset = submesh.meshlet_triangles_offset;
+			mesh_hlsl.meshlet_count = submesh.meshlet_count;
+		}
+		for (uint32 i = 0; i < range.material_count; ++i) UpdateMaterial(range.first_material + i, mesh.materials[i]);
+		for (uint32 i = 0; i < range.instance_count; ++i) UpdateInstance(range.first_instance + i);
+	}
+
+	void GPUScene::UpdateInstance(uint32 instance_index)
+	{
+		GPUSceneInstanceSource const& source = instance_sources[instance_index];
+		Mesh& mesh = reg.get<Mesh>(source.mesh_entity);
+		MeshRange const& range = mesh_ranges[source.mesh_entity];
+		SubMeshInstance const& instance = mesh.instances[source.mesh_instance_index];
+		SubMeshGPU& submesh = mesh.submeshes[instance.submesh_index];
+		Material const& material = mesh.materials[submesh.material_index];
+
+		Batch& batch = reg.get<Batch>(instance_batches[instance_index]);
+		instance_changes.push_back(GPUSceneInstanceChange{ .instance_id = instance_index, .previous_bounding_box = batch.bounding_box });
+		batch.instance_id = instance_index;
+		batch.alpha_mode = material.alpha_mode;
+		batch.submesh = &submesh;
+		batch.world_transform = instance.world_transform;
+		submesh.bounding_box.Transform(batch.bounding_box, batch.world_transform);
+		instance_culler.SetBounds(instance_index, batch.bounding_box);
+
+		InstanceGPU& instance_hlsl = instances[instance_index];
+		PackInstance(instance_hlsl, instance_index, instance.world_transform, submesh.bounding_box);
+		instance_hlsl.material_idx = range.first_material + submesh.material_index;
+		instance_hlsl.mesh_index = range.first_mesh + instance.submesh_index;
+
+		if (!full_upload[GPUSceneBuffer_Instance] && !instance_dirty[instance_index])
+		{
+			instance_dirty[instance_index] = true;
+			dirty_instances.push_back(instance_index);
+		}
+	}
+
+	void GPUScene::UpdateMaterial(uint32 material_index, Material const& material)
+	{
+		MaterialGPU& material_hlsl = materials[material_index];
+		material_hlsl.diffuse_idx = (uint32)material.albedo_texture;
+		material_hlsl.normal_idx = (uint32)material.normal_texture;
+		material_hlsl.roughness_metallic_idx = (uint32)material.metallic_roughness_texture;
+		material_hlsl.emissive_idx = (uint32)material.emissive_texture;
+		material_hlsl.base_color_factor = Vector3(material.base_color);
+		material_hlsl.emissive_factor = material.emissive_factor;
+		material_hlsl.metallic_factor = material.metallic_factor;
+		material_hlsl.roughness_factor = material.roughness_factor;
+		material_hlsl.alpha_cutoff = material.alpha_cutoff;
+
+		if (!full_upload[GPUSceneBuffer_Material] && !material_dirty[material_index])
+		{
+			material_dirty[material_index] = true;
+			dirty_materials.push_back(material_index);
+		}
+	}
+
+	void GPUScene::UpdateLights(Matrix const& light_transform)
+	{
+		lights.clear();
+		volumetric_light_count = 0;
+		uint32 light_index = 0;
+		for (auto light_entity : reg.view<Light>())
+		{
+			Light& light = reg.get<Light>(light_entity);
+			light.light_index = light_index;
+			++light_index;
+
+			LightGPU& hlsl_light = lights.emplace_back();
+			hlsl_light.color = light.color * light.intensity;
+			hlsl_light.position = Vector4::Transform(light.position, light_transform);
+			hlsl_light.direction = Vector4::Transform(light.direction, light_transform);
+			hlsl_light.range = light.range;
+			hlsl_light.type = static_cast<int32>(light.type);
+			hlsl_light.inner_cosine = light.inner_cosine;
+			hlsl_light.outer_cosine = light.outer_cosine;
+			hlsl_light.volumetric = light.volumetric;
+			hlsl_light.volumetric_strength = light.volumetric_strength;
+			hlsl_light.active = light.active;
+			hlsl_light.shadow_matrix_index = light.casts_shadows ? light.shadow_matrix_index : -1;
+			hlsl_light.shadow_texture_index = light.casts_shadows ? light.shadow_texture_index : -1;
+			hlsl_light.shadow_mask_index = light.ray_traced_shadows ? light.shadow_mask_index : -1;
+			hlsl_light.use_cascades = light.use_cascades;
+			if (light.volumetric) ++volumetric_light_count;
+		}
+		full_upload[GPUSceneBuffer_Light] = true;
+	}
+
+	void GPUScene::UpdateMeshDescriptors()
+	{
+		for (auto const& [mesh_entity, range] : mesh_ranges)
+		{
+			Mesh const& mesh = reg.get<Mesh>(mesh_entity);
+
+			GfxDescriptor mesh_buffer_srv = g_GeometryBufferCache.GetGeometryBufferSRV(mesh.geometry_buffer_handle);
+			GfxDescriptor mesh_buffer_online_srv = gfx->AllocateDescriptorsGPU();
+			gfx->CopyDescriptors(1, mesh_buffer_online_srv, mesh_buffer_srv);
+			for (uint32 i = 0; i < range.mesh_count; ++i) meshes[range.first_mesh + i].buffer_idx = mesh_buffer_online_srv.GetIndex();
+
+			for (Material const& material : mesh.materials)
+			{
+				g_TextureManager.MarkUsed(material.albedo_texture);
+				g_TextureManager.MarkUsed(material.normal_texture);
+				g_TextureManager.MarkUsed(material.metallic_roughness_texture);
+				g_TextureManager.MarkUsed(material.emissive_texture);
+			}
+		}
+		full_upload[GPUSceneBuffer_Mesh] = true;
+	}
+
+	template<typename T>
+	void GPUScene::ReserveBuffer(GPUSceneBufferType type, uint64 count)
+	{
+		if (count == 0) return;
+		SceneBuffer& scene_buffer = scene_buffers[type];
+		if (!scene_buffer.buffer || scene_buffer.buffer->GetCount() < count)
+		{
+			uint64 const capacity = scene_buffer.buffer ? std::max<uint64>(count, scene_buffer.buffer->GetCount() * 2ull) : count;
+			scene_buffer.buffer = gfx->CreateBuffer(StructuredBufferDesc<T>(capacity, false, false));
+			if (scene_buffer.buffer_srv.IsValid()) gfx->FreeDescriptorCPU(scene_buffer.buffer_srv, GfxDescriptorHeapType::CBV_SRV_UAV);
+			scene_buffer.buffer_srv = gfx->CreateBufferSRV(scene_buffer.buffer.get());
+			scene_buffer.shader_readable = false;
+			full_upload[type] = true;
+		}
+		scene_buffer.buffer_srv_gpu = gfx->AllocateDescriptorsGPU();
+		gfx->CopyDescriptors(1, scene_buffer.buffer_srv_gpu, scene_buffer.buffer_srv);
+	}
+
+	template<typename T>
+	void GPUScene::UploadBuffer(GfxCommandList* cmd_list, GPUSceneBufferType type, std::vector<T> const& data, std::vector<uint32>& dirty_elements)
+	{
+		SceneBuffer& scene_buffer = scene_buffers[type];
+		//scattered updates are uploaded as one copy per run of consecutive elements, large ones as a single copy of everything
+		bool const upload_all = full_upload[type] || dirty_elements.size() > data.size() / 2;
+		uint64 const upload_count = upload_all ? data.size() : dirty_elements.size();
+		if (upload_count == 0) return;
+
+		if (scene_buffer.shader_readable) cmd_list->BufferBarrier(*scene_buffer.buffer, GfxResourceState::AllSRV, GfxResourceState::CopyDst);
+		cmd_list->FlushBarriers();
+
+		GfxDynamicAllocation staging = gfx->GetDynamicAllocator()->Allocate(upload_count * sizeof(T), 16);
+		if (upload_all)
+		{
+			staging.Update(data.data(), upload_count * sizeof(T));
+			cmd_list->CopyBuffer(*scene_buffer.buffer, 0, *staging.buffer, staging.offset, upload_count * sizeof(T));
+		}
+		else
+		{
+			std::sort(dirty_elements.begin(), dirty_elements.end());
+			T* staging_data = reinterpret_cast<T*>(staging.cpu_address);
+			for (uint64 i = 0; i < upload_count; ++i) staging_data[i] = data[dirty_elements[i]];
+			for (uint64 run_begin = 0; run_begin < upload_count;)
+			{
+				uint64 run_end = run_begin + 1;
+				while (run_end < upload_count && dirty_elements[run_end] == dirty_elements[run_end - 1] + 1) ++run_end;
+				cmd_list->CopyBuffer(*scene_buffer.buffer, dirty_elements[run_begin] * sizeof(T),
+					*staging.buffer, staging.offset + run_begin * sizeof(T), (run_end - run_begin) * sizeof(T));
+				run_begin = run_end;
+			}
+		}
+		cmd_list->BufferBarrier(*scene_buffer.buffer, GfxResourceState::CopyDst, GfxResourceState::AllSRV);
+		scene_buffer.shader_readable = true;
+	}
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include "ShaderStructs.h"
+#include "FrustumCuller.h"
+#include "Graphics/GfxDescriptor.h"
+#include "entt/entity/observer.hpp"
+
+namespace adria
+{
+	class GfxDevice;
+	class GfxBuffer;
+	class GfxCommandList;
+	struct Material;
+
+	enum GPUSceneBufferType : uint8
+	{
+		GPUSceneBuffer_Light,
+		GPUSceneBuffer_Mesh,
+		GPUSceneBuffer_Material,
+		GPUSceneBuffer_Instance,
+		GPUSceneBuffer_Count
+	};
+
+	//mesh entity and index into Mesh::instances an instance id was packed from
+	struct GPUSceneInstanceSource
+	{
+		entt::entity mesh_entity;
+		uint32 mesh_instance_index;
+	};
+
+	struct GPUSceneInstanceChange
+	{
+		uint32 instance_id;
+		BoundingBox previous_bounding_box;
+	};
+
+	//Persistent scene buffers read by the shaders through the frame constants. Instances and materials are only repacked
+	//when they change: adding or removing a Mesh rebuilds everything, patching a Mesh (registry.patch<Mesh>) repacks its
+	//ranges and SetInstanceTransform repacks single instances. Changed ranges are copied into default heap buffers at
+	//the start of the frame. Lights are stored in view space and mesh entries hold per frame descriptor indices, so
+	//those two are rewritten every frame.
+	class GPUScene
+	{
+		struct SceneBuffer
+		{
+			std::unique_ptr<GfxBuffer> buffer;
+			GfxDescriptor			   buffer_srv;
+			GfxDescriptor			   buffer_srv_gpu;
+			bool					   shader_readable = false;
+		};
+		struct MeshRange
+		{
+			uint32 first_instance;
+			uint32 instance_count;
+			uint32 first_mesh;
+			uint32 mesh_count;
+			uint32 first_material;
+			uint32 material_count;
+		};
+	public:
+		GPUScene(entt::registry& reg, GfxDevice* gfx);
+		~GPUScene();
+
+		//CPU side of the update, before the frame has started
+		void Update(Matrix const& light_transform);
+		//records the copies of everything that changed since the previous upload
+		void Upload(GfxCommandList* cmd_list);
+		void EndFrame();
+
+		void SetInstanceTransform(uint32 instance_index, Matrix const& world_transform);
+
+		//times Update and Upload of a synthetic scene after a Rebuild, after registry.patch<Mesh> of 1% of the meshes
+		//and after SetInstanceTransform of 1% of the instances, and logs the CPU time of each
+		static void RunBenchmark(GfxDevice* gfx);
+
+		int32 GetBufferIndex(GPUSceneBufferType type) const { return (int32)scene_buffers[type].buffer_srv_gpu.GetIndex(); }
+		uint32 GetInstanceCount() const { return (uint32)instances.size(); }
+		uint32 GetVolumetricLightCount() const { return volumetric_light_count; }
+		//world space bounds of every instance, indexed by instance id
+		FrustumCuller const& GetCuller() const { return instance_culler; }
+		//instances repacked during the frame with their bounds before the change, a rebuild reassigns all instance ids
+		//and only bumps the structure version
+		std::vector<GPUSceneInstanceChange> const& GetInstanceChanges() const { return instance_changes; }
+		GPUSceneInstanceSource const& GetInstanceSource(uint32 instance_id) const { return instance_sources[instance_id]; }
+		uint64 GetStructureVersion() const { return structure_version; }
+
+	private:
+		entt::registry& reg;
+		GfxDevice* gfx;
+		entt::observer mesh_observer;
+		bool structure_dirty = true;
+
+		std::array<SceneBuffer, GPUSceneBuffer_Count> scene_buffers;
+		std::vector<LightGPU> lights;
+		std::vector<MeshGPU> meshes;
+		std::vector<MaterialGPU> materials;
+		std::vector<InstanceGPU> instances;
+		std::vector<entt::entity> instance_batches;
+		std::vector<GPUSceneInstanceSource> instance_sources;
+		std::unordered_map<entt::entity, MeshRange> mesh_ranges;
+		FrustumCuller instance_culler;
+		std::vector<GPUSceneInstanceChange> instance_changes;
+		uint64 structure_version = 0;
+		uint32 volumetric_light_count = 0;
+
+		std::array<bool, GPUSceneBuffer_Count> full_upload = {};
+		std::vector<bool> instance_dirty;
+		std::vector<uint32> dirty_instances;
+		std::vector<bool> material_dirty;
+		std::vector<uint32> dirty_materials;
+
+	private:
+		void OnMeshAddedOrRemoved(entt::registry&, entt::entity);
+
+		void Rebuild();
+		void UpdateMesh(entt::entity mesh_entity);
+		void UpdateInstance(uint32 instance_index);
+		void UpdateMaterial(uint32 material_index, Material const& material);
+		void UpdateLights(Matrix const& light_transform);
+		void UpdateMeshDescriptors();
+
+		template<typename T>
+		void ReserveBuffer(GPUSceneBufferType type, uint64 count);
+		template<typename T>
+		void UploadBuffer(GfxCommandList* cmd_list, GPUSceneBufferType type, std::vector<T> const& data, std::vector<uint32>& dirty_elements);
+	};
+}
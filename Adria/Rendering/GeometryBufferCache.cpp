@@ -1,7 +1,7 @@
 #include "GeometryBufferCache.h"
 #include "Graphics/GfxBuffer.h"
 #include "Graphics/GfxDevice.h"
-#include "Graphics/GfxCommandList.h"
+#include "Graphics/GfxUploadManager.h"
 
 namespace adria
 {
@@ -16,7 +16,7 @@ namespace adria
 		gfx = nullptr;
 	}
 
-	ArcGeometryBufferHandle GeometryBufferCache::CreateAndInitializeGeometryBuffer(GfxBuffer* staging_buffer, uint64 total_buffer_size, uint64 src_offset)
+	ArcGeometryBufferHandle GeometryBufferCache::CreateAndInitializeGeometryBuffer(void const* data, uint64 total_buffer_size)
 	{
 		GfxBufferDesc desc{};
 		desc.size = total_buffer_size;
@@ -26,7 +26,7 @@ namespace adria
 
 		++current_handle;
 		buffer_map[current_handle] = gfx->CreateBuffer(desc);
-		if(staging_buffer) gfx->GetCommandList()->CopyBuffer(*buffer_map[current_handle], 0, *staging_buffer, src_offset, total_buffer_size);
+		if(data) gfx->GetUploadManager()->UploadBuffer(*buffer_map[current_handle], 0, data, total_buffer_size);
 		buffer_srv_map[current_handle] = gfx->CreateBufferSRV(buffer_map[current_handle].get());
 		return current_handle;
 	}
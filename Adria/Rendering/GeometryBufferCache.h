@@ -53,7 +53,7 @@ namespace adria
 		void Initialize(GfxDevice* _gfx);
 		void Destroy();
 
-		ADRIA_NODISCARD ArcGeometryBufferHandle CreateAndInitializeGeometryBuffer(GfxBuffer* staging_buffer, uint64 total_buffer_size, uint64 src_offset);
+		ADRIA_NODISCARD ArcGeometryBufferHandle CreateAndInitializeGeometryBuffer(void const* data, uint64 total_buffer_size);
 		ADRIA_NODISCARD GfxBuffer* GetGeometryBuffer(GeometryBufferHandle& handle) const;
 		ADRIA_NODISCARD GfxDescriptor GetGeometryBufferSRV(GeometryBufferHandle& handle) const;
 		void DestroyGeometryBuffer(GeometryBufferHandle& handle);
@@ -0,0 +1,87 @@
+#include "MipFeedbackPass.h"
+#include "TextureManager.h"
+#include "Graphics/GfxBuffer.h"
+#include "Graphics/GfxDevice.h"
+#include "Graphics/GfxCommandList.h"
+#include "RenderGraph/RenderGraph.h"
+
+namespace adria
+{
+	MipFeedbackPass::MipFeedbackPass(GfxDevice* gfx) : gfx(gfx)
+	{
+		GfxBufferDesc feedback_buffer_desc{};
+		feedback_buffer_desc.stride = sizeof(uint32);
+		feedback_buffer_desc.resource_usage = GfxResourceUsage::Default;
+		feedback_buffer_desc.bind_flags = GfxBindFlag::ShaderResource | GfxBindFlag::UnorderedAccess;
+		feedback_buffer_desc.misc_flags = GfxBufferMiscFlag::BufferRaw;
+		feedback_buffer_desc.size = feedback_buffer_desc.stride * MAX_TEXTURES;
+		feedback_buffer = std::make_unique<GfxBuffer>(gfx, feedback_buffer_desc);
+		feedback_buffer->SetName("Mip Feedback Buffer");
+
+		uav_descriptor = gfx->CreateBufferUAV(feedback_buffer.get());
+		gfx->GetCommandList()->BufferBarrier(*feedback_buffer, GfxResourceState::Common, GfxResourceState::ComputeUAV);
+		for (auto& readback_buffer : readback_buffers)
+			readback_buffer = gfx->CreateBuffer(ReadBackBufferDesc(feedback_buffer_desc.size));
+	}
+
+	MipFeedbackPass::~MipFeedbackPass() = default;
+
+	int32 MipFeedbackPass::GetFeedbackBufferIndex()
+	{
+		if (!g_TextureManager.IsStreamingEnabled()) return -1;
+		gpu_uav_descriptor = gfx->AllocateDescriptorsGPU();
+		gfx->CopyDescriptors(1, gpu_uav_descriptor, uav_descriptor);
+		return (int32)gpu_uav_descriptor.GetIndex();
+	}
+
+	void MipFeedbackPass::AddClearPass(RenderGraph& rg)
+	{
+		if (!g_TextureManager.IsStreamingEnabled()) return;
+
+		rg.ImportBuffer(RG_NAME(MipFeedbackBuffer), feedback_buffer.get());
+		struct ClearMipFeedbackPassData
+		{
+			RGBufferReadWriteId feedback_buffer;
+		};
+		rg.AddPass<ClearMipFeedbackPassData>("Clear Mip Feedback Pass",
+			[=](ClearMipFeedbackPassData& data, RenderGraphBuilder& builder)
+			{
+				data.feedback_buffer = builder.WriteBuffer(RG_NAME(MipFeedbackBuffer));
+			},
+			[=](ClearMipFeedbackPassData const& data, RenderGraphContext& ctx, GfxCommandList* cmd_list)
+			{
+				uint32 clear[] = { uint32(-1), uint32(-1), uint32(-1), uint32(-1) };
+				cmd_list->ClearUAV(*feedback_buffer, gpu_uav_descriptor, uav_descriptor, clear);
+				//the graph only sees this pass as a compute write, the clear itself still has to finish before the GBuffer shaders write the feedback
+				cmd_list->BufferBarrier(*feedback_buffer, GfxResourceState::ClearUAV | GfxResourceState::AllUAV, GfxResourceState::ClearUAV | GfxResourceState::AllUAV);
+				cmd_list->FlushBarriers();
+			}, RGPassType::Compute, RGPassFlags::ForceNoCull);
+	}
+
+	void MipFeedbackPass::AddReadbackPass(RenderGraph& rg)
+	{
+		if (!g_TextureManager.IsStreamingEnabled()) return;
+
+		struct CopyMipFeedbackPassData
+		{
+			RGBufferCopySrcId feedback_buffer;
+		};
+		rg.AddPass<CopyMipFeedbackPassData>("Copy Mip Feedback Pass",
+			[=](CopyMipFeedbackPassData& data, RenderGraphBuilder& builder)
+			{
+				data.feedback_buffer = builder.ReadCopySrcBuffer(RG_NAME(MipFeedbackBuffer));
+			},
+			[&](CopyMipFeedbackPassData const& data, RenderGraphContext& ctx, GfxCommandList* cmd_list)
+			{
+				//the frame that last used this backbuffer index has finished, so its copy can be read before it is overwritten
+				uint32 const backbuffer_index = gfx->GetBackbufferIndex();
+				GfxBuffer& readback_buffer = *readback_buffers[backbuffer_index];
+				if (readback_written[backbuffer_index])
+				{
+					g_TextureManager.ProcessMipFeedback(std::span<uint32 const>(readback_buffer.GetMappedData<uint32>(), MAX_TEXTURES));
+				}
+				cmd_list->CopyBuffer(readback_buffer, *feedback_buffer);
+				readback_written[backbuffer_index] = true;
+			}, RGPassType::Copy, RGPassFlags::ForceNoCull);
+	}
+}
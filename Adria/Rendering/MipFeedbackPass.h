@@ -0,0 +1,39 @@
+#pragma once
+#include <memory>
+#include "Graphics/GfxDefines.h"
+#include "Graphics/GfxDescriptor.h"
+
+namespace adria
+{
+	class GfxDevice;
+	class GfxBuffer;
+	class RenderGraph;
+
+	//Owns the buffer the GBuffer shaders write the finest sampled mip of every texture into. The buffer is cleared each
+	//frame, copied to a readback buffer at the end of it and handed to the texture manager once the copy has finished.
+	class MipFeedbackPass
+	{
+	public:
+		//keep in sync with MipFeedback.hlsli
+		static constexpr uint32 MAX_TEXTURES = 16384;
+		static constexpr uint32 FEEDBACK_BIAS = 16;
+
+	public:
+		explicit MipFeedbackPass(GfxDevice* gfx);
+		ADRIA_NONCOPYABLE(MipFeedbackPass)
+		ADRIA_DEFAULT_MOVABLE(MipFeedbackPass)
+		~MipFeedbackPass();
+
+		int32 GetFeedbackBufferIndex();
+		void AddClearPass(RenderGraph& rg);
+		void AddReadbackPass(RenderGraph& rg);
+
+	private:
+		GfxDevice* gfx;
+		std::unique_ptr<GfxBuffer> feedback_buffer;
+		std::unique_ptr<GfxBuffer> readback_buffers[GFX_BACKBUFFER_COUNT];
+		bool readback_written[GFX_BACKBUFFER_COUNT] = {};
+		GfxDescriptor uav_descriptor;
+		GfxDescriptor gpu_uav_descriptor;
+	};
+}
@@ -7,6 +7,7 @@
 #include "TextureManager.h"
 #include "DebugRenderer.h"
 
+#include "Core/CpuProfiler.h"
 #include "Editor/GUICommand.h"
 #include "Editor/Editor.h"
 #include "Graphics/GfxBuffer.h"
@@ -14,9 +15,10 @@
 #include "Graphics/GfxCommon.h"
 #include "Graphics/GfxPipelineState.h"
 #include "Graphics/GfxProfiler.h"
+#include "Graphics/GfxPipelineStatistics.h"
 #include "Graphics/GfxTracyProfiler.h"
 #include "RenderGraph/RenderGraph.h"
-#include "Utilities/ThreadPool.h"
+#include "Utilities/JobSystem.h"
 #include "Utilities/Random.h"
 #include "Utilities/ImageWrite.h"
 #include "Math/Constants.h"
@@ -34,7 +36,7 @@ namespace adria
 	static TAutoConsoleVariable<int>  VolumetricPath("r.VolumetricPath", 1, "0 - None, 1 - 2D Raymarching, 2 - Fog Volume");
 
 	Renderer::Renderer(entt::registry& reg, GfxDevice* gfx, uint32 width, uint32 height) : reg(reg), gfx(gfx), resource_pool(gfx),
-		accel_structure(gfx), camera(nullptr), display_width(width), display_height(height), render_width(width), render_height(height),
+		gpu_scene(reg, gfx), accel_structure(gfx), camera(nullptr), display_width(width), display_height(height), render_width(width), render_height(height),
 		backbuffer_count(gfx->GetBackbufferCount()), backbuffer_index(gfx->GetBackbufferIndex()), final_texture(nullptr),
 		frame_cbuffer(gfx, backbuffer_count), gpu_driven_renderer(reg, gfx, width, height),
 		gbuffer_pass(reg, gfx, width, height),
@@ -45,12 +47,13 @@ namespace adria
 		clustered_deferred_lighting_pass(reg, gfx, width, height),
 		decals_pass(reg, gfx, width, height), rain_pass(reg, gfx, width, height), ocean_renderer(reg, gfx, width, height),
 		shadow_renderer(reg, gfx, width, height), renderer_output_pass(gfx, width, height),
-		path_tracer(gfx, width, height), ddgi(gfx, reg, width, height), gpu_debug_printer(gfx)
+		path_tracer(gfx, width, height), ddgi(gfx, reg, width, height), gpu_debug_printer(gfx), mip_feedback_pass(gfx)
 	{
 		ray_tracing_supported = gfx->GetCapabilities().SupportsRayTracing();
 
 		g_DebugRenderer.Initialize(gfx, width, height);
 		g_GfxProfiler.Initialize(gfx);
+		g_GfxPipelineStatistics.Initialize(gfx);
 		GfxTracyProfiler::Initialize(gfx);
 		CreateSizeDependentResources();
 
@@ -66,12 +69,20 @@ namespace adria
 		{
 			LightingPath->AddOnChanged(ConsoleVariableDelegate::CreateLambda([this](IConsoleVariable* cvar) { lighting_path = static_cast<LightingPathType>(cvar->GetInt()); }));
 			VolumetricPath->AddOnChanged(ConsoleVariableDelegate::CreateLambda([this](IConsoleVariable* cvar) { volumetric_path = static_cast<VolumetricPathType>(cvar->GetInt()); }));
+			g_ConsoleManager.RegisterConsoleCommand("r.MoveInstance", "Offsets the world transform of an instance by x y z: r.MoveInstance <instance id> <x> <y> <z>",
+				ConsoleCommandWithArgsDelegate::CreateMember(&Renderer::MoveInstance, *this));
+			g_ConsoleManager.RegisterConsoleCommand("r.GPUScene.Benchmark", "Times the GPU scene update of a synthetic scene with 1k, 10k and 100k instances after a rebuild, a mesh patch and instance moves and logs the results",
+				ConsoleCommandDelegate::CreateLambda([this]() { GPUScene::RunBenchmark(gfx); }));
 		}
 	}
 
 	Renderer::~Renderer()
 	{
+		g_ConsoleManager.UnregisterConsoleObject("r.MoveInstance");
+		g_ConsoleManager.UnregisterConsoleObject("r.GPUScene.Benchmark");
+		g_JobSystem.Wait(screenshot_write_counter);
 		GfxTracyProfiler::Destroy();
+		g_GfxPipelineStatistics.Destroy();
 		g_GfxProfiler.Destroy();
 		gfx->WaitForGPU();
 		reg.clear();
@@ -94,17 +105,24 @@ namespace adria
 		camera = _camera;
 		backbuffer_index = gfx->GetBackbufferIndex();
 		g_GfxProfiler.NewFrame();
+		g_GfxPipelineStatistics.NewFrame();
 		GfxTracyProfiler::NewFrame();
 	}
 	void Renderer::Update(float dt)
 	{
+		AdriaCpuProfileScope("Renderer::Update");
 		shadow_renderer.SetupShadows(camera);
-		UpdateSceneBuffers();
+		gpu_scene.Update(lighting_path == LightingPathType::PathTracing ? Matrix::Identity : camera->View());
+		UpdateASInstances();
+		volumetric_lights = gpu_scene.GetVolumetricLightCount();
 		UpdateFrameConstants(dt);
 		CameraFrustumCulling();
 	}
 	void Renderer::Render()
 	{
+		AdriaCpuProfileScope("Renderer::Render");
+		gpu_scene.Upload(gfx->GetCommandList());
+		accel_structure.Update();
 		RenderGraph render_graph(resource_pool);
 		RGBlackboard& rg_blackboard = render_graph.GetBlackboard();
 		FrameBlackboardData frame_data{};
@@ -133,8 +151,14 @@ namespace adria
 
 		gpu_debug_printer.AddClearPass(render_graph);
 		if (lighting_path == LightingPathType::PathTracing) Render_PathTracing(render_graph);
-		else Render_Deferred(render_graph);
-		if (take_screenshot) TakeScreenshot(render_graph);
+		else
+		{
+			mip_feedback_pass.AddClearPass(render_graph);
+			Render_Deferred(render_graph);
+			mip_feedback_pass.AddReadbackPass(render_graph);
+		}
+		WritePendingScreenshot();
+		if (take_screenshot && pending_screenshot_path.empty() && screenshot_write_counter.IsDone()) TakeScreenshot(render_graph);
 		gpu_debug_printer.AddPrintPass(render_graph);
 
 		if (!g_Editor.IsActive()) CopyToBackbuffer(render_graph);
@@ -142,6 +166,9 @@ namespace adria
 
 		render_graph.Build();
 		render_graph.Execute();
+		gpu_scene.EndFrame();
+		g_GfxProfiler.EndFrame(gfx->GetCommandList());
+		g_GfxPipelineStatistics.EndFrame(gfx->GetCommandList());
 
 		GUI();
 	}
@@ -232,133 +259,45 @@ namespace adria
 		for (auto entity : ray_tracing_view)
 		{
 			Mesh const& mesh = ray_tracing_view.get<Mesh>(entity);
-			accel_structure.AddInstance(mesh);
+			rt_instance_offsets[entity] = accel_structure.AddInstance(mesh);
 		}
 		accel_structure.Build();
 	}
 
-	void Renderer::UpdateSceneBuffers()
+	//instances repacked by the GPU scene this frame are moved in the TLAS as well, which refits it in the next Update
+	void Renderer::UpdateASInstances()
 	{
-		volumetric_lights = 0;
-		for (auto e : reg.view<Batch>()) reg.destroy(e);
-		reg.clear<Batch>();
-
-		std::vector<LightGPU> hlsl_lights{};
-		uint32 light_index = 0;
-		Matrix light_transform = lighting_path == LightingPathType::PathTracing ? Matrix::Identity : camera->View();
-		for (auto light_entity : reg.view<Light>())
+		if (rt_instance_offsets.empty()) return;
+		for (GPUSceneInstanceChange const& instance_change : gpu_scene.GetInstanceChanges())
 		{
-			Light& light = reg.get<Light>(light_entity);
-			light.light_index = light_index;
-			++light_index;
-
-			LightGPU& hlsl_light = hlsl_lights.emplace_back();
-			hlsl_light.color = light.color * light.intensity;
-			hlsl_light.position = Vector4::Transform(light.position, light_transform);
-			hlsl_light.direction = Vector4::Transform(light.direction, light_transform);
-			hlsl_light.range = light.range;
-			hlsl_light.type = static_cast<int32>(light.type);
-			hlsl_light.inner_cosine = light.inner_cosine;
-			hlsl_light.outer_cosine = light.outer_cosine;
-			hlsl_light.volumetric = light.volumetric;
-			hlsl_light.volumetric_strength = light.volumetric_strength;
-			hlsl_light.active = light.active;
-			hlsl_light.shadow_matrix_index = light.casts_shadows ? light.shadow_matrix_index : -1;
-			hlsl_light.shadow_texture_index = light.casts_shadows ? light.shadow_texture_index : -1;
-			hlsl_light.shadow_mask_index = light.ray_traced_shadows ? light.shadow_mask_index : -1;
-			hlsl_light.use_cascades = light.use_cascades;
-			if (light.volumetric) ++volumetric_lights;
-		}
+			GPUSceneInstanceSource const& source = gpu_scene.GetInstanceSource(instance_change.instance_id);
+			auto offset_it = rt_instance_offsets.find(source.mesh_entity);
+			if (offset_it == rt_instance_offsets.end()) continue;
 
-		std::vector<MeshGPU> meshes;
-		std::vector<InstanceGPU> instances;
-		std::vector<MaterialGPU> materials;
-		uint32 instanceID = 0;
+			Mesh const& mesh = reg.get<Mesh>(source.mesh_entity);
+			accel_structure.SetInstanceTransform(offset_it->second + source.mesh_instance_index, mesh.instances[source.mesh_instance_index].world_transform);
+		}
+	}
 
-		for (auto mesh_entity : reg.view<Mesh>())
+	void Renderer::MoveInstance(std::span<char const*> args)
+	{
+		if (args.size() != 4)
 		{
-			Mesh& mesh = reg.get<Mesh>(mesh_entity);
-
-			GfxBuffer* mesh_buffer = g_GeometryBufferCache.GetGeometryBuffer(mesh.geometry_buffer_handle);
-			GfxDescriptor mesh_buffer_srv = g_GeometryBufferCache.GetGeometryBufferSRV(mesh.geometry_buffer_handle);
-			GfxDescriptor mesh_buffer_online_srv = gfx->AllocateDescriptorsGPU();
-			gfx->CopyDescriptors(1, mesh_buffer_online_srv, mesh_buffer_srv);
-
-			for (auto const& instance : mesh.instances)
-			{
-				SubMeshGPU& submesh = mesh.submeshes[instance.submesh_index];
-				Material& material = mesh.materials[submesh.material_index];
-
-				submesh.buffer_address = mesh_buffer->GetGpuAddress();
-
-				entt::entity batch_entity = reg.create();
-				Batch& batch = reg.emplace<Batch>(batch_entity);
-				batch.instance_id = instanceID;
-				batch.alpha_mode = material.alpha_mode;
-				batch.submesh = &submesh;
-				batch.world_transform = instance.world_transform;
-				submesh.bounding_box.Transform(batch.bounding_box, batch.world_transform);
-
-				InstanceGPU& instance_hlsl = instances.emplace_back();
-				instance_hlsl.instance_id = instanceID;
-				instance_hlsl.material_idx = static_cast<uint32>(materials.size() + submesh.material_index);
-				instance_hlsl.mesh_index = static_cast<uint32>(meshes.size() + instance.submesh_index);
-				instance_hlsl.world_matrix = instance.world_transform;
-				instance_hlsl.inverse_world_matrix = XMMatrixInverse(nullptr, instance.world_transform);
-				instance_hlsl.bb_origin = submesh.bounding_box.Center;
-				instance_hlsl.bb_extents = submesh.bounding_box.Extents;
-
-				++instanceID;
-			}
-			for (auto const& submesh : mesh.submeshes)
-			{
-				MeshGPU& mesh_hlsl = meshes.emplace_back();
-				mesh_hlsl.buffer_idx = mesh_buffer_online_srv.GetIndex();
-				mesh_hlsl.indices_offset = submesh.indices_offset;
-				mesh_hlsl.positions_offset = submesh.positions_offset;
-				mesh_hlsl.normals_offset = submesh.normals_offset;
-				mesh_hlsl.tangents_offset = submesh.tangents_offset;
-				mesh_hlsl.uvs_offset = submesh.uvs_offset;
-
-				mesh_hlsl.meshlet_offset = submesh.meshlet_offset;
-				mesh_hlsl.meshlet_vertices_offset = submesh.meshlet_vertices_offset;
-				mesh_hlsl.meshlet_triangles_offset = submesh.meshlet_triangles_offset;
-				mesh_hlsl.meshlet_count = submesh.meshlet_count;
-			}
-
-			for (auto const& material : mesh.materials)
-			{
-				MaterialGPU& material_hlsl = materials.emplace_back();
-				material_hlsl.diffuse_idx = (uint32)material.albedo_texture;
-				material_hlsl.normal_idx = (uint32)material.normal_texture;
-				material_hlsl.roughness_metallic_idx = (uint32)material.metallic_roughness_texture;
-				material_hlsl.emissive_idx = (uint32)material.emissive_texture;
-				material_hlsl.base_color_factor = Vector3(material.base_color);
-				material_hlsl.emissive_factor = material.emissive_factor;
-				material_hlsl.metallic_factor = material.metallic_factor;
-				material_hlsl.roughness_factor = material.roughness_factor;
-				material_hlsl.alpha_cutoff = material.alpha_cutoff;
-			}
+			ADRIA_LOG(WARNING, "Usage: r.MoveInstance <instance id> <x> <y> <z>");
+			return;
 		}
-
-		auto CopyBuffer = [&]<typename T>(std::vector<T> const& data, SceneBuffer& scene_buffer)
+		uint32 const instance_id = (uint32)std::strtoul(args[0], nullptr, 10);
+		if (instance_id >= gpu_scene.GetInstanceCount())
 		{
-			if (data.empty()) return;
-			if (!scene_buffer.buffer || scene_buffer.buffer->GetCount() < data.size())
-			{
-				scene_buffer.buffer = gfx->CreateBuffer(StructuredBufferDesc<T>(data.size(), false, true));
-				scene_buffer.buffer_srv = gfx->CreateBufferSRV(scene_buffer.buffer.get());
-			}
-			scene_buffer.buffer->Update(data.data(), data.size() * sizeof(T));
-			scene_buffer.buffer_srv_gpu = gfx->AllocateDescriptorsGPU();
-			gfx->CopyDescriptors(1, scene_buffer.buffer_srv_gpu, scene_buffer.buffer_srv);
-		};
-		CopyBuffer(hlsl_lights, scene_buffers[SceneBuffer_Light]);
-		CopyBuffer(meshes, scene_buffers[SceneBuffer_Mesh]);
-		CopyBuffer(instances, scene_buffers[SceneBuffer_Instance]);
-		CopyBuffer(materials, scene_buffers[SceneBuffer_Material]);
+			ADRIA_LOG(WARNING, "Instance %u doesn't exist, the scene has %u instances", instance_id, gpu_scene.GetInstanceCount());
+			return;
+		}
+		Vector3 const offset(std::strtof(args[1], nullptr), std::strtof(args[2], nullptr), std::strtof(args[3], nullptr));
 
-		uint64 count = reg.size();
+		GPUSceneInstanceSource const& source = gpu_scene.GetInstanceSource(instance_id);
+		Mesh const& mesh = reg.get<Mesh>(source.mesh_entity);
+		Matrix const world_transform = mesh.instances[source.mesh_instance_index].world_transform * Matrix::CreateTranslation(offset);
+		gpu_scene.SetInstanceTransform(instance_id, world_transform);
 	}
 
 	void Renderer::UpdateFrameConstants(float dt)
@@ -394,13 +333,14 @@ namespace adria
 		frame_cbuf_data.mouse_normalized_coords_x = (viewport_data.mouse_position_x - viewport_data.scene_viewport_pos_x) / viewport_data.scene_viewport_size_x;
 		frame_cbuf_data.mouse_normalized_coords_y = (viewport_data.mouse_position_y - viewport_data.scene_viewport_pos_y) / viewport_data.scene_viewport_size_y;
 		frame_cbuf_data.env_map_idx = sky_pass.GetSkyIndex();
-		frame_cbuf_data.meshes_idx = (int32)scene_buffers[SceneBuffer_Mesh].buffer_srv_gpu.GetIndex();
-		frame_cbuf_data.materials_idx = (int32)scene_buffers[SceneBuffer_Material].buffer_srv_gpu.GetIndex();
-		frame_cbuf_data.instances_idx = (int32)scene_buffers[SceneBuffer_Instance].buffer_srv_gpu.GetIndex();
-		frame_cbuf_data.lights_idx = (int32)scene_buffers[SceneBuffer_Light].buffer_srv_gpu.GetIndex();
+		frame_cbuf_data.meshes_idx = gpu_scene.GetBufferIndex(GPUSceneBuffer_Mesh);
+		frame_cbuf_data.materials_idx = gpu_scene.GetBufferIndex(GPUSceneBuffer_Material);
+		frame_cbuf_data.instances_idx = gpu_scene.GetBufferIndex(GPUSceneBuffer_Instance);
+		frame_cbuf_data.lights_idx = gpu_scene.GetBufferIndex(GPUSceneBuffer_Light);
 		shadow_renderer.FillFrameCBuffer(frame_cbuf_data);
 		frame_cbuf_data.ddgi_volumes_idx = ddgi.IsEnabled() ? ddgi.GetDDGIVolumeIndex() : -1;
 		frame_cbuf_data.printf_buffer_idx = gpu_debug_printer.GetPrintfBufferIndex();
+		frame_cbuf_data.mip_feedback_idx = lighting_path == LightingPathType::PathTracing ? -1 : mip_feedback_pass.GetFeedbackBufferIndex();
 		frame_cbuf_data.rain_splash_diffuse_idx = rain_pass.GetRainSplashDiffuseIndex();
 		frame_cbuf_data.rain_splash_bump_idx = rain_pass.GetRainSplashBumpIndex();
 		frame_cbuf_data.rain_blocker_map_idx = rain_pass.GetRainBlockerMapIndex();
@@ -435,15 +375,8 @@ namespace adria
 	}
 	void Renderer::CameraFrustumCulling()
 	{
-		BoundingFrustum camera_frustum = camera->Frustum();
-		auto batch_view = reg.view<Batch>();
-		auto light_view = reg.view<Light>();
-		for (auto e : batch_view)
-		{
-			Batch& batch = batch_view.get<Batch>(e);
-			auto& aabb = batch.bounding_box;
-			batch.camera_visibility = camera_frustum.Intersects(aabb);
-		}
+		AdriaCpuProfileScope("Renderer::CameraFrustumCulling");
+		gpu_scene.GetCuller().Cull(camera->ViewProj(), camera_visibility);
 	}
 
 	void Renderer::Render_Deferred(RenderGraph& render_graph)
@@ -455,13 +388,13 @@ namespace adria
 		}
 		if (rain_pass.IsEnabled()) rain_pass.AddBlockerPass(render_graph);
 		if (gpu_driven_renderer.IsEnabled()) gpu_driven_renderer.AddPasses(render_graph);
-		else gbuffer_pass.AddPass(render_graph);
+		else gbuffer_pass.AddPass(render_graph, camera_visibility);
 
 		if(ddgi.IsEnabled()) ddgi.AddPasses(render_graph);
 
 		decals_pass.AddPass(render_graph);
 		postprocessor.AddAmbientOcclusionPass(render_graph);
-		shadow_renderer.AddShadowMapPasses(render_graph);
+		shadow_renderer.AddShadowMapPasses(render_graph, gpu_scene);
 		shadow_renderer.AddRayTracingShadowPasses(render_graph);
 
 		if (renderer_output == RendererOutput::Final)
@@ -517,6 +450,7 @@ namespace adria
 			ocean_renderer.GUI();
 			sky_pass.GUI();
 			rain_pass.GUI();
+			shadow_renderer.GUI();
 			QueueGUI([&]()
 				{
 					if (ImGui::TreeNode("Sun Settings"))
@@ -611,10 +545,11 @@ namespace adria
 		D3D12_RESOURCE_DESC d3d12_final_texture_desc = final_texture->GetNative()->GetDesc();
 		gfx->GetDevice()->GetCopyableFootprints(&d3d12_final_texture_desc, 0, 1, 0, &final_texture_footprint, nullptr, nullptr, nullptr);
 
-		if (!screenshot_buffer)
-		{	
+		uint64 const screenshot_size = final_texture_footprint.Footprint.RowPitch * final_texture_footprint.Footprint.Height;
+		if (!screenshot_buffer || screenshot_buffer->GetSize() < screenshot_size)
+		{
 			GfxBufferDesc screenshot_desc{};
-			screenshot_desc.size = final_texture_footprint.Footprint.RowPitch * final_texture_footprint.Footprint.Height;
+			screenshot_desc.size = screenshot_size;
 			screenshot_desc.resource_usage = GfxResourceUsage::Readback;
 			screenshot_buffer = gfx->CreateBuffer(screenshot_desc);
 		}
@@ -639,18 +574,25 @@ namespace adria
 				cmd_list->Signal(screenshot_fence, screenshot_fence_value);
 			}, RGPassType::Copy, RGPassFlags::ForceNoCull);
 
-		g_ThreadPool.Submit([this](std::string_view name) 
-			{
-			screenshot_fence.Wait(screenshot_fence_value);
-			WriteImageToFile(FileType::PNG, name.data(), display_width, display_height,
-							 screenshot_buffer->GetMappedData(), display_width * 4);
-			screenshot_buffer.reset();
-			ADRIA_LOG(INFO, "Screenshot %s.png saved to screenshots folder!", screenshot_name.c_str());
-			screenshot_fence_value++;
-			}, absolute_screenshot_path);
-
+		pending_screenshot_path = std::move(absolute_screenshot_path);
 		take_screenshot = false;
 	}
 
+	void Renderer::WritePendingScreenshot()
+	{
+		if (pending_screenshot_path.empty() || !screenshot_fence.IsCompleted(screenshot_fence_value)) return;
+
+		//the copy has finished. The job only reads the readback buffer, the next screenshot waits for it and buffers are
+		//released on the main thread, the device release queue is not thread safe
+		uint32 const width = display_width, height = display_height;
+		g_JobSystem.RunBackground([path = std::move(pending_screenshot_path), buffer = screenshot_buffer.get(), width, height]()
+			{
+				WriteImageToFile(FileType::PNG, path.c_str(), width, height, buffer->GetMappedData(), width * 4);
+				ADRIA_LOG(INFO, "Screenshot %s saved to screenshots folder!", path.c_str());
+			}, screenshot_write_counter);
+		pending_screenshot_path.clear();
+		screenshot_fence_value++;
+	}
+
 }
 
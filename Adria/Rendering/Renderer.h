@@ -12,18 +12,21 @@
 #include "ClusteredDeferredLightingPass.h"
 #include "DDGIPass.h"
 #include "GPUDebugPrinter.h"
+#include "MipFeedbackPass.h"
 #include "HelperPasses.h"
 #include "PickingPass.h"
 #include "DecalsPass.h"
 #include "RainPass.h"
 #include "OceanRenderer.h"
 #include "AccelerationStructure.h"
+#include "GPUScene.h"
 #include "ShadowRenderer.h"
 #include "PathTracingPass.h"
 #include "RendererOutputPass.h"
 #include "Graphics/GfxShaderCompiler.h"
 #include "Graphics/GfxConstantBuffer.h"
 #include "RenderGraph/RenderGraphResourcePool.h"
+#include "Utilities/JobSystem.h"
 
 namespace adria
 {
@@ -97,22 +100,8 @@ namespace adria
 		FrameCBuffer frame_cbuf_data{};
 		GfxConstantBuffer<FrameCBuffer> frame_cbuffer;
 
-		//scene buffers
-		enum SceneBufferType 
-		{ 
-			SceneBuffer_Light, 
-			SceneBuffer_Mesh, 
-			SceneBuffer_Material, 
-			SceneBuffer_Instance, 
-			SceneBuffer_Count 
-		};
-		struct SceneBuffer
-		{
-			std::unique_ptr<GfxBuffer>  buffer;
-			GfxDescriptor				buffer_srv;
-			GfxDescriptor				buffer_srv_gpu;
-		};
-		std::array<SceneBuffer, SceneBuffer_Count> scene_buffers;
+		GPUScene gpu_scene;
+		VisibilityMask camera_visibility;
 
 		//passes
 		GBufferPass  gbuffer_pass;
@@ -135,11 +124,13 @@ namespace adria
 		PathTracingPass path_tracer;
 		RendererOutputPass renderer_output_pass;
 		GPUDebugPrinter gpu_debug_printer;
+		MipFeedbackPass mip_feedback_pass;
 
 		//ray tracing
 		bool ray_tracing_supported = false;
 		AccelerationStructure accel_structure;
 		GfxDescriptor tlas_srv;
+		std::unordered_map<entt::entity, uint32> rt_instance_offsets; //TLAS index of the first instance of each ray traced mesh
 
 		//picking
 		bool update_picking_data = false;
@@ -160,6 +151,8 @@ namespace adria
 		GfxFence					screenshot_fence;
 		uint64						screenshot_fence_value = 1;
 		std::unique_ptr<GfxBuffer>  screenshot_buffer;
+		std::string					pending_screenshot_path;
+		JobCounter					screenshot_write_counter;	//the write job reads screenshot_buffer, it stays owned and released by the main thread
 
 		//volumetric
 		uint32			         volumetric_lights = 0;
@@ -170,9 +163,10 @@ namespace adria
 	private:
 		void CreateSizeDependentResources();
 		void CreateAS();
+		void UpdateASInstances();
+		void MoveInstance(std::span<char const*> args);
 
 		void GUI();
-		void UpdateSceneBuffers();
 		void UpdateFrameConstants(float dt);
 		void CameraFrustumCulling();
 
@@ -181,5 +175,6 @@ namespace adria
 
 		void CopyToBackbuffer(RenderGraph& rg);
 		void TakeScreenshot(RenderGraph& rg);
+		void WritePendingScreenshot();
 	};
 }
\ No newline at end of file
@@ -2,10 +2,12 @@
 #include "GFSDK_Aftermath_GpuCrashDumpDecoding.h"
 #include "ShaderManager.h"
 #include "Core/Paths.h"
+#include "Core/CpuProfiler.h"
 #include "Graphics/GfxShaderCompiler.h"
 #include "Graphics/GfxDevice.h"
 #include "Graphics/GfxPipelineState.h"
 #include "Logging/Logger.h"
+#include "Core/ConsoleManager.h"
 #include "Utilities/Timer.h"
 #include "Utilities/FileWatcher.h"
 
@@ -541,6 +543,7 @@ namespace adria
 		void CompileShader(GfxShaderKey const& shader, bool bypass_cache = false)
 		{
 			if (!shader.IsValid()) return;
+			AdriaCpuProfileScope("ShaderManager::CompileShader");
 
 			GfxShaderDesc shader_desc{};
 			shader_desc.entry_point = GetEntryPoint(shader);
@@ -567,15 +570,48 @@ namespace adria
 		}
 		void OnShaderFileChanged(std::string const& filename)
 		{
+			AdriaCpuProfileScope("ShaderManager::OnShaderFileChanged");
 			for (auto const& [shader, files] : dependent_files_map)
 			{
 				for (uint64 i = 0; i < files.size(); ++i)
 				{
 					fs::path const& file = files[i];
-					if (fs::equivalent(file, fs::path(filename))) CompileShader(shader, i != 0);
+					std::error_code ec;
+					if (fs::equivalent(file, fs::path(filename), ec)) CompileShader(shader, i != 0);
 				}
 			}
 		}
+
+		void BenchmarkShaderKeys()
+		{
+			if (shader_map.empty())
+			{
+				ADRIA_LOG(WARNING, "Shader key benchmark skipped: no shaders compiled");
+				return;
+			}
+
+			std::vector<GfxShaderKey> keys;
+			keys.reserve(shader_map.size());
+			for (auto const& [key, shader] : shader_map) keys.push_back(key);
+
+			constexpr uint32 Iterations = 1000000;
+			Timer<std::chrono::nanoseconds> timer;
+			uint64 found = 0;
+			for (uint32 i = 0; i < Iterations; ++i) found += shader_map.find(keys[i % keys.size()]) != shader_map.end();
+			float const lookup_ns = (float)timer.Mark() / Iterations;
+
+			GfxComputePipelineStateDesc desc{};
+			desc.CS = keys.front();
+			std::vector<GfxComputePipelineStateDesc> descs(1024);
+			timer.Mark();
+			for (uint32 i = 0; i < Iterations; ++i) descs[i % descs.size()] = desc;
+			float const copy_ns = (float)timer.Mark() / Iterations;
+
+			ADRIA_LOG(INFO, "Shader key benchmark (%zu keys, %u iterations): lookup %.2f ns, compute PSO desc copy %.2f ns, hits %llu",
+				keys.size(), Iterations, lookup_ns, copy_ns, found);
+		}
+		AutoConsoleCommand shader_key_benchmark("shader.KeyBenchmark", "Measures shader map lookups and pipeline state desc copies",
+			ConsoleCommandDelegate::CreateStatic(BenchmarkShaderKeys));
 	}
 
 	void ShaderManager::Initialize()
@@ -593,12 +629,13 @@ namespace adria
 	}
 	void ShaderManager::CheckIfShadersHaveChanged()
 	{
+		AdriaCpuProfileScope("ShaderManager::CheckIfShadersHaveChanged");
 		file_watcher->CheckWatchedFiles();
 	}
 
 	GfxShader const& ShaderManager::GetGfxShader(GfxShaderKey const& shader_key)
 	{
-		if (shader_map.contains(shader_key)) return shader_map[shader_key];
+		if (auto it = shader_map.find(shader_key); it != shader_map.end()) return it->second;
 		CompileShader(shader_key);
 		return shader_map[shader_key];
 	}
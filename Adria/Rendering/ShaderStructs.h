@@ -63,6 +63,8 @@ namespace adria
 		int32  rain_splash_bump_idx;
 		int32  rain_blocker_map_idx;
 		float  rain_total_time;
+
+		int32  mip_feedback_idx;
 	};
 
 	struct LightGPU
@@ -86,6 +88,12 @@ namespace adria
 		int32 padd;
 	};
 
+	struct ShadowViewGPU
+	{
+		Matrix view_projection;
+		Vector4 tile_bounds;
+	};
+
 	struct MeshGPU
 	{
 		uint32 buffer_idx;
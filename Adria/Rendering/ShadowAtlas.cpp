@@ -0,0 +1,163 @@
+#include "ShadowAtlas.h"
+#include <bit>
+
+namespace adria
+{
+	ShadowAtlas::ShadowAtlas(uint32 atlas_size, uint32 min_tile_size) : atlas_size(atlas_size), min_tile_size(min_tile_size)
+	{
+		ADRIA_ASSERT(std::has_single_bit(atlas_size) && std::has_single_bit(min_tile_size) && min_tile_size <= atlas_size);
+		Reset(atlas_size);
+	}
+
+	void ShadowAtlas::Reset(uint32 _atlas_size)
+	{
+		ADRIA_ASSERT(std::has_single_bit(_atlas_size) && min_tile_size <= _atlas_size);
+		atlas_size = _atlas_size;
+		nodes.clear();
+		free_child_blocks.clear();
+		nodes.push_back(Node{ .x = 0, .y = 0, .size = atlas_size, .largest_free = atlas_size, .first_child = -1, .allocated = false });
+		tile_count = 0;
+		allocated_texels = 0;
+	}
+
+	ShadowAtlasTile ShadowAtlas::Allocate(uint32 tile_size)
+	{
+		tile_size = std::clamp(std::bit_ceil(tile_size), min_tile_size, atlas_size);
+		int32 const node_index = AllocateNode(0, tile_size);
+		if (node_index < 0) return ShadowAtlasTile{};
+
+		++tile_count;
+		allocated_texels += (uint64)tile_size * tile_size;
+		Node const& node = nodes[node_index];
+		return ShadowAtlasTile{ .x = node.x, .y = node.y, .size = node.size };
+	}
+
+	void ShadowAtlas::Free(ShadowAtlasTile const& tile)
+	{
+		if (!tile.IsValid()) return;
+		bool const freed = FreeNode(0, tile);
+		ADRIA_ASSERT_MSG(freed, "Freeing a tile that was not allocated from this atlas!");
+		if (freed)
+		{
+			--tile_count;
+			allocated_texels -= (uint64)tile.size * tile.size;
+		}
+	}
+
+	ShadowAtlasStats ShadowAtlas::GetStats() const
+	{
+		return ShadowAtlasStats
+		{
+			.atlas_size = atlas_size,
+			.tile_count = tile_count,
+			.allocated_texels = allocated_texels,
+			.largest_free_tile = nodes[0].largest_free
+		};
+	}
+
+	int32 ShadowAtlas::AllocateNode(int32 node_index, uint32 tile_size)
+	{
+		if (nodes[node_index].largest_free < tile_size) return -1;
+		if (nodes[node_index].first_child < 0)
+		{
+			Node& node = nodes[node_index];
+			ADRIA_ASSERT(!node.allocated);
+			if (node.size == tile_size)
+			{
+				node.allocated = true;
+				node.largest_free = 0;
+				return node_index;
+			}
+			Split(node_index);
+		}
+
+		//best fit keeps the large quadrants free for large tiles
+		int32 best_child = -1;
+		for (int32 i = 0; i < 4; ++i)
+		{
+			int32 const child = nodes[node_index].first_child + i;
+			if (nodes[child].largest_free < tile_size) continue;
+			if (best_child < 0 || nodes[child].largest_free < nodes[best_child].largest_free) best_child = child;
+		}
+		ADRIA_ASSERT(best_child >= 0);
+		int32 const allocated_node = AllocateNode(best_child, tile_size);
+		UpdateLargestFree(node_index);
+		return allocated_node;
+	}
+
+	bool ShadowAtlas::FreeNode(int32 node_index, ShadowAtlasTile const& tile)
+	{
+		Node& node = nodes[node_index];
+		if (node.first_child < 0)
+		{
+			if (!node.allocated || node.x != tile.x || node.y != tile.y || node.size != tile.size) return false;
+			node.allocated = false;
+			node.largest_free = node.size;
+			return true;
+		}
+
+		uint32 const half_size = node.size / 2;
+		int32 const quadrant = (tile.x >= node.x + half_size ? 1 : 0) + (tile.y >= node.y + half_size ? 2 : 0);
+		if (!FreeNode(node.first_child + quadrant, tile)) return false;
+
+		bool children_free = true;
+		for (int32 i = 0; i < 4; ++i)
+		{
+			Node const& child = nodes[node.first_child + i];
+			children_free &= child.first_child < 0 && !child.allocated;
+		}
+		if (children_free)
+		{
+			free_child_blocks.push_back(node.first_child);
+			node.first_child = -1;
+		}
+		UpdateLargestFree(node_index);
+		return true;
+	}
+
+	void ShadowAtlas::Split(int32 node_index)
+	{
+		Node const parent = nodes[node_index];
+		ADRIA_ASSERT(parent.first_child < 0 && !parent.allocated && parent.size > min_tile_size);
+
+		int32 first_child = -1;
+		if (!free_child_blocks.empty())
+		{
+			first_child = free_child_blocks.back();
+			free_child_blocks.pop_back();
+		}
+		else
+		{
+			first_child = (int32)nodes.size();
+			nodes.resize(nodes.size() + 4);
+		}
+
+		uint32 const half_size = parent.size / 2;
+		for (uint32 i = 0; i < 4; ++i)
+		{
+			nodes[first_child + i] = Node
+			{
+				.x = parent.x + (i & 1) * half_size,
+				.y = parent.y + (i >> 1) * half_size,
+				.size = half_size,
+				.largest_free = half_size,
+				.first_child = -1,
+				.allocated = false
+			};
+		}
+		nodes[node_index].first_child = first_child;
+	}
+
+	void ShadowAtlas::UpdateLargestFree(int32 node_index)
+	{
+		Node& node = nodes[node_index];
+		if (node.first_child < 0)
+		{
+			node.largest_free = node.allocated ? 0 : node.size;
+			return;
+		}
+		uint32 largest_free = 0;
+		for (int32 i = 0; i < 4; ++i) largest_free = std::max(largest_free, nodes[node.first_child + i].largest_free);
+		node.largest_free = largest_free;
+	}
+}
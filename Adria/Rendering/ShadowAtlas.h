@@ -0,0 +1,70 @@
+#pragma once
+#include <vector>
+
+namespace adria
+{
+	struct ShadowAtlasTile
+	{
+		uint32 x = 0;
+		uint32 y = 0;
+		uint32 size = 0;
+
+		bool IsValid() const { return size != 0; }
+		bool operator==(ShadowAtlasTile const&) const = default;
+	};
+
+	struct ShadowAtlasStats
+	{
+		uint32 atlas_size;
+		uint32 tile_count;
+		uint64 allocated_texels;
+		uint32 largest_free_tile;
+
+		float GetOccupancy() const
+		{
+			uint64 const atlas_texels = (uint64)atlas_size * atlas_size;
+			return atlas_texels ? (float)allocated_texels / atlas_texels : 0.0f;
+		}
+	};
+
+	//Quadtree allocator of square power of two tiles inside one square atlas. A tile is taken from the smallest free
+	//node that fits, splitting it into quadrants until the size matches, and freed tiles are merged back with their
+	//siblings so larger tiles become available again.
+	class ShadowAtlas
+	{
+		struct Node
+		{
+			uint32 x;
+			uint32 y;
+			uint32 size;
+			uint32 largest_free;
+			int32  first_child;
+			bool   allocated;
+		};
+
+	public:
+		ShadowAtlas(uint32 atlas_size, uint32 min_tile_size);
+
+		void Reset(uint32 atlas_size);
+		ShadowAtlasTile Allocate(uint32 tile_size);
+		void Free(ShadowAtlasTile const& tile);
+
+		uint32 GetSize() const { return atlas_size; }
+		uint32 GetMinTileSize() const { return min_tile_size; }
+		ShadowAtlasStats GetStats() const;
+
+	private:
+		std::vector<Node> nodes;
+		std::vector<int32> free_child_blocks;
+		uint32 atlas_size;
+		uint32 min_tile_size;
+		uint32 tile_count = 0;
+		uint64 allocated_texels = 0;
+
+	private:
+		int32 AllocateNode(int32 node_index, uint32 tile_size);
+		bool FreeNode(int32 node_index, ShadowAtlasTile const& tile);
+		void Split(int32 node_index);
+		void UpdateLargestFree(int32 node_index);
+	};
+}
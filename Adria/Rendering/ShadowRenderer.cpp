@@ -1,9 +1,12 @@
+#include <bit>
+#include <numeric>
 #include "ShadowRenderer.h"
 #include "Components.h"
 #include "Camera.h"
 #include "ShaderManager.h"
 #include "BlackboardData.h"
 #include "ShaderStructs.h"
+#include "GPUScene.h"
 #include "Graphics/GfxBuffer.h"
 #include "Graphics/GfxTexture.h"
 #include "Graphics/GfxDevice.h"
@@ -11,13 +14,32 @@
 #include "Graphics/GfxReflection.h"
 #include "Graphics/GfxPipelineStatePermutations.h"
 #include "RenderGraph/RenderGraph.h"
+#include "Editor/GUICommand.h"
+#include "Core/CpuProfiler.h"
+#include "Core/ConsoleManager.h"
+#include "Utilities/JobSystem.h"
 
 using namespace DirectX;
 
 namespace adria
 {
+	static TAutoConsoleVariable<bool> ShadowCaching("r.Shadows.Caching", true, "Keep static shadow casters of spot and point lights cached per light face and only draw dynamic casters on top of them every frame");
+	static TAutoConsoleVariable<int>  ShadowAtlasSize("r.Shadows.AtlasSize", 4096, "Size of the shadow atlas every shadow map view is packed into, rounded up to a power of two");
+	static TAutoConsoleVariable<int>  ShadowAtlasMaxResizes("r.Shadows.AtlasMaxResizesPerFrame", 2, "Lights whose shadow map resolution can change in one frame, the others keep their atlas tiles until a later frame");
+
 	namespace
 	{
+		//moves the center of a directional shadow volume in whole texels (and depth steps of the same size), so shadow
+		//edges don't shimmer while the camera moves
+		Vector3 SnapToShadowTexels(Vector3 const& center, Vector3 const& light_dir, float texel_size)
+		{
+			Matrix const light_rotation = XMMatrixLookAtLH(Vector3::Zero, light_dir, Vector3::Up);
+			Vector3 light_space_center = Vector3::Transform(center, light_rotation);
+			light_space_center.x = std::floor(light_space_center.x / texel_size) * texel_size;
+			light_space_center.y = std::floor(light_space_center.y / texel_size) * texel_size;
+			light_space_center.z = std::floor(light_space_center.z / texel_size) * texel_size;
+			return Vector3::Transform(light_space_center, light_rotation.Invert());
+		}
 
 		std::pair<Matrix, Matrix> LightViewProjection_Directional(Light const& light, Camera const& camera, uint32 shadow_size)
 		{
@@ -47,6 +69,7 @@ namespace adria
 			Vector3 const min_extents = -max_extents;
 
 			Vector3 light_dir = XMVector3Normalize(light.direction);
+			frustum_center = SnapToShadowTexels(frustum_center, light_dir, 2.0f * radius / shadow_size);
 			Matrix V = XMMatrixLookAtLH(frustum_center, frustum_center + 1.0f * light_dir * radius, Vector3::Up);
 
 			float l = min_extents.x;
@@ -160,6 +183,7 @@ namespace adria
 			Vector3 const cascade_extents = max_extents - min_extents;
 
 			Vector3 light_dir = XMVector3Normalize(light.direction);
+			frustum_center = SnapToShadowTexels(frustum_center, light_dir, 2.0f * radius / shadow_cascade_size);
 			Matrix V = XMMatrixLookAtLH(frustum_center, frustum_center + light_distance_factor * light_dir * radius, Vector3::Up);
 
 			float l = min_extents.x;
@@ -183,14 +207,45 @@ namespace adria
 			P.m[3][1] += rounded_offset.y;
 			return { V,P };
 		}
+
+		//fraction of the screen height covered by the light volume, 0 when it is outside of the camera frustum
+		float ShadowScreenCoverage(Light const& light, Camera const& camera, BoundingFrustum const& camera_frustum)
+		{
+			Vector3 const light_pos(light.position);
+			if (!camera_frustum.Intersects(BoundingSphere(light_pos, light.range))) return 0.0f;
+			float const distance = Vector3::Distance(camera.Position(), light_pos);
+			if (distance <= light.range) return 1.0f;
+			return std::min(light.range / (distance * std::tan(camera.Fov() * 0.5f)), 1.0f);
+		}
+		uint32 ShadowTileSize(uint32 max_tile_size, uint32 min_tile_size, float coverage)
+		{
+			return std::clamp(std::bit_ceil((uint32)(max_tile_size * coverage)), min_tile_size, max_tile_size);
+		}
+		//maps the clip space of a shadow view onto its atlas tile, the shadow pass renders with it into the tile and the
+		//lighting samples the atlas with it, so neither has to know about the atlas layout
+		Matrix AtlasTileTransform(ShadowAtlasTile const& tile, uint32 atlas_size)
+		{
+			float const scale = (float)tile.size / atlas_size;
+			float const offset_x = 2.0f * (tile.x + 0.5f * tile.size) / atlas_size - 1.0f;
+			float const offset_y = 1.0f - 2.0f * (tile.y + 0.5f * tile.size) / atlas_size;
+			return XMMatrixScaling(scale, scale, 1.0f) * XMMatrixTranslation(offset_x, offset_y, 0.0f);
+		}
+		//uv bounds of a tile (min xy, max xy), the lighting clamps its shadow map taps to them
+		Vector4 AtlasTileBounds(ShadowAtlasTile const& tile, uint32 atlas_size)
+		{
+			return Vector4((float)tile.x, (float)tile.y, (float)(tile.x + tile.size), (float)(tile.y + tile.size)) / (float)atlas_size;
+		}
 	}
 
 	ShadowRenderer::ShadowRenderer(entt::registry& reg, GfxDevice* gfx, uint32 width, uint32 height) : reg(reg), gfx(gfx), width(width), height(height),
-		ray_traced_shadows_pass(gfx, width, height) 
+		ray_traced_shadows_pass(gfx, width, height), shadow_atlas(SHADOW_MAP_SIZE, SHADOW_MIN_TILE_SIZE)
 	{
 		CreatePSOs();
 	}
-	ShadowRenderer::~ShadowRenderer() {}
+	ShadowRenderer::~ShadowRenderer()
+	{
+		if (shadow_atlas_residency != INVALID_RESIDENCY_HANDLE) gfx->GetResidencyManager()->Unregister(shadow_atlas_residency);
+	}
 
 	void ShadowRenderer::FillFrameCBuffer(FrameCBuffer& frame_cbuffer)
 	{
@@ -199,8 +254,9 @@ namespace adria
 	}
 	void ShadowRenderer::SetupShadows(Camera const* camera)
 	{
-		static constexpr uint32 backbuffer_count = GFX_BACKBUFFER_COUNT;
-		uint32 backbuffer_index = gfx->GetBackbufferIndex();
+		uint32 const atlas_size = std::clamp(std::bit_ceil((uint32)std::max(ShadowAtlasSize.Get(), 1)), SHADOW_MAP_SIZE, 16384u);
+		if (!shadow_atlas_texture || shadow_atlas.GetSize() != atlas_size) CreateShadowAtlas(atlas_size);
+		gfx->GetResidencyManager()->MarkUsed(shadow_atlas_residency);
 
 		auto AddShadowMask = [&](Light& light, uint64 light_id)
 		{
@@ -224,109 +280,56 @@ namespace adria
 			gfx->CopyDescriptors(1, dst_descriptor, srv);
 			light.shadow_mask_index = (int32)dst_descriptor.GetIndex();
 		};
-		auto AddShadowMap  = [&](uint64 light_id, uint32 shadow_map_size)
-		{
-			GfxTextureDesc depth_desc{};
-			depth_desc.width = shadow_map_size;
-			depth_desc.height = shadow_map_size;
-			depth_desc.format = GfxFormat::R32_TYPELESS;
-			depth_desc.clear_value = GfxClearValue(1.0f, 0);
-			depth_desc.bind_flags = GfxBindFlag::DepthStencil | GfxBindFlag::ShaderResource;
-			depth_desc.initial_state = GfxResourceState::DSV;
-
-			light_shadow_maps[light_id].emplace_back(gfx->CreateTexture(depth_desc));
-			light_shadow_map_srvs[light_id].push_back(gfx->CreateTextureSRV(light_shadow_maps[light_id].back().get()));
-			light_shadow_map_dsvs[light_id].push_back(gfx->CreateTextureDSV(light_shadow_maps[light_id].back().get()));
-		};
-		auto AddShadowMaps = [&](Light& light, uint64 light_id)
-		{
-			switch (light.type)
-			{
-			case LightType::Directional:
-			{
-				if (light.use_cascades && light_shadow_maps[light_id].size() != SHADOW_CASCADE_COUNT)
-				{
-					light_shadow_maps[light_id].clear();
-					light_shadow_map_srvs[light_id].clear();
-					light_shadow_map_dsvs[light_id].clear();
-					for (uint32 i = 0; i < SHADOW_CASCADE_COUNT; ++i) AddShadowMap(light_id, SHADOW_CASCADE_MAP_SIZE);
-				}
-				else if (!light.use_cascades && light_shadow_maps[light_id].size() != 1)
-				{
-					light_shadow_maps[light_id].clear();
-					light_shadow_map_srvs[light_id].clear();
-					light_shadow_map_dsvs[light_id].clear();
-					AddShadowMap(light_id, SHADOW_MAP_SIZE);
-				}
-			}
-			break;
-			case LightType::Point:
-			{
-				if (light_shadow_maps[light_id].size() != 6)
-				{
-					light_shadow_maps[light_id].clear();
-					light_shadow_map_srvs[light_id].clear();
-					light_shadow_map_dsvs[light_id].clear();
-					for (uint32 i = 0; i < 6; ++i) AddShadowMap(light_id, SHADOW_CUBE_SIZE);
-				}
-			}
-			break;
-			case LightType::Spot:
-			{
-				if (light_shadow_maps[light_id].size() != 1)
-				{
-					light_shadow_maps[light_id].clear();
-					light_shadow_map_srvs[light_id].clear();
-					light_shadow_map_dsvs[light_id].clear();
-					AddShadowMap(light_id, SHADOW_MAP_SIZE);
-				}
-			}
-			break;
-			}
-
-			for (uint64 j = 0; j < light_shadow_maps[light_id].size(); ++j)
-			{
-				GfxDescriptor srv = light_shadow_map_srvs[light_id][j];
-				GfxDescriptor dst_descriptor = gfx->AllocateDescriptorsGPU();
-				gfx->CopyDescriptors(1, dst_descriptor, srv);
-				if (j == 0) light.shadow_texture_index = (int32)dst_descriptor.GetIndex();
-			}
-		};
-
-		static uint64 light_matrices_count = 0;
-		uint64 current_light_matrices_count = 0;
 
+		//directional lights always get their full resolution, local lights scale with how much of the screen they cover
+		BoundingFrustum const camera_frustum = camera->Frustum();
+		std::vector<ShadowTileRequest> tile_requests;
 		auto light_view = reg.view<Light>();
 		for (auto e : light_view)
 		{
-			auto& light = light_view.get<Light>(e);
-			if (light.casts_shadows)
+			Light const& light = light_view.get<Light>(e);
+			if (!light.casts_shadows || light.ray_traced_shadows) continue;
+
+			ShadowTileRequest& tile_request = tile_requests.emplace_back();
+			tile_request.light_id = entt::to_integral(e);
+			if (light.type == LightType::Directional)
 			{
-				if (light.type == LightType::Directional && light.use_cascades) current_light_matrices_count += SHADOW_CASCADE_COUNT;
-				else if (light.type == LightType::Point) current_light_matrices_count += 6;
-				else current_light_matrices_count++;
+				tile_request.face_count = light.use_cascades ? SHADOW_CASCADE_COUNT : 1;
+				tile_request.tile_size = light.use_cascades ? SHADOW_CASCADE_MAP_SIZE : SHADOW_MAP_SIZE;
+				tile_request.priority = std::numeric_limits<float>::max();
+				continue;
 			}
-		}
 
-		if (current_light_matrices_count != light_matrices_count)
-		{
-			gfx->WaitForGPU();
-			light_matrices_count = current_light_matrices_count;
-			if (light_matrices_count != 0)
+			uint32 const max_tile_size = light.type == LightType::Point ? SHADOW_CUBE_SIZE : SHADOW_MAP_SIZE;
+			float const coverage = ShadowScreenCoverage(light, *camera, camera_frustum);
+			tile_request.face_count = light.type == LightType::Point ? 6 : 1;
+			tile_request.tile_size = ShadowTileSize(max_tile_size, SHADOW_MIN_TILE_SIZE, coverage);
+			tile_request.priority = coverage;
+
+			//lights only drop to a lower resolution once they cover half the screen they would need to keep it, so lights
+			//near a size boundary do not bounce between two tiles
+			auto tiles_it = light_atlas_tiles.find(tile_request.light_id);
+			if (tiles_it != light_atlas_tiles.end() && tiles_it->second.size() == tile_request.face_count)
 			{
-				light_matrices_buffer = gfx->CreateBuffer(StructuredBufferDesc<Matrix>(light_matrices_count * backbuffer_count, false, true));
-				GfxBufferDescriptorDesc srv_desc{};
-				srv_desc.size = light_matrices_count * sizeof(Matrix);
-				for (uint32 i = 0; i < backbuffer_count; ++i)
+				uint32 const current_tile_size = tiles_it->second[0].size;
+				if (tile_request.tile_size < current_tile_size && ShadowTileSize(max_tile_size, SHADOW_MIN_TILE_SIZE, 2.0f * coverage) >= current_tile_size)
 				{
-					srv_desc.offset = i * light_matrices_count * sizeof(Matrix);
-					light_matrices_buffer_srvs[i] = gfx->CreateBufferSRV(light_matrices_buffer.get(), &srv_desc);
+					tile_request.tile_size = current_tile_size;
 				}
 			}
 		}
+		AllocateAtlasTiles(tile_requests);
+
+		GfxDescriptor shadow_atlas_srv_gpu = gfx->AllocateDescriptorsGPU();
+		gfx->CopyDescriptors(1, shadow_atlas_srv_gpu, shadow_atlas_srv);
 
 		std::vector<Matrix> _light_matrices;
-		_light_matrices.reserve(light_matrices_count);
+		std::vector<ShadowViewGPU> atlas_shadow_views;
+		auto AddLightMatrix = [&](Matrix const& view_projection, ShadowAtlasTile const& tile)
+		{
+			_light_matrices.push_back(XMMatrixTranspose(view_projection));
+			atlas_shadow_views.push_back(ShadowViewGPU{ .view_projection = XMMatrixTranspose(view_projection * AtlasTileTransform(tile, atlas_size)), .tile_bounds = AtlasTileBounds(tile, atlas_size) });
+		};
 		for (auto e : light_view)
 		{
 			auto& light = light_view.get<Light>(e);
@@ -335,41 +338,43 @@ namespace adria
 			if (light.casts_shadows)
 			{
 				if (light.ray_traced_shadows) continue;
+				//lights that did not fit into the atlas are left without shadows for this frame
+				auto tiles_it = light_atlas_tiles.find(entt::to_integral(e));
+				if (tiles_it == light_atlas_tiles.end()) continue;
+				std::vector<ShadowAtlasTile> const& tiles = tiles_it->second;
+
+				light.shadow_texture_index = (int32)shadow_atlas_srv_gpu.GetIndex();
 				light.shadow_matrix_index = (uint32)_light_matrices.size();
 				if (light.type == LightType::Directional)
 				{
 					if (light.use_cascades)
 					{
 						std::array<Matrix, SHADOW_CASCADE_COUNT> proj_matrices = RecalculateProjectionMatrices(*camera, cascades_split_lambda, split_distances);
-						AddShadowMaps(light, entt::to_integral(e));
 						for (uint32 i = 0; i < SHADOW_CASCADE_COUNT; ++i)
 						{
-							auto const& [V, P] = LightViewProjection_Cascades(light, *camera, proj_matrices[i], SHADOW_CASCADE_MAP_SIZE);
-							_light_matrices.push_back(XMMatrixTranspose(V * P));
+							auto const& [V, P] = LightViewProjection_Cascades(light, *camera, proj_matrices[i], tiles[i].size);
+							AddLightMatrix(V * P, tiles[i]);
 						}
 					}
 					else
 					{
-						AddShadowMaps(light, entt::to_integral(e));
-						auto const& [V, P] = LightViewProjection_Directional(light, *camera, SHADOW_MAP_SIZE);
-						_light_matrices.push_back(XMMatrixTranspose(V * P));
+						auto const& [V, P] = LightViewProjection_Directional(light, *camera, tiles[0].size);
+						AddLightMatrix(V * P, tiles[0]);
 					}
 
 				}
 				else if (light.type == LightType::Point)
 				{
-					AddShadowMaps(light, entt::to_integral(e));
 					for (uint32 i = 0; i < 6; ++i)
 					{
 						auto const& [V, P] = LightViewProjection_Point(light, i);
-						_light_matrices.push_back(XMMatrixTranspose(V * P));
+						AddLightMatrix(V * P, tiles[i]);
 					}
 				}
 				else if (light.type == LightType::Spot)
 				{
-					AddShadowMaps(light, entt::to_integral(e));
 					auto const& [V, P] = LightViewProjection_Spot(light);
-					_light_matrices.push_back(XMMatrixTranspose(V * P));
+					AddLightMatrix(V * P, tiles[0]);
 				}
 			}
 			else if (light.ray_traced_shadows)
@@ -377,110 +382,94 @@ namespace adria
 				AddShadowMask(light, entt::to_integral(e));
 			}
 		}
-		if (light_matrices_buffer)
-		{
-			light_matrices_buffer->Update(_light_matrices.data(), light_matrices_count * sizeof(Matrix), light_matrices_count * sizeof(Matrix) * backbuffer_index);
-			GfxDescriptor dst_descriptor = gfx->AllocateDescriptorsGPU();
-			gfx->CopyDescriptors(1, dst_descriptor, light_matrices_buffer_srvs[backbuffer_index]);
-			light_matrices_gpu_index = (int32)dst_descriptor.GetIndex();
-		}
+		UpdateLightMatricesBuffer(atlas_shadow_views);
 		light_matrices = std::move(_light_matrices);
 	}
 
-	void ShadowRenderer::AddShadowMapPasses(RenderGraph& rg)
+	void ShadowRenderer::AddShadowMapPasses(RenderGraph& rg, GPUScene const& gpu_scene)
 	{
-		FrameBlackboardData const& frame_data = rg.GetBlackboard().Get<FrameBlackboardData>();
-		auto light_view = reg.view<Light>();
-		for (auto e : light_view)
+		CullShadowCasters(gpu_scene);
+		if (shadow_views.empty() || !shadow_atlas_texture) return;
+
+		rg.ImportTexture(RG_NAME(ShadowAtlas), shadow_atlas_texture.get());
+		if (std::none_of(shadow_views.begin(), shadow_views.end(), [](ShadowView const& shadow_view) { return shadow_view.cached; }))
 		{
-			auto& light = light_view.get<Light>(e);
-			if (!light.casts_shadows) continue;
-			int32 light_index = light.light_index;
-			int32 light_matrix_index = light.shadow_matrix_index;
-			uint64 light_id = entt::to_integral(e);
+			std::vector<uint32> view_indices(shadow_views.size());
+			std::iota(view_indices.begin(), view_indices.end(), 0u);
+			AddShadowAtlasPass(rg, "Shadow Atlas Pass", RG_NAME(ShadowAtlas), ShadowAtlasClear::Atlas, view_indices, &ShadowView::static_casters);
+			shadow_atlas_static = false;
+			shadow_rendered_event.Broadcast(RG_NAME(ShadowAtlas));
+			return;
+		}
 
-			if (light.type == LightType::Directional)
-			{
-				if (light.use_cascades)
-				{
-					for (uint32 i = 0; i < SHADOW_CASCADE_COUNT; ++i)
-					{
-						rg.ImportTexture(RG_NAME_IDX(ShadowMap, light_matrix_index + i), light_shadow_maps[light_id][i].get());
-						std::string name = "Cascade Shadow Pass" + std::to_string(i);
-						rg.AddPass<void>(name.c_str(),
-							[=](RenderGraphBuilder& builder)
-							{
-								builder.WriteDepthStencil(RG_NAME_IDX(ShadowMap, light_matrix_index + i), RGLoadStoreAccessOp::Clear_Preserve);
-								builder.SetViewport(SHADOW_CASCADE_MAP_SIZE, SHADOW_CASCADE_MAP_SIZE);
-							},
-							[=](RenderGraphContext& context, GfxCommandList* cmd_list)
-							{
-								cmd_list->SetRootCBV(0, frame_data.frame_cbuffer_address);
-								ShadowMapPass_Common(gfx, cmd_list, light_index, light_matrix_index, i);
-							}, RGPassType::Graphics);
+		if (!static_atlas_texture)
+		{
+			static_atlas_texture = gfx->CreateTexture(shadow_atlas_texture->GetDesc());
+			uint64 const atlas_bytes = (uint64)shadow_atlas.GetSize() * shadow_atlas.GetSize() * sizeof(float);
+			gfx->GetResidencyManager()->UpdateSize(shadow_atlas_residency, 2 * atlas_bytes, 2 * atlas_bytes);
+		}
 
-						shadow_rendered_event.Broadcast(RG_NAME_IDX(ShadowMap, light_matrix_index + i));
-					}
-				}
-				else
-				{
-					rg.ImportTexture(RG_NAME_IDX(ShadowMap, light.shadow_matrix_index), light_shadow_maps[light_id][0].get());
-					std::string name = "Directional Shadow Pass";
-					rg.AddPass<void>(name.c_str(),
-						[=](RenderGraphBuilder& builder)
-						{
-							builder.WriteDepthStencil(RG_NAME_IDX(ShadowMap, light.shadow_matrix_index), RGLoadStoreAccessOp::Clear_Preserve);
-							builder.SetViewport(SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
-						},
-						[=](RenderGraphContext& context, GfxCommandList* cmd_list)
-						{
-							cmd_list->SetRootCBV(0, frame_data.frame_cbuffer_address);
-							ShadowMapPass_Common(gfx, cmd_list, light_index, light_matrix_index, 0);
-						}, RGPassType::Graphics);
+		std::vector<uint32> static_views;
+		std::vector<uint32> dynamic_views;
+		std::vector<uint32> uncached_views;
+		for (uint32 i = 0; i < shadow_views.size(); ++i)
+		{
+			if (!shadow_views[i].cached) uncached_views.push_back(i);
+			else if (!shadow_views[i].cache->IsValid()) static_views.push_back(i);
+			if (shadow_views[i].dynamic_casters.GetCount() > 0) dynamic_views.push_back(i);
+		}
 
-					shadow_rendered_event.Broadcast(RG_NAME_IDX(ShadowMap, light.shadow_matrix_index));
-				}
-			}
-			else if (light.type == LightType::Point)
+		//the static atlas holds the static casters of every view, only the tiles of invalid caches are redrawn
+		bool const copy_static_atlas = !static_views.empty() || !dynamic_views.empty() || !shadow_atlas_static;
+		if (!static_views.empty() || copy_static_atlas) rg.ImportTexture(RG_NAME(StaticShadowAtlas), static_atlas_texture.get());
+		if (!static_views.empty())
+		{
+			AddShadowAtlasPass(rg, "Static Shadow Atlas Pass", RG_NAME(StaticShadowAtlas), ShadowAtlasClear::Tiles, static_views, &ShadowView::static_casters);
+			for (uint32 view_index : static_views)
 			{
-				for (uint32 i = 0; i < 6; ++i)
-				{
-					rg.ImportTexture(RG_NAME_IDX(ShadowMap, light.shadow_matrix_index + i), light_shadow_maps[light_id][i].get());
-					std::string name = "Point Shadow Pass" + std::to_string(i);
-					rg.AddPass<void>(name.c_str(),
-						[=](RenderGraphBuilder& builder)
-						{
-							builder.WriteDepthStencil(RG_NAME_IDX(ShadowMap, light.shadow_matrix_index + i), RGLoadStoreAccessOp::Clear_Preserve);
-							builder.SetViewport(SHADOW_CUBE_SIZE, SHADOW_CUBE_SIZE);
-						},
-						[=](RenderGraphContext& context, GfxCommandList* cmd_list)
-						{
-							cmd_list->SetRootCBV(0, frame_data.frame_cbuffer_address);
-							ShadowMapPass_Common(gfx, cmd_list, light_index, light_matrix_index, i);
-						}, RGPassType::Graphics);
-
-					shadow_rendered_event.Broadcast(RG_NAME_IDX(ShadowMap, light.shadow_matrix_index + i));
-				}
+				shadow_views[view_index].static_redrawn = true;
+				shadow_views[view_index].cache->valid = true;
 			}
-			else if (light.type == LightType::Spot)
+		}
+		//without changes and dynamic casters the shadow atlas still holds exactly the static atlas from a previous frame
+		if (copy_static_atlas)
+		{
+			struct CopyShadowAtlasPassData
 			{
-				rg.ImportTexture(RG_NAME_IDX(ShadowMap, light_matrix_index), light_shadow_maps[light_id][0].get());
-				std::string name = "Spot Shadow Pass";
-				rg.AddPass<void>(name.c_str(),
-					[=](RenderGraphBuilder& builder)
-					{
-						builder.WriteDepthStencil(RG_NAME_IDX(ShadowMap, light_matrix_index), RGLoadStoreAccessOp::Clear_Preserve);
-						builder.SetViewport(SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
-					},
-					[=](RenderGraphContext& context, GfxCommandList* cmd_list)
-					{
-						cmd_list->SetRootCBV(0, frame_data.frame_cbuffer_address);
-						ShadowMapPass_Common(gfx, cmd_list, light_index, light_matrix_index, 0);
-					}, RGPassType::Graphics);
+				RGTextureCopySrcId copy_src;
+				RGTextureCopyDstId copy_dst;
+			};
+			rg.AddPass<CopyShadowAtlasPassData>("Static Shadow Atlas Copy Pass",
+				[=](CopyShadowAtlasPassData& data, RenderGraphBuilder& builder)
+				{
+					data.copy_dst = builder.WriteCopyDstTexture(RG_NAME(ShadowAtlas));
+					data.copy_src = builder.ReadCopySrcTexture(RG_NAME(StaticShadowAtlas));
+				},
+				[=](CopyShadowAtlasPassData const& data, RenderGraphContext& context, GfxCommandList* cmd_list)
+				{
+					GfxTexture const& src_texture = context.GetCopySrcTexture(data.copy_src);
+					GfxTexture& dst_texture = context.GetCopyDstTexture(data.copy_dst);
+					cmd_list->CopyTexture(dst_texture, src_texture);
+				}, RGPassType::Copy, RGPassFlags::ForceNoCull);
+			shadow_atlas_static = true;
+		}
+		if (!dynamic_views.empty())
+		{
+			AddShadowAtlasPass(rg, "Dynamic Shadow Atlas Pass", RG_NAME(ShadowAtlas), ShadowAtlasClear::None, dynamic_views, &ShadowView::dynamic_casters);
+			shadow_atlas_static = false;
+		}
+		//uncached tiles are cleared and drawn with all their casters, the cached tiles of the atlas are left untouched
+		if (!uncached_views.empty())
+		{
+			AddShadowAtlasPass(rg, "Uncached Shadow Atlas Pass", RG_NAME(ShadowAtlas), ShadowAtlasClear::Tiles, uncached_views, &ShadowView::static_casters);
+		}
 
-				shadow_rendered_event.Broadcast(RG_NAME_IDX(ShadowMap, light_matrix_index));
-			}
+		for (ShadowView const& shadow_view : shadow_views)
+		{
+			shadow_view.cache->view_projection = shadow_view.view_projection;
+			shadow_view.cache->tile = shadow_view.tile;
 		}
+		shadow_rendered_event.Broadcast(RG_NAME(ShadowAtlas));
 	}
 	void ShadowRenderer::AddRayTracingShadowPasses(RenderGraph& rg)
 	{
@@ -498,6 +487,63 @@ namespace adria
 		}
 	}
 
+	void ShadowRenderer::GUI()
+	{
+		QueueGUI([&]()
+			{
+				if (ImGui::TreeNodeEx("Shadow Atlas", ImGuiTreeNodeFlags_None))
+				{
+					ShadowAtlasStats const atlas_stats = shadow_atlas.GetStats();
+					ImGui::Text("Size: %ux%u", atlas_stats.atlas_size, atlas_stats.atlas_size);
+					ImGui::Text("Occupancy: %.1f%% (%u tiles)", 100.0f * atlas_stats.GetOccupancy(), atlas_stats.tile_count);
+					ImGui::Text("Largest Free Tile: %u", atlas_stats.largest_free_tile);
+					ImGui::Text("Lights Resized: %u, Dropped: %u%s", atlas_resized_lights, atlas_dropped_lights, atlas_repacked ? ", Repacked" : "");
+					ImGui::TreePop();
+					ImGui::Separator();
+				}
+				if (ImGui::TreeNodeEx("Shadow Caster Culling", ImGuiTreeNodeFlags_None))
+				{
+					uint32 const caster_count = (uint32)(opaque_casters.size() + masked_casters.size());
+					ImGui::Checkbox("Cache Static Casters", ShadowCaching.GetPtr());
+					ImGui::Text("Casters: %u opaque, %u masked, %u dynamic", (uint32)opaque_casters.size(), (uint32)masked_casters.size(), (uint32)dynamic_casters.size());
+					if (ImGui::BeginTable("Shadow Views", 6, ImGuiTableFlags_SizingFixedFit | ImGuiTableFlags_RowBg))
+					{
+						ImGui::TableSetupColumn("View");
+						ImGui::TableSetupColumn("Tile");
+						ImGui::TableSetupColumn("Draws Before");
+						ImGui::TableSetupColumn("Visible");
+						ImGui::TableSetupColumn("Draws After");
+						ImGui::TableSetupColumn("Static Layer");
+						ImGui::TableHeadersRow();
+						for (ShadowView const& shadow_view : shadow_views)
+						{
+							ImGui::TableNextRow();
+							ImGui::TableSetColumnIndex(0);
+							switch (shadow_view.light_type)
+							{
+							case LightType::Directional: ImGui::Text("Directional %llu: Cascade %u", shadow_view.light_id, shadow_view.face_index); break;
+							case LightType::Point:		 ImGui::Text("Point %llu: Face %u", shadow_view.light_id, shadow_view.face_index); break;
+							case LightType::Spot:		 ImGui::Text("Spot %llu", shadow_view.light_id); break;
+							}
+							ImGui::TableSetColumnIndex(1);
+							ImGui::Text("%u", shadow_view.tile.size);
+							ImGui::TableSetColumnIndex(2);
+							ImGui::Text("%u", caster_count);
+							ImGui::TableSetColumnIndex(3);
+							ImGui::Text("%u", shadow_view.visible_caster_count);
+							ImGui::TableSetColumnIndex(4);
+							ImGui::Text("%u", shadow_view.draw_count);
+							ImGui::TableSetColumnIndex(5);
+							ImGui::Text("%s", !ShadowCaching.Get() ? "Off" : (!shadow_view.cached ? "Uncached" : (shadow_view.static_redrawn ? "Redrawn" : "Cached")));
+						}
+						ImGui::EndTable();
+					}
+					ImGui::TreePop();
+					ImGui::Separator();
+				}
+			}, GUICommandGroup_Renderer);
+	}
+
 	void ShadowRenderer::CreatePSOs()
 	{
 		using enum GfxShaderStage;
@@ -511,6 +557,8 @@ namespace adria
 		gfx_pso_desc.rasterizer_state.depth_bias = 7500;
 		gfx_pso_desc.rasterizer_state.depth_bias_clamp = 0.0f;
 		gfx_pso_desc.rasterizer_state.slope_scaled_depth_bias = 1.0f;
+		//casters in front of the near plane are kept by culling (FrustumCullFlags::InfiniteNear) and clamped onto it here
+		gfx_pso_desc.rasterizer_state.depth_clip_enable = false;
 		gfx_pso_desc.depth_state.depth_enable = true;
 		gfx_pso_desc.depth_state.depth_write_mask = GfxDepthWriteMask::All;
 		gfx_pso_desc.depth_state.depth_func = GfxComparisonFunc::LessEqual;
@@ -521,7 +569,371 @@ namespace adria
 		shadow_psos->Finalize(gfx);
 	}
 
-	void ShadowRenderer::ShadowMapPass_Common(GfxDevice* gfx, GfxCommandList* cmd_list, uint64 light_index, uint64 matrix_index, uint64 matrix_offset)
+	void ShadowRenderer::CreateShadowAtlas(uint32 atlas_size)
+	{
+		GfxTextureDesc depth_desc{};
+		depth_desc.width = atlas_size;
+		depth_desc.height = atlas_size;
+		depth_desc.format = GfxFormat::R32_TYPELESS;
+		depth_desc.clear_value = GfxClearValue(1.0f, 0);
+		depth_desc.bind_flags = GfxBindFlag::DepthStencil | GfxBindFlag::ShaderResource;
+		depth_desc.initial_state = GfxResourceState::DSV;
+
+		//textures are released once the frames in flight are done with them, so resizing the atlas does not wait for the GPU
+		if (shadow_atlas_srv.IsValid()) gfx->FreeDescriptorCPU(shadow_atlas_srv, GfxDescriptorHeapType::CBV_SRV_UAV);
+		shadow_atlas_texture = gfx->CreateTexture(depth_desc);
+		shadow_atlas_srv = gfx->CreateTextureSRV(shadow_atlas_texture.get());
+		static_atlas_texture.reset();
+		shadow_atlas_static = false;
+
+		shadow_atlas.Reset(atlas_size);
+		light_atlas_tiles.clear();
+		light_shadow_caches.clear();
+
+		GfxResidencyManager* residency_manager = gfx->GetResidencyManager();
+		uint64 const atlas_bytes = (uint64)atlas_size * atlas_size * sizeof(float);
+		if (shadow_atlas_residency == INVALID_RESIDENCY_HANDLE)
+		{
+			//restoring is a no-op, an evicted atlas is recreated by the next SetupShadows and every tile is drawn again
+			shadow_atlas_residency = residency_manager->Register(atlas_bytes, atlas_bytes, GfxResidencyPriority::High,
+				GfxResidencyCallback::CreateLambda([this](GfxResidencyAction action)
+					{
+						if (action != GfxResidencyAction::Evict) return;
+						shadow_atlas_texture.reset();
+						static_atlas_texture.reset();
+					}));
+		}
+		else residency_manager->UpdateSize(shadow_atlas_residency, atlas_bytes, atlas_bytes);
+	}
+
+	void ShadowRenderer::AllocateAtlasTiles(std::vector<ShadowTileRequest>& tile_requests)
+	{
+		atlas_resized_lights = 0;
+		atlas_dropped_lights = 0;
+		atlas_repacked = false;
+
+		auto FreeLightTiles = [this](std::vector<ShadowAtlasTile> const& tiles)
+		{
+			for (ShadowAtlasTile const& tile : tiles) shadow_atlas.Free(tile);
+		};
+		auto AllocateLightTiles = [this](ShadowTileRequest const& tile_request)
+		{
+			std::vector<ShadowAtlasTile> tiles(tile_request.face_count);
+			for (uint32 i = 0; i < tile_request.face_count; ++i)
+			{
+				tiles[i] = shadow_atlas.Allocate(tile_request.tile_size);
+				if (!tiles[i].IsValid())
+				{
+					for (uint32 j = 0; j < i; ++j) shadow_atlas.Free(tiles[j]);
+					return false;
+				}
+			}
+			light_atlas_tiles[tile_request.light_id] = std::move(tiles);
+			return true;
+		};
+
+		for (auto it = light_atlas_tiles.begin(); it != light_atlas_tiles.end();)
+		{
+			uint64 const light_id = it->first;
+			if (std::none_of(tile_requests.begin(), tile_requests.end(), [light_id](ShadowTileRequest const& tile_request) { return tile_request.light_id == light_id; }))
+			{
+				FreeLightTiles(it->second);
+				light_shadow_caches.erase(light_id);
+				it = light_atlas_tiles.erase(it);
+			}
+			else ++it;
+		}
+
+		//lowest priority lights give up resolution first until every request fits into the atlas
+		std::sort(tile_requests.begin(), tile_requests.end(), [](ShadowTileRequest const& a, ShadowTileRequest const& b) { return a.priority > b.priority; });
+		auto RequestTexels = [](ShadowTileRequest const& tile_request) { return (uint64)tile_request.face_count * tile_request.tile_size * tile_request.tile_size; };
+		uint64 const atlas_texels = (uint64)shadow_atlas.GetSize() * shadow_atlas.GetSize();
+		uint64 requested_texels = 0;
+		for (ShadowTileRequest const& tile_request : tile_requests) requested_texels += RequestTexels(tile_request);
+		for (uint64 i = tile_requests.size(); i > 0 && requested_texels > atlas_texels;)
+		{
+			ShadowTileRequest& tile_request = tile_requests[i - 1];
+			if (tile_request.tile_size <= SHADOW_MIN_TILE_SIZE)
+			{
+				--i;
+				continue;
+			}
+			requested_texels -= RequestTexels(tile_request);
+			tile_request.tile_size /= 2;
+			requested_texels += RequestTexels(tile_request);
+		}
+
+		//new lights always get their tiles, lights that changed resolution are moved a few per frame
+		int32 resize_budget = std::max(ShadowAtlasMaxResizes.Get(), 1);
+		std::vector<ShadowTileRequest const*> pending_requests;
+		for (ShadowTileRequest& tile_request : tile_requests)
+		{
+			auto tiles_it = light_atlas_tiles.find(tile_request.light_id);
+			if (tiles_it == light_atlas_tiles.end())
+			{
+				pending_requests.push_back(&tile_request);
+				continue;
+			}
+			std::vector<ShadowAtlasTile> const& tiles = tiles_it->second;
+			bool const same_face_count = tiles.size() == tile_request.face_count;
+			if (same_face_count && tiles[0].size == tile_request.tile_size) continue;
+			if (same_face_count && resize_budget <= 0)
+			{
+				tile_request.tile_size = tiles[0].size;
+				continue;
+			}
+			--resize_budget;
+			++atlas_resized_lights;
+			FreeLightTiles(tiles);
+			light_atlas_tiles.erase(tiles_it);
+			pending_requests.push_back(&tile_request);
+		}
+
+		//largest tiles first keeps the quadtree from fragmenting
+		auto LargerTileFirst = [](ShadowTileRequest const& a, ShadowTileRequest const& b)
+		{
+			return a.tile_size != b.tile_size ? a.tile_size > b.tile_size : a.priority > b.priority;
+		};
+		std::sort(pending_requests.begin(), pending_requests.end(), [&](ShadowTileRequest const* a, ShadowTileRequest const* b) { return LargerTileFirst(*a, *b); });
+		bool const allocated = std::all_of(pending_requests.begin(), pending_requests.end(), [&](ShadowTileRequest const* tile_request) { return AllocateLightTiles(*tile_request); });
+		if (allocated) return;
+
+		//the free space is too fragmented, pack every light again from scratch. Their caches are invalidated by the tile change
+		//and the tiles are drawn again this frame, nothing on the GPU has to be moved.
+		atlas_repacked = true;
+		shadow_atlas.Reset(shadow_atlas.GetSize());
+		light_atlas_tiles.clear();
+		std::sort(tile_requests.begin(), tile_requests.end(), LargerTileFirst);
+		for (ShadowTileRequest& tile_request : tile_requests)
+		{
+			while (!AllocateLightTiles(tile_request) && tile_request.tile_size > SHADOW_MIN_TILE_SIZE) tile_request.tile_size /= 2;
+			if (!light_atlas_tiles.contains(tile_request.light_id)) ++atlas_dropped_lights;
+		}
+	}
+
+	void ShadowRenderer::UpdateLightMatricesBuffer(std::vector<ShadowViewGPU> const& atlas_shadow_views)
+	{
+		static constexpr uint32 backbuffer_count = GFX_BACKBUFFER_COUNT;
+		uint32 const backbuffer_index = gfx->GetBackbufferIndex();
+		uint64 const frame_index = gfx->GetFrameIndex();
+
+		//buffers that were outgrown stay alive until the frames in flight that read them are done, instead of waiting for the GPU
+		std::erase_if(retired_light_matrices_buffers, [frame_index](auto const& retired_buffer) { return frame_index >= retired_buffer.second + backbuffer_count; });
+
+		uint64 const light_matrices_count = atlas_shadow_views.size();
+		if (light_matrices_count == 0) return;
+		if (light_matrices_count > light_matrices_capacity)
+		{
+			if (light_matrices_buffer)
+			{
+				retired_light_matrices_buffers.emplace_back(std::move(light_matrices_buffer), frame_index);
+				for (GfxDescriptor& srv : light_matrices_buffer_srvs) gfx->FreeDescriptorCPU(srv, GfxDescriptorHeapType::CBV_SRV_UAV);
+			}
+			light_matrices_capacity = std::bit_ceil(light_matrices_count);
+			light_matrices_buffer = gfx->CreateBuffer(StructuredBufferDesc<ShadowViewGPU>(light_matrices_capacity * backbuffer_count, false, true));
+			GfxBufferDescriptorDesc srv_desc{};
+			srv_desc.size = light_matrices_capacity * sizeof(ShadowViewGPU);
+			for (uint32 i = 0; i < backbuffer_count; ++i)
+			{
+				srv_desc.offset = i * light_matrices_capacity * sizeof(ShadowViewGPU);
+				light_matrices_buffer_srvs[i] = gfx->CreateBufferSRV(light_matrices_buffer.get(), &srv_desc);
+			}
+		}
+
+		light_matrices_buffer->Update(atlas_shadow_views.data(), light_matrices_count * sizeof(ShadowViewGPU), light_matrices_capacity * sizeof(ShadowViewGPU) * backbuffer_index);
+		GfxDescriptor dst_descriptor = gfx->AllocateDescriptorsGPU();
+		gfx->CopyDescriptors(1, dst_descriptor, light_matrices_buffer_srvs[backbuffer_index]);
+		light_matrices_gpu_index = (int32)dst_descriptor.GetIndex();
+	}
+
+	void ShadowRenderer::UpdateDynamicCasters(GPUScene const& gpu_scene, std::vector<BoundingBox>& invalidated_bounds)
+	{
+		if (gpu_scene.GetStructureVersion() != scene_structure_version)
+		{
+			scene_structure_version = gpu_scene.GetStructureVersion();
+			caster_dynamic_frames.assign(gpu_scene.GetInstanceCount(), 0);
+			dynamic_casters.clear();
+			for (auto& [light_id, shadow_caches] : light_shadow_caches)
+			{
+				for (ShadowCache& shadow_cache : shadow_caches) shadow_cache.Invalidate();
+			}
+		}
+
+		//casters that stopped moving are drawn into the static layers again
+		for (uint64 i = 0; i < dynamic_casters.size();)
+		{
+			uint32 const instance_id = dynamic_casters[i];
+			if (--caster_dynamic_frames[instance_id] == 0)
+			{
+				invalidated_bounds.push_back(gpu_scene.GetCuller().GetBounds(instance_id));
+				dynamic_casters[i] = dynamic_casters.back();
+				dynamic_casters.pop_back();
+			}
+			else ++i;
+		}
+		//casters that start moving leave the static layers they were drawn into
+		for (GPUSceneInstanceChange const& instance_change : gpu_scene.GetInstanceChanges())
+		{
+			uint32& dynamic_frames = caster_dynamic_frames[instance_change.instance_id];
+			if (dynamic_frames == 0)
+			{
+				invalidated_bounds.push_back(instance_change.previous_bounding_box);
+				dynamic_casters.push_back(instance_change.instance_id);
+			}
+			dynamic_frames = DYNAMIC_CASTER_FRAMES;
+		}
+	}
+
+	void ShadowRenderer::CullShadowCasters(GPUScene const& gpu_scene)
+	{
+		AdriaCpuProfileScope("ShadowRenderer::CullShadowCasters");
+		std::vector<BoundingBox> invalidated_bounds;
+		UpdateDynamicCasters(gpu_scene, invalidated_bounds);
+
+		opaque_casters.clear();
+		masked_casters.clear();
+		for (auto batch_entity : reg.view<Batch>())
+		{
+			Batch const& batch = reg.get<Batch>(batch_entity);
+			ShadowCaster const caster{ .instance_id = batch.instance_id, .submesh = batch.submesh };
+			if (batch.alpha_mode == MaterialAlphaMode::Opaque) opaque_casters.push_back(caster);
+			else masked_casters.push_back(caster);
+		}
+
+		bool const caching = ShadowCaching.Get();
+		//a new static atlas starts out empty
+		bool const static_atlas_missing = !static_atlas_texture;
+		shadow_views.resize(light_matrices.size());
+		auto light_view = reg.view<Light>();
+		for (auto e : light_view)
+		{
+			Light const& light = light_view.get<Light>(e);
+			if (!light.casts_shadows || light.ray_traced_shadows) continue;
+
+			uint64 const light_id = entt::to_integral(e);
+			auto tiles_it = light_atlas_tiles.find(light_id);
+			if (tiles_it == light_atlas_tiles.end()) continue;
+			std::vector<ShadowAtlasTile> const& tiles = tiles_it->second;
+			uint32 const face_count = (uint32)tiles.size();
+
+			std::vector<ShadowCache>& shadow_caches = light_shadow_caches[light_id];
+			if (shadow_caches.size() != face_count)
+			{
+				shadow_caches.clear();
+				shadow_caches.resize(face_count);
+			}
+			for (uint32 i = 0; i < face_count; ++i)
+			{
+				ShadowView& shadow_view = shadow_views[light.shadow_matrix_index + i];
+				shadow_view.view_projection = XMMatrixTranspose(light_matrices[light.shadow_matrix_index + i]);
+				//casters outside of the camera view still shadow it when they are between the light and its shadow volume
+				shadow_view.cull_flags = light.type == LightType::Directional ? FrustumCullFlags::InfiniteNear : FrustumCullFlags::None;
+				shadow_view.light_type = light.type;
+				shadow_view.light_id = light_id;
+				shadow_view.light_index = light.light_index;
+				shadow_view.face_index = i;
+				shadow_view.tile = tiles[i];
+				shadow_view.cache = &shadow_caches[i];
+				shadow_view.cached = caching && light.type != LightType::Directional;
+				shadow_view.draw_count = 0;
+				shadow_view.static_redrawn = false;
+				if (!shadow_view.cached || static_atlas_missing || shadow_view.cache->view_projection != shadow_view.view_projection || shadow_view.cache->tile != shadow_view.tile)
+				{
+					shadow_view.cache->Invalidate();
+				}
+			}
+		}
+
+		for (ShadowView& shadow_view : shadow_views)
+		{
+			if (!shadow_view.cache->IsValid()) continue;
+			for (BoundingBox const& bounding_box : invalidated_bounds)
+			{
+				if (FrustumCuller::Intersects(shadow_view.view_projection, bounding_box, shadow_view.cull_flags))
+				{
+					shadow_view.cache->Invalidate();
+					break;
+				}
+			}
+		}
+
+		//one view per task, each view culls single threaded
+		FrustumCuller const& instance_culler = gpu_scene.GetCuller();
+		g_JobSystem.ParallelFor((uint32)shadow_views.size(), 1, [this, &instance_culler](uint32 begin, uint32 end)
+			{
+				for (uint32 i = begin; i < end; ++i)
+				{
+					ShadowView& shadow_view = shadow_views[i];
+					instance_culler.Cull(shadow_view.view_projection, shadow_view.visibility, shadow_view.cull_flags);
+
+					//static casters are only needed when the cache has to be redrawn, uncached views draw every caster as static
+					bool const draw_static_casters = !shadow_view.cached || !shadow_view.cache->IsValid();
+					shadow_view.static_casters.Clear();
+					shadow_view.dynamic_casters.Clear();
+					shadow_view.visible_caster_count = 0;
+					auto FilterCasters = [&](std::vector<ShadowCaster> const& casters, bool masked)
+					{
+						for (ShadowCaster const& caster : casters)
+						{
+							if (!shadow_view.visibility.IsVisible(caster.instance_id)) continue;
+							++shadow_view.visible_caster_count;
+
+							bool const dynamic = shadow_view.cached && caster.instance_id < caster_dynamic_frames.size() && caster_dynamic_frames[caster.instance_id] > 0;
+							ShadowDrawList* draw_list = dynamic ? &shadow_view.dynamic_casters : (draw_static_casters ? &shadow_view.static_casters : nullptr);
+							if (draw_list) (masked ? draw_list->masked_casters : draw_list->opaque_casters).push_back(caster);
+						}
+					};
+					FilterCasters(opaque_casters, false);
+					FilterCasters(masked_casters, true);
+				}
+			});
+	}
+
+	void ShadowRenderer::AddShadowAtlasPass(RenderGraph& rg, char const* name, RGResourceName atlas_name, ShadowAtlasClear clear,
+											std::vector<uint32> const& view_indices, ShadowDrawList ShadowView::* draw_list)
+	{
+		FrameBlackboardData const& frame_data = rg.GetBlackboard().Get<FrameBlackboardData>();
+		uint32 const atlas_size = shadow_atlas.GetSize();
+		for (uint32 view_index : view_indices) shadow_views[view_index].draw_count += (shadow_views[view_index].*draw_list).GetCount();
+
+		struct ShadowAtlasPassData
+		{
+			RGDepthStencilId atlas;
+		};
+		//clearing single tiles needs the atlas bound outside of a render pass
+		RGPassFlags const pass_flags = clear == ShadowAtlasClear::Tiles ? RGPassFlags::ForceNoCull | RGPassFlags::LegacyRenderPass : RGPassFlags::ForceNoCull;
+		rg.AddPass<ShadowAtlasPassData>(name,
+			[=](ShadowAtlasPassData& data, RenderGraphBuilder& builder)
+			{
+				data.atlas = builder.WriteDepthStencil(atlas_name, clear == ShadowAtlasClear::Atlas ? RGLoadStoreAccessOp::Clear_Preserve : RGLoadStoreAccessOp::Preserve_Preserve);
+				builder.SetViewport(atlas_size, atlas_size);
+			},
+			[=, this](ShadowAtlasPassData const& data, RenderGraphContext& context, GfxCommandList* cmd_list)
+			{
+				if (clear == ShadowAtlasClear::Tiles)
+				{
+					std::vector<GfxRect> tile_rects;
+					tile_rects.reserve(view_indices.size());
+					for (uint32 view_index : view_indices)
+					{
+						ShadowAtlasTile const& tile = shadow_views[view_index].tile;
+						tile_rects.push_back(GfxRect{ .x = tile.x, .y = tile.y, .width = tile.size, .height = tile.size });
+					}
+					cmd_list->ClearDepth(context.GetDepthStencil(data.atlas), tile_rects);
+				}
+
+				cmd_list->SetRootCBV(0, frame_data.frame_cbuffer_address);
+				for (uint32 view_index : view_indices)
+				{
+					//the light matrices already place each view inside its tile, the scissor keeps casters from spilling into the neighbouring tiles
+					ShadowView const& shadow_view = shadow_views[view_index];
+					cmd_list->SetScissorRect(shadow_view.tile.x, shadow_view.tile.y, shadow_view.tile.size, shadow_view.tile.size);
+					ShadowMapPass_Common(cmd_list, shadow_view.light_index, shadow_view.face_index, shadow_view.*draw_list);
+				}
+			}, RGPassType::Graphics, pass_flags);
+	}
+
+	void ShadowRenderer::ShadowMapPass_Common(GfxCommandList* cmd_list, uint64 light_index, uint64 matrix_offset, ShadowDrawList const& draw_list)
 	{
 		struct ShadowConstants
 		{
@@ -532,32 +944,24 @@ namespace adria
 			.light_index = (uint32)light_index,
 			.matrix_offset = (uint32)matrix_offset
 		};
-		auto view = reg.view<Batch>();
-		std::vector<Batch*> masked_batches, opaque_batches;
-		for (auto batch_entity : reg.view<Batch>())
-		{
-			Batch& batch = reg.get<Batch>(batch_entity);
-			if (batch.alpha_mode == MaterialAlphaMode::Opaque) opaque_batches.push_back(&batch);
-			else masked_batches.push_back(&batch);
-		}
 
 		auto DrawBatch = [&](GfxCommandList* cmd_list, bool masked_batch)
 		{
-			std::vector<Batch*>& batches = masked_batch ? masked_batches : opaque_batches;
+			std::vector<ShadowCaster> const& casters = masked_batch ? draw_list.masked_casters : draw_list.opaque_casters;
 			GfxPipelineState* pso = masked_batch ? shadow_psos->Get<1>() : shadow_psos->Get<0>();
 			cmd_list->SetRootConstants(1, constants);
 			cmd_list->SetPipelineState(pso);
-			for (Batch* batch : batches)
+			for (ShadowCaster const& caster : casters)
 			{
 				struct ModelConstants
 				{
 					uint32 instance_id;
-				} model_constants{ .instance_id = batch->instance_id };
+				} model_constants{ .instance_id = caster.instance_id };
 				cmd_list->SetRootCBV(2, model_constants);
-				GfxIndexBufferView ibv(batch->submesh->buffer_address + batch->submesh->indices_offset, batch->submesh->indices_count);
-				cmd_list->SetTopology(batch->submesh->topology);
+				GfxIndexBufferView ibv(caster.submesh->buffer_address + caster.submesh->indices_offset, caster.submesh->indices_count);
+				cmd_list->SetTopology(caster.submesh->topology);
 				cmd_list->SetIndexBuffer(&ibv);
-				cmd_list->DrawIndexed(batch->submesh->indices_count);
+				cmd_list->DrawIndexed(caster.submesh->indices_count);
 			}
 		};
 
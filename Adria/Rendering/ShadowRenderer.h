@@ -1,9 +1,12 @@
 #pragma once
 #include <array>
 #include "RayTracedShadowsPass.h"
+#include "FrustumCuller.h"
+#include "ShadowAtlas.h"
 #include "Graphics/GfxDefines.h"
 #include "Graphics/GfxDescriptor.h"
 #include "Graphics/GfxPipelineStatePermutationsFwd.h"
+#include "Graphics/GfxResidencyManager.h"
 #include "Utilities/Delegate.h"
 
 namespace adria
@@ -14,7 +17,11 @@ namespace adria
 	class GfxTexture;
 	class RenderGraph;
 	class Camera;
+	class GPUScene;
 	struct FrameCBuffer;
+	struct SubMeshGPU;
+	struct ShadowViewGPU;
+	enum class LightType : int32;
 
 
 	DECLARE_EVENT(ShadowTextureRenderedEvent, ShadowRenderer, RGResourceName)
@@ -25,6 +32,71 @@ namespace adria
 		static constexpr uint32 SHADOW_CUBE_SIZE = 512;
 		static constexpr uint32 SHADOW_CASCADE_MAP_SIZE = 1024;
 		static constexpr uint32 SHADOW_CASCADE_COUNT = 4;
+		static constexpr uint32 SHADOW_MIN_TILE_SIZE = 128;
+
+		static constexpr uint32 DYNAMIC_CASTER_FRAMES = 30;
+
+		struct ShadowCaster
+		{
+			uint32 instance_id;
+			SubMeshGPU const* submesh;
+		};
+		struct ShadowDrawList
+		{
+			std::vector<ShadowCaster> opaque_casters;
+			std::vector<ShadowCaster> masked_casters;
+
+			void Clear()
+			{
+				opaque_casters.clear();
+				masked_casters.clear();
+			}
+			uint32 GetCount() const { return (uint32)(opaque_casters.size() + masked_casters.size()); }
+		};
+		//static casters of one spot or point light face, kept in the static atlas across frames while the light matrix,
+		//the atlas tile and the static casters inside it stay the same
+		struct ShadowCache
+		{
+			Matrix view_projection;
+			ShadowAtlasTile tile;
+			bool valid = false;
+
+			bool IsValid() const { return valid; }
+			void Invalidate() { valid = false; }
+		};
+		//one per light matrix, casters are copied out of the batches since the gbuffer pass sorts them
+		struct ShadowView
+		{
+			Matrix view_projection;
+			FrustumCullFlags cull_flags;
+			LightType light_type;
+			uint64 light_id;
+			uint32 light_index;
+			uint32 face_index;
+			ShadowAtlasTile tile;
+			ShadowCache* cache;
+			bool cached;	//directional views follow the camera, they are not cached and drawn in full every frame
+			VisibilityMask visibility;
+			ShadowDrawList static_casters;
+			ShadowDrawList dynamic_casters;
+			uint32 visible_caster_count;
+			uint32 draw_count;
+			bool static_redrawn;
+		};
+		enum class ShadowAtlasClear : uint8
+		{
+			None,
+			Atlas,	//whole atlas through the render pass
+			Tiles	//only the tiles of the drawn views, the rest of the atlas is preserved
+		};
+		//tile size every face of a shadow casting light asks for this frame
+		struct ShadowTileRequest
+		{
+			uint64 light_id;
+			uint32 face_count;
+			uint32 tile_size;
+			float priority;
+		};
 
 	public:
 		ShadowRenderer(entt::registry& reg, GfxDevice* gfx, uint32 width, uint32 height);
@@ -41,10 +113,11 @@ namespace adria
 		}
 		void SetupShadows(Camera const* camera);
 
-		void AddShadowMapPasses(RenderGraph& rg);
+		void AddShadowMapPasses(RenderGraph& rg, GPUScene const& gpu_scene);
 		void AddRayTracingShadowPasses(RenderGraph& rg);
 
 		void FillFrameCBuffer(FrameCBuffer& frame_cbuffer);
+		void GUI();
 
 		ShadowTextureRenderedEvent& GetShadowTextureRenderedEvent() { return shadow_rendered_event; }
 
@@ -58,15 +131,33 @@ namespace adria
 
 		std::unique_ptr<GfxBuffer>  light_matrices_buffer;
 		GfxDescriptor				light_matrices_buffer_srvs[GFX_BACKBUFFER_COUNT];
-		std::unordered_map<uint64, std::vector<std::unique_ptr<GfxTexture>>> light_shadow_maps;
-		std::unordered_map<uint64, std::vector<GfxDescriptor>> light_shadow_map_srvs;
-		std::unordered_map<uint64, std::vector<GfxDescriptor>> light_shadow_map_dsvs;
+		uint64						light_matrices_capacity = 0;
+		std::vector<std::pair<std::unique_ptr<GfxBuffer>, uint64>> retired_light_matrices_buffers;
+		int32						light_matrices_gpu_index = -1;
+
+		ShadowAtlas										shadow_atlas;
+		std::unique_ptr<GfxTexture>						shadow_atlas_texture;
+		std::unique_ptr<GfxTexture>						static_atlas_texture;
+		GfxDescriptor									shadow_atlas_srv;
+		GfxResidencyHandle								shadow_atlas_residency = INVALID_RESIDENCY_HANDLE;
+		bool											shadow_atlas_static = false;
+		std::unordered_map<uint64, std::vector<ShadowAtlasTile>> light_atlas_tiles;
+		uint32											atlas_resized_lights = 0;
+		uint32											atlas_dropped_lights = 0;
+		bool											atlas_repacked = false;
+
 		std::unordered_map<uint64, std::unique_ptr<GfxTexture>> light_mask_textures;
 		std::unordered_map<uint64, GfxDescriptor> light_mask_texture_srvs;
 		std::unordered_map<uint64, GfxDescriptor> light_mask_texture_uavs;
-		int32						   light_matrices_gpu_index = -1;
 
 		std::vector<Matrix>								light_matrices;
+		std::vector<ShadowCaster>						opaque_casters;
+		std::vector<ShadowCaster>						masked_casters;
+		std::vector<ShadowView>							shadow_views;
+		std::unordered_map<uint64, std::vector<ShadowCache>> light_shadow_caches;
+		std::vector<uint32>								caster_dynamic_frames;
+		std::vector<uint32>								dynamic_casters;
+		uint64											scene_structure_version = uint64(-1);
 		std::array<float, SHADOW_CASCADE_COUNT>		    split_distances{};
 		float											cascades_split_lambda = 0.5f;
 
@@ -74,7 +165,14 @@ namespace adria
 
 	private:
 		void CreatePSOs();
-		void ShadowMapPass_Common(GfxDevice* gfx, GfxCommandList* cmd_list, uint64 light_index, uint64 matrix_index, uint64 matrix_offset);
+		void CreateShadowAtlas(uint32 atlas_size);
+		void AllocateAtlasTiles(std::vector<ShadowTileRequest>& requests);
+		void UpdateLightMatricesBuffer(std::vector<ShadowViewGPU> const& atlas_shadow_views);
+		void UpdateDynamicCasters(GPUScene const& gpu_scene, std::vector<BoundingBox>& invalidated_bounds);
+		void CullShadowCasters(GPUScene const& gpu_scene);
+		void AddShadowAtlasPass(RenderGraph& rg, char const* name, RGResourceName atlas_name, ShadowAtlasClear clear,
+								std::vector<uint32> const& view_indices, ShadowDrawList ShadowView::* draw_list);
+		void ShadowMapPass_Common(GfxCommandList* cmd_list, uint64 light_index, uint64 matrix_offset, ShadowDrawList const& draw_list);
 		static std::array<Matrix, SHADOW_CASCADE_COUNT> RecalculateProjectionMatrices(Camera const& camera, float split_lambda, std::array<float, SHADOW_CASCADE_COUNT>& split_distances);
 	};
 }
\ No newline at end of file
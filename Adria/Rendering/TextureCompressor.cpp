@@ -0,0 +1,210 @@
+#include <algorithm>
+#include <fstream>
+#include <filesystem>
+#include <stb_image.h>
+#include "TextureCompressor.h"
+#include "Core/Paths.h"
+#include "Core/CpuProfiler.h"
+#include "Logging/Logger.h"
+#include "Utilities/BCEncoder.h"
+#include "Utilities/FilesUtil.h"
+#include "Utilities/HashUtil.h"
+#include "Utilities/MemoryMappedFile.h"
+
+namespace adria
+{
+	namespace
+	{
+		constexpr uint32 TEXTURE_CACHE_VERSION = 1;
+		constexpr uint32 DDS_MAGIC = 0x20534444; //"DDS "
+
+#pragma pack(push, 1)
+		struct DDSPixelFormat
+		{
+			uint32 size;
+			uint32 flags;
+			uint32 four_cc;
+			uint32 rgb_bit_count;
+			uint32 r_bit_mask;
+			uint32 g_bit_mask;
+			uint32 b_bit_mask;
+			uint32 a_bit_mask;
+		};
+
+		struct DDSHeader
+		{
+			uint32 magic;
+			uint32 size;
+			uint32 flags;
+			uint32 height;
+			uint32 width;
+			uint32 pitch_or_linear_size;
+			uint32 depth;
+			uint32 mip_map_count;
+			uint32 reserved1[11];
+			DDSPixelFormat pixel_format;
+			uint32 caps;
+			uint32 caps2;
+			uint32 caps3;
+			uint32 caps4;
+			uint32 reserved2;
+		};
+
+		struct DDSHeaderDX10
+		{
+			uint32 dxgi_format;
+			uint32 resource_dimension;
+			uint32 misc_flag;
+			uint32 array_size;
+			uint32 misc_flags2;
+		};
+#pragma pack(pop)
+		static_assert(sizeof(DDSHeader) == 128);
+
+		bool WriteDDS(std::string const& path, GfxFormat format, uint32 width, uint32 height, uint32 mip_levels, std::vector<uint8> const& data)
+		{
+			DDSHeader header{};
+			header.magic = DDS_MAGIC;
+			header.size = sizeof(DDSHeader) - sizeof(header.magic);
+			header.flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; //caps, height, width, pixel format, mip map count, linear size
+			header.height = height;
+			header.width = width;
+			header.pitch_or_linear_size = (uint32)GetTextureMipByteSize(format, width, height, 1, 0);
+			header.depth = 1;
+			header.mip_map_count = mip_levels;
+			header.pixel_format.size = sizeof(DDSPixelFormat);
+			header.pixel_format.flags = 0x4; //four cc
+			header.pixel_format.four_cc = 0x30315844; //"DX10"
+			header.caps = 0x1000 | 0x400000 | 0x8; //texture, mip map, complex
+
+			DDSHeaderDX10 header_dx10{};
+			header_dx10.dxgi_format = ConvertGfxFormat(format);
+			header_dx10.resource_dimension = 3; //D3D12_RESOURCE_DIMENSION_TEXTURE2D
+			header_dx10.array_size = 1;
+
+			//written under a temporary name so that an interrupted write never leaves a truncated DDS in the cache
+			std::string const temp_path = path + ".tmp";
+			{
+				std::ofstream file(temp_path, std::ios::binary);
+				if (!file) return false;
+				file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+				file.write(reinterpret_cast<char const*>(&header_dx10), sizeof(header_dx10));
+				file.write(reinterpret_cast<char const*>(data.data()), data.size());
+				if (!file) return false;
+			}
+			std::error_code error;
+			std::filesystem::rename(temp_path, path, error);
+			return !error;
+		}
+
+		bool ReadDDSHeader(std::string const& path, DDSHeader& header)
+		{
+			std::ifstream file(path, std::ios::binary);
+			if (!file) return false;
+			file.read(reinterpret_cast<char*>(&header), sizeof(header));
+			return file && header.magic == DDS_MAGIC && header.size == sizeof(DDSHeader) - sizeof(header.magic);
+		}
+
+		//2x2 box filter, odd dimensions repeat their last row or column. Normal maps are renormalized after filtering.
+		std::vector<uint8> DownsampleMip(std::vector<uint8> const& texels, uint32 width, uint32 height, bool normal_map)
+		{
+			uint32 const mip_width = std::max(width / 2, 1u);
+			uint32 const mip_height = std::max(height / 2, 1u);
+			std::vector<uint8> mip(mip_width * mip_height * 4);
+			for (uint32 y = 0; y < mip_height; ++y)
+			{
+				uint32 const y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+				for (uint32 x = 0; x < mip_width; ++x)
+				{
+					uint32 const x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+					uint32 const offsets[4] = { (y0 * width + x0) * 4, (y0 * width + x1) * 4, (y1 * width + x0) * 4, (y1 * width + x1) * 4 };
+					float sum[4] = {};
+					for (uint32 offset : offsets)
+					{
+						for (uint32 c = 0; c < 4; ++c) sum[c] += normal_map && c < 3 ? texels[offset + c] / 127.5f - 1.0f : texels[offset + c] / 4.0f;
+					}
+					if (normal_map)
+					{
+						float const length = std::sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+						for (uint32 c = 0; c < 3; ++c) sum[c] = length > 0.0f ? (sum[c] / length * 0.5f + 0.5f) * 255.0f : 127.5f;
+					}
+					uint8* mip_texel = &mip[(y * mip_width + x) * 4];
+					for (uint32 c = 0; c < 4; ++c) mip_texel[c] = (uint8)std::clamp(std::lround(sum[c]), 0l, 255l);
+				}
+			}
+			return mip;
+		}
+	}
+
+	std::string CompressTexture(std::string const& path, GfxFormat format, TextureCompressionStats& stats)
+	{
+		AdriaCpuProfileScope("CompressTexture");
+		ADRIA_ASSERT(format == GfxFormat::BC1_UNORM || format == GfxFormat::BC4_UNORM || format == GfxFormat::BC5_UNORM || format == GfxFormat::BC7_UNORM);
+
+		std::string extension = GetExtension(path);
+		std::transform(std::begin(extension), std::end(extension), std::begin(extension), [](char c) { return (char)std::tolower(c); });
+		if (extension == ".dds") return {};
+
+		MemoryMappedFile source;
+		if (!source.Open(path)) return {};
+		stbi_uc const* source_data = source.GetData();
+		int32 const source_size = (int32)source.GetSize();
+		if (stbi_is_hdr_from_memory(source_data, source_size)) return {};
+
+		uint64 hash = crc64(reinterpret_cast<char const*>(source_data), source.GetSize());
+		HashCombine(hash, (uint32)format);
+		HashCombine(hash, TEXTURE_CACHE_VERSION);
+		char cache_path[256];
+		sprintf_s(cache_path, "%s%s_%llx.dds", paths::TextureCacheDir.c_str(), GetFilenameWithoutExtension(path).c_str(), hash);
+
+		DDSHeader cached_header{};
+		if (ReadDDSHeader(cache_path, cached_header))
+		{
+			++stats.cached_count;
+			stats.uncompressed_bytes += GetTextureByteSize(GfxFormat::R8G8B8A8_UNORM, cached_header.width, cached_header.height, 1, cached_header.mip_map_count);
+			stats.compressed_bytes += GetTextureByteSize(format, cached_header.width, cached_header.height, 1, cached_header.mip_map_count);
+			return cache_path;
+		}
+
+		int32 width = 0, height = 0, components = 0;
+		stbi_uc* texels = stbi_load_from_memory(source_data, source_size, &width, &height, &components, 4);
+		if (!texels) return {};
+		if (width % 4 != 0 || height % 4 != 0)
+		{
+			ADRIA_LOG(WARNING, "Texture '%s' is %dx%d, BC compression needs dimensions that are a multiple of 4", path.c_str(), width, height);
+			stbi_image_free(texels);
+			return {};
+		}
+		std::vector<uint8> mip(texels, texels + (uint64)width * height * 4);
+		stbi_image_free(texels);
+
+		uint32 mip_levels = 1;
+		while (std::max(width, height) >> mip_levels) ++mip_levels;
+		std::vector<uint8> compressed(GetTextureByteSize(format, width, height, 1, mip_levels));
+		uint64 offset = 0;
+		uint32 mip_width = width, mip_height = height;
+		for (uint32 mip_level = 0; mip_level < mip_levels; ++mip_level)
+		{
+			if (mip_level > 0)
+			{
+				mip = DownsampleMip(mip, mip_width, mip_height, format == GfxFormat::BC5_UNORM);
+				mip_width = std::max(mip_width / 2, 1u);
+				mip_height = std::max(mip_height / 2, 1u);
+			}
+			EncodeBCSurface(format, mip.data(), mip_width, mip_height, compressed.data() + offset);
+			offset += GetTextureMipByteSize(format, width, height, 1, mip_level);
+		}
+
+		std::error_code error;
+		std::filesystem::create_directories(paths::TextureCacheDir, error);
+		if (!WriteDDS(cache_path, format, width, height, mip_levels, compressed))
+		{
+			ADRIA_LOG(WARNING, "Failed to write compressed texture '%s'", cache_path);
+			return {};
+		}
+		++stats.encoded_count;
+		stats.uncompressed_bytes += GetTextureByteSize(GfxFormat::R8G8B8A8_UNORM, width, height, 1, mip_levels);
+		stats.compressed_bytes += compressed.size();
+		return cache_path;
+	}
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+#include "Graphics/GfxFormat.h"
+
+namespace adria
+{
+	struct TextureCompressionStats
+	{
+		uint32 encoded_count = 0;
+		uint32 cached_count = 0;
+		uint64 uncompressed_bytes = 0;	//size the compressed textures would have as RGBA8 with the same mips
+		uint64 compressed_bytes = 0;
+
+		TextureCompressionStats& operator+=(TextureCompressionStats const& other)
+		{
+			encoded_count += other.encoded_count;
+			cached_count += other.cached_count;
+			uncompressed_bytes += other.uncompressed_bytes;
+			compressed_bytes += other.compressed_bytes;
+			return *this;
+		}
+	};
+
+	//Compresses a texture and its full mip chain to format (BC1, BC4, BC5 or BC7 UNORM) and writes it as a DDS to the texture cache.
+	//The DDS is named after a hash of the source contents, so later calls load it as is until the source changes.
+	//Returns the path of the DDS, or an empty string if the source can't be compressed and should be loaded directly.
+	std::string CompressTexture(std::string const& path, GfxFormat format, TextureCompressionStats& stats);
+}
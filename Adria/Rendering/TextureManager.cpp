@@ -1,17 +1,165 @@
 #include "d3dx12.h"
 
 #include "TextureManager.h"
+#include "MipFeedbackPass.h"
 #include "Graphics/GfxTexture.h"
 #include "Graphics/GfxDevice.h"
 #include "Graphics/GfxCommon.h"
 #include "Graphics/GfxCommandList.h"
 #include "Graphics/GfxShaderCompiler.h"
+#include "Core/CpuProfiler.h"
+#include "Core/ConsoleManager.h"
 #include "Logging/Logger.h"
 #include "Utilities/Image.h"
 
 
 namespace adria
 {
+	namespace
+	{
+		static TAutoConsoleVariable<int>  MaxTextureUploadsPerFrame("r.Textures.MaxUploadsPerFrame", 16, "Maximum number of decoded textures created and submitted to the copy queue per frame");
+		static TAutoConsoleVariable<bool> TextureStreaming("r.TextureStreaming", true, "0: textures are loaded with all their mips. 1: residency managed textures load their mip tail and stream the other mips in and out driven by GPU feedback");
+		static TAutoConsoleVariable<int>  TextureStreamingBudget("r.TextureStreaming.BudgetMB", 512, "Memory budget of the streamed textures in MB");
+		static TAutoConsoleVariable<int>  TextureStreamingMaxInFlight("r.TextureStreaming.MaxInFlight", 8, "Maximum number of mip streaming requests in flight");
+		static TAutoConsoleVariable<int>  TextureStreamingTailSize("r.TextureStreaming.TailSize", 256, "Mips with both dimensions at or below this size are loaded up front and never streamed out");
+
+		uint64 GetAllocationSize(GfxDevice* gfx, D3D12_RESOURCE_DESC const& resource_desc)
+		{
+			return gfx->GetDevice()->GetResourceAllocationInfo(0, 1, &resource_desc).SizeInBytes;
+		}
+		//dropping the top mip is only supported for plain 2D textures with a mip chain
+		bool IsTrimmable(Image const& img)
+		{
+			return img.Depth() == 1 && !img.IsCubemap() && img.NextImage() == nullptr && img.MipLevels() > 1;
+		}
+		//first mip whose size is at most tail_size, block compressed textures can only start at mips that are a multiple of the block size
+		uint32 GetTailMip(Image const& img, uint32 tail_size)
+		{
+			uint32 const block_size = GetGfxFormatBlockSize(img.Format());
+			uint32 tail_mip = 0;
+			while (tail_mip + 1 < img.MipLevels() && std::max(img.Width(), img.Height()) >> tail_mip > tail_size)
+			{
+				uint32 const width = img.Width() >> (tail_mip + 1);
+				uint32 const height = img.Height() >> (tail_mip + 1);
+				if (width == 0 || height == 0 || width % block_size != 0 || height % block_size != 0) break;
+				++tail_mip;
+			}
+			return tail_mip;
+		}
+		//sizes[i] is the allocation size of the texture with mips i and down
+		std::vector<uint64> GetStreamingSizes(GfxDevice* gfx, D3D12_RESOURCE_DESC resource_desc, Image const& img)
+		{
+			std::vector<uint64> sizes(img.MipLevels());
+			for (uint32 mip = 0; mip < img.MipLevels(); ++mip)
+			{
+				resource_desc.Width = std::max<uint64>(img.Width() >> mip, 1);
+				resource_desc.Height = std::max<uint32>(img.Height() >> mip, 1);
+				resource_desc.MipLevels = img.MipLevels() - mip;
+				sizes[mip] = GetAllocationSize(gfx, resource_desc);
+			}
+			return sizes;
+		}
+		//drives the streaming scheduler with synthetic feedback: a working set of textures sweeps through the scene, the wanted mips
+		//change with a fake camera distance, feedback arrives a few frames late like the GPU readback and stream ins take a few frames
+		void SimulateTextureStreaming()
+		{
+			constexpr uint64 MB = 1024 * 1024;
+			constexpr uint32 TextureCount = 128;
+			constexpr uint32 TextureSize = 2048;
+			constexpr uint32 MipCount = 12;
+			constexpr uint32 TailMip = 3;
+			constexpr uint32 WorkingSetSize = 24;
+			constexpr uint64 FeedbackLatency = GFX_BACKBUFFER_COUNT;
+			constexpr uint64 StreamInLatency = 4;
+			constexpr uint64 FrameCount = 3000;
+			TextureStreamingDesc const desc{ .budget = 96 * MB, .max_in_flight = 8, .idle_frames = 60 };
+
+			std::vector<uint64> sizes(MipCount);
+			for (uint32 mip = MipCount; mip-- > 0;)
+			{
+				uint64 const mip_size = std::max<uint64>(TextureSize >> mip, 1);
+				sizes[mip] = mip_size * mip_size + (mip + 1 < MipCount ? sizes[mip + 1] : 0);
+			}
+
+			TextureStreamingScheduler scheduler(desc);
+			std::vector<uint32> ids(TextureCount);
+			for (uint32 i = 0; i < TextureCount; ++i) ids[i] = scheduler.AddEntry(sizes, TailMip, 0);
+			uint64 const tail_bytes = TextureCount * sizes[TailMip];
+
+			struct InFlightRequest
+			{
+				uint32 id;
+				uint64 completion_frame;
+			};
+			std::vector<InFlightRequest> in_flight;
+			std::vector<std::vector<uint32>> feedback_frames(FeedbackLatency + 1, std::vector<uint32>(TextureCount));
+
+			uint64 stream_ins = 0, stream_outs = 0, peak_committed = 0, max_in_flight = 0, violations = 0, starved_frames = 0;
+			uint64 mip_error_sum = 0, mip_error_count = 0;
+			for (uint64 frame = 0; frame < FrameCount; ++frame)
+			{
+				std::erase_if(in_flight, [&](InFlightRequest const& request)
+					{
+						if (request.completion_frame > frame) return false;
+						scheduler.CompleteRequest(request.id);
+						return true;
+					});
+
+				//the GPU renders this frame's working set, the CPU sees the feedback FeedbackLatency frames later
+				std::vector<uint32>& rendered_feedback = feedback_frames[frame % feedback_frames.size()];
+				std::fill(rendered_feedback.begin(), rendered_feedback.end(), uint32(-1));
+				uint32 const first_visible = static_cast<uint32>((frame / 100) % TextureCount);
+				for (uint32 i = 0; i < WorkingSetSize; ++i)
+				{
+					uint32 const texture = (first_visible + i) % TextureCount;
+					uint32 const wanted_mip = static_cast<uint32>((i + frame / 37) % (TailMip + 1));
+					rendered_feedback[texture] = wanted_mip;
+					uint32 const resident_mip = scheduler.GetEntry(ids[texture]).resident_mip;
+					mip_error_sum += resident_mip > wanted_mip ? resident_mip - wanted_mip : 0;
+					++mip_error_count;
+				}
+				if (frame >= FeedbackLatency)
+				{
+					std::vector<uint32> const& feedback = feedback_frames[(frame - FeedbackLatency) % feedback_frames.size()];
+					for (uint32 i = 0; i < TextureCount; ++i) if (feedback[i] != uint32(-1)) scheduler.AddFeedback(ids[i], feedback[i], frame);
+				}
+
+				for (TextureStreamingRequest const& request : scheduler.Evaluate(frame))
+				{
+					bool const stream_in = request.first_mip < scheduler.GetEntry(request.id).resident_mip;
+					if (stream_in) ++stream_ins;
+					else ++stream_outs;
+					in_flight.push_back(InFlightRequest{ request.id, frame + (stream_in ? StreamInLatency : 0) });
+				}
+
+				TextureStreamingStats const stats = scheduler.GetStats();
+				peak_committed = std::max(peak_committed, stats.committed_bytes);
+				max_in_flight = std::max<uint64>(max_in_flight, stats.in_flight_count);
+				starved_frames += stats.starved_count > 0;
+				violations += stats.in_flight_count > desc.max_in_flight || stats.committed_bytes > std::max(desc.budget, tail_bytes);
+			}
+
+			TextureStreamingStats const stats = scheduler.GetStats();
+			ADRIA_LOG(INFO, "Texture streaming simulation (%llu MB budget, %llu frames): %llu stream ins, %llu stream outs, peak %llu MB committed, at most %llu requests in flight",
+				desc.budget / MB, FrameCount, stream_ins, stream_outs, peak_committed / MB, max_in_flight);
+			ADRIA_LOG(INFO, "Texture streaming simulation: %.2f mips missing on average per visible texture, %llu frames starved by the budget, final %llu MB resident",
+				mip_error_count ? mip_error_sum * 1.0f / mip_error_count : 0.0f, starved_frames, stats.resident_bytes / MB);
+			if (violations > 0) ADRIA_LOG(WARNING, "Texture streaming simulation: %llu frames exceeded the budget or the in flight limit", violations);
+		}
+		AutoConsoleCommand texture_streaming_simulation("r.TextureStreaming.Simulate", "Runs the texture streaming scheduler against synthetic mip feedback and logs its decisions",
+			ConsoleCommandDelegate::CreateStatic(SimulateTextureStreaming));
+
+		GfxDescriptor GetPlaceholderSRV(TextureHandle placeholder)
+		{
+			switch (placeholder)
+			{
+			case DEFAULT_WHITE_TEXTURE_HANDLE:				return gfxcommon::GetCommonView(GfxCommonViewType::WhiteTexture2D_SRV);
+			case DEFAULT_NORMAL_TEXTURE_HANDLE:				return gfxcommon::GetCommonView(GfxCommonViewType::DefaultNormal2D_SRV);
+			case DEFAULT_METALLIC_ROUGHNESS_TEXTURE_HANDLE:	return gfxcommon::GetCommonView(GfxCommonViewType::MetallicRoughness2D_SRV);
+			default:										return gfxcommon::GetCommonView(GfxCommonViewType::BlackTexture2D_SRV);
+			}
+		}
+	}
 
     TextureManager::TextureManager() {}
     TextureManager::~TextureManager() = default;
@@ -22,63 +170,46 @@ namespace adria
 	}
 	void TextureManager::Destroy()
 	{
+        g_JobSystem.Wait(decode_counter);
+        decoded_textures.clear();
+        uploading_textures.clear();
+        pending_textures.clear();
+        streaming_uploads.clear();
+        residency_uploads.clear();
+        texture_streaming_map.clear();
+        streaming_handles.clear();
+        streaming_scheduler = TextureStreamingScheduler{};
+        for (auto const& [texture_handle, residency] : texture_residency_map) gfx->GetResidencyManager()->Unregister(residency.residency_handle);
+        texture_residency_map.clear();
         texture_map.clear();
         loaded_textures.clear();
         gfx = nullptr;
 	}
 
-    TextureHandle TextureManager::LoadTexture(std::string_view path)
+    TextureHandle TextureManager::LoadTexture(std::string_view path, bool residency_managed, TextureHandle placeholder)
     {
         std::string texture_name(path);
-        if (auto it = loaded_textures.find(texture_name); it == loaded_textures.end())
+        TextureHandle texture_handle;
         {
-            ++handle;
-            loaded_textures.insert({ texture_name, handle });
-            Image img(path);
-
-			GfxTextureDesc desc{};
-			desc.type = img.Depth() > 1 ? GfxTextureType_3D : GfxTextureType_2D;
-			desc.misc_flags = GfxTextureMiscFlag::None;
-			desc.width = img.Width();
-			desc.height = img.Height();
-			desc.array_size = img.IsCubemap() ? 6 : 1;
-			desc.depth = img.Depth();
-			desc.bind_flags = GfxBindFlag::ShaderResource;
-			desc.format = img.Format();
-			desc.initial_state = GfxResourceState::AllSRV; 
-			desc.heap_type = GfxResourceUsage::Default;
-			desc.mip_levels = img.MipLevels();
-            desc.misc_flags = img.IsCubemap() ? GfxTextureMiscFlag::TextureCube : GfxTextureMiscFlag::None;
-
-            std::vector<GfxTextureSubData> tex_data;
-			const Image* curr_img = &img;
-			while (curr_img)
-			{
-				for (uint32 i = 0; i < desc.mip_levels; ++i)
-				{
-                    GfxTextureSubData& data = tex_data.emplace_back();
-					data.data = curr_img->MipData(i);
-					data.row_pitch = GetRowPitch(curr_img->Format(), desc.width, i);
-					data.slice_pitch = GetSlicePitch(img.Format(), desc.width, desc.height, i);
-				}
-                curr_img = curr_img->NextImage();
-			}
-
-			GfxTextureData init_data{};
-			init_data.sub_data = tex_data.data();
-			init_data.sub_count = (uint32)tex_data.size();
-            std::unique_ptr<GfxTexture> tex = gfx->CreateTexture(desc, init_data);
-
-            texture_map[handle] = std::move(tex);
-			CreateViewForTexture(handle);
-			return handle;
+            std::lock_guard lock(load_mutex);
+            if (auto it = loaded_textures.find(texture_name); it != loaded_textures.end()) return it->second;
+            texture_handle = ++handle;
+            loaded_textures.insert({ texture_name, texture_handle });
+            pending_textures[texture_handle] = PendingTexture{ .path = texture_name, .placeholder = placeholder, .residency_managed = residency_managed };
         }
-	    else return it->second;
+        if (is_scene_initialized) gfx->CopyDescriptors(1, gfx->GetDescriptorGPU((uint32)texture_handle), GetPlaceholderSRV(placeholder));
+        DecodeTexture(texture_handle, texture_name);
+        return texture_handle;
     }
 
 	TextureHandle TextureManager::LoadCubemap(std::array<std::string, 6> const& cubemap_textures)
 	{
-		++handle;
+		AdriaCpuProfileScope("TextureManager::LoadCubemap");
+		TextureHandle cubemap_handle;
+		{
+			std::lock_guard lock(load_mutex);
+			cubemap_handle = ++handle;
+		}
 		GfxTextureDesc desc{};
 		desc.type = GfxTextureType_2D;
 		desc.mip_levels = 1;
@@ -104,23 +235,61 @@ namespace adria
 		init_data.sub_data = subresources.data();
 		std::unique_ptr<GfxTexture> cubemap = gfx->CreateTexture(desc, init_data);
 
-		texture_map.insert({ handle, std::move(cubemap) });
-		CreateViewForTexture(handle);
-		return handle;
+		texture_map.insert({ cubemap_handle, std::move(cubemap) });
+		CreateViewForTexture(cubemap_handle);
+		return cubemap_handle;
 	}
 
 	GfxDescriptor TextureManager::GetSRV(TextureHandle tex_handle)
 	{
-		return texture_srv_map[tex_handle];
+		{
+			std::lock_guard lock(load_mutex);
+			if (auto it = pending_textures.find(tex_handle); it != pending_textures.end()) return GetPlaceholderSRV(it->second.placeholder);
+		}
+		//evicted textures have no view of their own until they are restored
+		if (auto it = texture_srv_map.find(tex_handle); it != texture_srv_map.end()) return it->second;
+		return gfxcommon::GetCommonView(GfxCommonViewType::BlackTexture2D_SRV);
 	}
 
-	GfxTexture* TextureManager::GetTexture(TextureHandle handle) const
+	GfxTexture* TextureManager::GetTexture(TextureHandle handle)
 	{
 		if (handle == INVALID_TEXTURE_HANDLE) return nullptr;
-		else if (auto it = texture_map.find(handle); it != texture_map.end()) return it->second.get();
+
+		PendingTexture pending_texture{};
+		bool is_pending = false;
+		{
+			std::lock_guard lock(load_mutex);
+			if (auto it = pending_textures.find(handle); it != pending_textures.end())
+			{
+				pending_texture = it->second;
+				is_pending = true;
+			}
+		}
+		if (is_pending)
+		{
+			//the caller needs the texture now, decode it here instead of waiting for its turn in the decode queue.
+			//the graphics queue waits for the copy queue before executing, so the view can be bound right away
+			if (!texture_map.contains(handle))
+			{
+				Image img(pending_texture.path);
+				CreateLoadedTexture(handle, img, pending_texture);
+				gfx->GetUploadManager()->Submit();
+			}
+			BindLoadedTexture(handle);
+		}
+
+		if (auto it = texture_map.find(handle); it != texture_map.end()) return it->second.get();
 		else return nullptr;
 	}
 
+	void TextureManager::MarkUsed(TextureHandle tex_handle)
+	{
+		if (auto it = texture_residency_map.find(tex_handle); it != texture_residency_map.end())
+		{
+			gfx->GetResidencyManager()->MarkUsed(it->second.residency_handle);
+		}
+	}
+
 	void TextureManager::EnableMipMaps(bool mips)
     {
         mipmaps = mips;
@@ -133,8 +302,14 @@ namespace adria
 		gfx->CopyDescriptors(1, gfx->GetDescriptorGPU((uint32)DEFAULT_WHITE_TEXTURE_HANDLE), gfxcommon::GetCommonView(GfxCommonViewType::WhiteTexture2D_SRV));
 		gfx->CopyDescriptors(1, gfx->GetDescriptorGPU((uint32)DEFAULT_NORMAL_TEXTURE_HANDLE), gfxcommon::GetCommonView(GfxCommonViewType::DefaultNormal2D_SRV));
 		gfx->CopyDescriptors(1, gfx->GetDescriptorGPU((uint32)DEFAULT_METALLIC_ROUGHNESS_TEXTURE_HANDLE), gfxcommon::GetCommonView(GfxCommonViewType::MetallicRoughness2D_SRV));
+		std::lock_guard lock(load_mutex);
 		for (uint64 i = TEXTURE_MANAGER_START_HANDLE; i <= handle; ++i)
         {
+            if (auto it = pending_textures.find(TextureHandle(i)); it != pending_textures.end())
+            {
+                gfx->CopyDescriptors(1, gfx->GetDescriptorGPU((uint32)i), GetPlaceholderSRV(it->second.placeholder));
+                continue;
+            }
             GfxTexture* texture = texture_map[TextureHandle(i)].get();
             if (texture)
             {
@@ -144,14 +319,303 @@ namespace adria
         is_scene_initialized = true;
 	}
 
+	void TextureManager::Update()
+	{
+		AdriaCpuProfileScope("TextureManager::Update");
+		GfxUploadManager* upload_manager = gfx->GetUploadManager();
+		std::erase_if(uploading_textures, [this, upload_manager](UploadingTexture const& uploading_texture)
+			{
+				if (!upload_manager->IsCompleted(uploading_texture.ticket)) return false;
+				BindLoadedTexture(uploading_texture.handle);
+				return true;
+			});
+		std::erase_if(residency_uploads, [this, upload_manager](ResidencyUpload& upload)
+			{
+				if (!upload_manager->IsCompleted(upload.ticket)) return false;
+				if (texture_residency_map[upload.handle].generation == upload.generation)
+				{
+					texture_map[upload.handle] = std::move(upload.texture);
+					CreateViewForTexture(upload.handle);
+				}
+				return true;
+			});
+
+		std::vector<DecodedTexture> textures_to_create;
+		std::vector<PendingTexture> pending_to_create;
+		{
+			std::lock_guard lock(load_mutex);
+			uint32 const max_uploads = (uint32)std::max(MaxTextureUploadsPerFrame.Get(), 1);
+			while (!decoded_textures.empty() && textures_to_create.size() < max_uploads)
+			{
+				DecodedTexture& decoded_texture = decoded_textures.front();
+				if (decoded_texture.reason != DecodeReason::Load)
+				{
+					pending_to_create.emplace_back();
+					textures_to_create.push_back(std::move(decoded_texture));
+				}
+				//GetTexture may have finished the texture in the meantime
+				else if (auto it = pending_textures.find(decoded_texture.handle); it != pending_textures.end() && !texture_map.contains(decoded_texture.handle))
+				{
+					pending_to_create.push_back(it->second);
+					textures_to_create.push_back(std::move(decoded_texture));
+				}
+				decoded_textures.pop_front();
+			}
+		}
+
+		if (!textures_to_create.empty())
+		{
+			uint64 const first_streaming_upload = streaming_uploads.size();
+			uint64 const first_residency_upload = residency_uploads.size();
+			for (uint64 i = 0; i < textures_to_create.size(); ++i)
+			{
+				DecodedTexture const& decoded_texture = textures_to_create[i];
+				switch (decoded_texture.reason)
+				{
+				case DecodeReason::Load:
+					CreateLoadedTexture(decoded_texture.handle, *decoded_texture.image, pending_to_create[i]);
+					break;
+				case DecodeReason::StreamIn:
+					streaming_uploads.push_back(StreamingUpload{ .handle = decoded_texture.handle, .texture = CreateTexture(*decoded_texture.image, decoded_texture.first_mip),
+																 .first_mip = decoded_texture.first_mip });
+					break;
+				case DecodeReason::Residency:
+				{
+					//an eviction or another action may have superseded the request that started this decode
+					TextureResidency& residency = texture_residency_map[decoded_texture.handle];
+					if (!residency.restoring || residency.first_mip != decoded_texture.first_mip) break;
+					residency.restoring = false;
+					residency_uploads.push_back(ResidencyUpload{ .handle = decoded_texture.handle, .texture = CreateTexture(*decoded_texture.image, decoded_texture.first_mip),
+																 .generation = residency.generation });
+					break;
+				}
+				}
+			}
+			GfxUploadTicket const ticket = upload_manager->Submit();
+			for (DecodedTexture const& created_texture : textures_to_create)
+			{
+				if (created_texture.reason == DecodeReason::Load) uploading_textures.push_back(UploadingTexture{ .handle = created_texture.handle, .ticket = ticket });
+			}
+			for (uint64 i = first_streaming_upload; i < streaming_uploads.size(); ++i) streaming_uploads[i].ticket = ticket;
+			for (uint64 i = first_residency_upload; i < residency_uploads.size(); ++i) residency_uploads[i].ticket = ticket;
+		}
+		UpdateStreaming();
+	}
+
+	bool TextureManager::IsStreamingEnabled() const
+	{
+		return TextureStreaming.Get();
+	}
+
+	void TextureManager::ProcessMipFeedback(std::span<uint32 const> feedback)
+	{
+		AdriaCpuProfileScope("TextureManager::ProcessMipFeedback");
+		uint64 const frame = gfx->GetFrameIndex();
+		std::lock_guard lock(load_mutex);
+		for (auto const& [tex_handle, streaming] : texture_streaming_map)
+		{
+			//the feedback of textures still showing their placeholder is relative to the placeholder
+			uint64 const index = (uint64)tex_handle;
+			if (index >= feedback.size() || feedback[index] == uint32(-1) || pending_textures.contains(tex_handle)) continue;
+			int32 const mip = (int32)streaming.first_mip + (int32)feedback[index] - (int32)MipFeedbackPass::FEEDBACK_BIAS;
+			streaming_scheduler.AddFeedback(streaming.streaming_id, (uint32)std::max(mip, 0), frame);
+		}
+		mip_feedback_frame = frame;
+	}
+
 	void TextureManager::CreateViewForTexture(TextureHandle handle, bool flag)
 	{
         if (!is_scene_initialized && !flag) return;
 
 		GfxTexture* texture = texture_map[handle].get();
 		ADRIA_ASSERT(texture);
-        texture_srv_map[handle] = gfx->CreateTextureSRV(texture);
-        gfx->CopyDescriptors(1, gfx->GetDescriptorGPU((uint32)handle), texture_srv_map[handle]);
+		//streamed and restored textures replace their view, the old one was already copied to the shader visible heap
+		GfxDescriptor& srv = texture_srv_map[handle];
+		if (srv.IsValid()) gfx->FreeDescriptorCPU(srv, GfxDescriptorHeapType::CBV_SRV_UAV);
+		srv = gfx->CreateTextureSRV(texture);
+		gfx->CopyDescriptors(1, gfx->GetDescriptorGPU((uint32)handle), srv);
+	}
+
+	std::unique_ptr<GfxTexture> TextureManager::CreateTexture(Image const& img, uint32 first_mip)
+	{
+		ADRIA_ASSERT(first_mip == 0 || IsTrimmable(img));
+		GfxTextureDesc desc{};
+		desc.type = img.Depth() > 1 ? GfxTextureType_3D : GfxTextureType_2D;
+		desc.width = std::max(img.Width() >> first_mip, 1u);
+		desc.height = std::max(img.Height() >> first_mip, 1u);
+		desc.array_size = img.IsCubemap() ? 6 : 1;
+		desc.depth = img.Depth();
+		desc.bind_flags = GfxBindFlag::ShaderResource;
+		desc.format = img.Format();
+		desc.initial_state = GfxResourceState::AllSRV;
+		desc.heap_type = GfxResourceUsage::Default;
+		desc.mip_levels = img.MipLevels() - first_mip;
+		desc.misc_flags = img.IsCubemap() ? GfxTextureMiscFlag::TextureCube : GfxTextureMiscFlag::None;
+
+		std::vector<GfxTextureSubData> tex_data;
+		Image const* curr_img = &img;
+		while (curr_img)
+		{
+			for (uint32 i = first_mip; i < img.MipLevels(); ++i)
+			{
+				GfxTextureSubData& data = tex_data.emplace_back();
+				data.data = curr_img->MipData(i);
+				data.row_pitch = GetRowPitch(curr_img->Format(), img.Width(), i);
+				data.slice_pitch = GetSlicePitch(img.Format(), img.Width(), img.Height(), i);
+			}
+			curr_img = curr_img->NextImage();
+		}
+
+		GfxTextureData init_data{};
+		init_data.sub_data = tex_data.data();
+		init_data.sub_count = (uint32)tex_data.size();
+		return gfx->CreateTexture(desc, init_data);
+	}
+
+	void TextureManager::DecodeTexture(TextureHandle tex_handle, std::string const& path, uint32 first_mip, DecodeReason reason)
+	{
+		//decodes take long enough to stall a frame, keep them off the render thread
+		g_JobSystem.RunBackground([this, tex_handle, first_mip, reason, path]()
+			{
+				AdriaCpuProfileScope("TextureManager::DecodeTexture");
+				std::unique_ptr<Image> img = std::make_unique<Image>(path);
+				std::lock_guard lock(load_mutex);
+				decoded_textures.push_back(DecodedTexture{ .handle = tex_handle, .image = std::move(img), .first_mip = first_mip, .reason = reason });
+			}, decode_counter);
 	}
 
+	void TextureManager::CreateLoadedTexture(TextureHandle tex_handle, Image const& img, PendingTexture const& pending_texture)
+	{
+		AdriaCpuProfileScope("TextureManager::CreateLoadedTexture");
+		uint32 const tail_mip = IsStreamingEnabled() && pending_texture.residency_managed && IsTrimmable(img) ? GetTailMip(img, (uint32)TextureStreamingTailSize.Get()) : 0;
+		if (tail_mip > 0)
+		{
+			//streamed textures only get their mip tail now, the feedback decides which other mips they need
+			std::unique_ptr<GfxTexture> tex = CreateTexture(img, tail_mip);
+			std::vector<uint64> const sizes = GetStreamingSizes(gfx, tex->GetNative()->GetDesc(), img);
+			uint32 const streaming_id = streaming_scheduler.AddEntry(sizes, tail_mip, gfx->GetFrameIndex());
+			if (streaming_id >= streaming_handles.size()) streaming_handles.resize(streaming_id + 1);
+			streaming_handles[streaming_id] = tex_handle;
+			texture_streaming_map[tex_handle] = TextureStreaming{ .path = pending_texture.path, .streaming_id = streaming_id, .first_mip = tail_mip };
+			texture_map[tex_handle] = std::move(tex);
+			return;
+		}
+
+		std::unique_ptr<GfxTexture> tex = CreateTexture(img);
+		if (pending_texture.residency_managed)
+		{
+			D3D12_RESOURCE_DESC resource_desc = tex->GetNative()->GetDesc();
+			uint64 const size = GetAllocationSize(gfx, resource_desc);
+			uint64 trimmed_size = size;
+			if (IsTrimmable(img))
+			{
+				resource_desc.Width = std::max<uint64>(resource_desc.Width >> 1, 1);
+				resource_desc.Height = std::max<uint32>(resource_desc.Height >> 1, 1);
+				resource_desc.MipLevels -= 1;
+				trimmed_size = GetAllocationSize(gfx, resource_desc);
+			}
+
+			GfxResidencyHandle residency_handle = gfx->GetResidencyManager()->Register(size, trimmed_size, GfxResidencyPriority::Normal,
+				GfxResidencyCallback::CreateLambda([this, tex_handle](GfxResidencyAction action) { OnResidencyAction(tex_handle, action); }));
+			texture_residency_map[tex_handle] = TextureResidency{ .path = pending_texture.path, .residency_handle = residency_handle, .first_mip = 0 };
+		}
+		texture_map[tex_handle] = std::move(tex);
+	}
+
+	void TextureManager::BindLoadedTexture(TextureHandle tex_handle)
+	{
+		{
+			std::lock_guard lock(load_mutex);
+			if (pending_textures.erase(tex_handle) == 0) return;
+		}
+		CreateViewForTexture(tex_handle);
+	}
+
+	void TextureManager::UpdateStreaming()
+	{
+		AdriaCpuProfileScope("TextureManager::UpdateStreaming");
+		GfxUploadManager* upload_manager = gfx->GetUploadManager();
+		std::erase_if(streaming_uploads, [this, upload_manager](StreamingUpload& upload)
+			{
+				if (!upload_manager->IsCompleted(upload.ticket)) return false;
+				SwapStreamedTexture(upload.handle, std::move(upload.texture), upload.first_mip);
+				return true;
+			});
+
+		//without recent feedback, e.g. while path tracing, textures keep the mips they have
+		uint64 const frame = gfx->GetFrameIndex();
+		if (!IsStreamingEnabled() || frame > mip_feedback_frame + GFX_BACKBUFFER_COUNT + 1) return;
+
+		streaming_scheduler.SetDesc(TextureStreamingDesc
+			{
+				.budget = (uint64)std::max(TextureStreamingBudget.Get(), 0) * 1024 * 1024,
+				.max_in_flight = (uint32)std::max(TextureStreamingMaxInFlight.Get(), 1)
+			});
+		for (TextureStreamingRequest const& request : streaming_scheduler.Evaluate(frame))
+		{
+			TextureHandle const tex_handle = streaming_handles[request.id];
+			TextureStreaming const& streaming = texture_streaming_map[tex_handle];
+			if (request.first_mip > streaming.first_mip) StreamOut(tex_handle, request.first_mip);
+			else DecodeTexture(tex_handle, streaming.path, request.first_mip, DecodeReason::StreamIn);
+		}
+	}
+
+	void TextureManager::StreamOut(TextureHandle tex_handle, uint32 first_mip)
+	{
+		//the remaining mips are already on the GPU, copy them into a smaller texture instead of decoding the image again
+		GfxTexture const& texture = *texture_map[tex_handle];
+		uint32 const dropped_mips = first_mip - texture_streaming_map[tex_handle].first_mip;
+		GfxTextureDesc desc = texture.GetDesc();
+		desc.width = std::max(desc.width >> dropped_mips, 1u);
+		desc.height = std::max(desc.height >> dropped_mips, 1u);
+		desc.mip_levels -= dropped_mips;
+		desc.initial_state = GfxResourceState::CopyDst;
+		std::unique_ptr<GfxTexture> streamed_texture = gfx->CreateTexture(desc);
+
+		GfxCommandList* cmd_list = gfx->GetCommandList();
+		cmd_list->TextureBarrier(texture, GfxResourceState::AllSRV, GfxResourceState::CopySrc);
+		cmd_list->FlushBarriers();
+		for (uint32 mip = 0; mip < desc.mip_levels; ++mip) cmd_list->CopyTexture(*streamed_texture, mip, 0, texture, mip + dropped_mips, 0);
+		cmd_list->TextureBarrier(*streamed_texture, GfxResourceState::CopyDst, GfxResourceState::AllSRV);
+		cmd_list->FlushBarriers();
+		SwapStreamedTexture(tex_handle, std::move(streamed_texture), first_mip);
+	}
+
+	void TextureManager::SwapStreamedTexture(TextureHandle tex_handle, std::unique_ptr<GfxTexture>&& texture, uint32 first_mip)
+	{
+		//the old texture is released through the device release queue once in flight frames are done with it
+		texture_map[tex_handle] = std::move(texture);
+		TextureStreaming& streaming = texture_streaming_map[tex_handle];
+		streaming.first_mip = first_mip;
+		CreateViewForTexture(tex_handle);
+		streaming_scheduler.CompleteRequest(streaming.streaming_id);
+	}
+
+	void TextureManager::OnResidencyAction(TextureHandle tex_handle, GfxResidencyAction action)
+	{
+		AdriaCpuProfileScope("TextureManager::OnResidencyAction");
+		TextureResidency& residency = texture_residency_map[tex_handle];
+		++residency.generation;
+		if (action == GfxResidencyAction::Evict)
+		{
+			//the texture is released through the device release queue once in flight frames are done with it
+			residency.restoring = false;
+			texture_map[tex_handle].reset();
+			//the view was already copied to the shader visible heap, the restore creates a new one
+			if (auto it = texture_srv_map.find(tex_handle); it != texture_srv_map.end())
+			{
+				gfx->FreeDescriptorCPU(it->second, GfxDescriptorHeapType::CBV_SRV_UAV);
+				texture_srv_map.erase(it);
+			}
+			if (is_scene_initialized) gfx->CopyDescriptors(1, gfx->GetDescriptorGPU((uint32)tex_handle), gfxcommon::GetCommonView(GfxCommonViewType::BlackTexture2D_SRV));
+			return;
+		}
+
+		//this runs inside BeginFrame, decode on the job system and keep the current view bound until Update has uploaded the new texture
+		uint32 const first_mip = action == GfxResidencyAction::Trim ? 1 : 0;
+		bool const decode_in_flight = residency.restoring && residency.first_mip == first_mip;
+		residency.first_mip = first_mip;
+		residency.restoring = true;
+		if (!decode_in_flight) DecodeTexture(tex_handle, residency.path, first_mip, DecodeReason::Residency);
+	}
 }
\ No newline at end of file
@@ -1,13 +1,20 @@
 #pragma once
+#include <mutex>
+#include <deque>
 #include "TextureHandle.h"
+#include "TextureStreamingScheduler.h"
 #include "Graphics/GfxDescriptor.h"
+#include "Graphics/GfxResidencyManager.h"
+#include "Graphics/GfxUploadManager.h"
 #include "Utilities/Singleton.h"
+#include "Utilities/JobSystem.h"
 #include "Utilities/Ref.h"
 
 namespace adria
 {
 	class GfxDevice;
 	class GfxTexture;
+	class Image;
 
 	class TextureManager : public Singleton<TextureManager>
 	{
@@ -19,19 +26,100 @@ namespace adria
 		void Initialize(GfxDevice* gfx, uint32 max_textures);
 		void Destroy();
 
-		ADRIA_NODISCARD TextureHandle LoadTexture(std::string_view path);
+		//returns right away, the image is decoded on the job system and placeholder is bound until the upload has finished
+		ADRIA_NODISCARD TextureHandle LoadTexture(std::string_view path, bool residency_managed = false, TextureHandle placeholder = DEFAULT_BLACK_TEXTURE_HANDLE);
 		ADRIA_NODISCARD TextureHandle LoadCubemap(std::array<std::string, 6> const& cubemap_textures);
 		ADRIA_NODISCARD GfxDescriptor GetSRV(TextureHandle handle);
-		ADRIA_NODISCARD GfxTexture* GetTexture(TextureHandle handle) const;
+		//finishes loading the texture on the calling thread if it is still pending
+		ADRIA_NODISCARD GfxTexture* GetTexture(TextureHandle handle);
+		void MarkUsed(TextureHandle handle);
 		void EnableMipMaps(bool);
 		void OnSceneInitialized();
+		//creates the textures decoded since the last call, submits their uploads as one batch and binds the ones whose upload finished
+		void Update();
+
+		bool IsStreamingEnabled() const;
+		//finest mip sampled per texture handle as written by MipFeedback.hlsli, drives which mips are streamed in and out
+		void ProcessMipFeedback(std::span<uint32 const> feedback);
+		TextureStreamingStats GetStreamingStats() const { return streaming_scheduler.GetStats(); }
+
+	private:
+		struct TextureResidency
+		{
+			std::string path;
+			GfxResidencyHandle residency_handle;
+			uint32 first_mip;
+			uint32 generation = 0;	//bumped by every residency action, uploads of older generations are dropped
+			bool restoring = false;	//a decode for first_mip is in flight, the evicted placeholder stays bound until its upload finishes
+		};
+
+		struct PendingTexture
+		{
+			std::string path;
+			TextureHandle placeholder;
+			bool residency_managed;
+		};
+		enum class DecodeReason : uint8
+		{
+			Load,
+			StreamIn,
+			Residency
+		};
+		struct DecodedTexture
+		{
+			TextureHandle handle;
+			std::unique_ptr<Image> image;
+			uint32 first_mip = 0;
+			DecodeReason reason = DecodeReason::Load;
+		};
+		struct UploadingTexture
+		{
+			TextureHandle handle;
+			GfxUploadTicket ticket;
+		};
+
+		struct TextureStreaming
+		{
+			std::string path;
+			uint32 streaming_id;
+			uint32 first_mip;	//first mip of the texture that is bound right now
+		};
+		struct StreamingUpload
+		{
+			TextureHandle handle;
+			std::unique_ptr<GfxTexture> texture;
+			uint32 first_mip;
+			GfxUploadTicket ticket;
+		};
+		struct ResidencyUpload
+		{
+			TextureHandle handle;
+			std::unique_ptr<GfxTexture> texture;
+			uint32 generation;
+			GfxUploadTicket ticket;
+		};
 
 	private:
 		GfxDevice* gfx = nullptr;
-		
+
+		//guards loaded_textures, handle, pending_textures and decoded_textures, LoadTexture can be called from any thread
+		std::mutex load_mutex;
+		std::unordered_map<TextureHandle, PendingTexture> pending_textures;
+		std::deque<DecodedTexture> decoded_textures;
+		std::vector<UploadingTexture> uploading_textures;
+		JobCounter decode_counter;
+
 		std::unordered_map<TextureName, TextureHandle> loaded_textures;
 		std::unordered_map<TextureHandle, std::unique_ptr<GfxTexture>> texture_map;
 		std::unordered_map<TextureHandle, GfxDescriptor> texture_srv_map;
+		std::unordered_map<TextureHandle, TextureResidency> texture_residency_map;
+		std::vector<ResidencyUpload> residency_uploads;
+
+		TextureStreamingScheduler streaming_scheduler;
+		std::unordered_map<TextureHandle, TextureStreaming> texture_streaming_map;
+		std::vector<TextureHandle> streaming_handles;
+		std::vector<StreamingUpload> streaming_uploads;
+		uint64 mip_feedback_frame = 0;
 		TextureHandle handle = TEXTURE_MANAGER_START_HANDLE;
 		bool mipmaps = true;
 		bool is_scene_initialized = false;
@@ -41,6 +129,14 @@ namespace adria
 		~TextureManager();
 
 		void CreateViewForTexture(TextureHandle handle, bool flag = false);
+		std::unique_ptr<GfxTexture> CreateTexture(Image const& img, uint32 first_mip = 0);
+		void DecodeTexture(TextureHandle handle, std::string const& path, uint32 first_mip = 0, DecodeReason reason = DecodeReason::Load);
+		void CreateLoadedTexture(TextureHandle handle, Image const& img, PendingTexture const& pending_texture);
+		void BindLoadedTexture(TextureHandle handle);
+		void UpdateStreaming();
+		void StreamOut(TextureHandle handle, uint32 first_mip);
+		void SwapStreamedTexture(TextureHandle handle, std::unique_ptr<GfxTexture>&& texture, uint32 first_mip);
+		void OnResidencyAction(TextureHandle handle, GfxResidencyAction action);
 	};
 	#define g_TextureManager TextureManager::Get()
 
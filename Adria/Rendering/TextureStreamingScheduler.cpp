@@ -0,0 +1,167 @@
+#include <algorithm>
+#include "TextureStreamingScheduler.h"
+
+namespace adria
+{
+	uint32 TextureStreamingScheduler::AddEntry(std::span<uint64 const> sizes, uint32 tail_mip, uint64 frame)
+	{
+		ADRIA_ASSERT(tail_mip < sizes.size());
+		uint32 id;
+		if (!free_ids.empty())
+		{
+			id = free_ids.back();
+			free_ids.pop_back();
+		}
+		else
+		{
+			id = static_cast<uint32>(entries.size());
+			entries.emplace_back();
+		}
+
+		TextureStreamingEntry& entry = entries[id];
+		entry.sizes.assign(sizes.begin(), sizes.end());
+		entry.tail_mip = tail_mip;
+		entry.resident_mip = tail_mip;
+		entry.pending_mip = tail_mip;
+		entry.wanted_mip = tail_mip;
+		entry.wanted_frame = frame;
+		entry.registered = true;
+		committed_bytes += entry.sizes[tail_mip];
+		return id;
+	}
+
+	void TextureStreamingScheduler::RemoveEntry(uint32 id)
+	{
+		TextureStreamingEntry& entry = entries[id];
+		ADRIA_ASSERT(entry.registered);
+		committed_bytes -= entry.sizes[std::min(entry.resident_mip, entry.pending_mip)];
+		if (entry.pending_mip != entry.resident_mip)
+		{
+			if (entry.pending_mip > entry.resident_mip) releasing_bytes -= entry.sizes[entry.resident_mip] - entry.sizes[entry.pending_mip];
+			--in_flight_count;
+		}
+		entry = TextureStreamingEntry{};
+		free_ids.push_back(id);
+	}
+
+	void TextureStreamingScheduler::AddFeedback(uint32 id, uint32 mip, uint64 frame)
+	{
+		TextureStreamingEntry& entry = entries[id];
+		ADRIA_ASSERT(entry.registered);
+		mip = std::min(mip, entry.tail_mip);
+		if (mip <= entry.wanted_mip || frame - std::min(frame, entry.wanted_frame) > desc.idle_frames)
+		{
+			entry.wanted_mip = mip;
+			entry.wanted_frame = frame;
+		}
+	}
+
+	void TextureStreamingScheduler::CompleteRequest(uint32 id)
+	{
+		TextureStreamingEntry& entry = entries[id];
+		ADRIA_ASSERT(entry.registered && entry.pending_mip != entry.resident_mip);
+		if (entry.pending_mip > entry.resident_mip)
+		{
+			uint64 const released_bytes = entry.sizes[entry.resident_mip] - entry.sizes[entry.pending_mip];
+			committed_bytes -= released_bytes;
+			releasing_bytes -= released_bytes;
+		}
+		entry.resident_mip = entry.pending_mip;
+		--in_flight_count;
+	}
+
+	std::span<TextureStreamingRequest const> TextureStreamingScheduler::Evaluate(uint64 frame)
+	{
+		requests.clear();
+		starved_count = 0;
+
+		//stream out mips nobody asked for lately first, they free budget for the requests below
+		candidates.clear();
+		for (uint32 id = 0; id < entries.size(); ++id)
+		{
+			TextureStreamingEntry const& entry = entries[id];
+			if (entry.registered && entry.pending_mip == entry.resident_mip && GetTargetMip(entry, frame) > entry.resident_mip) candidates.push_back(id);
+		}
+		std::sort(candidates.begin(), candidates.end(), [this](uint32 a, uint32 b) { return entries[a].wanted_frame < entries[b].wanted_frame; });
+		for (uint32 id : candidates)
+		{
+			if (in_flight_count >= desc.max_in_flight) break;
+			Issue(id, GetTargetMip(entries[id], frame));
+		}
+
+		//the budget shrank below what is in use, drop the top mip of the least recently wanted textures
+		if (committed_bytes - releasing_bytes > desc.budget)
+		{
+			candidates.clear();
+			for (uint32 id = 0; id < entries.size(); ++id)
+			{
+				TextureStreamingEntry const& entry = entries[id];
+				if (entry.registered && entry.pending_mip == entry.resident_mip && entry.resident_mip < entry.tail_mip) candidates.push_back(id);
+			}
+			std::sort(candidates.begin(), candidates.end(), [this](uint32 a, uint32 b) { return entries[a].wanted_frame < entries[b].wanted_frame; });
+			for (uint32 id : candidates)
+			{
+				if (in_flight_count >= desc.max_in_flight || committed_bytes - releasing_bytes <= desc.budget) break;
+				Issue(id, entries[id].resident_mip + 1);
+			}
+		}
+
+		//stream in, textures that miss the most mips go first and the most recently wanted break ties
+		candidates.clear();
+		for (uint32 id = 0; id < entries.size(); ++id)
+		{
+			TextureStreamingEntry const& entry = entries[id];
+			if (entry.registered && entry.pending_mip == entry.resident_mip && GetTargetMip(entry, frame) < entry.resident_mip) candidates.push_back(id);
+		}
+		std::sort(candidates.begin(), candidates.end(), [this, frame](uint32 a, uint32 b)
+			{
+				TextureStreamingEntry const& entry_a = entries[a];
+				TextureStreamingEntry const& entry_b = entries[b];
+				uint32 const missing_a = entry_a.resident_mip - GetTargetMip(entry_a, frame);
+				uint32 const missing_b = entry_b.resident_mip - GetTargetMip(entry_b, frame);
+				return missing_a != missing_b ? missing_a > missing_b : entry_a.wanted_frame > entry_b.wanted_frame;
+			});
+		for (uint32 id : candidates)
+		{
+			if (in_flight_count >= desc.max_in_flight) break;
+			TextureStreamingEntry const& entry = entries[id];
+			uint32 const target_mip = GetTargetMip(entry, frame);
+			uint32 first_mip = target_mip;
+			while (first_mip < entry.resident_mip && committed_bytes - entry.sizes[entry.resident_mip] + entry.sizes[first_mip] > desc.budget) ++first_mip;
+			if (first_mip > target_mip) ++starved_count;
+			if (first_mip < entry.resident_mip) Issue(id, first_mip);
+		}
+		return requests;
+	}
+
+	TextureStreamingStats TextureStreamingScheduler::GetStats() const
+	{
+		TextureStreamingStats stats{};
+		for (TextureStreamingEntry const& entry : entries)
+		{
+			if (!entry.registered) continue;
+			++stats.texture_count;
+			stats.resident_bytes += entry.sizes[entry.resident_mip];
+		}
+		stats.in_flight_count = in_flight_count;
+		stats.starved_count = starved_count;
+		stats.committed_bytes = committed_bytes;
+		return stats;
+	}
+
+	uint32 TextureStreamingScheduler::GetTargetMip(TextureStreamingEntry const& entry, uint64 frame) const
+	{
+		return frame - std::min(frame, entry.wanted_frame) > desc.idle_frames ? entry.tail_mip : entry.wanted_mip;
+	}
+
+	void TextureStreamingScheduler::Issue(uint32 id, uint32 first_mip)
+	{
+		TextureStreamingEntry& entry = entries[id];
+		ADRIA_ASSERT(first_mip != entry.resident_mip && first_mip <= entry.tail_mip);
+		if (first_mip < entry.resident_mip) committed_bytes += entry.sizes[first_mip] - entry.sizes[entry.resident_mip];
+		else releasing_bytes += entry.sizes[entry.resident_mip] - entry.sizes[first_mip];
+		entry.pending_mip = first_mip;
+		++in_flight_count;
+		requests.push_back(TextureStreamingRequest{ id, first_mip });
+	}
+}
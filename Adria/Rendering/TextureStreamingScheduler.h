@@ -0,0 +1,76 @@
+#pragma once
+#include <vector>
+#include <span>
+
+namespace adria
+{
+	struct TextureStreamingDesc
+	{
+		uint64 budget = 512ull * 1024 * 1024;	//bytes the streamed textures may use, mip tails always stay resident and count against it
+		uint32 max_in_flight = 8;				//requests that may be outstanding at once
+		uint64 idle_frames = 60;				//frames a finer request is kept before coarser feedback or no feedback at all drops mips
+	};
+
+	struct TextureStreamingRequest
+	{
+		uint32 id;
+		uint32 first_mip;	//first mip the texture should have once the request is carried out
+	};
+
+	struct TextureStreamingEntry
+	{
+		std::vector<uint64> sizes;	//sizes[i] is the size of the texture with mips i and down resident
+		uint32 tail_mip = 0;		//first mip of the tail that is loaded up front and never streamed out
+		uint32 resident_mip = 0;
+		uint32 pending_mip = 0;		//target of the request in flight, equal to resident_mip if there is none
+		uint32 wanted_mip = 0;		//finest mip the feedback asked for since wanted_frame
+		uint64 wanted_frame = 0;
+		bool registered = false;
+	};
+
+	struct TextureStreamingStats
+	{
+		uint32 texture_count = 0;
+		uint32 in_flight_count = 0;
+		uint32 starved_count = 0;	//textures that want finer mips than the budget allows
+		uint64 resident_bytes = 0;
+		uint64 committed_bytes = 0;	//resident bytes plus the growth of the requests in flight
+	};
+
+	//Decides which textures stream mips in or out given the mips sampled on the GPU and a memory budget. Like the
+	//residency policy it only does bookkeeping: the owner feeds it feedback, carries out the returned requests and
+	//reports them back with CompleteRequest, so it can be driven by synthetic feedback as well as by the GPU.
+	class TextureStreamingScheduler
+	{
+	public:
+		explicit TextureStreamingScheduler(TextureStreamingDesc const& desc = {}) : desc(desc) {}
+
+		void SetDesc(TextureStreamingDesc const& _desc) { desc = _desc; }
+
+		uint32 AddEntry(std::span<uint64 const> sizes, uint32 tail_mip, uint64 frame);
+		void RemoveEntry(uint32 id);
+		//finer mips are taken right away, coarser ones only once the finer request is older than idle_frames
+		void AddFeedback(uint32 id, uint32 mip, uint64 frame);
+		void CompleteRequest(uint32 id);
+
+		std::span<TextureStreamingRequest const> Evaluate(uint64 frame);
+
+		TextureStreamingEntry const& GetEntry(uint32 id) const { return entries[id]; }
+		TextureStreamingStats GetStats() const;
+
+	private:
+		TextureStreamingDesc desc;
+		std::vector<TextureStreamingEntry> entries;
+		std::vector<uint32> free_ids;
+		std::vector<uint32> candidates;
+		std::vector<TextureStreamingRequest> requests;
+		uint64 committed_bytes = 0;
+		uint64 releasing_bytes = 0;	//bytes the stream outs in flight give back once completed
+		uint32 in_flight_count = 0;
+		uint32 starved_count = 0;
+
+	private:
+		uint32 GetTargetMip(TextureStreamingEntry const& entry, uint64 frame) const;
+		void Issue(uint32 id, uint32 first_mip);
+	};
+}
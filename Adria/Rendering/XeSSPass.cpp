@@ -19,16 +19,16 @@ namespace adria
 			switch (logging_level)
 			{
 			case XESS_LOGGING_LEVEL_DEBUG:
-				ADRIA_LOG(DEBUG, message);
+				ADRIA_LOG(DEBUG, "%s", message);
 				break;
 			case XESS_LOGGING_LEVEL_INFO:
-				ADRIA_LOG(INFO, message);
+				ADRIA_LOG(INFO, "%s", message);
 				break;
 			case XESS_LOGGING_LEVEL_WARNING:
-				ADRIA_LOG(WARNING, message);
+				ADRIA_LOG(WARNING, "%s", message);
 				break;
 			case XESS_LOGGING_LEVEL_ERROR:
-				ADRIA_LOG(ERROR, message);
+				ADRIA_LOG(ERROR, "%s", message);
 				break;
 			default:
 				break;
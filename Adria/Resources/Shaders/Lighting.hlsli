@@ -36,13 +36,26 @@ struct Light
 
 ///Shadows
 
+//light matrix of a shadow map view and the uv bounds of its atlas tile (min xy, max xy)
+struct ShadowView
+{
+	float4x4 viewProjection;
+	float4   tileBounds;
+};
+
+//shadow maps of all lights share one atlas, the light matrices already map into the tile of each view
 float CalcShadowFactor_PCF3x3(SamplerComparisonState shadowSampler,
-	Texture2D<float> shadowMap, float3 uvd, int shadowMapSize)
+	Texture2D<float> shadowMap, float3 uvd, float4 tileBounds)
 {
 	if (uvd.z > 1.0f) return 1.0;
 
+	uint shadowMapSize, shadowMapHeight;
+	shadowMap.GetDimensions(shadowMapSize, shadowMapHeight);
 	float depth = uvd.z;
 	const float dx = 1.0f / shadowMapSize;
+	//taps are clamped to the tile shrunk by one texel, so neither the kernel nor the bilinear footprint reads a neighbouring tile
+	float2 minUV = tileBounds.xy + dx;
+	float2 maxUV = tileBounds.zw - dx;
 	float2 offsets[9] =
 	{
 		float2(-dx, -dx),  float2(0.0f, -dx),  float2(dx, -dx),
@@ -55,7 +68,7 @@ float CalcShadowFactor_PCF3x3(SamplerComparisonState shadowSampler,
 	for (int i = 0; i < 9; ++i)
 	{
 		percentLit += shadowMap.SampleCmpLevelZero(shadowSampler,
-			uvd.xy + offsets[i], depth);
+			clamp(uvd.xy + offsets[i], minUV, maxUV), depth);
 	}
     percentLit /= 9.0f;
     return percentLit;
@@ -63,7 +76,7 @@ float CalcShadowFactor_PCF3x3(SamplerComparisonState shadowSampler,
 
 float GetShadowMapFactorWS(Light light, float3 worldPosition)
 {
-	StructuredBuffer<float4x4> lightViewProjections = ResourceDescriptorHeap[FrameCB.lightsMatricesIdx];
+	StructuredBuffer<ShadowView> shadowViews = ResourceDescriptorHeap[FrameCB.lightsMatricesIdx];
 	bool castsShadows = light.shadowTextureIndex >= 0;
 	float shadowFactor = 1.0f;
 	if (castsShadows)
@@ -78,29 +91,29 @@ float GetShadowMapFactorWS(Light light, float3 worldPosition)
 				float viewDepth = viewPosition.z;
 				for (uint i = 0; i < 4; ++i)
 				{
-					float4x4 lightViewProjection = lightViewProjections[light.shadowMatrixIndex + i];
-					float4 shadowMapPosition = mul(float4(worldPosition, 1.0f), lightViewProjection);
+					ShadowView shadowView = shadowViews[light.shadowMatrixIndex + i];
+					float4 shadowMapPosition = mul(float4(worldPosition, 1.0f), shadowView.viewProjection);
 					float3 UVD = shadowMapPosition.xyz / shadowMapPosition.w;
 					UVD.xy = 0.5 * UVD.xy + 0.5;
 					UVD.y = 1.0 - UVD.y;
 
 					if (viewDepth < FrameCB.cascadeSplits[i])
 					{
-						Texture2D<float> shadowMap = ResourceDescriptorHeap[NonUniformResourceIndex(light.shadowTextureIndex + i)];
-						shadowFactor = CalcShadowFactor_PCF3x3(ShadowWrapSampler, shadowMap, UVD, 2048);
+						Texture2D<float> shadowMap = ResourceDescriptorHeap[NonUniformResourceIndex(light.shadowTextureIndex)];
+						shadowFactor = CalcShadowFactor_PCF3x3(ShadowClampSampler, shadowMap, UVD, shadowView.tileBounds);
 						break;
 					}
 				}
 			}
 			else
 			{
-				float4x4 lightViewProjection = lightViewProjections[light.shadowMatrixIndex];
-				float4 shadowMapPosition = mul(float4(worldPosition, 1.0f), lightViewProjection);
+				ShadowView shadowView = shadowViews[light.shadowMatrixIndex];
+				float4 shadowMapPosition = mul(float4(worldPosition, 1.0f), shadowView.viewProjection);
 				float3 UVD = shadowMapPosition.xyz / shadowMapPosition.w;
 				UVD.xy = 0.5 * UVD.xy + 0.5;
 				UVD.y = 1.0 - UVD.y;
 				Texture2D<float> shadowMap = ResourceDescriptorHeap[NonUniformResourceIndex(light.shadowTextureIndex)];
-				shadowFactor = CalcShadowFactor_PCF3x3(ShadowWrapSampler, shadowMap, UVD, 1024);
+				shadowFactor = CalcShadowFactor_PCF3x3(ShadowClampSampler, shadowMap, UVD, shadowView.tileBounds);
 			}
 		}
 		break;
@@ -108,24 +121,24 @@ float GetShadowMapFactorWS(Light light, float3 worldPosition)
 		{
 			float3 lightToPixelWS = worldPosition - light.position.xyz;
 			uint cubeFaceIndex = GetCubeFaceIndex(lightToPixelWS);
-			float4x4 lightViewProjection = lightViewProjections[light.shadowMatrixIndex + cubeFaceIndex];
-			float4 shadowMapPosition = mul(float4(worldPosition, 1.0f), lightViewProjection);
+			ShadowView shadowView = shadowViews[light.shadowMatrixIndex + cubeFaceIndex];
+			float4 shadowMapPosition = mul(float4(worldPosition, 1.0f), shadowView.viewProjection);
 			float3 UVD = shadowMapPosition.xyz / shadowMapPosition.w;
 			UVD.xy = 0.5 * UVD.xy + 0.5;
 			UVD.y = 1.0 - UVD.y;
-			Texture2D<float> shadowMap = ResourceDescriptorHeap[NonUniformResourceIndex(light.shadowTextureIndex + cubeFaceIndex)];
-			shadowFactor = CalcShadowFactor_PCF3x3(ShadowWrapSampler, shadowMap, UVD, 512);
+			Texture2D<float> shadowMap = ResourceDescriptorHeap[NonUniformResourceIndex(light.shadowTextureIndex)];
+			shadowFactor = CalcShadowFactor_PCF3x3(ShadowClampSampler, shadowMap, UVD, shadowView.tileBounds);
 		}
 		break;
 		case SPOT_LIGHT:
 		{
-			float4x4 lightViewProjection = lightViewProjections[light.shadowMatrixIndex];
-			float4 shadowMapPosition = mul(float4(worldPosition, 1.0f), lightViewProjection);
+			ShadowView shadowView = shadowViews[light.shadowMatrixIndex];
+			float4 shadowMapPosition = mul(float4(worldPosition, 1.0f), shadowView.viewProjection);
 			float3 UVD = shadowMapPosition.xyz / shadowMapPosition.w;
 			UVD.xy = 0.5 * UVD.xy + 0.5;
 			UVD.y = 1.0 - UVD.y;
 			Texture2D<float> shadowMap = ResourceDescriptorHeap[NonUniformResourceIndex(light.shadowTextureIndex)];
-			shadowFactor = CalcShadowFactor_PCF3x3(ShadowWrapSampler, shadowMap, UVD, 1024);
+			shadowFactor = CalcShadowFactor_PCF3x3(ShadowClampSampler, shadowMap, UVD, shadowView.tileBounds);
 		}
 		break;
 		}
@@ -135,7 +148,7 @@ float GetShadowMapFactorWS(Light light, float3 worldPosition)
 
 float GetShadowMapFactor(Light light, float3 viewPosition)
 {
-	StructuredBuffer<float4x4> lightViewProjections = ResourceDescriptorHeap[FrameCB.lightsMatricesIdx];
+	StructuredBuffer<ShadowView> shadowViews = ResourceDescriptorHeap[FrameCB.lightsMatricesIdx];
 	bool castsShadows = light.shadowTextureIndex >= 0;
 	float shadowFactor = 1.0f;
 	if (castsShadows)
@@ -151,16 +164,16 @@ float GetShadowMapFactor(Light light, float3 viewPosition)
 				{
 					float4 worldPosition = mul(float4(viewPosition, 1.0f), FrameCB.inverseView);
 					worldPosition /= worldPosition.w;
-					float4x4 lightViewProjection = lightViewProjections[light.shadowMatrixIndex + i];
-					float4 shadowMapPosition = mul(worldPosition, lightViewProjection);
+					ShadowView shadowView = shadowViews[light.shadowMatrixIndex + i];
+					float4 shadowMapPosition = mul(worldPosition, shadowView.viewProjection);
 					float3 UVD = shadowMapPosition.xyz / shadowMapPosition.w;
 					UVD.xy = 0.5 * UVD.xy + 0.5;
 					UVD.y = 1.0 - UVD.y;
 
 					if (viewDepth < FrameCB.cascadeSplits[i])
 					{
-						Texture2D<float> shadowMap = ResourceDescriptorHeap[NonUniformResourceIndex(light.shadowTextureIndex + i)];
-						shadowFactor = CalcShadowFactor_PCF3x3(ShadowWrapSampler, shadowMap, UVD, 2048);
+						Texture2D<float> shadowMap = ResourceDescriptorHeap[NonUniformResourceIndex(light.shadowTextureIndex)];
+						shadowFactor = CalcShadowFactor_PCF3x3(ShadowClampSampler, shadowMap, UVD, shadowView.tileBounds);
 						break;
 					}
 				}
@@ -169,13 +182,13 @@ float GetShadowMapFactor(Light light, float3 viewPosition)
 			{
 				float4 worldPosition = mul(float4(viewPosition, 1.0f), FrameCB.inverseView);
 				worldPosition /= worldPosition.w;
-				float4x4 lightViewProjection = lightViewProjections[light.shadowMatrixIndex];
-				float4 shadowMapPosition = mul(worldPosition, lightViewProjection);
+				ShadowView shadowView = shadowViews[light.shadowMatrixIndex];
+				float4 shadowMapPosition = mul(worldPosition, shadowView.viewProjection);
 				float3 UVD = shadowMapPosition.xyz / shadowMapPosition.w;
 				UVD.xy = 0.5 * UVD.xy + 0.5;
 				UVD.y = 1.0 - UVD.y;
 				Texture2D<float> shadowMap = ResourceDescriptorHeap[NonUniformResourceIndex(light.shadowTextureIndex)];
-				shadowFactor = CalcShadowFactor_PCF3x3(ShadowWrapSampler, shadowMap, UVD, 1024);
+				shadowFactor = CalcShadowFactor_PCF3x3(ShadowClampSampler, shadowMap, UVD, shadowView.tileBounds);
 			}
 		}
 		break;
@@ -185,26 +198,26 @@ float GetShadowMapFactor(Light light, float3 viewPosition)
 			uint cubeFaceIndex = GetCubeFaceIndex(lightToPixelWS);
 			float4 worldPosition = mul(float4(viewPosition, 1.0f), FrameCB.inverseView);
 			worldPosition /= worldPosition.w;
-			float4x4 lightViewProjection = lightViewProjections[light.shadowMatrixIndex + cubeFaceIndex];
-			float4 shadowMapPosition = mul(worldPosition, lightViewProjection);
+			ShadowView shadowView = shadowViews[light.shadowMatrixIndex + cubeFaceIndex];
+			float4 shadowMapPosition = mul(worldPosition, shadowView.viewProjection);
 			float3 UVD = shadowMapPosition.xyz / shadowMapPosition.w;
 			UVD.xy = 0.5 * UVD.xy + 0.5;
 			UVD.y = 1.0 - UVD.y;
-			Texture2D<float> shadowMap = ResourceDescriptorHeap[NonUniformResourceIndex(light.shadowTextureIndex + cubeFaceIndex)];
-			shadowFactor = CalcShadowFactor_PCF3x3(ShadowWrapSampler, shadowMap, UVD, 512);
+			Texture2D<float> shadowMap = ResourceDescriptorHeap[NonUniformResourceIndex(light.shadowTextureIndex)];
+			shadowFactor = CalcShadowFactor_PCF3x3(ShadowClampSampler, shadowMap, UVD, shadowView.tileBounds);
 		}
 		break;
 		case SPOT_LIGHT:
 		{
 			float4 worldPosition = mul(float4(viewPosition, 1.0f), FrameCB.inverseView);
 			worldPosition /= worldPosition.w;
-			float4x4 lightViewProjection = lightViewProjections[light.shadowMatrixIndex];
-			float4 shadowMapPosition = mul(worldPosition, lightViewProjection);
+			ShadowView shadowView = shadowViews[light.shadowMatrixIndex];
+			float4 shadowMapPosition = mul(worldPosition, shadowView.viewProjection);
 			float3 UVD = shadowMapPosition.xyz / shadowMapPosition.w;
 			UVD.xy = 0.5 * UVD.xy + 0.5;
 			UVD.y = 1.0 - UVD.y;
 			Texture2D<float> shadowMap = ResourceDescriptorHeap[NonUniformResourceIndex(light.shadowTextureIndex)];
-			shadowFactor = CalcShadowFactor_PCF3x3(ShadowWrapSampler, shadowMap, UVD, 1024);
+			shadowFactor = CalcShadowFactor_PCF3x3(ShadowClampSampler, shadowMap, UVD, shadowView.tileBounds);
 		}
 		break;
 		}
@@ -1,4 +1,5 @@
 #include "Scene.hlsli"
+#include "MipFeedback.hlsli"
 #if RAIN
 #include "Weather/RainUtil.hlsli"
 #endif
@@ -70,13 +71,19 @@ PSOutput GBufferPS(VSToPS input)
 	Texture2D metallicRoughnessTexture = ResourceDescriptorHeap[materialData.roughnessMetallicIdx];
 	Texture2D emissiveTexture = ResourceDescriptorHeap[materialData.emissiveIdx];
 
+	uint2 pixel = (uint2)input.Position.xy;
+	WriteMipFeedback(materialData.diffuseIdx, albedoTexture, LinearWrapSampler, input.Uvs, pixel);
+	WriteMipFeedback(materialData.normalIdx, normalTexture, LinearWrapSampler, input.Uvs, pixel);
+	WriteMipFeedback(materialData.roughnessMetallicIdx, metallicRoughnessTexture, LinearWrapSampler, input.Uvs, pixel);
+	WriteMipFeedback(materialData.emissiveIdx, emissiveTexture, LinearWrapSampler, input.Uvs, pixel);
+
 	float4 albedoColor = albedoTexture.Sample(LinearWrapSampler, input.Uvs) * float4(materialData.baseColorFactor, 1.0f);
 	if (albedoColor.a < materialData.alphaCutoff) discard;
 
 	float3 normal = normalize(input.NormalWS);
 	float3 tangent = normalize(input.TangentWS);
 	float3 bitangent = normalize(input.BitangentWS);
-    float3 normalTS = normalize(normalTexture.Sample(LinearWrapSampler, input.Uvs).xyz * 2.0f - 1.0f);
+    float3 normalTS = normalize(UnpackNormalMap(normalTexture.Sample(LinearWrapSampler, input.Uvs).xy));
     float3x3 TBN = float3x3(tangent, bitangent, normal); 
     normal = normalize(mul(normalTS, TBN));
 
@@ -26,9 +26,9 @@ struct VSToPS
 VSToPS ShadowVS(uint VertexId : SV_VertexID)
 {
 	StructuredBuffer<Light> lightBuffer = ResourceDescriptorHeap[FrameCB.lightsIdx];
-	StructuredBuffer<float4x4> lightViewProjections = ResourceDescriptorHeap[FrameCB.lightsMatricesIdx];
+	StructuredBuffer<ShadowView> shadowViews = ResourceDescriptorHeap[FrameCB.lightsMatricesIdx];
 	Light light = lightBuffer[ShadowPassCB.lightIndex];
-	float4x4 lightViewProjection = lightViewProjections[light.shadowMatrixIndex + ShadowPassCB.matrixIndex];
+	float4x4 lightViewProjection = shadowViews[light.shadowMatrixIndex + ShadowPassCB.matrixIndex].viewProjection;
 
 	VSToPS output = (VSToPS)0;
 	Instance instanceData = GetInstanceData(ModelCB.instanceId);
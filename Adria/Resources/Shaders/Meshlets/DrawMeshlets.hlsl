@@ -1,5 +1,6 @@
 #include "GpuDrivenRendering.hlsli"
 #include "Scene.hlsli"
+#include "MipFeedback.hlsli"
 #if RAIN
 #include "Weather/RainUtil.hlsli"
 #endif
@@ -104,13 +105,19 @@ PSOutput DrawMeshletsPS(MSToPS input)
 	Texture2D metallicRoughnessTexture = ResourceDescriptorHeap[material.roughnessMetallicIdx];
 	Texture2D emissiveTexture = ResourceDescriptorHeap[material.emissiveIdx];
 
+	uint2 pixel = (uint2)input.Position.xy;
+	WriteMipFeedback(material.diffuseIdx, albedoTexture, LinearWrapSampler, input.Uvs, pixel);
+	WriteMipFeedback(material.normalIdx, normalTexture, LinearWrapSampler, input.Uvs, pixel);
+	WriteMipFeedback(material.roughnessMetallicIdx, metallicRoughnessTexture, LinearWrapSampler, input.Uvs, pixel);
+	WriteMipFeedback(material.emissiveIdx, emissiveTexture, LinearWrapSampler, input.Uvs, pixel);
+
 	float4 albedoColor = albedoTexture.Sample(LinearWrapSampler, input.Uvs) * float4(material.baseColorFactor, 1.0f);
 	if (albedoColor.a < material.alphaCutoff) discard;
 
 	float3 normal = normalize(input.NormalWS);
 	float3 tangent = normalize(input.TangentWS);
 	float3 bitangent = normalize(input.BitangentWS);
-    float3 normalTS = normalize(normalTexture.Sample(LinearWrapSampler, input.Uvs).xyz * 2.0f - 1.0f);
+    float3 normalTS = normalize(UnpackNormalMap(normalTexture.Sample(LinearWrapSampler, input.Uvs).xy));
     float3x3 TBN = float3x3(tangent, bitangent, normal); 
     normal = normalize(mul(normalTS, TBN));
 
@@ -0,0 +1,23 @@
+#ifndef _MIP_FEEDBACK_
+#define _MIP_FEEDBACK_
+
+#include "CommonResources.hlsli"
+
+//keep in sync with MipFeedbackPass
+#define MIP_FEEDBACK_MAX_TEXTURES 16384
+#define MIP_FEEDBACK_BIAS 16
+
+//Writes the finest mip sampled from a texture into the feedback buffer, relative to the mips the texture currently has.
+//Only one pixel of every 4x4 block writes per frame, rotating through the block, to keep the atomics cheap.
+void WriteMipFeedback(uint textureIdx, Texture2D texture, SamplerState samplerState, float2 uv, uint2 pixel)
+{
+	float lod = texture.CalculateLevelOfDetailUnclamped(samplerState, uv);
+	if (FrameCB.mipFeedbackIdx < 0 || textureIdx >= MIP_FEEDBACK_MAX_TEXTURES) return;
+	if ((pixel.x & 3) + (pixel.y & 3) * 4 != FrameCB.frameCount % 16) return;
+
+	RWByteAddressBuffer mipFeedbackBuffer = ResourceDescriptorHeap[FrameCB.mipFeedbackIdx];
+	uint feedback = (uint)clamp(floor(lod) + MIP_FEEDBACK_BIAS, 0.0f, 2.0f * MIP_FEEDBACK_BIAS);
+	mipFeedbackBuffer.InterlockedMin(textureIdx * 4, feedback);
+}
+
+#endif
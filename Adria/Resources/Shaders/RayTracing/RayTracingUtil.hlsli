@@ -221,7 +221,7 @@ MaterialProperties GetMaterialProperties(Material material, float2 UV, int mipLe
     properties.normalTS = float3(0.5f, 0.5f, 1.0f);
     if (material.normalIdx >= 0)
     {
-        properties.normalTS = SampleBindlessLevel2D(material.normalIdx, LinearWrapSampler, UV, mipLevel).rgb;
+        properties.normalTS = UnpackNormalMap(SampleBindlessLevel2D(material.normalIdx, LinearWrapSampler, UV, mipLevel).xy) * 0.5f + 0.5f;
     }
     return properties;
 }
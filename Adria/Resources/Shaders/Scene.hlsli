@@ -61,6 +61,13 @@ Material GetMaterialData(uint materialIdx)
 	return materials[materialIdx];
 }
 
+//normal maps can be BC5 compressed, which only keeps the two channels z is rebuilt from
+float3 UnpackNormalMap(float2 normalSample)
+{
+	float2 normalXY = normalSample * 2.0f - 1.0f;
+	return float3(normalXY, sqrt(saturate(1.0f - dot(normalXY, normalXY))));
+}
+
 template<typename T>
 T LoadMeshBuffer(uint bufferIdx, uint bufferOffset, uint vertexId)
 {
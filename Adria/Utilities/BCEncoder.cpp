@@ -0,0 +1,406 @@
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include "BCEncoder.h"
+#include "JobSystem.h"
+
+namespace adria
+{
+	namespace
+	{
+		constexpr uint32 BlockTexelCount = 16;
+		constexpr uint32 BC7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+		using BlockPoints = float[BlockTexelCount][4];
+		using BlockIndices = uint32[BlockTexelCount];
+
+		void LoadBlockPoints(uint8 const* texels, BlockPoints& points)
+		{
+			for (uint32 i = 0; i < BlockTexelCount; ++i)
+			{
+				for (uint32 c = 0; c < 4; ++c) points[i][c] = texels[i * 4 + c];
+			}
+		}
+
+		//endpoints along the direction of the largest variance, found with power iteration on the covariance matrix
+		void ComputePrincipalEndpoints(BlockPoints const& points, uint32 channels, float (&endpoint0)[4], float (&endpoint1)[4])
+		{
+			float mean[4] = {};
+			for (uint32 i = 0; i < BlockTexelCount; ++i)
+			{
+				for (uint32 c = 0; c < channels; ++c) mean[c] += points[i][c] / BlockTexelCount;
+			}
+
+			float covariance[4][4] = {};
+			for (uint32 i = 0; i < BlockTexelCount; ++i)
+			{
+				for (uint32 a = 0; a < channels; ++a)
+				{
+					for (uint32 b = 0; b < channels; ++b) covariance[a][b] += (points[i][a] - mean[a]) * (points[i][b] - mean[b]);
+				}
+			}
+
+			//start from the row of the channel with the largest variance so the iteration can't start orthogonal to the axis
+			uint32 start_channel = 0;
+			for (uint32 c = 1; c < channels; ++c)
+			{
+				if (covariance[c][c] > covariance[start_channel][start_channel]) start_channel = c;
+			}
+			float axis[4] = {};
+			for (uint32 c = 0; c < channels; ++c) axis[c] = covariance[start_channel][c];
+
+			for (uint32 iteration = 0; iteration < 8; ++iteration)
+			{
+				float next_axis[4] = {};
+				float length = 0.0f;
+				for (uint32 a = 0; a < channels; ++a)
+				{
+					for (uint32 b = 0; b < channels; ++b) next_axis[a] += covariance[a][b] * axis[b];
+					length += next_axis[a] * next_axis[a];
+				}
+				if (length < 1e-12f) break;
+				length = std::sqrt(length);
+				for (uint32 c = 0; c < channels; ++c) axis[c] = next_axis[c] / length;
+			}
+
+			float min_projection = 0.0f, max_projection = 0.0f;
+			for (uint32 i = 0; i < BlockTexelCount; ++i)
+			{
+				float projection = 0.0f;
+				for (uint32 c = 0; c < channels; ++c) projection += (points[i][c] - mean[c]) * axis[c];
+				min_projection = std::min(min_projection, projection);
+				max_projection = std::max(max_projection, projection);
+			}
+			for (uint32 c = 0; c < channels; ++c)
+			{
+				endpoint0[c] = std::clamp(mean[c] + axis[c] * max_projection, 0.0f, 255.0f);
+				endpoint1[c] = std::clamp(mean[c] + axis[c] * min_projection, 0.0f, 255.0f);
+			}
+		}
+
+		//least squares endpoints for fixed interpolation weights, weights[i] is how much of endpoint1 texel i gets
+		bool SolveEndpoints(BlockPoints const& points, float const (&weights)[BlockTexelCount], uint32 channels, float (&endpoint0)[4], float (&endpoint1)[4])
+		{
+			float a = 0.0f, b = 0.0f, c = 0.0f;
+			float x0[4] = {}, x1[4] = {};
+			for (uint32 i = 0; i < BlockTexelCount; ++i)
+			{
+				float const w = weights[i];
+				float const u = 1.0f - w;
+				a += u * u;
+				b += u * w;
+				c += w * w;
+				for (uint32 ch = 0; ch < channels; ++ch)
+				{
+					x0[ch] += u * points[i][ch];
+					x1[ch] += w * points[i][ch];
+				}
+			}
+			float const determinant = a * c - b * b;
+			if (std::abs(determinant) < 1e-6f) return false;
+			for (uint32 ch = 0; ch < channels; ++ch)
+			{
+				endpoint0[ch] = std::clamp((c * x0[ch] - b * x1[ch]) / determinant, 0.0f, 255.0f);
+				endpoint1[ch] = std::clamp((a * x1[ch] - b * x0[ch]) / determinant, 0.0f, 255.0f);
+			}
+			return true;
+		}
+
+		template<uint32 Channels>
+		float SquaredDistance(float const* a, float const* b)
+		{
+			float distance = 0.0f;
+			for (uint32 c = 0; c < Channels; ++c) distance += (a[c] - b[c]) * (a[c] - b[c]);
+			return distance;
+		}
+
+		uint16 PackRGB565(float const (&color)[4])
+		{
+			auto Quantize = [](float value, int32 max_value) { return (uint32)std::clamp((int32)std::lround(value * max_value / 255.0f), 0, max_value); };
+			return uint16((Quantize(color[0], 31) << 11) | (Quantize(color[1], 63) << 5) | Quantize(color[2], 31));
+		}
+
+		void UnpackRGB565(uint16 packed, float (&color)[4])
+		{
+			uint32 const r = packed >> 11, g = (packed >> 5) & 63, b = packed & 31;
+			color[0] = float((r << 3) | (r >> 2));
+			color[1] = float((g << 2) | (g >> 4));
+			color[2] = float((b << 3) | (b >> 2));
+		}
+
+		//orders the endpoints for the four color mode and picks the nearest palette entry for every texel
+		float FitBC1(BlockPoints const& points, uint16& color0, uint16& color1, BlockIndices& indices)
+		{
+			if (color0 < color1) std::swap(color0, color1);
+			float palette[4][4] = {};
+			UnpackRGB565(color0, palette[0]);
+			UnpackRGB565(color1, palette[1]);
+			for (uint32 c = 0; c < 3; ++c)
+			{
+				palette[2][c] = std::floor((2.0f * palette[0][c] + palette[1][c]) / 3.0f);
+				palette[3][c] = std::floor((palette[0][c] + 2.0f * palette[1][c]) / 3.0f);
+			}
+			//equal endpoints select the three color mode, only index 0 is safe to use there
+			uint32 const palette_size = color0 == color1 ? 1 : 4;
+
+			float error = 0.0f;
+			for (uint32 i = 0; i < BlockTexelCount; ++i)
+			{
+				float best_distance = FLT_MAX;
+				for (uint32 p = 0; p < palette_size; ++p)
+				{
+					float const distance = SquaredDistance<3>(points[i], palette[p]);
+					if (distance < best_distance)
+					{
+						best_distance = distance;
+						indices[i] = p;
+					}
+				}
+				error += best_distance;
+			}
+			return error;
+		}
+
+		struct BC7Endpoints
+		{
+			uint32 colors[2][4];	//7 bits per channel, the p-bit is the lowest bit of the 8 bit value
+			uint32 pbits[2];
+		};
+
+		float FitBC7(BlockPoints const& points, BC7Endpoints const& endpoints, BlockIndices& indices)
+		{
+			int32 expanded[2][4];
+			for (uint32 e = 0; e < 2; ++e)
+			{
+				for (uint32 c = 0; c < 4; ++c) expanded[e][c] = int32((endpoints.colors[e][c] << 1) | endpoints.pbits[e]);
+			}
+			float palette[16][4];
+			for (uint32 p = 0; p < 16; ++p)
+			{
+				int32 const w = (int32)BC7Weights[p];
+				for (uint32 c = 0; c < 4; ++c) palette[p][c] = float(((64 - w) * expanded[0][c] + w * expanded[1][c] + 32) >> 6);
+			}
+
+			float error = 0.0f;
+			for (uint32 i = 0; i < BlockTexelCount; ++i)
+			{
+				float best_distance = FLT_MAX;
+				for (uint32 p = 0; p < 16; ++p)
+				{
+					float const distance = SquaredDistance<4>(points[i], palette[p]);
+					if (distance < best_distance)
+					{
+						best_distance = distance;
+						indices[i] = p;
+					}
+				}
+				error += best_distance;
+			}
+			return error;
+		}
+
+		//tries the four p-bit combinations and keeps the one with the lowest error
+		float QuantizeBC7(BlockPoints const& points, float const (&endpoint0)[4], float const (&endpoint1)[4], BC7Endpoints& endpoints, BlockIndices& indices)
+		{
+			float best_error = FLT_MAX;
+			for (uint32 pbits = 0; pbits < 4; ++pbits)
+			{
+				BC7Endpoints candidate{};
+				candidate.pbits[0] = pbits & 1;
+				candidate.pbits[1] = pbits >> 1;
+				for (uint32 c = 0; c < 4; ++c)
+				{
+					candidate.colors[0][c] = (uint32)std::clamp((int32)std::lround((endpoint0[c] - candidate.pbits[0]) / 2.0f), 0, 127);
+					candidate.colors[1][c] = (uint32)std::clamp((int32)std::lround((endpoint1[c] - candidate.pbits[1]) / 2.0f), 0, 127);
+				}
+				BlockIndices candidate_indices;
+				float const error = FitBC7(points, candidate, candidate_indices);
+				if (error < best_error)
+				{
+					best_error = error;
+					endpoints = candidate;
+					std::copy_n(candidate_indices, BlockTexelCount, indices);
+				}
+			}
+			return best_error;
+		}
+
+		class BlockBitWriter
+		{
+		public:
+			explicit BlockBitWriter(uint8* block) : block(block) {}
+
+			void Write(uint32 value, uint32 bit_count)
+			{
+				for (uint32 bit = 0; bit < bit_count; ++bit, ++position)
+				{
+					if ((value >> bit) & 1) block[position >> 3] |= uint8(1u << (position & 7));
+				}
+			}
+
+		private:
+			uint8* block;
+			uint32 position = 0;
+		};
+	}
+
+	void EncodeBC1Block(uint8 const* texels, uint8* block)
+	{
+		BlockPoints points;
+		LoadBlockPoints(texels, points);
+		float endpoint0[4] = {}, endpoint1[4] = {};
+		ComputePrincipalEndpoints(points, 3, endpoint0, endpoint1);
+
+		uint16 color0 = PackRGB565(endpoint0);
+		uint16 color1 = PackRGB565(endpoint1);
+		BlockIndices indices;
+		float error = FitBC1(points, color0, color1, indices);
+		for (uint32 iteration = 0; iteration < 2; ++iteration)
+		{
+			constexpr float IndexWeights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+			float weights[BlockTexelCount];
+			for (uint32 i = 0; i < BlockTexelCount; ++i) weights[i] = IndexWeights[indices[i]];
+			if (!SolveEndpoints(points, weights, 3, endpoint0, endpoint1)) break;
+
+			uint16 refined_color0 = PackRGB565(endpoint0);
+			uint16 refined_color1 = PackRGB565(endpoint1);
+			BlockIndices refined_indices;
+			float const refined_error = FitBC1(points, refined_color0, refined_color1, refined_indices);
+			if (refined_error >= error) break;
+			error = refined_error;
+			color0 = refined_color0;
+			color1 = refined_color1;
+			std::copy_n(refined_indices, BlockTexelCount, indices);
+		}
+
+		uint32 index_bits = 0;
+		for (uint32 i = 0; i < BlockTexelCount; ++i) index_bits |= indices[i] << (2 * i);
+		block[0] = uint8(color0 & 0xff);
+		block[1] = uint8(color0 >> 8);
+		block[2] = uint8(color1 & 0xff);
+		block[3] = uint8(color1 >> 8);
+		for (uint32 byte = 0; byte < 4; ++byte) block[4 + byte] = uint8(index_bits >> (8 * byte));
+	}
+
+	void EncodeBC4Block(uint8 const* texels, uint32 channel, uint8* block)
+	{
+		int32 min_value = 255, max_value = 0;
+		for (uint32 i = 0; i < BlockTexelCount; ++i)
+		{
+			min_value = std::min<int32>(min_value, texels[i * 4 + channel]);
+			max_value = std::max<int32>(max_value, texels[i * 4 + channel]);
+		}
+
+		//the first endpoint being larger selects the eight value mode
+		int32 palette[8] = { max_value, min_value };
+		for (int32 k = 2; k < 8; ++k) palette[k] = ((8 - k) * max_value + (k - 1) * min_value + 3) / 7;
+
+		uint64 index_bits = 0;
+		if (max_value > min_value)
+		{
+			for (uint32 i = 0; i < BlockTexelCount; ++i)
+			{
+				int32 const value = texels[i * 4 + channel];
+				uint64 best_index = 0;
+				for (uint32 k = 1; k < 8; ++k)
+				{
+					if (std::abs(palette[k] - value) < std::abs(palette[best_index] - value)) best_index = k;
+				}
+				index_bits |= best_index << (3 * i);
+			}
+		}
+		block[0] = uint8(max_value);
+		block[1] = uint8(min_value);
+		for (uint32 byte = 0; byte < 6; ++byte) block[2 + byte] = uint8(index_bits >> (8 * byte));
+	}
+
+	void EncodeBC5Block(uint8 const* texels, uint8* block)
+	{
+		EncodeBC4Block(texels, 0, block);
+		EncodeBC4Block(texels, 1, block + 8);
+	}
+
+	void EncodeBC7Block(uint8 const* texels, uint8* block)
+	{
+		BlockPoints points;
+		LoadBlockPoints(texels, points);
+		float endpoint0[4] = {}, endpoint1[4] = {};
+		ComputePrincipalEndpoints(points, 4, endpoint0, endpoint1);
+
+		BC7Endpoints endpoints{};
+		BlockIndices indices;
+		float error = QuantizeBC7(points, endpoint0, endpoint1, endpoints, indices);
+		for (uint32 iteration = 0; iteration < 2; ++iteration)
+		{
+			float weights[BlockTexelCount];
+			for (uint32 i = 0; i < BlockTexelCount; ++i) weights[i] = BC7Weights[indices[i]] / 64.0f;
+			if (!SolveEndpoints(points, weights, 4, endpoint0, endpoint1)) break;
+
+			BC7Endpoints refined_endpoints{};
+			BlockIndices refined_indices;
+			float const refined_error = QuantizeBC7(points, endpoint0, endpoint1, refined_endpoints, refined_indices);
+			if (refined_error >= error) break;
+			error = refined_error;
+			endpoints = refined_endpoints;
+			std::copy_n(refined_indices, BlockTexelCount, indices);
+		}
+
+		//the index of the first texel is stored without its top bit, swap the endpoints if it would be set
+		if (indices[0] >= 8)
+		{
+			std::swap(endpoints.colors[0], endpoints.colors[1]);
+			std::swap(endpoints.pbits[0], endpoints.pbits[1]);
+			for (uint32 i = 0; i < BlockTexelCount; ++i) indices[i] = 15 - indices[i];
+		}
+
+		std::fill_n(block, 16, uint8(0));
+		BlockBitWriter writer(block);
+		writer.Write(1u << 6, 7);
+		for (uint32 c = 0; c < 4; ++c)
+		{
+			writer.Write(endpoints.colors[0][c], 7);
+			writer.Write(endpoints.colors[1][c], 7);
+		}
+		writer.Write(endpoints.pbits[0], 1);
+		writer.Write(endpoints.pbits[1], 1);
+		writer.Write(indices[0], 3);
+		for (uint32 i = 1; i < BlockTexelCount; ++i) writer.Write(indices[i], 4);
+	}
+
+	void EncodeBCSurface(GfxFormat format, uint8 const* texels, uint32 width, uint32 height, uint8* blocks)
+	{
+		ADRIA_ASSERT(format == GfxFormat::BC1_UNORM || format == GfxFormat::BC4_UNORM || format == GfxFormat::BC5_UNORM || format == GfxFormat::BC7_UNORM);
+		uint32 const block_stride = GetGfxFormatStride(format);
+		uint32 const blocks_x = DivideAndRoundUp(width, 4);
+		uint32 const blocks_y = DivideAndRoundUp(height, 4);
+		g_JobSystem.ParallelFor(blocks_y, 4, [=](uint32 begin, uint32 end)
+			{
+				uint8 block_texels[BlockTexelCount * 4];
+				for (uint32 block_y = begin; block_y < end; ++block_y)
+				{
+					for (uint32 block_x = 0; block_x < blocks_x; ++block_x)
+					{
+						for (uint32 y = 0; y < 4; ++y)
+						{
+							uint32 const texel_y = std::min(block_y * 4 + y, height - 1);
+							for (uint32 x = 0; x < 4; ++x)
+							{
+								uint32 const texel_x = std::min(block_x * 4 + x, width - 1);
+								std::copy_n(texels + ((uint64)texel_y * width + texel_x) * 4, 4, block_texels + (y * 4 + x) * 4);
+							}
+						}
+
+						uint8* block = blocks + ((uint64)block_y * blocks_x + block_x) * block_stride;
+						switch (format)
+						{
+						case GfxFormat::BC1_UNORM: EncodeBC1Block(block_texels, block); break;
+						case GfxFormat::BC4_UNORM: EncodeBC4Block(block_texels, 0, block); break;
+						case GfxFormat::BC5_UNORM: EncodeBC5Block(block_texels, block); break;
+						case GfxFormat::BC7_UNORM: EncodeBC7Block(block_texels, block); break;
+						default: ADRIA_UNREACHABLE();
+						}
+					}
+				}
+			});
+	}
+}
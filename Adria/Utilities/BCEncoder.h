@@ -0,0 +1,17 @@
+#pragma once
+#include "Graphics/GfxFormat.h"
+
+namespace adria
+{
+	//block encoders take the 16 texels of a 4x4 block as RGBA8 in row major order
+	void EncodeBC1Block(uint8 const* texels, uint8* block);
+	void EncodeBC4Block(uint8 const* texels, uint32 channel, uint8* block);
+	//red and green channels
+	void EncodeBC5Block(uint8 const* texels, uint8* block);
+	//mode 6 only: one subset with RGBA endpoints and 4 bit indices
+	void EncodeBC7Block(uint8 const* texels, uint8* block);
+
+	//compresses a RGBA8 surface to BC1_UNORM, BC4_UNORM, BC5_UNORM or BC7_UNORM, rows of blocks are encoded in parallel.
+	//Blocks that reach past the edge of the surface repeat its last row and column.
+	void EncodeBCSurface(GfxFormat format, uint8 const* texels, uint32 width, uint32 height, uint8* blocks);
+}
@@ -0,0 +1,319 @@
+#include "FileWatcher.h"
+#include "Logging/Logger.h"
+
+namespace fs = std::filesystem;
+
+namespace adria
+{
+	namespace
+	{
+		constexpr std::chrono::milliseconds DebounceInterval(100);
+		constexpr std::chrono::milliseconds PollInterval(500);
+		constexpr uint32 NotificationBufferSize = 64 * 1024;
+
+		struct FileState
+		{
+			fs::file_time_type last_write_time;
+			uintmax_t size;
+
+			bool operator==(FileState const&) const = default;
+		};
+		bool GetFileState(fs::directory_entry const& entry, FileState& state)
+		{
+			std::error_code ec;
+			if (!entry.is_regular_file(ec)) return false;
+			state.last_write_time = entry.last_write_time(ec);
+			if (ec) return false;
+			state.size = entry.file_size(ec);
+			return !ec;
+		}
+
+		using FileSnapshot = std::unordered_map<std::string, FileState>;
+		FileSnapshot TakeSnapshot(fs::path const& path, bool recursive)
+		{
+			FileSnapshot snapshot;
+			std::error_code ec;
+			auto Visit = [&](fs::directory_entry const& entry)
+				{
+					FileState state;
+					if (GetFileState(entry, state)) snapshot.emplace(entry.path().string(), state);
+				};
+
+			if (recursive)
+			{
+				for (auto const& entry : fs::recursive_directory_iterator(path, fs::directory_options::skip_permission_denied, ec)) Visit(entry);
+			}
+			else
+			{
+				for (auto const& entry : fs::directory_iterator(path, fs::directory_options::skip_permission_denied, ec)) Visit(entry);
+			}
+			return snapshot;
+		}
+	}
+
+	struct FileWatcher::WatchedDirectory
+	{
+		fs::path path;
+		bool recursive = true;
+		bool polling = false;
+		FileSnapshot snapshot;
+
+		HANDLE handle = INVALID_HANDLE_VALUE;
+		OVERLAPPED overlapped{};
+		alignas(DWORD) uint8 buffer[NotificationBufferSize];
+
+		WatchedDirectory(std::string const& path, bool recursive) : path(path), recursive(recursive) {}
+		~WatchedDirectory()
+		{
+			if (handle != INVALID_HANDLE_VALUE)
+			{
+				DWORD bytes = 0;
+				if (CancelIoEx(handle, &overlapped)) GetOverlappedResult(handle, &overlapped, &bytes, TRUE);
+				CloseHandle(handle);
+			}
+			if (overlapped.hEvent) CloseHandle(overlapped.hEvent);
+		}
+	};
+
+	FileWatcher::FileWatcher()
+	{
+		wake_event = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+		watch_thread = std::thread(&FileWatcher::WatchThread, this);
+	}
+
+	FileWatcher::~FileWatcher()
+	{
+		exit.store(true);
+		SetEvent(wake_event);
+		if (watch_thread.joinable()) watch_thread.join();
+		directories.clear();
+		CloseHandle(wake_event);
+		file_modified_event.RemoveAll();
+	}
+
+	void FileWatcher::AddPathToWatch(std::string const& path, bool recursive)
+	{
+		{
+			std::lock_guard lock(mutex);
+			added_directories.push_back(std::make_unique<WatchedDirectory>(path, recursive));
+		}
+		SetEvent(wake_event);
+	}
+
+	void FileWatcher::CheckWatchedFiles()
+	{
+		std::vector<std::pair<std::string, FileStatus>> changes;
+		{
+			std::lock_guard lock(mutex);
+			if (ready_changes.empty()) return;
+			changes.swap(ready_changes);
+		}
+
+		for (auto const& [file, status] : changes)
+		{
+			if (status != FileStatus::Deleted) file_modified_event.Broadcast(file);
+		}
+	}
+
+	void FileWatcher::WatchThread()
+	{
+		std::vector<HANDLE> wait_handles;
+		while (!exit.load())
+		{
+			AcceptAddedDirectories();
+
+			wait_handles.clear();
+			wait_handles.push_back(wake_event);
+			for (auto const& directory : directories)
+			{
+				if (!directory->polling) wait_handles.push_back(directory->overlapped.hEvent);
+			}
+			ADRIA_ASSERT(wait_handles.size() <= MAXIMUM_WAIT_OBJECTS);
+			WaitForMultipleObjects((DWORD)wait_handles.size(), wait_handles.data(), FALSE, GetWaitTimeout());
+			if (exit.load()) break;
+
+			for (auto& directory : directories)
+			{
+				if (!directory->polling && WaitForSingleObject(directory->overlapped.hEvent, 0) == WAIT_OBJECT_0)
+				{
+					ProcessNotifications(*directory);
+				}
+			}
+
+			Clock::time_point now = Clock::now();
+			if (now - last_poll_time >= PollInterval)
+			{
+				for (auto& directory : directories)
+				{
+					if (directory->polling) PollDirectory(*directory);
+				}
+				last_poll_time = now;
+			}
+			FlushSettledChanges();
+		}
+	}
+
+	void FileWatcher::AcceptAddedDirectories()
+	{
+		std::vector<std::unique_ptr<WatchedDirectory>> added;
+		{
+			std::lock_guard lock(mutex);
+			added.swap(added_directories);
+		}
+
+		for (auto& directory : added)
+		{
+			directory->snapshot = TakeSnapshot(directory->path, directory->recursive);
+			directory->handle = CreateFileW(directory->path.c_str(), FILE_LIST_DIRECTORY,
+				FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+				FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+			directory->overlapped.hEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+
+			if (directory->handle == INVALID_HANDLE_VALUE || !BeginReadChanges(*directory))
+			{
+				ADRIA_LOG(WARNING, "Directory change notifications unavailable for %s, falling back to polling", directory->path.string().c_str());
+				directory->polling = true;
+			}
+			directories.push_back(std::move(directory));
+		}
+	}
+
+	bool FileWatcher::BeginReadChanges(WatchedDirectory& directory)
+	{
+		ResetEvent(directory.overlapped.hEvent);
+		DWORD const notify_filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE;
+		return ReadDirectoryChangesW(directory.handle, directory.buffer, NotificationBufferSize, directory.recursive,
+			notify_filter, nullptr, &directory.overlapped, nullptr);
+	}
+
+	void FileWatcher::ProcessNotifications(WatchedDirectory& directory)
+	{
+		DWORD bytes = 0;
+		if (!GetOverlappedResult(directory.handle, &directory.overlapped, &bytes, FALSE))
+		{
+			ADRIA_LOG(WARNING, "Reading directory changes failed for %s, falling back to polling", directory.path.string().c_str());
+			directory.polling = true;
+			return;
+		}
+
+		if (bytes == 0)
+		{
+			//notification buffer overflowed, rescan to recover the lost changes
+			PollDirectory(directory);
+		}
+		else
+		{
+			uint8 const* entry = directory.buffer;
+			while (true)
+			{
+				FILE_NOTIFY_INFORMATION const* info = reinterpret_cast<FILE_NOTIFY_INFORMATION const*>(entry);
+				std::wstring filename(info->FileName, info->FileNameLength / sizeof(WCHAR));
+				std::string file = (directory.path / filename).string();
+				switch (info->Action)
+				{
+				case FILE_ACTION_ADDED:
+				case FILE_ACTION_RENAMED_NEW_NAME:
+					QueueChange(directory, file, FileStatus::Created);
+					break;
+				case FILE_ACTION_MODIFIED:
+					QueueChange(directory, file, FileStatus::Modified);
+					break;
+				case FILE_ACTION_REMOVED:
+				case FILE_ACTION_RENAMED_OLD_NAME:
+					QueueChange(directory, file, FileStatus::Deleted);
+					break;
+				}
+				if (info->NextEntryOffset == 0) break;
+				entry += info->NextEntryOffset;
+			}
+		}
+
+		if (!BeginReadChanges(directory))
+		{
+			ADRIA_LOG(WARNING, "Reading directory changes failed for %s, falling back to polling", directory.path.string().c_str());
+			directory.polling = true;
+		}
+	}
+
+	void FileWatcher::PollDirectory(WatchedDirectory& directory)
+	{
+		//the snapshot is updated in FlushSettledChanges once a change is reported, a file still being written is queued again and stays debounced
+		FileSnapshot current = TakeSnapshot(directory.path, directory.recursive);
+		for (auto const& [file, state] : current)
+		{
+			auto it = directory.snapshot.find(file);
+			if (it == directory.snapshot.end()) QueueChange(directory, file, FileStatus::Created);
+			else if (it->second != state) QueueChange(directory, file, FileStatus::Modified);
+		}
+		for (auto const& [file, state] : directory.snapshot)
+		{
+			if (!current.contains(file)) QueueChange(directory, file, FileStatus::Deleted);
+		}
+	}
+
+	void FileWatcher::QueueChange(WatchedDirectory& directory, std::string const& file, FileStatus status)
+	{
+		Clock::time_point now = Clock::now();
+		auto it = pending_changes.find(file);
+		if (it == pending_changes.end())
+		{
+			pending_changes.emplace(file, PendingChange{ status, now, &directory });
+			return;
+		}
+
+		FileStatus& pending_status = it->second.status;
+		if (pending_status == FileStatus::Deleted && status != FileStatus::Deleted) pending_status = FileStatus::Modified; //file was replaced, e.g. by an editor doing atomic saves
+		else if (pending_status != FileStatus::Created || status == FileStatus::Deleted) pending_status = status;
+		it->second.last_event_time = now;
+	}
+
+	void FileWatcher::FlushSettledChanges()
+	{
+		if (pending_changes.empty()) return;
+
+		Clock::time_point now = Clock::now();
+		std::vector<std::pair<std::string, FileStatus>> settled_changes;
+		for (auto it = pending_changes.begin(); it != pending_changes.end();)
+		{
+			if (now - it->second.last_event_time < DebounceInterval)
+			{
+				++it;
+				continue;
+			}
+
+			//record the state the change is reported with, later polls and overflow rescans compare against it
+			FileSnapshot& snapshot = it->second.directory->snapshot;
+			FileState state;
+			std::error_code ec;
+			if (GetFileState(fs::directory_entry(it->first, ec), state)) snapshot.insert_or_assign(it->first, state);
+			else snapshot.erase(it->first);
+
+			if (it->second.status == FileStatus::Deleted || snapshot.contains(it->first))
+			{
+				settled_changes.emplace_back(it->first, it->second.status);
+			}
+			it = pending_changes.erase(it);
+		}
+
+		if (!settled_changes.empty())
+		{
+			std::lock_guard lock(mutex);
+			for (auto& change : settled_changes) ready_changes.push_back(std::move(change));
+		}
+	}
+
+	uint32 FileWatcher::GetWaitTimeout() const
+	{
+		std::chrono::milliseconds timeout = std::chrono::milliseconds::max();
+		if (!pending_changes.empty()) timeout = DebounceInterval;
+		for (auto const& directory : directories)
+		{
+			if (directory->polling)
+			{
+				timeout = std::min(timeout, PollInterval);
+				break;
+			}
+		}
+		return timeout == std::chrono::milliseconds::max() ? INFINITE : (uint32)timeout.count();
+	}
+}
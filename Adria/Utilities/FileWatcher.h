@@ -1,5 +1,9 @@
 #pragma once
 #include <filesystem>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
 #include "Utilities/Delegate.h"
 
 namespace adria
@@ -13,49 +17,55 @@ namespace adria
 
 	DECLARE_EVENT(FileModifiedEvent, FileWatcher, std::string const&)
 
+	//Watches directories on a background thread. Directory change notifications (ReadDirectoryChangesW) are used when possible,
+	//with a polling backend as fallback for directories that can't be opened for notifications (e.g. some network shares).
+	//Bursts of writes to the same file are coalesced and only reported once the file has been quiet for a debounce interval.
+	//CheckWatchedFiles only drains the changes queued by the watch thread so its cost is proportional to the number of changes.
 	class FileWatcher
 	{
-	public:
-		FileWatcher() = default;
-		~FileWatcher()
+		using Clock = std::chrono::steady_clock;
+		struct WatchedDirectory;
+		struct PendingChange
 		{
-			file_modified_event.RemoveAll();
-		}
+			FileStatus status;
+			Clock::time_point last_event_time;
+			WatchedDirectory* directory;
+		};
 
-		void AddPathToWatch(std::string const& path, bool recursive = true)
-		{
-			if (recursive)
-			{
-				for (auto& path : std::filesystem::recursive_directory_iterator(path))
-				{
-					if (path.is_regular_file()) files_map[path.path().string()] = std::filesystem::last_write_time(path);
-				}
-			}
-			else
-			{
-				for (auto& path : std::filesystem::directory_iterator(path))
-				{
-					if (path.is_regular_file()) files_map[path.path().string()] = std::filesystem::last_write_time(path);
-				}
-			}
-		}
-		void CheckWatchedFiles()
-		{
-			for (auto const& [file, ft] : files_map)
-			{
-				auto current_file_last_write_time = std::filesystem::last_write_time(file);
-				if (files_map[file] != current_file_last_write_time)
-				{
-					files_map[file] = current_file_last_write_time;
-					file_modified_event.Broadcast(file);
-				}
-			}
-		}
+	public:
+		FileWatcher();
+		ADRIA_NONCOPYABLE_NONMOVABLE(FileWatcher)
+		~FileWatcher();
+
+		void AddPathToWatch(std::string const& path, bool recursive = true);
+		void CheckWatchedFiles();
 
 		FileModifiedEvent& GetFileModifiedEvent() { return file_modified_event; }
+
 	private:
-		std::vector<std::string> paths_to_watch;
-		std::unordered_map<std::string, std::filesystem::file_time_type> files_map;
 		FileModifiedEvent file_modified_event;
+
+		std::thread watch_thread;
+		std::atomic_bool exit = false;
+		void* wake_event = nullptr;
+
+		std::mutex mutex;
+		std::vector<std::unique_ptr<WatchedDirectory>> added_directories;
+		std::vector<std::pair<std::string, FileStatus>> ready_changes;
+
+		//accessed only by the watch thread
+		std::vector<std::unique_ptr<WatchedDirectory>> directories;
+		std::unordered_map<std::string, PendingChange> pending_changes;
+		Clock::time_point last_poll_time;
+
+	private:
+		void WatchThread();
+		void AcceptAddedDirectories();
+		bool BeginReadChanges(WatchedDirectory& directory);
+		void ProcessNotifications(WatchedDirectory& directory);
+		void PollDirectory(WatchedDirectory& directory);
+		void QueueChange(WatchedDirectory& directory, std::string const& file, FileStatus status);
+		void FlushSettledChanges();
+		uint32 GetWaitTimeout() const;
 	};
-}
\ No newline at end of file
+}
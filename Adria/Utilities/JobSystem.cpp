@@ -0,0 +1,359 @@
+#include <array>
+#include <cmath>
+#include "JobSystem.h"
+#include "Core/ConsoleManager.h"
+#include "Logging/Logger.h"
+#include "Utilities/Timer.h"
+
+namespace adria
+{
+	namespace
+	{
+		constexpr uint32 INVALID_THREAD_INDEX = uint32(-1);
+		thread_local uint32 current_thread_index = INVALID_THREAD_INDEX;
+
+		constexpr uint32 SPINS_BEFORE_SLEEP = 64;
+	}
+
+	//Chase-Lev deque of a fixed capacity (Le et al., "Correct and Efficient Work-Stealing for Weak Memory Models").
+	//Only the owning thread pushes and pops at the bottom, any thread steals from the top.
+	class JobSystem::JobDeque
+	{
+	public:
+		bool Push(Job* job)
+		{
+			int64 const b = bottom.load(std::memory_order_relaxed);
+			int64 const t = top.load(std::memory_order_acquire);
+			if (b - t >= (int64)JOB_CAPACITY) return false;
+			buffer[b & (JOB_CAPACITY - 1)].store(job, std::memory_order_relaxed);
+			bottom.store(b + 1, std::memory_order_release);
+			return true;
+		}
+
+		Job* Pop()
+		{
+			int64 const b = bottom.load(std::memory_order_relaxed) - 1;
+			bottom.store(b, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64 t = top.load(std::memory_order_relaxed);
+			if (t > b)
+			{
+				bottom.store(b + 1, std::memory_order_relaxed);
+				return nullptr;
+			}
+
+			Job* job = buffer[b & (JOB_CAPACITY - 1)].load(std::memory_order_relaxed);
+			if (t == b)
+			{
+				//last job, race the thieves for it
+				if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) job = nullptr;
+				bottom.store(b + 1, std::memory_order_relaxed);
+			}
+			return job;
+		}
+
+		Job* Steal()
+		{
+			int64 t = top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64 const b = bottom.load(std::memory_order_acquire);
+			if (t >= b) return nullptr;
+
+			Job* job = buffer[t & (JOB_CAPACITY - 1)].load(std::memory_order_relaxed);
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return nullptr;
+			return job;
+		}
+
+	private:
+		alignas(64) std::atomic<int64> top = 0;
+		alignas(64) std::atomic<int64> bottom = 0;
+		std::array<std::atomic<Job*>, JOB_CAPACITY> buffer{};
+	};
+
+	struct JobSystem::JobThread
+	{
+		JobDeque deque;
+		std::array<Job, JOB_CAPACITY> jobs;
+		uint32 next_job = 0;
+		uint32 steal_seed = 0;
+	};
+
+	namespace
+	{
+		void JobSystemBenchmark()
+		{
+			JobSystem& job_system = g_JobSystem;
+			uint32 const worker_count = job_system.GetWorkerCount();
+
+			static constexpr uint32 ElementCount = 1 << 22;
+			static constexpr uint32 GrainSize = 4096;
+			static constexpr uint32 EmptyJobCount = 100000;
+			std::vector<float> elements(ElementCount);
+			auto Workload = [&elements](uint32 begin, uint32 end)
+			{
+				for (uint32 i = begin; i < end; ++i) elements[i] = std::sqrt((float)i) * std::sin((float)i) + std::cos((float)i);
+			};
+
+			float single_thread_ms = 0.0f;
+			for (uint32 active_workers = 0; active_workers <= worker_count; ++active_workers)
+			{
+				job_system.SetActiveWorkerCount(active_workers);
+
+				Timer<std::chrono::microseconds> timer;
+				job_system.ParallelFor(ElementCount, GrainSize, Workload);
+				float const parallel_for_ms = timer.ElapsedInSeconds() * 1000.0f;
+				if (active_workers == 0) single_thread_ms = parallel_for_ms;
+
+				timer.Mark();
+				JobCounter counter;
+				for (uint32 i = 0; i < EmptyJobCount; ++i) job_system.Run([]() {}, counter);
+				job_system.Wait(counter);
+				float const empty_jobs_ms = timer.ElapsedInSeconds() * 1000.0f;
+
+				ADRIA_LOG(INFO, "Job system (%u threads): ParallelFor of %u elements %.3f ms (%.2fx), %u empty jobs %.3f ms (%.1f ns per job)",
+					active_workers + 1, ElementCount, parallel_for_ms, parallel_for_ms > 0.0f ? single_thread_ms / parallel_for_ms : 0.0f,
+					EmptyJobCount, empty_jobs_ms, empty_jobs_ms * 1e6f / EmptyJobCount);
+			}
+			job_system.SetActiveWorkerCount(worker_count);
+		}
+		AutoConsoleCommand job_system_benchmark("jobs.Benchmark", "Runs a parallel loop and a batch of empty jobs on 1 to N threads and logs the speedup over a single thread",
+			ConsoleCommandDelegate::CreateStatic(JobSystemBenchmark));
+	}
+
+	JobSystem::JobSystem() = default;
+	JobSystem::~JobSystem()
+	{
+		Destroy();
+	}
+
+	void JobSystem::Initialize(uint32 worker_count)
+	{
+		if (!threads.empty()) return;
+		uint32 const hardware_threads = std::max(std::thread::hardware_concurrency(), 1u);
+		if (worker_count == 0) worker_count = hardware_threads - 1;
+
+		done = false;
+		threads.reserve(worker_count + 1);
+		for (uint32 i = 0; i <= worker_count; ++i)
+		{
+			threads.push_back(std::make_unique<JobThread>());
+			threads.back()->steal_seed = i * 2654435761u + 1;
+		}
+		external_jobs.reserve(JOB_CAPACITY);
+		external_thread = std::make_unique<JobThread>();
+		background_thread = std::make_unique<JobThread>();
+		active_worker_count = worker_count;
+
+		current_thread_index = 0;
+		workers.reserve(worker_count);
+		for (uint32 i = 1; i <= worker_count; ++i) workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+	}
+
+	void JobSystem::Destroy()
+	{
+		if (threads.empty()) return;
+		{
+			std::lock_guard lock(sleep_mutex);
+			done = true;
+		}
+		sleep_cv.notify_all();
+		for (std::thread& worker : workers) if (worker.joinable()) worker.join();
+		workers.clear();
+		threads.clear();
+		external_jobs.clear();
+		external_thread.reset();
+		background_jobs.clear();
+		background_job_count = 0;
+		background_thread.reset();
+		current_thread_index = INVALID_THREAD_INDEX;
+	}
+
+	void JobSystem::Wait(JobCounter const& counter)
+	{
+		uint32 const thread_index = current_thread_index;
+		while (!counter.IsDone())
+		{
+			if (thread_index == INVALID_THREAD_INDEX || !TryExecuteJob(thread_index)) std::this_thread::yield();
+		}
+	}
+
+	void JobSystem::SetActiveWorkerCount(uint32 worker_count)
+	{
+		active_worker_count = std::min(worker_count, GetWorkerCount());
+		std::lock_guard lock(sleep_mutex);
+		sleep_cv.notify_all();
+	}
+
+	Job* JobSystem::AllocateJob()
+	{
+		uint32 const thread_index = current_thread_index;
+		std::unique_lock lock(external_mutex, std::defer_lock);
+		JobThread* thread = nullptr;
+		if (thread_index != INVALID_THREAD_INDEX) thread = threads[thread_index].get();
+		else if (external_thread)
+		{
+			lock.lock();
+			thread = external_thread.get();
+		}
+		if (!thread) return nullptr;
+		return AllocateJob(*thread);
+	}
+
+	Job* JobSystem::AllocateJob(JobThread& thread)
+	{
+		//jobs finish out of order, skip a few that are still running before giving up
+		static constexpr uint32 MaxProbes = 8;
+		for (uint32 probe = 0; probe < MaxProbes; ++probe)
+		{
+			Job& job = thread.jobs[thread.next_job++ & (JOB_CAPACITY - 1)];
+			if (job.in_use.load(std::memory_order_acquire)) continue;
+			job.in_use.store(true, std::memory_order_relaxed);
+			return &job;
+		}
+		return nullptr;
+	}
+
+	Job* JobSystem::AllocateBackgroundJob()
+	{
+		std::lock_guard lock(background_mutex);
+		if (!background_thread) return nullptr;
+		return AllocateJob(*background_thread);
+	}
+
+	void JobSystem::Schedule(Job* job)
+	{
+		uint32 const thread_index = current_thread_index;
+		if (thread_index != INVALID_THREAD_INDEX)
+		{
+			if (!threads[thread_index]->deque.Push(job))
+			{
+				Execute(job, thread_index);
+				return;
+			}
+		}
+		else
+		{
+			std::lock_guard lock(external_mutex);
+			external_jobs.push_back(job);
+			external_job_count.fetch_add(1, std::memory_order_release);
+		}
+		queued_jobs.fetch_add(1, std::memory_order_seq_cst);
+		WakeWorkers();
+	}
+
+	void JobSystem::ScheduleBackground(Job* job)
+	{
+		{
+			std::lock_guard lock(background_mutex);
+			background_jobs.push_back(job);
+			background_job_count.fetch_add(1, std::memory_order_release);
+		}
+		queued_jobs.fetch_add(1, std::memory_order_seq_cst);
+		WakeWorkers();
+	}
+
+	Job* JobSystem::FindJob(uint32 thread_index)
+	{
+		JobThread& thread = *threads[thread_index];
+		Job* job = thread.deque.Pop();
+		if (!job && external_job_count.load(std::memory_order_acquire) > 0)
+		{
+			std::lock_guard lock(external_mutex);
+			if (!external_jobs.empty())
+			{
+				job = external_jobs.back();
+				external_jobs.pop_back();
+				external_job_count.fetch_sub(1, std::memory_order_relaxed);
+			}
+		}
+		if (!job)
+		{
+			//start at a random victim so thieves spread over the deques
+			uint32 const thread_count = (uint32)threads.size();
+			thread.steal_seed = thread.steal_seed * 1664525u + 1013904223u;
+			uint32 const first_victim = (thread.steal_seed >> 16) % thread_count;
+			for (uint32 i = 0; i < thread_count && !job; ++i)
+			{
+				uint32 const victim = (first_victim + i) % thread_count;
+				if (victim != thread_index) job = threads[victim]->deque.Steal();
+			}
+		}
+		//background jobs come last and are left to the workers, thread 0 waits on frame work and must not start a long job
+		if (!job && thread_index != 0 && background_job_count.load(std::memory_order_acquire) > 0)
+		{
+			std::lock_guard lock(background_mutex);
+			if (!background_jobs.empty())
+			{
+				job = background_jobs.front();
+				background_jobs.pop_front();
+				background_job_count.fetch_sub(1, std::memory_order_relaxed);
+			}
+		}
+		if (job) queued_jobs.fetch_sub(1, std::memory_order_relaxed);
+		return job;
+	}
+
+	bool JobSystem::TryExecuteJob(uint32 thread_index)
+	{
+		Job* job = FindJob(thread_index);
+		if (!job) return false;
+		Execute(job, thread_index);
+		return true;
+	}
+
+	void JobSystem::Execute(Job* job, uint32 thread_index)
+	{
+		if (job->dependency && !job->dependency->IsDone())
+		{
+			//not ready yet, put it back and let the thread pick up other work in the meantime
+			if (threads[thread_index]->deque.Push(job))
+			{
+				queued_jobs.fetch_add(1, std::memory_order_seq_cst);
+				std::this_thread::yield();
+				return;
+			}
+			Wait(*job->dependency);
+		}
+
+		JobCounter* counter = job->counter;
+		job->execute(job->storage);
+		job->in_use.store(false, std::memory_order_release);
+		if (counter) counter->value.fetch_sub(1, std::memory_order_acq_rel);
+	}
+
+	void JobSystem::WakeWorkers()
+	{
+		if (sleeping_workers.load(std::memory_order_seq_cst) == 0) return;
+		std::lock_guard lock(sleep_mutex);
+		//parked workers would swallow a single notification
+		if (active_worker_count.load(std::memory_order_relaxed) < GetWorkerCount()) sleep_cv.notify_all();
+		else sleep_cv.notify_one();
+	}
+
+	void JobSystem::WorkerLoop(uint32 thread_index)
+	{
+		current_thread_index = thread_index;
+		auto IsActive = [this, thread_index]() { return thread_index <= active_worker_count.load(std::memory_order_relaxed); };
+
+		uint32 spin_count = 0;
+		while (!done.load(std::memory_order_acquire))
+		{
+			if (IsActive() && TryExecuteJob(thread_index))
+			{
+				spin_count = 0;
+				continue;
+			}
+			if (++spin_count < SPINS_BEFORE_SLEEP)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			std::unique_lock lock(sleep_mutex);
+			sleeping_workers.fetch_add(1, std::memory_order_seq_cst);
+			sleep_cv.wait(lock, [&]() { return done.load() || (IsActive() && queued_jobs.load(std::memory_order_seq_cst) > 0); });
+			sleeping_workers.fetch_sub(1, std::memory_order_seq_cst);
+			spin_count = 0;
+		}
+	}
+}
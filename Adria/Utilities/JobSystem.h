@@ -0,0 +1,199 @@
+#pragma once
+#include <thread>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <new>
+#include <type_traits>
+#include "Singleton.h"
+
+namespace adria
+{
+	//counts unfinished jobs, incremented when a job is scheduled and decremented once it has run.
+	//Waiting on a counter executes other jobs instead of blocking, and jobs can wait on a counter before they start.
+	class JobCounter
+	{
+		friend class JobSystem;
+	public:
+		JobCounter() = default;
+		ADRIA_NONCOPYABLE_NONMOVABLE(JobCounter)
+
+		bool IsDone() const { return value.load(std::memory_order_acquire) == 0; }
+
+	private:
+		std::atomic<uint32> value = 0;
+	};
+
+	//callable stored inline, the job system never allocates for a job
+	class Job
+	{
+		friend class JobSystem;
+	public:
+		static constexpr uint64 STORAGE_SIZE = 64;
+
+		template<typename F>
+		static constexpr bool Fits = sizeof(std::decay_t<F>) <= STORAGE_SIZE && alignof(std::decay_t<F>) <= alignof(std::max_align_t);
+
+	private:
+		alignas(std::max_align_t) std::byte storage[STORAGE_SIZE];
+		void (*execute)(void*) = nullptr;
+		JobCounter* counter = nullptr;
+		JobCounter const* dependency = nullptr;
+		std::atomic<bool> in_use = false;
+
+	private:
+		template<typename F>
+		void Set(F&& f, JobCounter* _counter, JobCounter const* _dependency)
+		{
+			using Callable = std::decay_t<F>;
+			static_assert(Fits<F>, "Job callable does not fit into the inline storage, capture less or capture by reference");
+			new (storage) Callable(std::forward<F>(f));
+			execute = [](void* callable)
+			{
+				Callable& c = *std::launder(reinterpret_cast<Callable*>(callable));
+				c();
+				c.~Callable();
+			};
+			counter = _counter;
+			dependency = _dependency;
+		}
+	};
+
+	//Work stealing job system. Every worker and the main thread own a Chase-Lev deque: the owner pushes and pops jobs
+	//at the bottom without locks and idle workers steal from the top of the others. Jobs come from a fixed ring per
+	//thread and are tracked with counters instead of futures. Threads that were not started by the job system submit
+	//through a locked queue. Long running jobs go to a separate background queue that only the workers take from,
+	//so waiting on the main thread never picks them up.
+	class JobSystem : public Singleton<JobSystem>
+	{
+		friend class Singleton<JobSystem>;
+		static constexpr uint32 JOB_CAPACITY = 2048;
+
+		class JobDeque;
+		struct JobThread;
+
+	public:
+		ADRIA_NONCOPYABLE_NONMOVABLE(JobSystem);
+		~JobSystem();
+
+		//worker_count = 0 uses one worker per hardware thread besides the calling thread, which becomes thread 0
+		void Initialize(uint32 worker_count = 0);
+		void Destroy();
+
+		//schedules f, counter is decremented once it has run and the job does not start before dependency is done
+		template<typename F>
+		void Run(F&& f, JobCounter* counter = nullptr, JobCounter const* dependency = nullptr)
+		{
+			if (counter) counter->value.fetch_add(1, std::memory_order_relaxed);
+			Job* job = AllocateJob();
+			if (!job)
+			{
+				//every job of this thread is still in flight, run it right away
+				if (dependency) Wait(*dependency);
+				f();
+				if (counter) counter->value.fetch_sub(1, std::memory_order_release);
+				return;
+			}
+			job->Set(std::forward<F>(f), counter, dependency);
+			Schedule(job);
+		}
+		template<typename F>
+		void Run(F&& f, JobCounter& counter, JobCounter const* dependency = nullptr)
+		{
+			Run(std::forward<F>(f), &counter, dependency);
+		}
+
+		//schedules f on the background queue, e.g. for file loading and decoding. It runs on a worker after the jobs
+		//they find in the deques, and never on thread 0 unless there are no workers.
+		template<typename F>
+		void RunBackground(F&& f, JobCounter* counter = nullptr)
+		{
+			if (counter) counter->value.fetch_add(1, std::memory_order_relaxed);
+			Job* job = GetWorkerCount() > 0 ? AllocateBackgroundJob() : nullptr;
+			if (!job)
+			{
+				f();
+				if (counter) counter->value.fetch_sub(1, std::memory_order_release);
+				return;
+			}
+			job->Set(std::forward<F>(f), counter, nullptr);
+			ScheduleBackground(job);
+		}
+		template<typename F>
+		void RunBackground(F&& f, JobCounter& counter)
+		{
+			RunBackground(std::forward<F>(f), &counter);
+		}
+
+		//executes other jobs until the counter reaches zero
+		void Wait(JobCounter const& counter);
+
+		//splits [0, count) into batches of grain_size and calls f(begin, end) for each batch on the workers and the
+		//calling thread. Waiting executes jobs as well, so parallel loops can be nested inside jobs.
+		template<typename F>
+		void ParallelFor(uint32 count, uint32 grain_size, F&& f)
+		{
+			if (count == 0) return;
+			grain_size = std::max(grain_size, 1u);
+			uint32 const batch_count = (count + grain_size - 1) / grain_size;
+			if (batch_count == 1 || GetWorkerCount() == 0)
+			{
+				f(0u, count);
+				return;
+			}
+
+			JobCounter counter;
+			for (uint32 batch = 1; batch < batch_count; ++batch)
+			{
+				uint32 const begin = batch * grain_size;
+				uint32 const end = std::min(begin + grain_size, count);
+				Run([&f, begin, end]() { f(begin, end); }, counter);
+			}
+			f(0u, std::min(grain_size, count));
+			Wait(counter);
+		}
+
+		uint32 GetWorkerCount() const { return threads.empty() ? 0 : (uint32)threads.size() - 1; }
+		//parks the workers past worker_count, used to measure how the job system scales
+		void SetActiveWorkerCount(uint32 worker_count);
+
+	private:
+		std::vector<std::unique_ptr<JobThread>> threads;
+		std::vector<std::thread> workers;
+		std::atomic<uint32> active_worker_count = 0;
+		std::atomic<bool> done = false;
+
+		std::unique_ptr<JobThread> external_thread;
+		std::mutex external_mutex;
+		std::vector<Job*> external_jobs;
+		std::atomic<uint32> external_job_count = 0;
+
+		std::unique_ptr<JobThread> background_thread;
+		std::mutex background_mutex;
+		std::deque<Job*> background_jobs;
+		std::atomic<uint32> background_job_count = 0;
+
+		std::atomic<uint32> queued_jobs = 0;
+		std::atomic<uint32> sleeping_workers = 0;
+		std::mutex sleep_mutex;
+		std::condition_variable sleep_cv;
+
+	private:
+		JobSystem();
+
+		Job* AllocateJob();
+		Job* AllocateJob(JobThread& thread);
+		Job* AllocateBackgroundJob();
+		void Schedule(Job* job);
+		void ScheduleBackground(Job* job);
+		Job* FindJob(uint32 thread_index);
+		bool TryExecuteJob(uint32 thread_index);
+		void Execute(Job* job, uint32 thread_index);
+		void WakeWorkers();
+		void WorkerLoop(uint32 thread_index);
+	};
+	#define g_JobSystem JobSystem::Get()
+}
@@ -0,0 +1,52 @@
+#include "MemoryMappedFile.h"
+#include "Core/Windows.h"
+
+namespace adria
+{
+	MemoryMappedFile::~MemoryMappedFile()
+	{
+		Close();
+	}
+
+	bool MemoryMappedFile::Open(std::string_view path)
+	{
+		Close();
+		std::string const path_str(path);
+		HANDLE file_handle = CreateFileA(path_str.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file_handle == INVALID_HANDLE_VALUE) return false;
+		file = file_handle;
+
+		LARGE_INTEGER file_size{};
+		if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0)
+		{
+			Close();
+			return false;
+		}
+
+		mapping = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mapping)
+		{
+			Close();
+			return false;
+		}
+		data = static_cast<uint8 const*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		if (!data)
+		{
+			Close();
+			return false;
+		}
+		size = (uint64)file_size.QuadPart;
+		return true;
+	}
+
+	void MemoryMappedFile::Close()
+	{
+		if (data) UnmapViewOfFile(data);
+		if (mapping) CloseHandle(mapping);
+		if (file) CloseHandle(file);
+		data = nullptr;
+		mapping = nullptr;
+		file = nullptr;
+		size = 0;
+	}
+}
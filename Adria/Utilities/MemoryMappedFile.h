@@ -0,0 +1,27 @@
+#pragma once
+#include <string_view>
+
+namespace adria
+{
+	//read only view of a whole file, pages are loaded by the OS on first access
+	class MemoryMappedFile
+	{
+	public:
+		MemoryMappedFile() = default;
+		ADRIA_NONCOPYABLE_NONMOVABLE(MemoryMappedFile)
+		~MemoryMappedFile();
+
+		bool Open(std::string_view path);
+		void Close();
+
+		bool IsOpen() const { return data != nullptr; }
+		uint8 const* GetData() const { return data; }
+		uint64 GetSize() const { return size; }
+
+	private:
+		void* file = nullptr;
+		void* mapping = nullptr;
+		uint8 const* data = nullptr;
+		uint64 size = 0;
+	};
+}